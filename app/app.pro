@@ -57,7 +57,8 @@ HEADERS += \
     tooloptionwidget.h \
     importexportdialog.h \
     exportimagedialog.h \
-    importimageseqdialog.h
+    importimageseqdialog.h \
+    importmoviedialog.h
 
 SOURCES += \
     main.cpp \
@@ -84,7 +85,8 @@ SOURCES += \
     tooloptionwidget.cpp \
     importexportdialog.cpp \
     exportimagedialog.cpp \
-    importimageseqdialog.cpp
+    importimageseqdialog.cpp \
+    importmoviedialog.cpp
 
 FORMS += \
     ui/mainwindow2.ui \
@@ -97,7 +99,8 @@ FORMS += \
     ui/importexportdialog.ui \
     ui/exportmovieoptions.ui \
     ui/exportimageoptions.ui \
-    ui/importimageseqoptions.ui
+    ui/importimageseqoptions.ui \
+    ui/importmovieoptions.ui
 
 DEPENDPATH += .
 
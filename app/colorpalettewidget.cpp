@@ -372,6 +372,7 @@ void ColorPaletteWidget::clickAddColorButton()
     ColourRef ref(newColour);
     ref.name = getDefaultColorName(newColour);
 
+    editor()->stopPrefetch();
     editor()->object()->addColour(ref);
     refreshColorList();
 
@@ -384,6 +385,7 @@ void ColorPaletteWidget::clickAddColorButton()
 void ColorPaletteWidget::clickRemoveColorButton()
 {
     int colorNumber = ui->colorListWidget->currentRow();
+    editor()->stopPrefetch();
     editor()->object()->removeColour(colorNumber);
 
     refreshColorList();
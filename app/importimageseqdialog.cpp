@@ -39,6 +39,11 @@ int ImportImageSeqDialog::getSpace()
     return ui->spaceSpinBox->value();
 }
 
+bool ImportImageSeqDialog::getAutoCrop()
+{
+    return ui->autoCropCheckBox->isChecked();
+}
+
 ImportExportDialog::Mode ImportImageSeqDialog::getMode()
 {
     return ImportExportDialog::Import;
@@ -33,6 +33,7 @@ public:
     ~ImportImageSeqDialog();
 
     int getSpace();
+    bool getAutoCrop();
 
 protected:
     Mode getMode();
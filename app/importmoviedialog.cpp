@@ -0,0 +1,53 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2005-2007 Patrick Corrieri & Pascal Naidon
+Copyright (C) 2013-2017 Matt Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "importmoviedialog.h"
+#include "ui_importmovieoptions.h"
+
+ImportMovieDialog::ImportMovieDialog(QWidget* parent) :
+    ImportExportDialog(parent),
+    ui(new Ui::ImportMovieOptions)
+{
+    ui->setupUi(getOptionsGroupBox());
+    init();
+    setWindowTitle(tr("Import movie"));
+}
+
+ImportMovieDialog::~ImportMovieDialog()
+{
+    delete ui;
+}
+
+int ImportMovieDialog::getFrameStep()
+{
+    return ui->frameStepSpinBox->value();
+}
+
+float ImportMovieDialog::getScale()
+{
+    return ui->scaleSpinBox->value() / 100.f;
+}
+
+ImportExportDialog::Mode ImportMovieDialog::getMode()
+{
+    return ImportExportDialog::Import;
+}
+
+FileType ImportMovieDialog::getFileType()
+{
+    return FileType::MOVIE;
+}
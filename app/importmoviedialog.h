@@ -0,0 +1,46 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2005-2007 Patrick Corrieri & Pascal Naidon
+Copyright (C) 2013-2017 Matt Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef IMPORTMOVIEDIALOG_H
+#define IMPORTMOVIEDIALOG_H
+
+#include "importexportdialog.h"
+
+namespace Ui {
+class ImportMovieOptions;
+}
+
+class ImportMovieDialog : public ImportExportDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ImportMovieDialog(QWidget *parent = 0);
+    ~ImportMovieDialog();
+
+    int getFrameStep();
+    float getScale();
+
+protected:
+    Mode getMode();
+    FileType getFileType();
+
+private:
+    Ui::ImportMovieOptions *ui;
+};
+
+#endif // IMPORTMOVIEDIALOG_H
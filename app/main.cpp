@@ -19,15 +19,47 @@ GNU General Public License for more details.
 #include <QDir>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
+#include <QElapsedTimer>
 #include "editor.h"
 #include "mainwindow2.h"
 #include "pencilapplication.h"
+#include "object.h"
+#include "objectdata.h"
+#include "layercamera.h"
+#include "filemanager.h"
+#include "movieexporter.h"
 #include <iostream>
-#include <cstring>
+#include <memory>
+#include <QFileInfo>
 
 using std::cout;
+using std::cerr;
 using std::endl;
 
+// What the command line renderer returns to the shell
+enum RenderExitCode
+{
+    RENDER_OK = 0,
+    RENDER_BAD_ARGUMENTS = 1,
+    RENDER_LOAD_FAILED = 2,
+    RENDER_FAILED = 3,
+    RENDER_FFMPEG_NOT_FOUND = 4,
+};
+
+struct CliRenderOptions
+{
+    int startFrame = 1;
+    int endFrame = -1;      // -1 means the last keyframe of the project
+    QString cameraName;     // empty means the first camera layer
+    int width = -1;
+    int height = -1;
+    double scale = 1.0;     // of the camera size, when no width or height is given
+    QString format;         // empty means the extension of each output path
+    bool transparency = false;
+    int jobs = 0;           // 0 means one render thread per core
+    QString ffmpegPath;
+};
+
 void installTranslator( PencilApplication& app )
 {
     QSettings setting( PENCIL2D, PENCIL2D );
@@ -56,13 +88,125 @@ void installTranslator( PencilApplication& app )
     qDebug() << "Install translation = " << b;
 }
 
-int handleArguments( MainWindow2 & mainWindow )
+int runGUI( PencilApplication& app, const QString& inputPath )
+{
+    MainWindow2 mainWindow;
+    mainWindow.setWindowTitle( PENCIL_WINDOW_TITLE );
+
+    QObject::connect( &app, &PencilApplication::openFileRequested, &mainWindow, &MainWindow2::openFile );
+    app.emitOpenFileRequest();
+
+    mainWindow.show();
+    if ( !inputPath.isEmpty() )
+    {
+        mainWindow.openFile( inputPath );
+    }
+    return app.exec();
+}
+
+int projectLength( const Object* object )
+{
+    int maxFrame = 1;
+    for ( int i = 0; i < object->getLayerCount(); i++ )
+    {
+        maxFrame = qMax( maxFrame, object->getLayer( i )->getMaxKeyFramePosition() );
+    }
+    return maxFrame;
+}
+
+// Renders the object to one output path, frames in parallel, without creating any widget
+int renderFile( const Object* object, QString outputPath, const CliRenderOptions& options )
+{
+    const QStringList movieFormats{ "mp4", "avi", "gif" };
+    const QStringList imageFormats{ "png", "jpg", "tif", "bmp" };
+
+    QString format = options.format.isEmpty() ? QFileInfo( outputPath ).suffix().toLower() : options.format.toLower();
+    if ( format == "jpeg" ) format = "jpg";
+    if ( format == "tiff" ) format = "tif";
+
+    bool isMovie = movieFormats.contains( format );
+    if ( !isMovie && !imageFormats.contains( format ) )
+    {
+        cerr << qPrintable( PencilApplication::tr( "Warning: Output format is not specified or unsupported. Using PNG." ) ) << endl;
+        format = "png";
+    }
+    if ( isMovie && QFileInfo( outputPath ).suffix().toLower() != format )
+    {
+        outputPath += "." + format; // ffmpeg picks the container from the extension
+    }
+
+    LayerCamera* camera = nullptr;
+    if ( options.cameraName.isEmpty() )
+    {
+        std::vector< LayerCamera* > cameras = object->getLayersByType< LayerCamera >();
+        camera = cameras.empty() ? nullptr : cameras.front();
+    }
+    else
+    {
+        camera = static_cast< LayerCamera* >( object->findLayerByName( options.cameraName, Layer::CAMERA ) );
+    }
+    if ( camera == nullptr )
+    {
+        cerr << qPrintable( PencilApplication::tr( "Error: the file has no camera layer named '%1'" ).arg( options.cameraName ) ) << endl;
+        return RENDER_BAD_ARGUMENTS;
+    }
+
+    QSize exportSize = camera->getViewSize() * options.scale;
+    if ( options.width > 0 )
+    {
+        exportSize.setWidth( options.width );
+    }
+    if ( options.height > 0 )
+    {
+        exportSize.setHeight( options.height );
+    }
+
+    ExportMovieDesc desc;
+    desc.strFileName   = outputPath;
+    desc.startFrame    = options.startFrame;
+    desc.endFrame      = options.endFrame;
+    desc.fps           = object->data()->getFrameRate();
+    desc.exportSize    = exportSize;
+    desc.strCameraName = camera->name();
+    desc.renderThreads = options.jobs;
+
+    MovieExporter exporter;
+    exporter.setFFmpegPath( options.ffmpegPath );
+    exporter.setFrameCallback( []( int frame, qint64 renderNs )
+    {
+        cout << qPrintable( PencilApplication::tr( "Frame %1: %2 ms" ).arg( frame ).arg( renderNs / 1e6, 0, 'f', 1 ) ) << endl;
+    } );
+
+    cout << qPrintable( PencilApplication::tr( "Rendering frames %1 to %2 of camera '%3' at %4x%5 to %6" )
+                        .arg( desc.startFrame ).arg( desc.endFrame ).arg( desc.strCameraName )
+                        .arg( exportSize.width() ).arg( exportSize.height() ).arg( outputPath ) ) << endl;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto noProgress = []( float ) {};
+    Status st = isMovie ? exporter.run( object, desc, noProgress )
+                        : exporter.exportImageSequence( object, desc, format, options.transparency, noProgress );
+    if ( !st.ok() )
+    {
+        cerr << qPrintable( PencilApplication::tr( "Error: rendering '%1' failed: %2" ).arg( outputPath ).arg( st.msg() ) ) << endl;
+        return ( st.code() == Status::ERROR_FFMPEG_NOT_FOUND ) ? RENDER_FFMPEG_NOT_FOUND : RENDER_FAILED;
+    }
+
+    double seconds = timer.elapsed() / 1000.0;
+    int frameCount = desc.endFrame - desc.startFrame + 1;
+    cout << qPrintable( PencilApplication::tr( "Rendered %1 frames in %2 s (%3 frames per second)" )
+                        .arg( frameCount ).arg( seconds, 0, 'f', 2 )
+                        .arg( seconds > 0 ? frameCount / seconds : 0.0, 0, 'f', 1 ) ) << endl;
+    return RENDER_OK;
+}
+
+int handleArguments( PencilApplication& app )
 {
     QStringList args = PencilApplication::arguments();
     QString inputPath;
     QStringList outputPaths;
-    int width = -1, height = -1;
-    bool transparency = false;
+    CliRenderOptions options;
 
     QCommandLineParser parser;
     // TODO: Ignore -NSDocumentRevisionsDebugMode
@@ -73,7 +217,7 @@ int handleArguments( MainWindow2 & mainWindow )
     parser.addPositionalArgument( "input", PencilApplication::tr( "Path to the input pencil file." ) );
 
     QCommandLineOption exportSeqOption( QStringList() << "o" << "export-sequence",
-                                        PencilApplication::tr( "Render the file to <output_path>" ),
+                                        PencilApplication::tr( "Render the file to <output_path>, an image sequence or a .mp4, .avi or .gif movie" ),
                                         PencilApplication::tr( "output_path" ) );
     parser.addOption( exportSeqOption );
 
@@ -91,6 +235,41 @@ int handleArguments( MainWindow2 & mainWindow )
                                            PencilApplication::tr( "Render transparency when possible" ) );
     parser.addOption( transparencyOption );
 
+    QCommandLineOption startOption( QStringList() << "start",
+                                    PencilApplication::tr( "First frame to render, 1 by default" ),
+                                    PencilApplication::tr( "frame" ) );
+    parser.addOption( startOption );
+
+    QCommandLineOption endOption( QStringList() << "end",
+                                  PencilApplication::tr( "Last frame to render, the last keyframe by default" ),
+                                  PencilApplication::tr( "frame" ) );
+    parser.addOption( endOption );
+
+    QCommandLineOption cameraOption( QStringList() << "camera",
+                                     PencilApplication::tr( "Name of the camera layer to render through" ),
+                                     PencilApplication::tr( "layer_name" ) );
+    parser.addOption( cameraOption );
+
+    QCommandLineOption scaleOption( QStringList() << "scale",
+                                    PencilApplication::tr( "Size of the output frames relative to the camera" ),
+                                    PencilApplication::tr( "factor" ) );
+    parser.addOption( scaleOption );
+
+    QCommandLineOption formatOption( QStringList() << "format",
+                                     PencilApplication::tr( "Output format (png, jpg, tif, bmp, mp4, avi or gif) instead of the extension of output_path" ),
+                                     PencilApplication::tr( "format" ) );
+    parser.addOption( formatOption );
+
+    QCommandLineOption jobsOption( QStringList() << "j" << "jobs",
+                                   PencilApplication::tr( "Number of frames rendered at once, one per core by default" ),
+                                   PencilApplication::tr( "integer" ) );
+    parser.addOption( jobsOption );
+
+    QCommandLineOption ffmpegOption( QStringList() << "ffmpeg",
+                                     PencilApplication::tr( "Path to the ffmpeg executable used for movies" ),
+                                     PencilApplication::tr( "path" ) );
+    parser.addOption( ffmpegOption );
+
     parser.process( args );
 
     QStringList posArgs = parser.positionalArguments();
@@ -101,87 +280,119 @@ int handleArguments( MainWindow2 & mainWindow )
 
     outputPaths = parser.values( exportSeqOption );
 
+    // If there are no output paths, open up the GUI (to the input path if there is one)
+    if ( outputPaths.isEmpty() )
+    {
+        return runGUI( app, inputPath );
+    }
+    else if ( inputPath.isEmpty() )
+    {
+        // Error if there are output paths without an input path
+        cerr << qPrintable( PencilApplication::tr( "Error: No input file specified." ) ) << endl;
+        return RENDER_BAD_ARGUMENTS;
+    }
+
     if ( !parser.value( widthOption ).isEmpty() )
     {
         bool ok = false;
-        width = parser.value( widthOption ).toInt( &ok );
+        options.width = parser.value( widthOption ).toInt( &ok );
         if ( !ok )
         {
-            qDebug() << PencilApplication::tr( "Warning: width value %1 is not an integer, ignoring." ).arg(parser.value( widthOption ));
-            width = -1;
+            cerr << qPrintable( PencilApplication::tr( "Warning: width value %1 is not an integer, ignoring." ).arg(parser.value( widthOption )) ) << endl;
+            options.width = -1;
         }
     }
     if ( !parser.value( heightOption ).isEmpty() )
     {
         bool ok = false;
-        height = parser.value( heightOption ).toInt( &ok );
+        options.height = parser.value( heightOption ).toInt( &ok );
         if ( !ok )
         {
-            qDebug() << PencilApplication::tr( "Warning: height value %1 is not an integer, ignoring." ).arg(parser.value( heightOption ));
-            height = -1;
+            cerr << qPrintable( PencilApplication::tr( "Warning: height value %1 is not an integer, ignoring." ).arg(parser.value( heightOption )) ) << endl;
+            options.height = -1;
         }
     }
-    transparency = parser.isSet( transparencyOption );
+    options.transparency = parser.isSet( transparencyOption );
+    options.cameraName = parser.value( cameraOption );
+    options.format = parser.value( formatOption );
+    options.ffmpegPath = parser.value( ffmpegOption );
 
-    // If there are no output paths, open up the GUI (to the input path if there is one)
-    if ( outputPaths.isEmpty() )
+    // The range, scale and jobs are what the render farm asks for, a typo there is an error
+    auto positiveInt = [&parser]( const QCommandLineOption& option, int* value )
     {
-        mainWindow.show();
-        if( !inputPath.isEmpty() )
+        if ( !parser.isSet( option ) )
+        {
+            return true;
+        }
+        bool ok = false;
+        int v = parser.value( option ).toInt( &ok );
+        if ( !ok || v < 1 )
         {
-            mainWindow.openFile(inputPath);
+            cerr << qPrintable( PencilApplication::tr( "Error: %1 must be a positive integer, not '%2'" )
+                                .arg( option.names().last() ).arg( parser.value( option ) ) ) << endl;
+            return false;
         }
-        return PencilApplication::exec();
+        *value = v;
+        return true;
+    };
+    if ( !positiveInt( startOption, &options.startFrame ) ||
+         !positiveInt( endOption, &options.endFrame ) ||
+         !positiveInt( jobsOption, &options.jobs ) )
+    {
+        return RENDER_BAD_ARGUMENTS;
     }
-    else if ( inputPath.isEmpty() )
+    if ( parser.isSet( scaleOption ) )
     {
-        // Error if there are output paths without an input path
-        qDebug() << PencilApplication::tr( "Error: No input file specified." );
-        return 1;
+        bool ok = false;
+        options.scale = parser.value( scaleOption ).toDouble( &ok );
+        if ( !ok || options.scale <= 0 )
+        {
+            cerr << qPrintable( PencilApplication::tr( "Error: scale must be a positive number, not '%1'" ).arg( parser.value( scaleOption ) ) ) << endl;
+            return RENDER_BAD_ARGUMENTS;
+        }
     }
 
-    std::cout << PencilApplication::tr( "Exporting image sequence..." ).constData() << std::endl;
-
     QFileInfo inputFileInfo(inputPath);
     if(!inputFileInfo.exists()) {
-        qDebug() << PencilApplication::tr( "Error: the input file at '%1' does not exist" ).arg(inputPath);
-        return 1;
+        cerr << qPrintable( PencilApplication::tr( "Error: the input file at '%1' does not exist" ).arg(inputPath) ) << endl;
+        return RENDER_BAD_ARGUMENTS;
     }
     if ( !inputFileInfo.isFile() )
     {
-        qDebug() << PencilApplication::tr( "Error: the input path '%1' is not a file" ).arg(inputPath);
-        return 1;
+        cerr << qPrintable( PencilApplication::tr( "Error: the input path '%1' is not a file" ).arg(inputPath) ) << endl;
+        return RENDER_BAD_ARGUMENTS;
     }
 
-    for ( int i = 0; i < outputPaths.length(); i++ )
+    FileManager fileManager;
+    std::unique_ptr< Object > object( fileManager.load( inputPath ) );
+    if ( object == nullptr )
     {
-        mainWindow.openFile( inputPath );
+        cerr << qPrintable( PencilApplication::tr( "Error: could not load '%1': %2" ).arg( inputPath ).arg( fileManager.error().msg() ) ) << endl;
+        return RENDER_LOAD_FAILED;
+    }
+
+    if ( options.endFrame < 0 )
+    {
+        options.endFrame = qMax( options.startFrame, projectLength( object.get() ) );
+    }
+    if ( options.endFrame < options.startFrame )
+    {
+        cerr << qPrintable( PencilApplication::tr( "Error: the last frame %1 is before the first one %2" )
+                            .arg( options.endFrame ).arg( options.startFrame ) ) << endl;
+        return RENDER_BAD_ARGUMENTS;
+    }
 
-        // Detect format
-        QString format;
-        QMap<QString, QString> extensionMapping;
-        extensionMapping[ "png" ] = "PNG";
-        extensionMapping[ "jpg" ] = "JPG";
-        extensionMapping[ "jpeg" ] = "JPG";
-        extensionMapping[ "tif" ] = "TIF";
-        extensionMapping[ "tiff" ] = "TIF";
-        extensionMapping[ "bmp" ] = "BMP";
-        QString extension = outputPaths[i].mid( outputPaths[i].lastIndexOf( "." ) + 1 ).toLower();
-        //qDebug() << "Ext: " << outputPaths[i].lastIndexOf(".") << " " << extension << " " << outputPaths[i];
-        if ( inputPath.contains(".") && extensionMapping.contains( extension ) )
+    for ( const QString& outputPath : outputPaths )
+    {
+        int result = renderFile( object.get(), outputPath, options );
+        if ( result != RENDER_OK )
         {
-            format = extensionMapping[extension];
-        }
-        else {
-            qDebug() << PencilApplication::tr( "Warning: Output format is not specified or unsupported. Using PNG." );
-            format = "PNG";
+            return result;
         }
-
-        mainWindow.mEditor->exportSeqCLI( outputPaths[i], format, width, height, transparency );
     }
-    qDebug() << PencilApplication::tr( "Done." );
+    cout << qPrintable( PencilApplication::tr( "Done." ) ) << endl;
 
-    return 0;
+    return RENDER_OK;
 }
 
 bool isGUIMode(int argc, char* argv[] )
@@ -192,23 +403,35 @@ bool isGUIMode(int argc, char* argv[] )
 	return b;
 }
 
+// Rendering from the command line creates no window, so it needs no display either
+bool isRenderMode( int argc, char* argv[] )
+{
+    for ( int i = 1; i < argc; i++ )
+    {
+        QString arg( argv[ i ] );
+        if ( arg == "-o" || arg.startsWith( "--export-sequence" ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 int main(int argc, char* argv[])
 {
+    if ( !isGUIMode( argc, argv ) && isRenderMode( argc, argv ) && qgetenv( "QT_QPA_PLATFORM" ).isEmpty() )
+    {
+        qputenv( "QT_QPA_PLATFORM", "offscreen" );
+    }
+
     PencilApplication app( argc, argv );
 
     installTranslator( app );
 
-    MainWindow2 mainWindow;
-    mainWindow.setWindowTitle( PENCIL_WINDOW_TITLE );
-
-	QObject::connect( &app, &PencilApplication::openFileRequested, &mainWindow, &MainWindow2::openFile );
-    app.emitOpenFileRequest();
-
     if ( isGUIMode( argc, argv ) )
     {
-        mainWindow.show();
-        return app.exec();
+        return runGUI( app, QString() );
     }
 
-    return handleArguments( mainWindow );
+    return handleArguments( app );
 }
@@ -20,6 +20,7 @@ GNU General Public License for more details.
 #include "ui_mainwindow2.h"
 
 // standard headers
+#include <atomic>
 #include <memory>
 
 // Qt headers
@@ -60,6 +61,7 @@ GNU General Public License for more details.
 #include "timeline2.h"
 #include "errordialog.h"
 #include "importimageseqdialog.h"
+#include "importmoviedialog.h"
 #include "aboutdialog.h"
 
 #include "colorbox.h"
@@ -74,6 +76,7 @@ GNU General Public License for more details.
 #include "shortcutfilter.h"
 #include "filedialogex.h"
 #include "movieexporter.h"
+#include "movieimporter.h"
 #include "app_util.h"
 
 MainWindow2::MainWindow2( QWidget *parent ) : QMainWindow( parent )
@@ -667,16 +670,21 @@ void MainWindow2::importImage()
 
 void MainWindow2::importImageSequence()
 {
-    auto imageSeqDialog = new ImportImageSeqDialog( this );
-    imageSeqDialog->exec();
-    if ( imageSeqDialog->result() == QDialog::Rejected )
+    if ( mEditor->layers()->currentLayer()->type() != Layer::BITMAP )
     {
+        QMessageBox::warning( this, tr( "Warning" ), tr( "Please select a bitmap layer to import the images into." ) );
         return;
     }
 
-    QStringList files = imageSeqDialog->getFilePaths();
-    int number = imageSeqDialog->getSpace();
-    for ( QString strImgFile : files )
+    ImportImageSeqDialog imageSeqDialog( this );
+    imageSeqDialog.exec();
+    if ( imageSeqDialog.result() == QDialog::Rejected )
+    {
+        return;
+    }
+
+    QStringList files;
+    for ( QString strImgFile : imageSeqDialog.getFilePaths() )
     {
         if ( strImgFile.endsWith( ".png" ) ||
              strImgFile.endsWith( ".jpg" ) ||
@@ -685,24 +693,91 @@ void MainWindow2::importImageSequence()
              strImgFile.endsWith( ".tiff" ) ||
              strImgFile.endsWith( ".bmp" ) )
         {
-            mEditor->importImage( strImgFile );
-            for ( int i = 1; i < number; i++ )
-            {
-                mEditor->scrubForward();
-            }
+            files.append( strImgFile );
         }
     }
+    if ( files.isEmpty() )
+    {
+        return;
+    }
+
+    QProgressDialog progressDlg( tr( "Importing image sequence..." ), tr( "Abort" ), 0, 100, this );
+    hideQuestionMark( progressDlg );
+    progressDlg.setWindowModality( Qt::WindowModal );
+    progressDlg.show();
+
+    std::atomic<bool> canceled{ false };
+    connect( &progressDlg, &QProgressDialog::canceled, [&canceled]
+    {
+        canceled = true;
+    } );
+
+    Status st = mEditor->importImageSequence( files, imageSeqDialog.getSpace(), imageSeqDialog.getAutoCrop(), [ &progressDlg ]( float f )
+    {
+        progressDlg.setValue( (int)( f * 100.f ) );
+        QApplication::processEvents();
+    }, &canceled );
+    progressDlg.close();
+
+    if ( !st.ok() && st.code() != Status::CANCELED )
+    {
+        QMessageBox::warning( this, tr( "Warning" ), tr( "Unable to import the image sequence." ) );
+    }
+    else if ( st.code() == Status::SAFE )
+    {
+        // the details are the function, then the files left out
+        QMessageBox::warning( this, tr( "Warning" ), tr( "These images could not be read and were left out:" ) + "\n" +
+                              st.detailsList().mid( 1 ).join( "\n" ) );
+    }
 }
 
 void MainWindow2::importMovie()
 {
-    FileDialog fileDialog( this );
-    QString filePath = fileDialog.openFile( FileType::MOVIE );
-    if ( filePath.isEmpty() )
+    if ( mEditor->layers()->currentLayer()->type() != Layer::BITMAP )
+    {
+        QMessageBox::warning( this, tr( "Warning" ), tr( "Please select a bitmap layer to import the movie into." ) );
+        return;
+    }
+
+    ImportMovieDialog movieDialog( this );
+    movieDialog.exec();
+    if ( movieDialog.result() == QDialog::Rejected || movieDialog.getFilePath().isEmpty() )
     {
         return;
     }
-    mEditor->importMovie( filePath, mEditor->playback()->fps() );
+
+    ImportMovieDesc desc;
+    desc.strFileName = movieDialog.getFilePath();
+    desc.fps         = mEditor->playback()->fps();
+    desc.frameStep   = movieDialog.getFrameStep();
+    desc.scale       = movieDialog.getScale();
+
+    QProgressDialog progressDlg( tr( "Importing movie..." ), tr( "Abort" ), 0, 100, this );
+    hideQuestionMark( progressDlg );
+    progressDlg.setWindowModality( Qt::WindowModal );
+    progressDlg.show();
+
+    MovieImporter importer;
+    connect( &progressDlg, &QProgressDialog::canceled, [&importer]
+    {
+        importer.cancel();
+    } );
+
+    Status st = mEditor->importMovie( importer, desc, [ &progressDlg ]( float f )
+    {
+        progressDlg.setValue( (int)( f * 100.f ) );
+        QApplication::processEvents();
+    } );
+    progressDlg.close();
+
+    if ( st.code() == Status::ERROR_FFMPEG_NOT_FOUND )
+    {
+        QMessageBox::warning( this, tr( "Warning" ), tr( "Importing a movie needs ffmpeg, which could not be found." ) );
+    }
+    else if ( !st.ok() && st.code() != Status::CANCELED )
+    {
+        QMessageBox::warning( this, tr( "Warning" ), tr( "Unable to import the movie." ) );
+    }
 }
 
 void MainWindow2::lockWidgets(bool shouldLock)
@@ -1027,7 +1102,7 @@ void MainWindow2::undoActSetText( void )
         ui->actionUndo->setEnabled( true );
     }
 
-    if ( this->mEditor->mBackupIndex + 2 < this->mEditor->mBackupList.size() )
+    if ( this->mEditor->mBackupIndex + 1 < this->mEditor->mBackupList.size() )
     {
         ui->actionRedo->setText( tr("Redo   %1 %2")
                                 .arg(QString::number( this->mEditor->mBackupIndex + 2 ))
@@ -1100,12 +1175,13 @@ void MainWindow2::makeConnections( Editor* editor, ScribbleArea* scribbleArea )
 {
     connect( editor->tools(), &ToolManager::toolChanged, scribbleArea, &ScribbleArea::setCurrentTool );
     connect( editor->tools(), &ToolManager::toolPropertyChanged, scribbleArea, &ScribbleArea::updateToolCursor );
-    connect( editor->layers(), &LayerManager::currentLayerChanged, scribbleArea, &ScribbleArea::updateAllFrames );
+    connect( editor->layers(), &LayerManager::currentLayerChanged, scribbleArea, &ScribbleArea::redrawAllFrames );
 
-    connect( editor, &Editor::currentFrameChanged, scribbleArea, &ScribbleArea::updateFrame );
+    connect( editor, &Editor::currentFrameChanged, scribbleArea, &ScribbleArea::redrawFrame );
+    connect( editor->playback(), &PlaybackManager::playStateChanged, scribbleArea, &ScribbleArea::setPlaying );
     connect( editor, &Editor::selectAll, scribbleArea, &ScribbleArea::selectAll );
 
-    connect( editor->view(), &ViewManager::viewChanged, scribbleArea, &ScribbleArea::updateAllFrames );
+    connect( editor->view(), &ViewManager::viewChanged, scribbleArea, &ScribbleArea::redrawAllFrames );
 //    connect( editor->preference(), &PreferenceManager::preferenceChanged, scribbleArea, &ScribbleArea::onPreferencedChanged );
 }
 
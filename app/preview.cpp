@@ -29,7 +29,7 @@ void PreviewCanvas::paintEvent( QPaintEvent* )
 	QPainter painter( this );
 	if ( mBitmapImage )
 	{
-		painter.drawImage( rect( ), *( mBitmapImage->image() ) );
+		painter.drawImage( rect( ), mBitmapImage->toImage() );
 	}
 	painter.end( );
 }
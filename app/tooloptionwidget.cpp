@@ -30,6 +30,7 @@ GNU General Public License for more details.
 #include "util.h"
 #include "layer.h"
 #include "layermanager.h"
+#include "preferencemanager.h"
 
 ToolOptionWidget::ToolOptionWidget( QWidget* parent ) : BaseDockWidget( parent )
 {
@@ -66,6 +67,8 @@ void ToolOptionWidget::updateUI()
     mToleranceSlider->setVisible(currentTool->isPropertyEnabled( TOLERANCE ) );
     mToleranceSpinBox->setVisible(currentTool->isPropertyEnabled( TOLERANCE ) );
     mFillContour->setVisible( currentTool->isPropertyEnabled( FILLCONTOUR ) );
+    mFillGapSlider->setVisible( currentTool->type() == BUCKET );
+    mFillGapSpinBox->setVisible( currentTool->type() == BUCKET );
 
     visibilityOnLayer();
 
@@ -82,6 +85,7 @@ void ToolOptionWidget::updateUI()
     setInpolLevel(p.inpolLevel);
     setTolerance(p.tolerance);
     setFillContour(p.useFillContour);
+    setFillGapSize( editor()->preference()->getInt( SETTING::FILL_GAP_SIZE ) );
 }
 
 void ToolOptionWidget::createUI()
@@ -186,6 +190,12 @@ void ToolOptionWidget::createUI()
     mToleranceSpinBox->setRange(1,100);
     mToleranceSpinBox->setValue(settings.value( "Tolerance" ).toInt() );
 
+    mFillGapSlider = new SpinSlider( tr( "Close Gaps" ), SpinSlider::LINEAR, SpinSlider::INTEGER, 0, 20, this );
+    mFillGapSlider->setToolTip( tr( "Gaps in the outline up to twice this many pixels wide don't let the fill leak out" ) );
+
+    mFillGapSpinBox = new QSpinBox(this);
+    mFillGapSpinBox->setRange(0,20);
+
     mMakeInvisibleBox = new QCheckBox( tr( "Invisible" ) );
     mMakeInvisibleBox->setToolTip( tr( "Make invisible" ) );
     mMakeInvisibleBox->setFont( QFont( "Helvetica", 10 ) );
@@ -215,6 +225,8 @@ void ToolOptionWidget::createUI()
     pLayout->addWidget( mInpolLevelsBox, 10, 0, 1, 4);
     pLayout->addWidget( mToleranceSlider, 1, 0, 1, 2);
     pLayout->addWidget( mToleranceSpinBox, 1, 2, 1, 2);
+    pLayout->addWidget( mFillGapSlider, 2, 0, 1, 2);
+    pLayout->addWidget( mFillGapSpinBox, 2, 2, 1, 2);
     pLayout->addWidget( mFillContour, 1, 0, 1, 2);
 
     pLayout->setRowStretch( 17, 1 );
@@ -254,6 +266,23 @@ void ToolOptionWidget::makeConnectionToEditor( Editor* editor )
 
     connect( mFillContour, &QCheckBox::clicked, toolManager, &ToolManager::setUseFillContour );
 
+    auto prefs = editor->preference();
+    connect( mFillGapSlider, &SpinSlider::valueChanged, prefs, [=]( qreal value )
+    {
+        prefs->set( SETTING::FILL_GAP_SIZE, static_cast< int >( value ) );
+    } );
+    connect( mFillGapSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), prefs, [=]( int value )
+    {
+        prefs->set( SETTING::FILL_GAP_SIZE, value );
+    } );
+    connect( prefs, &PreferenceManager::optionChanged, this, [=]( SETTING setting )
+    {
+        if ( setting == SETTING::FILL_GAP_SIZE )
+        {
+            setFillGapSize( prefs->getInt( SETTING::FILL_GAP_SIZE ) );
+        }
+    } );
+
     connect( toolManager, &ToolManager::toolChanged, this, &ToolOptionWidget::onToolChanged );
     connect( toolManager, &ToolManager::toolPropertyChanged, this, &ToolOptionWidget::onToolPropertyChanged );
 }
@@ -319,6 +348,8 @@ void ToolOptionWidget::visibilityOnLayer()
             default:
                 mToleranceSlider->setVisible(false);
                 mToleranceSpinBox->setVisible(false);
+                mFillGapSlider->setVisible(false);
+                mFillGapSpinBox->setVisible(false);
                 mUseAABox->setVisible(false);
                 break;
         }
@@ -465,6 +496,17 @@ void ToolOptionWidget::setFillContour(int useFill)
     mFillContour->setChecked(useFill > 0);
 }
 
+void ToolOptionWidget::setFillGapSize( int gapSize )
+{
+    SignalBlocker b( mFillGapSlider );
+    mFillGapSlider->setEnabled( true );
+    mFillGapSlider->setValue( gapSize );
+
+    SignalBlocker b2( mFillGapSpinBox );
+    mFillGapSpinBox->setEnabled( true );
+    mFillGapSpinBox->setValue( gapSize );
+}
+
 void ToolOptionWidget::disableAllOptions()
 {
     mSizeSlider->hide();
@@ -482,4 +524,6 @@ void ToolOptionWidget::disableAllOptions()
     mToleranceSlider->hide();
     mToleranceSpinBox->hide();
     mFillContour->hide();
+    mFillGapSlider->hide();
+    mFillGapSpinBox->hide();
 }
@@ -59,6 +59,7 @@ private:
     void setInpolLevel( int );
     void setTolerance( int );
     void setFillContour( int );
+    void setFillGapSize( int );
 
     void disableAllOptions();
     void createUI();
@@ -82,6 +83,8 @@ private:
     SpinSlider* mToleranceSlider = nullptr;
     QSpinBox* mToleranceSpinBox  = nullptr;
     QCheckBox* mFillContour      = nullptr;
+    SpinSlider* mFillGapSlider   = nullptr;
+    QSpinBox* mFillGapSpinBox    = nullptr;
 
 };
 
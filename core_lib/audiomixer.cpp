@@ -0,0 +1,455 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "audiomixer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <QAudioDecoder>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include "object.h"
+#include "layersound.h"
+#include "soundclip.h"
+#include "functiontask.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AUDIOMIXER_X86
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+    // Reads 16 bit PCM at 44.1 kHz, mono or stereo, anything else is left to a decoder
+    bool readWav( const QString& fileName, PcmBuffer& pcm )
+    {
+        QFile file( fileName );
+        if ( !file.open( QIODevice::ReadOnly ) )
+        {
+            return false;
+        }
+
+        char riff[ 12 ];
+        if ( file.read( riff, 12 ) != 12 || memcmp( riff, "RIFF", 4 ) != 0 || memcmp( riff + 8, "WAVE", 4 ) != 0 )
+        {
+            return false;
+        }
+
+        int channels = 0;
+        bool formatOk = false;
+        char chunk[ 8 ];
+        while ( file.read( chunk, 8 ) == 8 )
+        {
+            quint32 size;
+            memcpy( &size, chunk + 4, 4 );
+            if ( memcmp( chunk, "fmt ", 4 ) == 0 )
+            {
+                QByteArray fmt = file.read( size );
+                if ( fmt.size() < 16 )
+                {
+                    return false;
+                }
+                qint16 audioFormat, bitsPerSample;
+                qint16 channelCount;
+                qint32 sampleRate;
+                memcpy( &audioFormat, fmt.constData(), 2 );
+                memcpy( &channelCount, fmt.constData() + 2, 2 );
+                memcpy( &sampleRate, fmt.constData() + 4, 4 );
+                memcpy( &bitsPerSample, fmt.constData() + 14, 2 );
+                channels = channelCount;
+                formatOk = ( audioFormat == 1 && bitsPerSample == 16 && sampleRate == AudioMixer::SAMPLE_RATE &&
+                             ( channels == 1 || channels == 2 ) );
+            }
+            else if ( memcmp( chunk, "data", 4 ) == 0 )
+            {
+                if ( !formatOk )
+                {
+                    return false;
+                }
+                std::vector< int16_t > data( size / 2 );
+                file.read( reinterpret_cast< char* >( data.data() ), data.size() * 2 );
+                if ( channels == 2 )
+                {
+                    pcm.swap( data );
+                }
+                else
+                {
+                    pcm.resize( data.size() * 2 );
+                    for ( size_t i = 0; i < data.size(); i++ )
+                    {
+                        pcm[ 2 * i ] = pcm[ 2 * i + 1 ] = data[ i ];
+                    }
+                }
+                return true;
+            }
+            else
+            {
+                file.seek( file.pos() + size + ( size & 1 ) );
+            }
+        }
+        return false;
+    }
+
+    bool appendBuffer( const QAudioBuffer& buffer, PcmBuffer& pcm )
+    {
+        QAudioFormat format = buffer.format();
+        if ( format.sampleType() != QAudioFormat::SignedInt || format.sampleSize() != 16 ||
+             format.sampleRate() != AudioMixer::SAMPLE_RATE || format.channelCount() > 2 )
+        {
+            return false;
+        }
+        const int16_t* samples = buffer.constData< int16_t >();
+        const int count = buffer.sampleCount();
+        if ( format.channelCount() == 2 )
+        {
+            pcm.insert( pcm.end(), samples, samples + count );
+        }
+        else
+        {
+            for ( int i = 0; i < count; i++ )
+            {
+                pcm.push_back( samples[ i ] );
+                pcm.push_back( samples[ i ] );
+            }
+        }
+        return true;
+    }
+
+    // QAudioDecoder runs on the event loop of the calling thread, so it gets one here
+    bool decodeWithQt( const QString& fileName, PcmBuffer& pcm )
+    {
+        QAudioDecoder decoder;
+        if ( !decoder.isAvailable() )
+        {
+            return false;
+        }
+
+        QAudioFormat format;
+        format.setSampleRate( AudioMixer::SAMPLE_RATE );
+        format.setChannelCount( AudioMixer::CHANNELS );
+        format.setSampleSize( 16 );
+        format.setSampleType( QAudioFormat::SignedInt );
+        format.setByteOrder( QAudioFormat::LittleEndian );
+        format.setCodec( "audio/pcm" );
+        decoder.setAudioFormat( format );
+        decoder.setSourceFilename( fileName );
+
+        QEventLoop loop;
+        bool done = false;
+        bool failed = false;
+        QObject::connect( &decoder, &QAudioDecoder::bufferReady, [ & ]
+        {
+            if ( !appendBuffer( decoder.read(), pcm ) )
+            {
+                failed = done = true;
+                decoder.stop();
+                loop.quit();
+            }
+        } );
+        QObject::connect( &decoder, &QAudioDecoder::finished, [ & ]
+        {
+            done = true;
+            loop.quit();
+        } );
+        auto errorSignal = static_cast< void ( QAudioDecoder::* )( QAudioDecoder::Error ) >( &QAudioDecoder::error );
+        QObject::connect( &decoder, errorSignal, [ & ]( QAudioDecoder::Error )
+        {
+            failed = done = true;
+            loop.quit();
+        } );
+
+        decoder.start();
+        if ( !done )
+        {
+            loop.exec();
+        }
+        return !failed && !pcm.empty();
+    }
+
+    bool decodeWithFFmpeg( const QString& fileName, const QString& ffmpegPath, PcmBuffer& pcm )
+    {
+        QTemporaryDir dir;
+        QString wavPath = dir.path() + "/decoded.wav";
+        QStringList args;
+        args << "-i" << fileName << "-ar" << QString::number( AudioMixer::SAMPLE_RATE )
+             << "-acodec" << "pcm_s16le" << "-ac" << "2" << "-y" << wavPath;
+        if ( QProcess::execute( ffmpegPath, args ) != 0 )
+        {
+            return false;
+        }
+        return readWav( wavPath, pcm );
+    }
+
+    struct CacheEntry
+    {
+        QMutex mutex; // held while decoding, so a file is decoded by one thread only
+        bool decoded = false;
+        std::shared_ptr< const PcmBuffer > pcm;
+        // guarded by cacheMutex
+        qint64 bytes = 0;
+        quint64 lastUse = 0;
+    };
+
+    // about 25 minutes of stereo sound, clips still mixed keep their PCM when dropped
+    const qint64 CACHE_BUDGET = 256 * 1024 * 1024;
+
+    QMutex cacheMutex;
+    std::map< QString, std::shared_ptr< CacheEntry > > cache;
+    quint64 useCounter = 0;
+
+    std::shared_ptr< CacheEntry > cacheEntry( const QString& fileName )
+    {
+        QFileInfo info( fileName );
+        QString key = QString( "%1|%2|%3" ).arg( info.absoluteFilePath() )
+                                          .arg( info.lastModified().toMSecsSinceEpoch() )
+                                          .arg( info.size() );
+
+        QMutexLocker locker( &cacheMutex );
+        std::shared_ptr< CacheEntry >& slot = cache[ key ];
+        if ( !slot )
+        {
+            slot = std::make_shared< CacheEntry >();
+        }
+        slot->lastUse = ++useCounter;
+        return slot;
+    }
+
+    // Drops the least recently used files until the cache fits its budget again
+    void trimCache( const std::shared_ptr< CacheEntry >& keep )
+    {
+        QMutexLocker locker( &cacheMutex );
+        qint64 total = 0;
+        std::vector< std::pair< quint64, QString > > byAge;
+        for ( auto& pair : cache )
+        {
+            total += pair.second->bytes;
+            if ( pair.second->bytes > 0 && pair.second != keep )
+            {
+                byAge.emplace_back( pair.second->lastUse, pair.first );
+            }
+        }
+        std::sort( byAge.begin(), byAge.end() );
+
+        for ( auto& age : byAge )
+        {
+            if ( total <= CACHE_BUDGET )
+            {
+                break;
+            }
+            auto it = cache.find( age.second );
+            // one being decoded again is left alone, it can't be waited for under cacheMutex
+            if ( !it->second->mutex.tryLock() )
+            {
+                continue;
+            }
+            total -= it->second->bytes;
+            it->second->mutex.unlock();
+            cache.erase( it );
+        }
+    }
+}
+
+Status AudioMixer::setClips( const Object* object, int fps )
+{
+    return collectClips( object, fps, true );
+}
+
+Status AudioMixer::setDecodedClips( const Object* object, int fps )
+{
+    return collectClips( object, fps, false );
+}
+
+Status AudioMixer::collectClips( const Object* object, int fps, bool wait )
+{
+    mClips.clear();
+    mFps = fps;
+
+    QStringList failed;
+    QStringList pending;
+    for ( LayerSound* layer : object->getLayersByType< LayerSound >() )
+    {
+        layer->foreachKeyFrame( [ & ]( KeyFrame* key )
+        {
+            SoundClip* clip = static_cast< SoundClip* >( key );
+            if ( clip->fileName().isEmpty() )
+            {
+                return;
+            }
+            std::shared_ptr< const PcmBuffer > pcm;
+            if ( wait )
+            {
+                pcm = decode( clip->fileName(), mFFmpegPath );
+            }
+            else
+            {
+                std::shared_ptr< CacheEntry > entry = cacheEntry( clip->fileName() );
+                bool ready = entry->mutex.tryLock();
+                if ( ready )
+                {
+                    ready = entry->decoded;
+                    pcm = entry->pcm;
+                    entry->mutex.unlock();
+                }
+                if ( !ready )
+                {
+                    preload( clip->fileName() );
+                    pending << clip->fileName();
+                    return;
+                }
+            }
+
+            if ( pcm )
+            {
+                mClips.push_back( Clip{ pcm, frameToSample( clip->pos() ) } );
+            }
+            else
+            {
+                failed << clip->fileName();
+            }
+        } );
+    }
+
+    if ( !pending.isEmpty() )
+    {
+        return Status( Status::FAIL, QStringList() << "AudioMixer: still decoding" << pending );
+    }
+    if ( !failed.isEmpty() )
+    {
+        return Status( Status::FAIL, QStringList() << "AudioMixer: could not decode" << failed );
+    }
+    return Status::OK;
+}
+
+void AudioMixer::mix( qint64 firstSample, int sampleCount, int16_t* out ) const
+{
+    std::fill( out, out + qint64( sampleCount ) * CHANNELS, int16_t( 0 ) );
+
+    const qint64 lastSample = firstSample + sampleCount;
+    for ( const Clip& clip : mClips )
+    {
+        const qint64 clipEnd = clip.firstSample + qint64( clip.pcm->size() ) / CHANNELS;
+        const qint64 from = std::max( firstSample, clip.firstSample );
+        const qint64 to = std::min( lastSample, clipEnd );
+        if ( from < to )
+        {
+            mixRow( out + ( from - firstSample ) * CHANNELS,
+                    clip.pcm->data() + ( from - clip.firstSample ) * CHANNELS,
+                    int( ( to - from ) * CHANNELS ) );
+        }
+    }
+}
+
+void AudioMixer::preload( const QString& fileName )
+{
+    QThreadPool::globalInstance()->start( new FunctionTask( [ fileName ] { AudioMixer::decode( fileName, QString() ); } ) );
+}
+
+std::shared_ptr< const PcmBuffer > AudioMixer::decode( const QString& fileName, const QString& ffmpegPath )
+{
+    std::shared_ptr< CacheEntry > entry = cacheEntry( fileName );
+
+    QMutexLocker locker( &entry->mutex );
+    if ( entry->decoded && ( entry->pcm || ffmpegPath.isEmpty() ) )
+    {
+        return entry->pcm;
+    }
+
+    auto pcm = std::make_shared< PcmBuffer >();
+    bool ok = readWav( fileName, *pcm ) || decodeWithQt( fileName, *pcm );
+    if ( !ok && !ffmpegPath.isEmpty() )
+    {
+        pcm->clear();
+        ok = decodeWithFFmpeg( fileName, ffmpegPath, *pcm );
+    }
+
+    entry->decoded = true;
+    entry->pcm = ok ? pcm : nullptr;
+    std::shared_ptr< const PcmBuffer > result = entry->pcm;
+    locker.unlock();
+
+    {
+        QMutexLocker cacheLocker( &cacheMutex );
+        entry->bytes = result ? qint64( result->size() * sizeof( int16_t ) ) : 0;
+    }
+    trimCache( entry );
+    return result;
+}
+
+qint64 AudioMixer::cacheUsage()
+{
+    QMutexLocker locker( &cacheMutex );
+    qint64 total = 0;
+    for ( auto& pair : cache )
+    {
+        total += pair.second->bytes;
+    }
+    return total;
+}
+
+void AudioMixer::mixRowScalar( int16_t* dst, const int16_t* src, int count )
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        int32_t sum = int32_t( dst[ i ] ) + int32_t( src[ i ] );
+        dst[ i ] = int16_t( qBound( int32_t( INT16_MIN ), sum, int32_t( INT16_MAX ) ) );
+    }
+}
+
+void AudioMixer::mixRow( int16_t* dst, const int16_t* src, int count )
+{
+#ifdef AUDIOMIXER_X86
+    // a saturating add is a single SSE2 instruction, memory is what limits this
+    int i = 0;
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + i ) );
+        __m128i s = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i ), _mm_adds_epi16( d, s ) );
+    }
+    mixRowScalar( dst + i, src + i, count - i );
+#else
+    mixRowScalar( dst, src, count );
+#endif
+}
+
+AudioMixerDevice::AudioMixerDevice( const AudioMixer* mixer, qint64 firstSample, QObject* parent )
+    : QIODevice( parent )
+    , mMixer( mixer )
+    , mPosition( firstSample )
+{
+}
+
+qint64 AudioMixerDevice::bytesAvailable() const
+{
+    // endless, the playback stops reading
+    return QIODevice::bytesAvailable() + AudioMixer::SAMPLE_RATE * AudioMixer::CHANNELS * sizeof( int16_t );
+}
+
+qint64 AudioMixerDevice::readData( char* data, qint64 maxSize )
+{
+    const int sampleBytes = AudioMixer::CHANNELS * sizeof( int16_t );
+    const int samples = int( std::min< qint64 >( maxSize / sampleBytes, AudioMixer::SAMPLE_RATE ) );
+    mMixer->mix( mPosition, samples, reinterpret_cast< int16_t* >( data ) );
+    mPosition += samples;
+    return qint64( samples ) * sampleBytes;
+}
@@ -0,0 +1,99 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <QIODevice>
+#include <QString>
+#include "pencilerror.h"
+
+class Object;
+
+typedef std::vector< int16_t > PcmBuffer; // 44.1 kHz, interleaved stereo
+
+
+/*
+ * Mixes the sound clips of an object with saturation, sample by sample.
+ * Each sound file is decoded once into PCM and cached, up to a budget, the
+ * least recently used files go first. The playback reads the mix through
+ * AudioMixerDevice and the movie export asks for its whole range at once.
+ */
+class AudioMixer
+{
+public:
+    static const int SAMPLE_RATE = 44100;
+    static const int CHANNELS = 2;
+
+    void setFFmpegPath( const QString& path ) { mFFmpegPath = path; } // for files Qt can't decode
+
+    // Decodes the clips which aren't cached yet, fails when one can't be
+    Status setClips( const Object* object, int fps );
+    // Never blocks: fails when a clip isn't decoded yet, and queues its decoding
+    Status setDecodedClips( const Object* object, int fps );
+    bool isEmpty() const { return mClips.empty(); }
+
+    qint64 frameToSample( int frame ) const { return qint64( frame ) * SAMPLE_RATE / mFps; }
+
+    // sampleCount stereo samples from firstSample on, silence where no clip plays
+    void mix( qint64 firstSample, int sampleCount, int16_t* out ) const;
+
+    // Decodes on the global thread pool ahead of the first setClips()
+    static void preload( const QString& fileName );
+    static std::shared_ptr< const PcmBuffer > decode( const QString& fileName, const QString& ffmpegPath );
+    static qint64 cacheUsage(); // bytes of PCM held by the cache
+
+    // dst = dst + src, clamped to int16
+    static void mixRow( int16_t* dst, const int16_t* src, int count );
+    static void mixRowScalar( int16_t* dst, const int16_t* src, int count );
+
+private:
+    Status collectClips( const Object* object, int fps, bool wait );
+
+    struct Clip
+    {
+        std::shared_ptr< const PcmBuffer > pcm;
+        qint64 firstSample;
+    };
+
+    std::vector< Clip > mClips;
+    int mFps = 12;
+    QString mFFmpegPath;
+};
+
+
+// The mix as an endless stream from a sample on, for QAudioOutput
+class AudioMixerDevice : public QIODevice
+{
+public:
+    AudioMixerDevice( const AudioMixer* mixer, qint64 firstSample, QObject* parent = nullptr );
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData( char* data, qint64 maxSize ) override;
+    qint64 writeData( const char*, qint64 ) override { return -1; }
+
+private:
+    const AudioMixer* mMixer;
+    qint64 mPosition;
+};
+
+#endif // AUDIOMIXER_H
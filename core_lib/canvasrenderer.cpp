@@ -24,15 +24,38 @@ GNU General Public License for more details.
 #include "util.h"
 
 
+struct CanvasRenderer::LayerCacheEntry
+{
+    int         modificationCount = 0;
+    QTransform  view;
+    int         options = 0;
+    BitmapImage bitmap;
+    QImage      image;
+};
+
+namespace
+{
+    // The render options a vector rasterization depends on
+    int vectorRenderOptions( const RenderOptions& options )
+    {
+        return ( options.bOutlines ? 1 : 0 ) | ( options.bThinLines ? 2 : 0 ) | ( options.bAntiAlias ? 4 : 0 );
+    }
+}
+
 
 CanvasRenderer::CanvasRenderer( QObject* parent ) : QObject( parent )
     , mLog( "CanvasRenderer" )
 {
     ENABLE_DEBUG_LOG( mLog, false );
+    mLayerCache.setMaxCost( 256 * 1024 ); // 256MB
 }
 
 CanvasRenderer::~CanvasRenderer()
 {
+    for ( KeyFrame* keyFrame : mWatchedKeyFrames )
+    {
+        keyFrame->removeEventListner( this );
+    }
 }
 
 void CanvasRenderer::setCanvas( QPixmap* canvas )
@@ -77,20 +100,26 @@ void CanvasRenderer::paint( Object* object, int layer, int frame, QRect rect )
     mLayerIndex = layer;
     mFrameNumber = frame;
 
+    // Only rect is recomposited, everything outside it is left as it is
+    mDirtyRect = rect.isNull() ? mCanvas->rect() : ( rect & mCanvas->rect() );
+    if ( mDirtyRect.isEmpty() )
+    {
+        return;
+    }
+    mDirtyCanvasRect = mViewTransform.inverted().mapRect( QRectF( mDirtyRect ) ).toAlignedRect().adjusted( -1, -1, 1, 1 );
+
     QPainter painter( mCanvas );
 
+    // in screen pixels, so it goes before the view transform
+    painter.setClipRect( mDirtyRect );
+
     painter.setWorldTransform( mViewTransform );
     painter.setRenderHint( QPainter::SmoothPixmapTransform, mOptions.bAntiAlias );
     painter.setRenderHint( QPainter::Antialiasing, true );
 
-    // Don't set clip rect, paint whole canvas. `rect` therefore unused.
-    Q_UNUSED(rect);
-    //painter.setClipRect( rect );
-    //painter.setClipping( true );
-
     painter.setWorldMatrixEnabled( true );
 
-    paintBackground();
+    paintBackground( painter );
     paintOnionSkin( painter );
 
     paintCurrentFrame( painter );
@@ -101,11 +130,138 @@ void CanvasRenderer::paint( Object* object, int layer, int frame, QRect rect )
     {
         paintAxis( painter );
     }
+
+    qCDebug( mLog ) << "Layer cache hits =" << mCacheHits << ", misses =" << mCacheMisses;
+}
+
+void CanvasRenderer::invalidateFrame( Object* object, int frame )
+{
+    for ( int i = 0; i < object->getLayerCount(); ++i )
+    {
+        KeyFrame* keyFrame = object->getLayer( i )->getLastKeyFrameAtPosition( frame );
+        if ( keyFrame != nullptr )
+        {
+            removeFromCache( keyFrame );
+        }
+    }
+}
+
+void CanvasRenderer::invalidateAll()
+{
+    mLayerCache.clear();
+}
+
+void CanvasRenderer::onKeyFrameDestroy( KeyFrame* keyFrame )
+{
+    // the keyframe is going through its listeners, it mustn't be told to remove us
+    mWatchedKeyFrames.erase( keyFrame );
+    removeFromCache( keyFrame );
+}
+
+void CanvasRenderer::removeFromCache( KeyFrame* keyFrame )
+{
+    for ( const LayerCacheKey& key : mLayerCache.keys() )
+    {
+        if ( key.keyFrame == keyFrame )
+        {
+            mLayerCache.remove( key );
+        }
+    }
+}
+
+BitmapImage CanvasRenderer::cachedBitmapFrame( BitmapImage* bitmapImage, QColor tint )
+{
+    LayerCacheKey key{ bitmapImage, true, tint.rgba() };
+
+    LayerCacheEntry* entry = mLayerCache.object( key );
+    if ( entry != nullptr && entry->modificationCount == bitmapImage->modificationCount() )
+    {
+        mCacheHits++;
+        return entry->bitmap;
+    }
+    mCacheMisses++;
+
+    entry = new LayerCacheEntry;
+    entry->modificationCount = bitmapImage->modificationCount();
+    entry->bitmap = bitmapImage->copy();
+    entry->bitmap.drawRect( bitmapImage->bounds(),
+                            Qt::NoPen,
+                            QBrush( tint ),
+                            QPainter::CompositionMode_SourceIn,
+                            false );
+
+    BitmapImage result = entry->bitmap; // tiles are shared, the insert may evict the entry right away
+    int cost = qMax( 1, entry->bitmap.tileCount() * BitmapImage::TILE_SIZE * BitmapImage::TILE_SIZE * 4 / 1024 );
+    mLayerCache.insert( key, entry, cost );
+
+    if ( mWatchedKeyFrames.insert( bitmapImage ).second )
+    {
+        bitmapImage->addEventListener( this );
+    }
+    return result;
+}
+
+QImage CanvasRenderer::cachedVectorFrame( VectorImage* vectorImage, bool tinted, QColor tint )
+{
+    LayerCacheKey key{ vectorImage, tinted, tinted ? tint.rgba() : 0 };
+    const int options = vectorRenderOptions( mOptions );
+
+    LayerCacheEntry* entry = mLayerCache.object( key );
+    if ( entry != nullptr &&
+         entry->modificationCount == vectorImage->modificationCount() &&
+         entry->view == mViewTransform &&
+         entry->options == options &&
+         entry->image.size() == mCanvas->size() )
+    {
+        mCacheHits++;
+        return entry->image;
+    }
+    mCacheMisses++;
+
+    entry = new LayerCacheEntry;
+    entry->modificationCount = vectorImage->modificationCount();
+    entry->view = mViewTransform;
+    entry->options = options;
+    entry->image = QImage( mCanvas->size(), QImage::Format_ARGB32_Premultiplied );
+    vectorImage->outputImage( &entry->image, mViewTransform, mOptions.bOutlines, mOptions.bThinLines, mOptions.bAntiAlias );
+
+    if ( tinted )
+    {
+        QPainter tintPainter( &entry->image );
+        tintPainter.setCompositionMode( QPainter::CompositionMode_SourceIn );
+        tintPainter.fillRect( entry->image.rect(), tint );
+    }
+
+    QImage result = entry->image;
+    mLayerCache.insert( key, entry, qMax( 1, result.byteCount() / 1024 ) );
+
+    if ( mWatchedKeyFrames.insert( vectorImage ).second )
+    {
+        vectorImage->addEventListener( this );
+    }
+    return result;
 }
 
-void CanvasRenderer::paintBackground()
+QColor CanvasRenderer::onionSkinTint( int nFrame )
 {
-    mCanvas->fill( Qt::transparent );
+    if ( nFrame < mFrameNumber )
+    {
+        return Qt::red;
+    }
+    else if ( nFrame > mFrameNumber )
+    {
+        return Qt::blue;
+    }
+    return Qt::transparent; //no color for the current frame
+}
+
+void CanvasRenderer::paintBackground( QPainter& painter )
+{
+    painter.save();
+    painter.setWorldMatrixEnabled( false );
+    painter.setCompositionMode( QPainter::CompositionMode_Source );
+    painter.fillRect( mDirtyRect, Qt::transparent );
+    painter.restore();
 }
 
 void CanvasRenderer::paintOnionSkin( QPainter& painter )
@@ -215,33 +371,19 @@ void CanvasRenderer::paintBitmapFrame( QPainter& painter,
         return;
     }
 
-    BitmapImage* tempBitmapImage = new BitmapImage;
-    tempBitmapImage->paste(bitmapImage);
-
+    // Bitmaps are painted straight from their tiles, only the tinted onion skin is cached
+    BitmapImage tintedImage;
     if ( colorize )
     {
-        QBrush colorBrush = QBrush(Qt::transparent); //no color for the current frame
-
-        if (nFrame < mFrameNumber)
-        {
-            colorBrush = QBrush(Qt::red);
-        }
-        else if (nFrame > mFrameNumber)
-        {
-            colorBrush = QBrush(Qt::blue);
-        }
-
-        tempBitmapImage->drawRect(  bitmapImage->bounds(),
-                                    Qt::NoPen,
-                                    colorBrush,
-                                    QPainter::CompositionMode_SourceIn,
-                                    false);
+        tintedImage = cachedBitmapFrame( bitmapImage, onionSkinTint( nFrame ) );
+        bitmapImage = &tintedImage;
     }
 
     // If the current frame on the current layer has a transformation, we apply it.
+    // The selected pixels are left out with a clip rather than cleared from a copy.
     //
-    if (mRenderTransform && nFrame == mFrameNumber && layerId == mLayerIndex ) {
-        tempBitmapImage->clear(mSelection);
+    bool cutSelection = mRenderTransform && nFrame == mFrameNumber && layerId == mLayerIndex;
+    if ( cutSelection ) {
         paintTransformedSelection(painter);
     }
 
@@ -251,9 +393,16 @@ void CanvasRenderer::paintBitmapFrame( QPainter& painter,
         painter.setOpacity( bitmapLayer->getOpacity() );
     }
 
-    tempBitmapImage->paintImage( painter );
-
-    delete tempBitmapImage;
+    if ( cutSelection )
+    {
+        painter.save();
+        painter.setClipRegion( QRegion( bitmapImage->bounds() ).subtracted( QRegion( mSelection ) ), Qt::IntersectClip );
+    }
+    bitmapImage->paintImage( painter, mDirtyCanvasRect );
+    if ( cutSelection )
+    {
+        painter.restore();
+    }
 }
 
 void CanvasRenderer::paintVectorFrame( QPainter& painter,
@@ -291,41 +440,10 @@ void CanvasRenderer::paintVectorFrame( QPainter& painter,
         return;
     }
 
-    QImage* pImage = new QImage( mCanvas->size(), QImage::Format_ARGB32_Premultiplied );
-    vectorImage->outputImage( pImage, mViewTransform, mOptions.bOutlines, mOptions.bThinLines, mOptions.bAntiAlias );
-
-
-    //painter.drawImage( QPoint( 0, 0 ), *pImage );
-
-    // Go through a Bitmap image to paint the onion skin colour
-    //
-    BitmapImage* tempBitmapImage = new BitmapImage();
-    tempBitmapImage->setImage(pImage);
-
-    if ( colorize )
-    {
-        QBrush colorBrush = QBrush(Qt::transparent); //no color for the current frame
-
-        if (nFrame < mFrameNumber)
-        {
-            colorBrush = QBrush(Qt::red);
-        }
-        else if (nFrame > mFrameNumber)
-        {
-            colorBrush = QBrush(Qt::blue);
-        }
-
-        tempBitmapImage->drawRect(  pImage->rect(),
-                                    Qt::NoPen,
-                                    colorBrush,
-                                    QPainter::CompositionMode_SourceIn,
-                                    false);
-    }
+    QImage frameImage = cachedVectorFrame( vectorImage, colorize, onionSkinTint( nFrame ) );
 
     painter.setWorldMatrixEnabled( false ); //Don't tranform the image here as we used the viewTransform in the image output
-    tempBitmapImage->paintImage( painter );
-
-    delete tempBitmapImage;
+    painter.drawImage( mDirtyRect.topLeft(), frameImage, mDirtyRect );
 }
 
 void CanvasRenderer::paintTransformedSelection( QPainter& painter )
@@ -471,11 +589,13 @@ void CanvasRenderer::paintCameraBorder(QPainter &painter)
             QRegion rg2(mCameraRect);
             QRegion rg3=rg1.subtracted(rg2);
 
-            painter.setClipRegion(rg3);
+            // within the dirty rect
+            painter.save();
+            painter.setClipRegion(rg3, Qt::IntersectClip);
 
             painter.drawRect( boundingRect );
 
-            painter.setClipping(false);
+            painter.restore();
 
             QPen pen( Qt::black,
                       2,
@@ -21,12 +21,17 @@ GNU General Public License for more details.
 #include <QObject>
 #include <QTransform>
 #include <QPainter>
+#include <QCache>
 #include <memory>
+#include <set>
 #include "log.h"
+#include "keyframe.h"
 
 
 class Object;
 class Layer;
+class BitmapImage;
+class VectorImage;
 
 
 struct RenderOptions
@@ -50,7 +55,26 @@ struct RenderOptions
 };
 
 
-class CanvasRenderer : public QObject
+// One rasterized keyframe in CanvasRenderer's layer cache, plain or tinted for the onion skin
+struct LayerCacheKey
+{
+    KeyFrame* keyFrame;
+    bool      tinted;
+    QRgb      tint;
+
+    bool operator==( const LayerCacheKey& other ) const
+    {
+        return keyFrame == other.keyFrame && tinted == other.tinted && tint == other.tint;
+    }
+};
+
+inline uint qHash( const LayerCacheKey& key, uint seed = 0 )
+{
+    return qHash( reinterpret_cast< quintptr >( key.keyFrame ), seed ) ^ ( key.tinted ? key.tint : ~key.tint );
+}
+
+
+class CanvasRenderer : public QObject, public KeyFrameEventListener
 {
     Q_OBJECT
 
@@ -65,17 +89,34 @@ public:
     void ignoreTransformedSelection();
     QRect getCameraRect();
 
+    // Recomposites the part of the canvas in rect, in screen pixels, or all of it for a null rect
     void paint( Object* object, int layer, int frame, QRect rect );
     void renderGrid(QPainter& painter);
 
+    // Drop the cached images of every keyframe showing at this frame
+    void invalidateFrame( Object* object, int frame );
+    void invalidateAll();
+    void setCacheLimit( int kiloBytes ) { mLayerCache.setMaxCost( kiloBytes ); }
+
+    int  cacheHits() const { return mCacheHits; }
+    int  cacheMisses() const { return mCacheMisses; }
+    void resetCacheCounters() { mCacheHits = 0; mCacheMisses = 0; }
+
+    void onKeyFrameDestroy( KeyFrame* keyFrame ) override;
+
 private:
-    void paintBackground();
+    void paintBackground( QPainter& painter );
     void paintOnionSkin( QPainter& painter );
     void paintCurrentFrame( QPainter& painter );
 
     void paintBitmapFrame( QPainter&, int layerId, int nFrame, bool colorize = false , bool useLastKeyFrame = true );
     void paintVectorFrame(QPainter&, int layerId, int nFrame, bool colorize = false , bool useLastKeyFrame = true );
 
+    BitmapImage cachedBitmapFrame( BitmapImage* bitmapImage, QColor tint );
+    QImage      cachedVectorFrame( VectorImage* vectorImage, bool tinted, QColor tint );
+    void        removeFromCache( KeyFrame* keyFrame );
+    QColor      onionSkinTint( int nFrame );
+
     void paintTransformedSelection( QPainter& painter );
     void paintGrid( QPainter& painter );
     void paintCameraBorder(QPainter &painter);
@@ -90,6 +131,9 @@ private:
     int mLayerIndex = 0;
     int mFrameNumber = 0;
 
+    QRect mDirtyRect;       // being painted, in screen pixels
+    QRect mDirtyCanvasRect; // the same in canvas coordinates, for picking tiles
+
     bool bMultiLayerOnionSkin = false;
     
     RenderOptions mOptions;
@@ -100,6 +144,13 @@ private:
     QRect mSelection;
     QTransform mSelectionTransform;
 
+    // Rasterized layer images, cost is in kilobytes
+    struct LayerCacheEntry;
+    QCache< LayerCacheKey, LayerCacheEntry > mLayerCache;
+    std::set< KeyFrame* > mWatchedKeyFrames;
+    int mCacheHits = 0;
+    int mCacheMisses = 0;
+
     QLoggingCategory mLog;
 
 };
@@ -31,10 +31,18 @@ INCLUDEPATH += . \
 # Input
 HEADERS +=  \
     graphics/bitmap/bitmapimage.h \
+    graphics/bitmap/pixelkernels.h \
+    graphics/bitmap/dabrasterizer.h \
+    graphics/bitmap/smudgeengine.h \
+    graphics/bitmap/floodfill.h \
     graphics/vector/bezierarea.h \
     graphics/vector/beziercurve.h \
     graphics/vector/colourref.h \
+    graphics/vector/cubicsegments.h \
+    graphics/vector/curvegraph.h \
     graphics/vector/vectorimage.h \
+    graphics/vector/sharedlist.h \
+    graphics/vector/spatialgrid.h \
     graphics/vector/vectorselection.h \
     graphics/vector/vertexref.h \
     interface/backupelement.h \
@@ -90,15 +98,26 @@ HEADERS +=  \
     util/pencilsettings.h \
     util/util.h \
     util/log.h \
+    util/functiontask.h \
     canvasrenderer.h \
+    frameprefetcher.h \
     soundplayer.h \
-    movieexporter.h
+    audiomixer.h \
+    movieexporter.h \
+    movieimporter.h
 
 
 SOURCES +=  graphics/bitmap/bitmapimage.cpp \
+    graphics/bitmap/pixelkernels.cpp \
+    graphics/bitmap/dabrasterizer.cpp \
+    graphics/bitmap/smudgeengine.cpp \
+    graphics/bitmap/floodfill.cpp \
     graphics/vector/bezierarea.cpp \
     graphics/vector/beziercurve.cpp \
     graphics/vector/colourref.cpp \
+    graphics/vector/cubicsegments.cpp \
+    graphics/vector/curvegraph.cpp \
+    graphics/vector/spatialgrid.cpp \
     graphics/vector/vectorimage.cpp \
     graphics/vector/vectorselection.cpp \
     graphics/vector/vertexref.cpp \
@@ -152,9 +171,12 @@ SOURCES +=  graphics/bitmap/bitmapimage.cpp \
     util/pencilsettings.cpp \
     util/util.cpp \
     canvasrenderer.cpp \
+    frameprefetcher.cpp \
     soundplayer.cpp \
+    audiomixer.cpp \
     managers/soundmanager.cpp \
-    movieexporter.cpp
+    movieexporter.cpp \
+    movieimporter.cpp
 
 VERSION = 0.5.4
 DEFINES += APP_VERSION=\\\"$$VERSION\\\"
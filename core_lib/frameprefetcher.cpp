@@ -0,0 +1,257 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "frameprefetcher.h"
+
+#include <algorithm>
+#include <functional>
+#include <QPainter>
+#include <QThread>
+#include "object.h"
+#include "functiontask.h"
+
+
+namespace
+{
+    const int MIN_SLOTS = 4;
+    const int MAX_SLOTS = 16;
+    const qint64 MAX_BUFFER_BYTES = 256 * 1024 * 1024;
+}
+
+FramePrefetcher::FramePrefetcher()
+{
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    stop();
+}
+
+void FramePrefetcher::start( const Object* object, int currentFrame, int startFrame, int endFrame, bool looping,
+                             QTransform view, QSize size, bool antialias, int threads )
+{
+    stop();
+    if ( object == nullptr || size.isEmpty() || endFrame < startFrame )
+    {
+        return;
+    }
+
+    mObject = object;
+    mStartFrame = startFrame;
+    mEndFrame = endFrame;
+    mLooping = looping;
+    mView = view;
+    mSize = size;
+    mAntialias = antialias;
+    mDroppedFrames = 0;
+
+    mPool.setMaxThreadCount( ( threads > 0 ) ? threads : QThread::idealThreadCount() );
+
+    // two frames per thread, as many as fit in the budget
+    qint64 frameBytes = qint64( size.width() ) * size.height() * 4;
+    int slotCount = qBound( MIN_SLOTS, mPool.maxThreadCount() * 2, MAX_SLOTS );
+    slotCount = std::max( 2, std::min< int >( slotCount, int( MAX_BUFFER_BYTES / frameBytes ) ) );
+    mSlots.assign( slotCount, Slot() );
+
+    object->prepareThreadedPainting();
+
+    QMutexLocker locker( &mMutex );
+    mShownFrame = currentFrame;
+    restartAt( frameAfter( currentFrame ) );
+}
+
+void FramePrefetcher::stop()
+{
+    if ( !isRunning() )
+    {
+        return;
+    }
+
+    {
+        QMutexLocker locker( &mMutex );
+        for ( Slot& slot : mSlots )
+        {
+            slot.ticket = 0; // whatever is still running is thrown away
+        }
+        mCount = 0;
+    }
+    mPool.clear();
+    mPool.waitForDone();
+
+    mSlots.clear();
+    mObject = nullptr;
+}
+
+bool FramePrefetcher::takeFrame( int frame, QImage& image )
+{
+    QMutexLocker locker( &mMutex );
+    if ( !isRunning() || frame == mShownFrame )
+    {
+        return false;
+    }
+    mShownFrame = frame;
+
+    int offset = -1;
+    for ( int i = 0; i < mCount; i++ )
+    {
+        if ( mSlots[ ( mHead + i ) % mSlots.size() ].frame == frame )
+        {
+            offset = i;
+            break;
+        }
+    }
+
+    if ( offset < 0 )
+    {
+        // the playhead went somewhere else
+        mDroppedFrames++;
+        restartAt( frameAfter( frame ) );
+        return false;
+    }
+
+    // skipped frames are simply let go
+    for ( int i = 0; i < offset; i++ )
+    {
+        mSlots[ mHead ].ticket = 0;
+        mSlots[ mHead ].image = QImage();
+        mHead = ( mHead + 1 ) % mSlots.size();
+    }
+    mCount -= offset;
+
+    Slot& slot = mSlots[ mHead ];
+    bool ready = slot.ready;
+    if ( ready )
+    {
+        image = slot.image;
+    }
+    else
+    {
+        mDroppedFrames++;
+    }
+    slot.ticket = 0;
+    slot.image = QImage();
+    mHead = ( mHead + 1 ) % mSlots.size();
+    mCount--;
+
+    fill();
+    return ready;
+}
+
+int FramePrefetcher::framesReady() const
+{
+    QMutexLocker locker( &mMutex );
+    int ready = 0;
+    while ( ready < mCount && mSlots[ ( mHead + ready ) % mSlots.size() ].ready )
+    {
+        ready++;
+    }
+    return ready;
+}
+
+int FramePrefetcher::frameAfter( int frame ) const
+{
+    if ( frame < mStartFrame )
+    {
+        return mStartFrame;
+    }
+    if ( frame >= mEndFrame )
+    {
+        return mLooping ? mStartFrame : -1;
+    }
+    return frame + 1;
+}
+
+// Called with the mutex held
+void FramePrefetcher::restartAt( int frame )
+{
+    for ( Slot& slot : mSlots )
+    {
+        slot.ticket = 0;
+        slot.image = QImage();
+    }
+    mHead = 0;
+    mCount = 0;
+    mLastFrame = -1;
+    if ( frame >= 0 )
+    {
+        submit( mSlots[ 0 ], frame );
+        mCount = 1;
+        fill();
+    }
+}
+
+// Called with the mutex held
+void FramePrefetcher::fill()
+{
+    while ( mCount > 0 && mCount < static_cast< int >( mSlots.size() ) )
+    {
+        int frame = frameAfter( mLastFrame );
+        if ( frame < 0 || frame == mSlots[ mHead ].frame )
+        {
+            break; // the end, or a short loop which is all in already
+        }
+        submit( mSlots[ ( mHead + mCount ) % mSlots.size() ], frame );
+        mCount++;
+    }
+}
+
+// Called with the mutex held
+void FramePrefetcher::submit( Slot& slot, int frame )
+{
+    const quint64 ticket = ++mNextTicket;
+    slot.frame = frame;
+    slot.ticket = ticket;
+    slot.ready = false;
+    slot.image = QImage();
+    mLastFrame = frame;
+
+    Slot* target = &slot;
+    mPool.start( new FunctionTask( [ this, target, ticket, frame ]
+    {
+        {
+            QMutexLocker locker( &mMutex );
+            if ( target->ticket != ticket )
+            {
+                return; // let go before it was started
+            }
+        }
+        QImage image;
+        {
+            // only while painting, in between the keys may be unloaded to stay within the budget
+            BitmapImage::UnloadBlocker keepLoaded;
+            image = render( frame );
+        }
+
+        QMutexLocker locker( &mMutex );
+        if ( target->ticket == ticket )
+        {
+            target->image = image;
+            target->ready = true;
+        }
+    } ) );
+}
+
+QImage FramePrefetcher::render( int frame ) const
+{
+    QImage image( mSize, QImage::Format_ARGB32_Premultiplied );
+    image.fill( Qt::transparent );
+
+    QPainter painter( &image );
+    painter.setWorldTransform( mView );
+    mObject->paintImage( painter, frame, false, mAntialias );
+    painter.end();
+    return image;
+}
@@ -0,0 +1,95 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef FRAMEPREFETCHER_H
+#define FRAMEPREFETCHER_H
+
+#include <vector>
+#include <QImage>
+#include <QMutex>
+#include <QThreadPool>
+#include <QTransform>
+#include "bitmapimage.h"
+
+class Object;
+
+
+/*
+ * Renders the frames following the playhead on a thread pool into a ring of
+ * images, so that playback only has to show them. The frames are painted by
+ * Object::paintImage at the size and transform of the view.
+ *
+ * The object must not be edited while the prefetcher runs: stop() waits for
+ * the frames being painted. The editor does this through Editor::stopPrefetch()
+ * before an undo step, a key or layer change or an import, and the canvas on a
+ * mouse press; the next redraw of a playing canvas starts it again.
+ */
+class FramePrefetcher
+{
+public:
+    FramePrefetcher();
+    ~FramePrefetcher();
+
+    void start( const Object* object, int currentFrame, int startFrame, int endFrame, bool looping,
+                QTransform view, QSize size, bool antialias, int threads = 0 );
+    void stop();
+    bool isRunning() const { return mObject != nullptr; }
+
+    // Gives the frame if it's rendered and lets go of the ones before it. A frame
+    // which isn't ready counts as dropped, a playhead off the predicted frames
+    // makes the prefetch start over from there.
+    bool takeFrame( int frame, QImage& image );
+
+    int framesReady() const; // rendered frames waiting ahead of the playhead
+    int droppedFrames() const { return mDroppedFrames; }
+    int capacity() const { return static_cast< int >( mSlots.size() ); }
+
+private:
+    struct Slot
+    {
+        int frame = -1;
+        quint64 ticket = 0; // a task only delivers to a slot still holding its ticket
+        bool ready = false;
+        QImage image;
+    };
+
+    int frameAfter( int frame ) const;
+    void restartAt( int frame );
+    void fill();
+    void submit( Slot& slot, int frame );
+    QImage render( int frame ) const;
+
+    const Object* mObject = nullptr;
+    int mStartFrame = 1;
+    int mEndFrame = 1;
+    bool mLooping = false;
+    QTransform mView;
+    QSize mSize;
+    bool mAntialias = false;
+
+    mutable QMutex mMutex; // guards the slots, tasks deliver to them from the pool
+    std::vector< Slot > mSlots;
+    int mHead = 0;  // slot of the next frame to show
+    int mCount = 0; // slots in use from the head on
+    int mLastFrame = -1; // last frame submitted
+    int mShownFrame = -1;
+    quint64 mNextTicket = 0;
+    int mDroppedFrames = 0;
+
+    QThreadPool mPool;
+};
+
+#endif // FRAMEPREFETCHER_H
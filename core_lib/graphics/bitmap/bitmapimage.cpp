@@ -15,81 +15,738 @@ GNU General Public License for more details.
 
 */
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <QImageReader>
+#include <QMutex>
 #include "bitmapimage.h"
+#include "pixelkernels.h"
+#include "floodfill.h"
 #include "util.h"
 
+const int BitmapImage::TILE_SIZE = 64;
+
+namespace
+{
+    inline int floorDiv( int a, int b )
+    {
+        return ( a >= 0 ) ? a / b : -( ( -a + b - 1 ) / b );
+    }
+
+    // x * a / 255 on all four channels of a premultiplied pixel
+    inline QRgb byteMul( QRgb x, uint a )
+    {
+        uint t = ( x & 0xFF00FF ) * a;
+        t = ( ( t + ( ( t >> 8 ) & 0xFF00FF ) + 0x800080 ) >> 8 ) & 0xFF00FF;
+        x = ( ( x >> 8 ) & 0xFF00FF ) * a;
+        x = ( x + ( ( x >> 8 ) & 0xFF00FF ) + 0x800080 ) & 0xFF00FF00;
+        return x | t;
+    }
+
+    // SourceOver of a single premultiplied colour onto a row
+    void blendSpan( QRgb* dst, QRgb colour, int count )
+    {
+        const uint inverseAlpha = 255 - qAlpha( colour );
+        if ( inverseAlpha == 0 )
+        {
+            std::fill( dst, dst + count, colour );
+            return;
+        }
+        for ( int x = 0; x < count; x++ )
+        {
+            dst[ x ] = colour + byteMul( dst[ x ], inverseAlpha );
+        }
+    }
+
+    // Modes which leave a transparent destination pixel transparent,
+    // so there is no point in allocating tiles for them.
+    bool isDestinationOnly( QPainter::CompositionMode cm )
+    {
+        switch ( cm )
+        {
+            case QPainter::CompositionMode_Clear:
+            case QPainter::CompositionMode_SourceIn:
+            case QPainter::CompositionMode_SourceAtop:
+            case QPainter::CompositionMode_DestinationIn:
+            case QPainter::CompositionMode_DestinationOut:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Modes for which a fully transparent source pixel leaves the destination untouched,
+    // so the missing tiles of a source image can simply be skipped.
+    bool isTransparentSourceNoOp( QPainter::CompositionMode cm )
+    {
+        switch ( cm )
+        {
+            case QPainter::CompositionMode_SourceOver:
+            case QPainter::CompositionMode_DestinationOver:
+            case QPainter::CompositionMode_SourceAtop:
+            case QPainter::CompositionMode_DestinationOut:
+            case QPainter::CompositionMode_Xor:
+            case QPainter::CompositionMode_Plus:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+namespace
+{
+    // Images whose pixels have a copy on disk, the ones trimLoadedImages() may unload
+    QMutex gFileImagesMutex;
+    QSet< BitmapImage* > gFileImages;
+    qint64 gLoadedMemoryLimit = qint64( 512 ) * 1024 * 1024;
+    int    gUnloadBlockers = 0;
+    std::atomic< quint64 > gUseClock{ 0 };
+}
+
 BitmapImage::BitmapImage()
 {
-    mImage = std::make_shared< QImage >(); // null image
     mBounds = QRect( 0, 0, 0, 0 );
 }
 
 BitmapImage::BitmapImage( const BitmapImage& a )
 {
+    // decoding doesn't change what the source holds
+    const_cast< BitmapImage& >( a ).loadFile();
     mBounds = a.mBounds;
-    mImage = std::make_shared< QImage >( *a.mImage );
+    mOrigin = a.mOrigin;
+    mTiles = a.mTiles; // tiles are implicitly shared, they detach on write
+    if ( a.mImage )
+    {
+        mImage = std::make_shared< QImage >( *a.mImage );
+    }
 }
 
 BitmapImage::BitmapImage( const QRect& rectangle, const QColor& colour)
 {
     mBounds = rectangle;
-    mImage = std::make_shared< QImage >( mBounds.size(), QImage::Format_ARGB32_Premultiplied);
-    mImage->fill(colour.rgba());
+    mOrigin = rectangle.topLeft();
+    if ( colour.alpha() != 0 )
+    {
+        forEachTile( mBounds, true, [&]( QImage& tile, const QRect& tileRect )
+        {
+            QPainter painter( &tile );
+            painter.setCompositionMode( QPainter::CompositionMode_Source );
+            painter.fillRect( mBounds.intersected( tileRect ).translated( -tileRect.topLeft() ), colour );
+        } );
+    }
 }
 
 BitmapImage::BitmapImage( const QRect& rectangle, const QImage& image )
 {
     mBounds = rectangle.normalized();
     mExtendable = true;
-    mImage = std::make_shared< QImage >(image);
-    if ( mImage->width() != rectangle.width() || mImage->height() != rectangle.height())
+    if ( image.width() != rectangle.width() || image.height() != rectangle.height())
     {
         qDebug() << "Error instancing bitmapImage.";
     }
+    setTilesFromImage( image, mBounds.topLeft() );
 }
 
 BitmapImage::BitmapImage( const QString& path, const QPoint& topLeft )
 {
-    mImage = std::make_shared< QImage >(path);
-    if ( mImage->isNull() )
+    // only the header is read here
+    QSize size = QImageReader( path ).size();
+    mBounds = QRect( topLeft, size.isValid() ? size : QSize( 0, 0 ) );
+    mOrigin = topLeft;
+    mFileToLoad = path;
+    mIsLoaded = false;
+    if ( !size.isValid() )
     {
-        qDebug() << "ERROR: Image " << path << " not loaded";
+        decodeFile();
     }
-    mBounds = QRect( topLeft, mImage->size() );
 }
 
 BitmapImage::~BitmapImage()
 {
+    if ( mIsRegistered )
+    {
+        QMutexLocker locker( &gFileImagesMutex );
+        gFileImages.remove( this );
+    }
+}
+
+void BitmapImage::decodeFile()
+{
+    // Decoding is the slow part and happens unlocked, if two threads get here
+    // at the same time only the first result is kept.
+    QImage image( mFileToLoad );
+    if ( image.isNull() )
+    {
+        qDebug() << "ERROR: Image " << mFileToLoad << " not loaded";
+    }
+
+    QMutexLocker locker( &gFileImagesMutex );
+    if ( isLoaded() )
+    {
+        return;
+    }
+    mBounds = QRect( mBounds.topLeft(), image.size() );
+    setTilesFromImage( image, mBounds.topLeft() );
+    registerFileImage();
+    mLastUse = ++gUseClock;
+    mIsLoaded.store( true, std::memory_order_release );
+}
+
+void BitmapImage::registerFileImage()
+{
+    // gFileImagesMutex is held by the caller
+    if ( !mIsRegistered )
+    {
+        gFileImages.insert( this );
+        mIsRegistered = true;
+    }
+}
+
+qint64 BitmapImage::decodedBytes() const
+{
+    qint64 bytes = qint64( mTiles.size() ) * TILE_SIZE * TILE_SIZE * 4;
+    if ( mImage )
+    {
+        bytes += mImage->byteCount();
+    }
+    return bytes;
+}
+
+bool BitmapImage::unloadFile()
+{
+    QMutexLocker locker( &gFileImagesMutex );
+    if ( !isLoaded() || gUnloadBlockers > 0 || mImage || isModified() || fileName().isEmpty() )
+    {
+        return false;
+    }
+    if ( !QFile::exists( fileName() ) )
+    {
+        return false;
+    }
+    mFileToLoad = fileName();
+    mIsLoaded.store( false, std::memory_order_release );
+    decltype( mTiles )().swap( mTiles );
+    return true;
+}
+
+void BitmapImage::setFileStored()
+{
+    setModified( false );
+    QMutexLocker locker( &gFileImagesMutex );
+    registerFileImage();
+}
+
+void BitmapImage::setLoadedMemoryLimit( qint64 bytes )
+{
+    {
+        QMutexLocker locker( &gFileImagesMutex );
+        gLoadedMemoryLimit = bytes;
+    }
+    trimLoadedImages();
+}
+
+qint64 BitmapImage::loadedMemoryUsage()
+{
+    QMutexLocker locker( &gFileImagesMutex );
+    qint64 usage = 0;
+    for ( BitmapImage* image : gFileImages )
+    {
+        usage += image->isLoaded() ? image->decodedBytes() : 0;
+    }
+    return usage;
+}
+
+void BitmapImage::trimLoadedImages()
+{
+    std::vector< BitmapImage* > loaded;
+    qint64 usage = 0;
+    qint64 limit = 0;
+    {
+        QMutexLocker locker( &gFileImagesMutex );
+        if ( gUnloadBlockers > 0 )
+        {
+            return;
+        }
+        for ( BitmapImage* image : gFileImages )
+        {
+            if ( image->isLoaded() )
+            {
+                usage += image->decodedBytes();
+                loaded.push_back( image );
+            }
+        }
+        limit = gLoadedMemoryLimit;
+    }
+    if ( usage <= limit )
+    {
+        return;
+    }
+
+    std::sort( loaded.begin(), loaded.end(), []( BitmapImage* a, BitmapImage* b )
+    {
+        return a->mLastUse < b->mLastUse;
+    } );
+    for ( BitmapImage* image : loaded )
+    {
+        if ( usage <= limit )
+        {
+            break;
+        }
+        qint64 bytes = image->decodedBytes();
+        if ( image->unloadFile() )
+        {
+            usage -= bytes;
+        }
+    }
+}
+
+BitmapImage::UnloadBlocker::UnloadBlocker()
+{
+    QMutexLocker locker( &gFileImagesMutex );
+    ++gUnloadBlockers;
+}
+
+BitmapImage::UnloadBlocker::~UnloadBlocker()
+{
+    QMutexLocker locker( &gFileImagesMutex );
+    --gUnloadBlockers;
+}
+
+QImage* BitmapImage::image()
+{
+    // The caller may draw into the returned image, so from now on it is the
+    // authoritative copy until the next tiled operation splits it up again.
+    loadFile();
+    if ( !mImage )
+    {
+        mImage = std::make_shared< QImage >( flatten( mBounds ) );
+        mTiles.clear();
+    }
+    modification();
+    return mImage.get();
+}
+
+QImage BitmapImage::toImage() const
+{
+    // decoding and tiling don't change the pixels
+    BitmapImage* self = const_cast< BitmapImage* >( this );
+    self->loadFile();
+    if ( mImage )
+    {
+        return *mImage;
+    }
+    return self->flatten( mBounds );
 }
 
 void BitmapImage::setImage( QImage* img )
 {
     Q_CHECK_PTR( img );
     mImage.reset( img );
+    mTiles.clear();
+    mIsLoaded = true;
+    mBounds = QRect( mBounds.topLeft(), img->size() );
+    modification();
 }
 
 BitmapImage& BitmapImage::operator=(const BitmapImage& a)
 {
+    const_cast< BitmapImage& >( a ).loadFile();
+    mIsLoaded = true;
     mBounds = a.mBounds;
-    mImage = std::make_shared< QImage >( *a.mImage );
+    mOrigin = a.mOrigin;
+    mTiles = a.mTiles;
+    mImage.reset();
+    if ( a.mImage )
+    {
+        mImage = std::make_shared< QImage >( *a.mImage );
+    }
+    modification();
     return *this;
 }
 
+BitmapImage::TileKey BitmapImage::tileKeyAt( QPoint P ) const
+{
+    int tx = floorDiv( P.x() - mOrigin.x(), TILE_SIZE );
+    int ty = floorDiv( P.y() - mOrigin.y(), TILE_SIZE );
+    return ( static_cast< TileKey >( static_cast< quint32 >( tx ) ) << 32 ) | static_cast< quint32 >( ty );
+}
+
+QRect BitmapImage::tileRect( TileKey key ) const
+{
+    int tx = static_cast< qint32 >( static_cast< quint32 >( key >> 32 ) );
+    int ty = static_cast< qint32 >( static_cast< quint32 >( key & 0xFFFFFFFF ) );
+    return QRect( mOrigin.x() + tx * TILE_SIZE, mOrigin.y() + ty * TILE_SIZE, TILE_SIZE, TILE_SIZE );
+}
+
+QImage* BitmapImage::tile( TileKey key, bool create )
+{
+    auto it = mTiles.find( key );
+    if ( it != mTiles.end() )
+    {
+        return &it->second;
+    }
+    if ( !create )
+    {
+        return nullptr;
+    }
+    QImage newTile( TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied );
+    newTile.fill( Qt::transparent );
+    return &( mTiles[ key ] = newTile );
+}
+
+void BitmapImage::forEachTile( QRect rectangle, bool create, TileAction action )
+{
+    loadFile();
+    rectangle = rectangle.normalized();
+    if ( rectangle.isEmpty() )
+    {
+        return;
+    }
+    QRect first = tileRect( tileKeyAt( rectangle.topLeft() ) );
+    for ( int y = first.top(); y <= rectangle.bottom(); y += TILE_SIZE )
+    {
+        for ( int x = first.left(); x <= rectangle.right(); x += TILE_SIZE )
+        {
+            TileKey key = tileKeyAt( QPoint( x, y ) );
+            QImage* t = tile( key, create );
+            if ( t != nullptr )
+            {
+                action( *t, tileRect( key ) );
+            }
+        }
+    }
+}
+
+void BitmapImage::paintOnTiles( QRect rectangle, QPainter::CompositionMode cm, std::function< void( QPainter& ) > paint )
+{
+    QRect area = rectangle.normalized().intersected( mBounds );
+    forEachTile( area, !isDestinationOnly( cm ), [&]( QImage& tile, const QRect& tileRect )
+    {
+        QPainter painter( &tile );
+        painter.translate( -tileRect.topLeft() );
+        painter.setClipRect( area );
+        painter.setCompositionMode( cm );
+        paint( painter );
+        painter.end();
+    } );
+    modification();
+}
+
+void BitmapImage::compositeRows( BitmapImage* source, std::function< void( QRgb*, const QRgb*, int ) > rowOp )
+{
+    source->ensureTiled();
+    for ( auto& srcTile : source->mTiles )
+    {
+        const QRect srcTileRect = source->tileRect( srcTile.first );
+        const QRect srcArea = srcTileRect.intersected( source->mBounds );
+        const QImage& srcImage = srcTile.second;
+
+        forEachTile( srcArea, true, [&]( QImage& tile, const QRect& tileRect )
+        {
+            QRect overlap = srcArea.intersected( tileRect );
+            for ( int y = overlap.top(); y <= overlap.bottom(); y++ )
+            {
+                QRgb* dst = reinterpret_cast< QRgb* >( tile.scanLine( y - tileRect.top() ) ) + ( overlap.left() - tileRect.left() );
+                const QRgb* src = reinterpret_cast< const QRgb* >( srcImage.constScanLine( y - srcTileRect.top() ) ) + ( overlap.left() - srcTileRect.left() );
+                rowOp( dst, src, overlap.width() );
+            }
+        } );
+    }
+    modification();
+}
+
+void BitmapImage::ensureTiled()
+{
+    loadFile();
+    if ( mImage )
+    {
+        QImage dense = *mImage;
+        mImage.reset();
+        setTilesFromImage( dense, mBounds.topLeft() );
+    }
+}
+
+void BitmapImage::setTilesFromImage( const QImage& image, QPoint topLeft )
+{
+    mTiles.clear();
+    mOrigin = topLeft;
+    if ( image.isNull() )
+    {
+        return;
+    }
+
+    const QImage source = image.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+    for ( int ty = 0; ty < source.height(); ty += TILE_SIZE )
+    {
+        for ( int tx = 0; tx < source.width(); tx += TILE_SIZE )
+        {
+            const int w = qMin( TILE_SIZE, source.width() - tx );
+            const int h = qMin( TILE_SIZE, source.height() - ty );
+
+            // skip blocks without a single visible pixel, premultiplied transparent is 0
+            bool isEmpty = true;
+            for ( int y = 0; y < h && isEmpty; y++ )
+            {
+                const QRgb* row = reinterpret_cast< const QRgb* >( source.constScanLine( ty + y ) ) + tx;
+                for ( int x = 0; x < w; x++ )
+                {
+                    if ( row[ x ] != 0 )
+                    {
+                        isEmpty = false;
+                        break;
+                    }
+                }
+            }
+            if ( isEmpty )
+            {
+                continue;
+            }
+
+            QImage* t = tile( tileKeyAt( topLeft + QPoint( tx, ty ) ), true );
+            for ( int y = 0; y < h; y++ )
+            {
+                memcpy( t->scanLine( y ), source.constScanLine( ty + y ) + tx * sizeof( QRgb ), w * sizeof( QRgb ) );
+            }
+        }
+    }
+}
+
+QImage BitmapImage::flatten( QRect rectangle )
+{
+    ensureTiled();
+    if ( rectangle.isEmpty() )
+    {
+        return QImage(); // null image
+    }
+    QImage result( rectangle.size(), QImage::Format_ARGB32_Premultiplied );
+    result.fill( Qt::transparent );
+
+    QPainter painter( &result );
+    painter.setCompositionMode( QPainter::CompositionMode_Source );
+    painter.translate( -rectangle.topLeft() );
+    forEachTile( rectangle, false, [&]( QImage& tile, const QRect& tileRect )
+    {
+        QRect overlap = tileRect.intersected( rectangle );
+        painter.drawImage( overlap.topLeft(), tile, overlap.translated( -tileRect.topLeft() ) );
+    } );
+    painter.end();
+    return result;
+}
+
 void BitmapImage::paintImage(QPainter& painter)
 {
-    painter.drawImage(topLeft(), *mImage);
+    paintImage( painter, QRect() );
+}
+
+void BitmapImage::paintImage(QPainter& painter, const QRect& rect)
+{
+    ensureTiled();
+    mLastUse.store( ++gUseClock, std::memory_order_relaxed );
+
+    // Antialiased edges would leave hairline seams between neighbouring tiles
+    // when the view is scaled, tiles are aligned on pixels anyway.
+    bool antialiasing = painter.testRenderHint( QPainter::Antialiasing );
+    painter.setRenderHint( QPainter::Antialiasing, false );
+    for ( auto& t : mTiles )
+    {
+        QRect r = tileRect( t.first );
+        if ( rect.isNull() || r.intersects( rect ) )
+        {
+            painter.drawImage( r.topLeft(), t.second );
+        }
+    }
+    painter.setRenderHint( QPainter::Antialiasing, antialiasing );
+}
+
+void BitmapImage::setBounds( QRect rectangle )
+{
+    ensureTiled();
+    mBounds = rectangle.normalized();
+
+    // pixels left outside would still take memory and show up in differenceRect()
+    for ( auto it = mTiles.begin(); it != mTiles.end(); )
+    {
+        const QRect r = tileRect( it->first );
+        if ( !r.intersects( mBounds ) )
+        {
+            it = mTiles.erase( it );
+            continue;
+        }
+        if ( !mBounds.contains( r ) )
+        {
+            QPainter painter( &it->second );
+            painter.setCompositionMode( QPainter::CompositionMode_Clear );
+            for ( const QRect& outside : QRegion( r ).subtracted( QRegion( mBounds ) ).rects() )
+            {
+                painter.fillRect( outside.translated( -r.topLeft() ), QColor( 0, 0, 0, 0 ) );
+            }
+            painter.end();
+        }
+        ++it;
+    }
+    modification();
+}
+
+QRect BitmapImage::differenceRect( BitmapImage& other )
+{
+    ensureTiled();
+    other.ensureTiled();
+    if ( mOrigin != other.mOrigin )
+    {
+        // tile grids don't line up, nothing can be assumed shared
+        return mBounds.united( other.mBounds );
+    }
+
+    int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+    auto compareTiles = [&]( TileKey key, const QImage* a, const QImage* b )
+    {
+        if ( a != nullptr && b != nullptr && a->constBits() == b->constBits() )
+        {
+            return;
+        }
+        const QRect rect = tileRect( key );
+        for ( int y = 0; y < TILE_SIZE; y++ )
+        {
+            const QRgb* rowA = a ? reinterpret_cast< const QRgb* >( a->constScanLine( y ) ) : nullptr;
+            const QRgb* rowB = b ? reinterpret_cast< const QRgb* >( b->constScanLine( y ) ) : nullptr;
+            for ( int x = 0; x < TILE_SIZE; x++ )
+            {
+                QRgb pixelA = rowA ? rowA[ x ] : 0;
+                QRgb pixelB = rowB ? rowB[ x ] : 0;
+                if ( pixelA != pixelB )
+                {
+                    left = qMin( left, rect.left() + x );
+                    right = qMax( right, rect.left() + x );
+                    top = qMin( top, rect.top() + y );
+                    bottom = qMax( bottom, rect.top() + y );
+                }
+            }
+        }
+    };
+
+    for ( auto& t : mTiles )
+    {
+        auto it = other.mTiles.find( t.first );
+        compareTiles( t.first, &t.second, ( it != other.mTiles.end() ) ? &it->second : nullptr );
+    }
+    for ( auto& t : other.mTiles )
+    {
+        if ( mTiles.find( t.first ) == mTiles.end() )
+        {
+            compareTiles( t.first, nullptr, &t.second );
+        }
+    }
+
+    if ( left > right )
+    {
+        return QRect();
+    }
+    return QRect( QPoint( left, top ), QPoint( right, bottom ) );
+}
+
+void BitmapImage::writePixels( QPoint topLeft, const QImage& pixels )
+{
+    ensureTiled();
+    if ( pixels.isNull() )
+    {
+        return;
+    }
+    const QImage source = pixels.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+    const QRect area( topLeft, source.size() );
+    extend( area );
+
+    auto rowAt = [&]( int x, int y )
+    {
+        return reinterpret_cast< const QRgb* >( source.constScanLine( y - area.top() ) ) + ( x - area.left() );
+    };
+
+    QRect first = tileRect( tileKeyAt( area.topLeft() ) );
+    for ( int ty = first.top(); ty <= area.bottom(); ty += TILE_SIZE )
+    {
+        for ( int tx = first.left(); tx <= area.right(); tx += TILE_SIZE )
+        {
+            TileKey key = tileKeyAt( QPoint( tx, ty ) );
+            QRect overlap = area.intersected( tileRect( key ) );
+
+            QImage* t = tile( key, false );
+            if ( t == nullptr )
+            {
+                // don't allocate a tile just to write transparent pixels into it
+                bool isEmpty = true;
+                for ( int y = overlap.top(); y <= overlap.bottom() && isEmpty; y++ )
+                {
+                    const QRgb* row = rowAt( overlap.left(), y );
+                    isEmpty = std::all_of( row, row + overlap.width(), []( QRgb p ) { return p == 0; } );
+                }
+                if ( isEmpty )
+                {
+                    continue;
+                }
+                t = tile( key, true );
+            }
+            for ( int y = overlap.top(); y <= overlap.bottom(); y++ )
+            {
+                memcpy( reinterpret_cast< QRgb* >( t->scanLine( y - ty ) ) + ( overlap.left() - tx ),
+                        rowAt( overlap.left(), y ),
+                        overlap.width() * sizeof( QRgb ) );
+            }
+        }
+    }
+    modification();
+}
+
+void BitmapImage::blendMask( QPoint topLeft, const QImage& mask, QRgb colour )
+{
+    ensureTiled();
+    Q_ASSERT( mask.format() == QImage::Format_Alpha8 );
+    if ( mask.isNull() || qAlpha( colour ) == 0 )
+    {
+        return;
+    }
+    const QRect area( topLeft, mask.size() );
+    extend( area );
+    forEachTile( area, true, [&]( QImage& tile, const QRect& tileRect )
+    {
+        QRect overlap = area.intersected( tileRect );
+        for ( int y = overlap.top(); y <= overlap.bottom(); y++ )
+        {
+            QRgb* dst = reinterpret_cast< QRgb* >( tile.scanLine( y - tileRect.top() ) ) + ( overlap.left() - tileRect.left() );
+            const uchar* coverage = mask.constScanLine( y - area.top() ) + ( overlap.left() - area.left() );
+            PixelKernels::blendMaskRow( dst, coverage, colour, overlap.width() );
+        }
+    } );
+    modification();
 }
 
 BitmapImage BitmapImage::copy()
 {
-    return BitmapImage(mBounds, QImage(*mImage));
+    return BitmapImage( *this );
 }
 
 BitmapImage BitmapImage::copy(QRect rectangle)
 {
-    //QRect intersection = boundaries.intersected( rectangle );
-    QRect intersection2  = rectangle.translated( -topLeft() );
-    BitmapImage result = BitmapImage(rectangle, mImage->copy(intersection2));
+    ensureTiled();
+
+    BitmapImage result;
+    result.mBounds = rectangle;
+    result.mOrigin = mOrigin;
+    forEachTile( rectangle, false, [&]( QImage& tile, const QRect& tileRect )
+    {
+        TileKey key = tileKeyAt( tileRect.topLeft() );
+        if ( rectangle.contains( tileRect ) )
+        {
+            result.mTiles[ key ] = tile; // shared until either side writes to it
+            return;
+        }
+        QRect keep = rectangle.intersected( tileRect ).translated( -tileRect.topLeft() );
+        QImage* part = result.tile( key, true );
+        QPainter painter( part );
+        painter.setCompositionMode( QPainter::CompositionMode_Source );
+        painter.drawImage( keep.topLeft(), tile, keep );
+        painter.end();
+    } );
     return result;
 }
 
@@ -100,8 +757,11 @@ void BitmapImage::paste(BitmapImage* bitmapImage)
 
 void BitmapImage::paste(BitmapImage* bitmapImage, QPainter::CompositionMode cm)
 {
+    ensureTiled();
+    bitmapImage->ensureTiled();
+
     QRect newBoundaries;
-    if ( mImage->width() == 0 || mImage->height() == 0 )
+    if ( mBounds.width() == 0 || mBounds.height() == 0 )
     {
         newBoundaries = bitmapImage->mBounds;
     }
@@ -111,20 +771,35 @@ void BitmapImage::paste(BitmapImage* bitmapImage, QPainter::CompositionMode cm)
     }
     extend( newBoundaries );
 
-    QImage* image2 = bitmapImage->image();
-
-    QPainter painter( mImage.get() );
-    painter.setCompositionMode(cm);
-    painter.drawImage( bitmapImage->mBounds.topLeft() - mBounds.topLeft(), *image2);
-    painter.end();
+    if ( isTransparentSourceNoOp( cm ) )
+    {
+        for ( auto& srcTile : bitmapImage->mTiles )
+        {
+            const QRect srcTileRect = bitmapImage->tileRect( srcTile.first );
+            const QImage& srcImage = srcTile.second;
+            paintOnTiles( srcTileRect.intersected( bitmapImage->mBounds ), cm, [&]( QPainter& painter )
+            {
+                painter.drawImage( srcTileRect.topLeft(), srcImage );
+            } );
+        }
+    }
+    else
+    {
+        const QRect srcRect = bitmapImage->mBounds;
+        const QImage srcImage = bitmapImage->flatten( srcRect );
+        paintOnTiles( srcRect, cm, [&]( QPainter& painter )
+        {
+            painter.drawImage( srcRect.topLeft(), srcImage );
+        } );
+    }
 }
 
 void BitmapImage::add(BitmapImage* bitmapImage)
 {
-    QImage* image2 = bitmapImage->image();
+    ensureTiled();
 
     QRect newBoundaries;
-    if ( mImage->width() == 0 || mImage->height() == 0 )
+    if ( mBounds.width() == 0 || mBounds.height() == 0 )
     {
         newBoundaries = bitmapImage->mBounds;
     }
@@ -133,44 +808,16 @@ void BitmapImage::add(BitmapImage* bitmapImage)
         newBoundaries = mBounds.united( bitmapImage->mBounds );
     }
     extend( newBoundaries );
-    QPoint offset = bitmapImage->mBounds.topLeft() - mBounds.topLeft();
-    for (int y = 0; y < image2->height(); y++)
-    {
-        for (int x = 0; x < image2->width(); x++)
-        {
-            QRgb p1  = mImage->pixel(offset.x()+x,offset.y()+y);
-            QRgb p2 = image2->pixel(x,y);
-
-            int a1 = qAlpha(p1);
-            int a2 = qAlpha(p2);
-            int r1 = qRed(p1);
-            int r2 = qRed(p2); // remember that the bitmap format is RGB32 Premultiplied
-            int g1 = qGreen(p1);
-            int g2 = qGreen(p2);
-            int b1 = qBlue(p1);
-            int b2 = qBlue(p2);
-
-            // unite
-            int a = qMax(a1, a2);
-            int r = qMax(r1, r2);
-            int g = qMax(g1, g2);
-            int b = qMax(b1, b2);
-
-            QRgb mix = qRgba(r, g, b, a);
-            if (a2 != 0)
-            {
-                mImage->setPixel(offset.x()+x,offset.y()+y, mix);
-            }
-        }
-    }
+
+    compositeRows( bitmapImage, PixelKernels::uniteRow );
 }
 
 void BitmapImage::compareAlpha(BitmapImage* bitmapImage) // this function picks the greater alpha value
 {
-    QImage* image2 = bitmapImage->image();
+    ensureTiled();
 
     QRect newBoundaries;
-    if ( mImage->width() == 0 || mImage->height() == 0 )
+    if ( mBounds.width() == 0 || mBounds.height() == 0 )
     {
         newBoundaries = bitmapImage->mBounds;
     }
@@ -179,61 +826,51 @@ void BitmapImage::compareAlpha(BitmapImage* bitmapImage) // this function picks
         newBoundaries = mBounds.united( bitmapImage->mBounds );
     }
     extend( newBoundaries );
-    QPoint offset = bitmapImage->mBounds.topLeft() - mBounds.topLeft();
-    for (int y = 0; y < image2->height(); y++)
-    {
-        for (int x = 0; x < image2->width(); x++)
-        {
-            QRgb p1  = mImage->pixel(offset.x()+x,offset.y()+y);
-            QRgb p2 = image2->pixel(x,y);
-
-            int a1 = qAlpha(p1);
-            int a2 = qAlpha(p2);
 
-            if (a1 <= a2)
-            {
-            QRgb mix = qRgba(qRed(p2), qGreen(p2), qBlue(p2), a2);
-            mImage->setPixel(offset.x()+x,offset.y()+y, mix);
-            }
-        }
-    }
+    compositeRows( bitmapImage, PixelKernels::compareAlphaRow );
 }
 
 void BitmapImage::moveTopLeft(QPoint point)
 {
+    // tiles are placed relative to mOrigin, so moving them is free
+    loadFile();
+    mOrigin += point - mBounds.topLeft();
     mBounds.moveTopLeft(point);
+    modification();
 }
 
 void BitmapImage::transform(QRect newBoundaries, bool smoothTransform)
 {
+    QImage oldImage = flatten( mBounds );
+
     mBounds = newBoundaries;
     newBoundaries.moveTopLeft( QPoint(0,0) );
-    QImage* newImage = new QImage( mBounds.size(), QImage::Format_ARGB32_Premultiplied);
-    //newImage->fill(QColor(255,255,255).rgb());
-    QPainter painter(newImage);
+    QImage newImage( mBounds.size(), QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&newImage);
     painter.setRenderHint(QPainter::SmoothPixmapTransform, smoothTransform);
     painter.setCompositionMode(QPainter::CompositionMode_Source);
-    painter.fillRect( newImage->rect(), QColor(0,0,0,0) );
+    painter.fillRect( newImage.rect(), QColor(0,0,0,0) );
     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    painter.drawImage(newBoundaries, *mImage );
+    painter.drawImage(newBoundaries, oldImage );
     painter.end();
-    mImage.reset( newImage );
+    setTilesFromImage( newImage, mBounds.topLeft() );
+    modification();
 }
 
 BitmapImage BitmapImage::transformed(QRect selection, QTransform transform, bool smoothTransform)
 {
-    BitmapImage selectedPart = copy(selection);
+    QImage selectedPart = flatten( selection );
 
     // Get the transformed image
     //
     QImage transformedImage;
     if (smoothTransform)
     {
-        transformedImage = selectedPart.image()->transformed(transform, Qt::SmoothTransformation);
+        transformedImage = selectedPart.transformed(transform, Qt::SmoothTransformation);
     }
     else
     {
-        transformedImage = selectedPart.image()->transformed(transform);
+        transformedImage = selectedPart.transformed(transform);
     }
 
     return BitmapImage(transform.mapRect(selection), transformedImage);
@@ -241,13 +878,15 @@ BitmapImage BitmapImage::transformed(QRect selection, QTransform transform, bool
 
 BitmapImage BitmapImage::transformed(QRect newBoundaries, bool smoothTransform)
 {
-    BitmapImage transformedImage(newBoundaries, QColor(0,0,0,0));
-    QPainter painter(transformedImage.image());
+    QImage oldImage = flatten( mBounds );
+    QImage newImage( newBoundaries.size(), QImage::Format_ARGB32_Premultiplied );
+    newImage.fill( Qt::transparent );
+
+    QPainter painter( &newImage );
     painter.setRenderHint(QPainter::SmoothPixmapTransform, smoothTransform);
-    newBoundaries.moveTopLeft( QPoint(0,0) );
-    painter.drawImage(newBoundaries, *mImage );
+    painter.drawImage( QRect( QPoint( 0, 0 ), newBoundaries.size() ), oldImage );
     painter.end();
-    return transformedImage;
+    return BitmapImage( newBoundaries, newImage );
 }
 
 
@@ -266,6 +905,7 @@ void BitmapImage::extend(QPoint P)
 void BitmapImage::extend(QRect rectangle)
 {
     if (!mExtendable) return;
+    loadFile(); // a file is read back at the top left of the bounds
     if (rectangle.width() <= 0) rectangle.setWidth(1);
     if (rectangle.height() <= 0) rectangle.setHeight(1);
     if (mBounds.contains( rectangle ))
@@ -274,17 +914,9 @@ void BitmapImage::extend(QRect rectangle)
     }
     else
     {
-        QRect newBoundaries = mBounds.united(rectangle).normalized();
-        QImage* newImage = new QImage( newBoundaries.size(), QImage::Format_ARGB32_Premultiplied);
-        newImage->fill(Qt::transparent);
-        if (!newImage->isNull())
-        {
-            QPainter painter(newImage);
-            painter.drawImage(mBounds.topLeft() - newBoundaries.topLeft(), *mImage);
-            painter.end();
-        }
-        mImage.reset( newImage );
-        mBounds = newBoundaries;
+        // No pixel is touched here, tiles get allocated when something is drawn into them.
+        mBounds = mBounds.united(rectangle).normalized();
+        modification();
     }
 }
 
@@ -295,9 +927,7 @@ QRgb BitmapImage::pixel(int x, int y)
 
 QRgb BitmapImage::pixel(QPoint P)
 {
-    QRgb result = qRgba(0,0,0,0); // black
-    if ( mBounds.contains( P ) ) result = mImage->pixel(P - topLeft());
-    return result;
+    return constScanLine( P.x(), P.y() );
 }
 
 void BitmapImage::setPixel(int x, int y, QRgb colour)
@@ -307,93 +937,68 @@ void BitmapImage::setPixel(int x, int y, QRgb colour)
 
 void BitmapImage::setPixel(QPoint P, QRgb colour)
 {
-    extend( P );
-    if ( mBounds.contains(P) )
-        mImage->setPixel(P-topLeft(), colour);
-    //drawLine( QPointF(P), QPointF(P), QPen(QColor(colour)), QPainter::CompositionMode_SourceOver, false);
+    scanLine( P.x(), P.y(), colour );
 }
 
-
 void BitmapImage::drawLine( QPointF P1, QPointF P2, QPen pen, QPainter::CompositionMode cm, bool antialiasing)
 {
+    ensureTiled();
     int width = 2+pen.width();
-    extend( QRect(P1.toPoint(), P2.toPoint()).normalized().adjusted(-width,-width,width,width) );
-    if (mImage != NULL && !mImage->isNull() )
+    QRect area = QRect(P1.toPoint(), P2.toPoint()).normalized().adjusted(-width,-width,width,width);
+    extend( area );
+    paintOnTiles( area, cm, [&]( QPainter& painter )
     {
-        QPainter painter( mImage.get() );
-        painter.setCompositionMode(cm);
         painter.setRenderHint(QPainter::Antialiasing, antialiasing);
         painter.setPen(pen);
-        painter.drawLine( P1-topLeft(), P2-topLeft());
-        painter.end();
-    }
+        painter.drawLine( P1, P2 );
+    } );
 }
 
 void BitmapImage::drawRect( QRectF rectangle, QPen pen, QBrush brush, QPainter::CompositionMode cm, bool antialiasing)
 {
+    ensureTiled();
     int width = pen.width();
-    extend( rectangle.adjusted(-width,-width,width,width).toRect() );
-    if (brush.style() == Qt::RadialGradientPattern)
-    {
-        QRadialGradient* gradient = (QRadialGradient*)brush.gradient();
-        gradient->setCenter( gradient->center() - topLeft() );
-        gradient->setFocalPoint( gradient->focalPoint() - topLeft() );
-    }
-    if ( mImage && !mImage->isNull() )
+    QRect area = rectangle.adjusted(-width,-width,width,width).toAlignedRect();
+    extend( area );
+    paintOnTiles( area, cm, [&]( QPainter& painter )
     {
-        QPainter painter( mImage.get() );
-        painter.setCompositionMode(cm);
         painter.setRenderHint(QPainter::Antialiasing, antialiasing);
         painter.setPen(pen);
         painter.setBrush(brush);
-        painter.drawRect( rectangle.translated(-topLeft()) );
-        painter.end();
-    }
+        painter.drawRect( rectangle );
+    } );
 }
 
 void BitmapImage::drawEllipse( QRectF rectangle, QPen pen, QBrush brush, QPainter::CompositionMode cm, bool antialiasing)
 {
+    ensureTiled();
     int width = pen.width();
-    extend( rectangle.adjusted(-width,-width,width,width).toRect() );
-    if (brush.style() == Qt::RadialGradientPattern)
+    QRect area = rectangle.adjusted(-width,-width,width,width).toAlignedRect();
+    extend( area );
+    paintOnTiles( area, cm, [&]( QPainter& painter )
     {
-        QRadialGradient* gradient = (QRadialGradient*)brush.gradient();
-        gradient->setCenter( gradient->center() - topLeft() );
-        gradient->setFocalPoint( gradient->focalPoint() - topLeft() );
-    }
-    if ( mImage && !mImage->isNull() )
-    {
-        QPainter painter( mImage.get() );
-
         painter.setRenderHint(QPainter::Antialiasing, antialiasing);
         painter.setPen(pen);
         painter.setBrush(brush);
-        //if (brush == Qt::NoBrush)
-
-        painter.setCompositionMode(cm);
-        painter.drawEllipse( rectangle.translated(-topLeft()) );
-
-        painter.end();
-    }
+        painter.drawEllipse( rectangle );
+    } );
 }
 
 void BitmapImage::drawPath( QPainterPath path, QPen pen, QBrush brush,
                             QPainter::CompositionMode cm, bool antialiasing)
 {
+    ensureTiled();
     int width = pen.width();
     qreal inc = 1.0 + width / 20.0; // qreal?
     //if (inc<1) { inc=1.0; }
-    extend( path.controlPointRect().adjusted(-width,-width,width,width).toRect() );
+    QRect area = path.controlPointRect().adjusted(-width,-width,width,width).toAlignedRect();
+    extend( area );
 
-    if ( mImage != NULL && !mImage->isNull() )
+    paintOnTiles( area, cm, [&]( QPainter& painter )
     {
-        QPainter painter( mImage.get() );
-        painter.setCompositionMode(cm);
         painter.setRenderHint( QPainter::Antialiasing, antialiasing );
         painter.setPen(pen);
         painter.setBrush(brush);
-        painter.setTransform(QTransform().translate(-topLeft().x(), -topLeft().y()));
-        painter.setMatrixEnabled(true);
         if (path.length() > 0)
         {
             for ( int pt = 0; pt < path.elementCount() - 1; pt++ )
@@ -416,51 +1021,78 @@ void BitmapImage::drawPath( QPainterPath path, QPen pen, QBrush brush,
         else
         {
             // forces drawing when points are coincident (mousedown)
-            painter.drawPoint( path.elementAt(0).x, path.elementAt(0).y );
+            painter.drawPoint( QPointF( path.elementAt(0).x, path.elementAt(0).y ) );
         }
-        painter.end();
-    }
+    } );
 }
 
 void BitmapImage::clear()
 {
-    mImage = std::make_shared< QImage >(); // null image
+    mImage.reset();
+    mTiles.clear();
+    mIsLoaded = true;
     mBounds = QRect(0,0,0,0);
+    modification();
 }
 
-QRgb BitmapImage::constScanLine(int x, int y) {
-    QRgb result = qRgba( 0, 0, 0, 0 );
-    if ( mBounds.contains( QPoint( x, y ) ) ) {
-        result = *( reinterpret_cast< const QRgb* >( mImage->constScanLine( y - topLeft().y() ) ) + x - topLeft().x() );
+QRgb BitmapImage::constScanLine(int x, int y)
+{
+    ensureTiled();
+    QPoint P( x, y );
+    if ( !mBounds.contains( P ) )
+    {
+        return qRgba( 0, 0, 0, 0 );
     }
-
-    return result;
+    TileKey key = tileKeyAt( P );
+    QImage* t = tile( key, false );
+    if ( t == nullptr )
+    {
+        return qRgba( 0, 0, 0, 0 );
+    }
+    QPoint local = P - tileRect( key ).topLeft();
+    return reinterpret_cast< const QRgb* >( t->constScanLine( local.y() ) )[ local.x() ];
 }
 
 void BitmapImage::scanLine(int x, int y, QRgb colour)
 {
-    extend( QPoint( x, y ) );
-    if( mBounds.contains( QPoint( x, y ) ) ) {
+    ensureTiled();
+    QPoint P( x, y );
+    extend( P );
+    if ( mBounds.contains( P ) )
+    {
+        TileKey key = tileKeyAt( P );
+        QPoint local = P - tileRect( key ).topLeft();
 
         // Make sure color is premultiplied before calling
-        *( reinterpret_cast< QRgb* >( mImage->scanLine( y - topLeft().y() ) ) + x - topLeft().x() ) =
-                 qRgba(
-                       qRed( colour ),
-                       qGreen( colour ),
-                       qBlue( colour ),
-                       qAlpha( colour ) );
+        reinterpret_cast< QRgb* >( tile( key, true )->scanLine( local.y() ) )[ local.x() ] = colour;
+        modification();
     }
 }
 
 void BitmapImage::clear(QRect rectangle)
 {
+    ensureTiled();
     QRect clearRectangle = mBounds.intersected( rectangle );
-    clearRectangle.moveTopLeft( clearRectangle.topLeft() - topLeft() );
 
-    QPainter painter( mImage.get() );
-    painter.setCompositionMode(QPainter::CompositionMode_Clear);
-    painter.fillRect( clearRectangle, QColor(0,0,0,0) );
-    painter.end();
+    std::vector< TileKey > emptied;
+    forEachTile( clearRectangle, false, [&]( QImage& tile, const QRect& tileRect )
+    {
+        if ( clearRectangle.contains( tileRect ) )
+        {
+            emptied.push_back( tileKeyAt( tileRect.topLeft() ) );
+            return;
+        }
+        QPainter painter( &tile );
+        painter.setCompositionMode(QPainter::CompositionMode_Clear);
+        painter.fillRect( clearRectangle.intersected( tileRect ).translated( -tileRect.topLeft() ), QColor(0,0,0,0) );
+        painter.end();
+    } );
+
+    for ( TileKey key : emptied )
+    {
+        mTiles.erase( key );
+    }
+    modification();
 }
 
 int BitmapImage::pow(int n)   // pow of a number
@@ -499,78 +1131,59 @@ bool BitmapImage::compareColor(QRgb color1, QRgb color2, int tolerance)
 }
 
 // Flood fill
-// ----- http://lodev.org/cgtutor/floodfill.html
-void BitmapImage::floodFill(BitmapImage* targetImage, QRect cameraRect, QPoint point, QRgb oldColor, QRgb newColor, int tolerance)
+// The fill mask is built by FloodFill straight from the tile rows,
+// then the new colour is blended into the tiles span by span.
+void BitmapImage::floodFill( BitmapImage* targetImage, QRect cameraRect, QPoint point, QRgb newColor, int tolerance, int gapSize )
 {
-    if ( oldColor == newColor ){
+    if ( qAlpha( newColor ) == 0 )
+    {
+        return; // painting transparent over anything changes nothing
+    }
+    if ( targetImage->pixel( point ) == newColor )
+    {
         return;
     }
 
-    oldColor = targetImage->pixel( point );
-    oldColor = qRgba( qRed( oldColor ), qGreen( oldColor ), qBlue( oldColor ), qAlpha( oldColor ) );
-
-    // Preparations
-    QList<QPoint> queue; // queue all the pixels of the filled area (as they are found)
-
-    BitmapImage* replaceImage = nullptr;
-    QPoint tempPoint;
-    QRgb newPlacedColor;
-
-    int xTemp;
-    bool spanLeft, spanRight;
-
     // Extend to size of Camera
     targetImage->extend( cameraRect );
-    replaceImage = new BitmapImage( cameraRect, Qt::transparent );
-
-    queue.append( point );
-    // Preparations END
-
-    while( !queue.empty() ) {
-        tempPoint = queue.takeFirst();
-
-        point.setX( tempPoint.x() );
-        point.setY( tempPoint.y() );
-
-        xTemp = point.x();
-
-        newPlacedColor = replaceImage->constScanLine( xTemp, point.y() );
-        while( xTemp >= targetImage->topLeft().x() &&
-               compareColor( targetImage->constScanLine( xTemp, point.y() ), oldColor, tolerance) ) xTemp--;
-        xTemp++;
-
-        spanLeft = spanRight = false;
-        while( xTemp <= targetImage->right() &&
-               compareColor( targetImage->constScanLine( xTemp, point.y() ), oldColor, tolerance ) &&
-               newPlacedColor != newColor ) {
-
-            // Set pixel color
-            replaceImage->scanLine( xTemp, point.y(), newColor );
-
-            if( !spanLeft && (point.y() > targetImage->top() ) &&
-                    compareColor( targetImage->constScanLine( xTemp, point.y() - 1 ), oldColor, tolerance ) ) {
-                queue.append( QPoint( xTemp, point.y() - 1) );
-                spanLeft = true;
-            } else if( spanLeft && ( point.y() > targetImage->top() ) &&
-                      !compareColor( targetImage->constScanLine( xTemp, point.y() - 1 ), oldColor, tolerance ) ) {
-                spanLeft = false;
-            }
-
-            if( !spanRight && point.y() < targetImage->bottom() &&
-                    compareColor( targetImage->constScanLine( xTemp, point.y() + 1 ), oldColor, tolerance ) ) {
-                queue.append( QPoint( xTemp, point.y() + 1 ) );
-                spanRight = true;
+    targetImage->ensureTiled();
 
-            } else if( spanRight && point.y() < targetImage->bottom() &&
-                      !compareColor( targetImage->constScanLine( xTemp, point.y() + 1 ), oldColor, tolerance ) ) {
-                spanRight = false;
-            }
+    auto readTiles = [ targetImage ]( int x, int y, int* count ) -> const QRgb*
+    {
+        TileKey key = targetImage->tileKeyAt( QPoint( x, y ) );
+        QRect rect = targetImage->tileRect( key );
+        *count = rect.right() - x + 1;
 
-            Q_ASSERT( queue.count() < ( targetImage->width() * targetImage->height() ) );
-            xTemp++;
+        const QImage* t = targetImage->tile( key, false );
+        if ( t == nullptr )
+        {
+            return nullptr;
         }
+        return reinterpret_cast< const QRgb* >( t->constScanLine( y - rect.top() ) ) + ( x - rect.left() );
+    };
+
+    FloodFill fill( targetImage->mBounds, readTiles );
+    fill.setTolerance( tolerance );
+    fill.setGapSize( gapSize );
+    if ( !fill.fill( point ) )
+    {
+        return;
     }
 
-    targetImage->paste( replaceImage );
-    delete replaceImage;
+    fill.forEachSpan( [&]( int y, int x1, int x2 )
+    {
+        int x = x1;
+        while ( x <= x2 )
+        {
+            TileKey key = targetImage->tileKeyAt( QPoint( x, y ) );
+            QRect rect = targetImage->tileRect( key );
+            int end = qMin( x2, rect.right() );
+
+            QImage* t = targetImage->tile( key, true );
+            QRgb* dst = reinterpret_cast< QRgb* >( t->scanLine( y - rect.top() ) ) + ( x - rect.left() );
+            blendSpan( dst, newColor, end - x + 1 );
+            x = end + 1;
+        }
+    } );
+    targetImage->modification();
 }
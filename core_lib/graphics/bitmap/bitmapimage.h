@@ -18,26 +18,44 @@ GNU General Public License for more details.
 #define BITMAP_IMAGE_H
 
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
 #include <QtXml>
 #include <QPainter>
 #include "keyframe.h"
 
 
+/*
+ * Pixels are kept in fixed-size tiles which are only allocated where
+ * something has been drawn. mBounds is the logical extent of the image,
+ * growing it is free. toImage() flattens the tiles into a copy for reading,
+ * image() hands out a single QImage to draw into and marks the key modified.
+ *
+ * An image created from a file only reads the size up front, the pixels are
+ * decoded the first time anything touches them. Clean images can be unloaded
+ * again, trimLoadedImages() does that for the least recently painted ones.
+ */
 class BitmapImage : public KeyFrame
 {
 public:
+    static const int TILE_SIZE;
+
     BitmapImage();
     BitmapImage( const BitmapImage& );
     BitmapImage( const QRect& boundaries, const QColor& colour );
     BitmapImage( const QRect& boundaries, const QImage& image );
+    // The file is decoded on first use
     BitmapImage( const QString& path, const QPoint& topLeft );
 
     ~BitmapImage();
     BitmapImage& operator=( const BitmapImage& a );
 
     void paintImage( QPainter& painter );
+    void paintImage( QPainter& painter, const QRect& rect ); // only the tiles touching rect, all for a null one
 
-    QImage* image() { return mImage.get(); }
+    QImage* image();         // to draw into, marks the image modified
+    QImage  toImage() const; // a copy to read
     void    setImage( QImage* pImg );
 
     BitmapImage copy();
@@ -72,7 +90,7 @@ public:
 
     static int pow( int );
     static bool compareColor(QRgb color1, QRgb color2, int tolerance);
-    static void floodFill(BitmapImage* targetImage, QRect cameraRect, QPoint point, QRgb oldColor, QRgb newColor, int tolerance );
+    static void floodFill( BitmapImage* targetImage, QRect cameraRect, QPoint point, QRgb newColor, int tolerance, int gapSize = 0 );
 
     void drawLine( QPointF P1, QPointF P2, QPen pen, QPainter::CompositionMode cm, bool antialiasing );
     void drawRect( QRectF rectangle, QPen pen, QBrush brush, QPainter::CompositionMode cm, bool antialiasing );
@@ -90,12 +108,73 @@ public:
     int width() { return mBounds.width(); }
     int height() { return mBounds.height(); }
 
-    QRect& bounds() { return mBounds; }
+    QRect bounds() { return mBounds; }
+    void  setBounds( QRect rectangle ); // pixels outside of it are dropped
+    int tileCount() { ensureTiled(); return static_cast< int >( mTiles.size() ); }
+
+    // Splits a flattened image() back into tiles, after that paintImage() only reads
+    void ensureTiled();
+
+    // Smallest rectangle holding every pixel which differs from other. Tiles
+    // still shared with a copy() are skipped without looking at their pixels.
+    QRect differenceRect( BitmapImage& other );
+    // Copy of the pixels under rectangle, transparent where nothing was drawn
+    QImage readPixels( QRect rectangle ) { return flatten( rectangle ); }
+    // Overwrites the pixels under the image, alpha included, no blending
+    void  writePixels( QPoint topLeft, const QImage& pixels );
+    // Source over of a premultiplied colour through an Alpha8 coverage mask
+    void  blendMask( QPoint topLeft, const QImage& mask, QRgb colour );
+
+    bool isLoaded() const { return mIsLoaded.load( std::memory_order_acquire ); }
+    // Safe to call from several threads at once
+    void loadFile() { if ( !isLoaded() ) { decodeFile(); } }
+    // Drops the pixels when fileName() holds exactly them, they are decoded again on demand
+    bool unloadFile();
+    // The pixels were just written to fileName(), so they may be unloaded from now on
+    void setFileStored();
+
+    // Unloads clean images, least recently painted first, until the decoded ones fit the limit
+    static void   setLoadedMemoryLimit( qint64 bytes );
+    static qint64 loadedMemoryUsage();
+    static void   trimLoadedImages();
+
+    // Keeps every image loaded while it exists, for threads painting keyframes
+    class UnloadBlocker
+    {
+    public:
+        UnloadBlocker();
+        ~UnloadBlocker();
+    };
 
 private:
-    std::shared_ptr< QImage > mImage;
+    typedef quint64 TileKey;
+    typedef std::function< void( QImage& tile, const QRect& tileRect ) > TileAction;
+
+    TileKey tileKeyAt( QPoint P ) const;
+    QRect   tileRect( TileKey key ) const;
+    QImage* tile( TileKey key, bool create );
+
+    void forEachTile( QRect rectangle, bool create, TileAction action );
+    void paintOnTiles( QRect rectangle, QPainter::CompositionMode cm, std::function< void( QPainter& ) > paint );
+    void compositeRows( BitmapImage* source, std::function< void( QRgb* dst, const QRgb* src, int count ) > rowOp );
+
+    void   setTilesFromImage( const QImage& image, QPoint topLeft );
+    QImage flatten( QRect rectangle );
+
+    void   decodeFile();
+    void   registerFileImage();
+    qint64 decodedBytes() const;
+
+    std::unordered_map< TileKey, QImage > mTiles;
+    std::shared_ptr< QImage > mImage; // set only while a caller holds the flattened image()
+    QPoint  mOrigin; // canvas position of the top left corner of tile (0,0)
     QRect   mBounds;
     bool    mExtendable = true;
+
+    QString mFileToLoad; // where the pixels come from while they aren't decoded
+    std::atomic< bool >    mIsLoaded{ true };
+    std::atomic< quint64 > mLastUse{ 0 };
+    bool    mIsRegistered = false;
 };
 
 #endif
@@ -0,0 +1,154 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "dabrasterizer.h"
+
+#include <cmath>
+#include <QElapsedTimer>
+#include <QtMath>
+#include "bitmapimage.h"
+
+
+void DabRasterizer::stamp( BitmapImage* target, QPointF centre, qreal width, qreal feather,
+                           QColor colour, qreal opacity, bool useFeather, bool useAA )
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int widthSteps = qRound( width * SUBPIXEL_STEPS );
+    if ( widthSteps <= 0 )
+    {
+        return;
+    }
+    int featherPercent = qBound( 0, qRound( feather ), 100 );
+
+    int alpha = colour.alpha();
+    if ( useFeather )
+    {
+        // the gradient stops of setGaussianGradient()
+        int mainColorAlpha = qRound( colour.alphaF() * 255 * opacity );
+        alpha = mainColorAlpha - qRound( ( mainColorAlpha * featherPercent ) / 100.0 );
+    }
+    QRgb premultiplied = qPremultiply( qRgba( colour.red(), colour.green(), colour.blue(), qBound( 0, alpha, 255 ) ) );
+
+    int stepsX = qRound( centre.x() * SUBPIXEL_STEPS );
+    int stepsY = qRound( centre.y() * SUBPIXEL_STEPS );
+    int pixelX = qFloor( stepsX / qreal( SUBPIXEL_STEPS ) );
+    int pixelY = qFloor( stepsY / qreal( SUBPIXEL_STEPS ) );
+
+    const Mask& m = mask( widthSteps, useFeather ? featherPercent : 0, useFeather, useAA,
+                          stepsX - pixelX * SUBPIXEL_STEPS, stepsY - pixelY * SUBPIXEL_STEPS );
+    target->blendMask( QPoint( pixelX, pixelY ) + m.topLeft, m.coverage, premultiplied );
+
+    mDabCount++;
+    mStampNs += timer.nsecsElapsed();
+}
+
+double DabRasterizer::dabsPerSecond() const
+{
+    if ( mStampNs == 0 )
+    {
+        return 0.0;
+    }
+    return mDabCount * 1e9 / mStampNs;
+}
+
+void DabRasterizer::resetStats()
+{
+    mDabCount = 0;
+    mStampNs = 0;
+}
+
+const DabRasterizer::Mask& DabRasterizer::mask( int widthSteps, int feather, bool useFeather, bool useAA, int phaseX, int phaseY )
+{
+    for ( auto it = mMasks.begin(); it != mMasks.end(); ++it )
+    {
+        if ( it->widthSteps == widthSteps && it->feather == feather && it->useFeather == useFeather &&
+             it->useAA == useAA && it->phaseX == phaseX && it->phaseY == phaseY )
+        {
+            mMasks.splice( mMasks.begin(), mMasks, it );
+            return mMasks.front();
+        }
+    }
+
+    Mask m;
+    m.widthSteps = widthSteps;
+    m.feather = feather;
+    m.useFeather = useFeather;
+    m.useAA = useAA;
+    m.phaseX = phaseX;
+    m.phaseY = phaseY;
+    m.coverage = createMask( widthSteps / qreal( SUBPIXEL_STEPS ), feather, useFeather, useAA,
+                             QPointF( phaseX, phaseY ) / SUBPIXEL_STEPS, &m.topLeft );
+
+    mMasks.push_front( m );
+    if ( mMasks.size() > static_cast< size_t >( CACHE_SIZE ) )
+    {
+        mMasks.pop_back();
+    }
+    return mMasks.front();
+}
+
+QImage DabRasterizer::createMask( qreal width, int feather, bool useFeather, bool useAA,
+                                  QPointF phase, QPoint* topLeft )
+{
+    const qreal radius = 0.5 * width;
+    const int left = qFloor( phase.x() - radius );
+    const int top = qFloor( phase.y() - radius );
+    const int right = qCeil( phase.x() + radius );
+    const int bottom = qCeil( phase.y() + radius );
+
+    QImage coverage( right - left, bottom - top, QImage::Format_Alpha8 );
+    coverage.fill( 0 );
+    *topLeft = QPoint( left, top );
+
+    const qreal solid = 1.0 - feather / 100.0; // the gradient is flat up to there
+    const int samples = ( !useFeather && useAA ) ? 4 : 1; // per axis, for antialiased edges
+
+    for ( int y = 0; y < coverage.height(); y++ )
+    {
+        uchar* row = coverage.scanLine( y );
+        for ( int x = 0; x < coverage.width(); x++ )
+        {
+            const qreal dx = left + x + 0.5 - phase.x();
+            const qreal dy = top + y + 0.5 - phase.y();
+
+            if ( useFeather )
+            {
+                const qreal t = std::sqrt( dx * dx + dy * dy ) / radius;
+                if ( t <= 1.0 )
+                {
+                    const qreal value = ( t <= solid ) ? 1.0 : ( 1.0 - t ) / ( 1.0 - solid );
+                    row[ x ] = static_cast< uchar >( qRound( 255 * value ) );
+                }
+                continue;
+            }
+
+            int inside = 0;
+            for ( int sy = 0; sy < samples; sy++ )
+            {
+                for ( int sx = 0; sx < samples; sx++ )
+                {
+                    const qreal px = dx + ( sx + 0.5 ) / samples - 0.5;
+                    const qreal py = dy + ( sy + 0.5 ) / samples - 0.5;
+                    inside += ( px * px + py * py <= radius * radius ) ? 1 : 0;
+                }
+            }
+            row[ x ] = static_cast< uchar >( ( 255 * inside ) / ( samples * samples ) );
+        }
+    }
+    return coverage;
+}
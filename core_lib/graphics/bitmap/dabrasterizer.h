@@ -0,0 +1,77 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef DABRASTERIZER_H
+#define DABRASTERIZER_H
+
+#include <list>
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+
+class BitmapImage;
+
+
+/*
+ * Stamps round brush dabs into a bitmap.
+ * The coverage of a dab only depends on its width, feather, antialiasing and
+ * where its centre falls inside a pixel, so the masks are computed once per
+ * combination and kept in a small cache. Stamping is then a row blend of the
+ * colour through the mask, see PixelKernels::blendMaskRow().
+ */
+class DabRasterizer
+{
+public:
+    static const int SUBPIXEL_STEPS = 4; // dab centres are snapped to quarter pixels
+    static const int CACHE_SIZE = 64;
+
+    // Same look as a radial gradient of setGaussianGradient() when feathered,
+    // a plain ellipse of colour otherwise, which ignores the opacity
+    void stamp( BitmapImage* target, QPointF centre, qreal width, qreal feather,
+                QColor colour, qreal opacity, bool useFeather, bool useAA );
+
+    qint64 dabCount() const { return mDabCount; }
+    double dabsPerSecond() const;
+    void   resetStats();
+    int    cachedMaskCount() const { return static_cast< int >( mMasks.size() ); }
+
+    // Coverage of a dab centred at phase (in [0, 1) pixels) from pixel (0, 0),
+    // topLeft is where the mask starts relative to that pixel
+    static QImage createMask( qreal width, int feather, bool useFeather, bool useAA,
+                              QPointF phase, QPoint* topLeft );
+
+private:
+    struct Mask
+    {
+        int widthSteps;
+        int feather;
+        bool useFeather;
+        bool useAA;
+        int phaseX;
+        int phaseY;
+        QPoint topLeft;
+        QImage coverage;
+    };
+
+    const Mask& mask( int widthSteps, int feather, bool useFeather, bool useAA, int phaseX, int phaseY );
+
+    std::list< Mask > mMasks; // most recently used first
+
+    qint64 mDabCount = 0;
+    qint64 mStampNs = 0;
+};
+
+#endif // DABRASTERIZER_H
@@ -0,0 +1,381 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "floodfill.h"
+#include <cstdlib>
+#include <QtAlgorithms>
+
+
+namespace
+{
+    // Bits of a & ~b, b may be null
+    inline quint64 wordAt( const quint64* a, const quint64* b, int w )
+    {
+        return ( b == nullptr ) ? a[ w ] : ( a[ w ] & ~b[ w ] );
+    }
+
+    void setRange( quint64* bits, int x1, int x2 )
+    {
+        int w1 = x1 >> 6;
+        int w2 = x2 >> 6;
+        quint64 first = ~quint64( 0 ) << ( x1 & 63 );
+        quint64 last = ~quint64( 0 ) >> ( 63 - ( x2 & 63 ) );
+        if ( w1 == w2 )
+        {
+            bits[ w1 ] |= first & last;
+            return;
+        }
+        bits[ w1 ] |= first;
+        for ( int w = w1 + 1; w < w2; w++ )
+        {
+            bits[ w ] = ~quint64( 0 );
+        }
+        bits[ w2 ] |= last;
+    }
+
+    // First set bit of a & ~b in [from, to], -1 if there is none
+    int firstSet( const quint64* a, const quint64* b, int from, int to )
+    {
+        int x = from;
+        while ( x <= to )
+        {
+            int w = x >> 6;
+            quint64 word = wordAt( a, b, w ) >> ( x & 63 );
+            if ( word != 0 )
+            {
+                int found = x + qCountTrailingZeroBits( word );
+                return ( found <= to ) ? found : -1;
+            }
+            x = ( w + 1 ) << 6;
+        }
+        return -1;
+    }
+
+    // Last set bit of the run of a & ~b which contains x
+    int runEnd( const quint64* a, const quint64* b, int x, int wordsPerRow )
+    {
+        for ( ;; )
+        {
+            int w = x >> 6;
+            quint64 blocked = ~wordAt( a, b, w ) >> ( x & 63 );
+            if ( blocked != 0 )
+            {
+                return x + qCountTrailingZeroBits( blocked ) - 1;
+            }
+            x = ( w + 1 ) << 6;
+            if ( w + 1 == wordsPerRow )
+            {
+                return x - 1;
+            }
+        }
+    }
+
+    // First set bit of the run of a & ~b which contains x
+    int runStart( const quint64* a, const quint64* b, int x )
+    {
+        for ( ;; )
+        {
+            int w = x >> 6;
+            quint64 blocked = ~wordAt( a, b, w ) << ( 63 - ( x & 63 ) );
+            if ( blocked != 0 )
+            {
+                return x - qCountLeadingZeroBits( blocked ) + 1;
+            }
+            if ( w == 0 )
+            {
+                return 0;
+            }
+            x = ( w << 6 ) - 1;
+        }
+    }
+
+    // Grows the set bits by radius pixels in every direction (square structuring element)
+    void dilate( std::vector< quint64 >& bits, int wordsPerRow, int height, int radius )
+    {
+        std::vector< quint64 > horizontal( bits.size() );
+        for ( int y = 0; y < height; y++ )
+        {
+            quint64* rowBits = bits.data() + y * wordsPerRow;
+            for ( int r = 0; r < radius; r++ )
+            {
+                quint64 carryLeft = 0;
+                for ( int w = 0; w < wordsPerRow; w++ )
+                {
+                    quint64 current = rowBits[ w ];
+                    quint64 next = ( w + 1 < wordsPerRow ) ? rowBits[ w + 1 ] : 0;
+                    rowBits[ w ] = current | ( current << 1 ) | carryLeft | ( current >> 1 ) | ( next << 63 );
+                    carryLeft = current >> 63;
+                }
+            }
+            std::copy( rowBits, rowBits + wordsPerRow, horizontal.data() + y * wordsPerRow );
+        }
+
+        for ( int y = 0; y < height; y++ )
+        {
+            quint64* out = bits.data() + y * wordsPerRow;
+            int y1 = qMax( 0, y - radius );
+            int y2 = qMin( height - 1, y + radius );
+            for ( int w = 0; w < wordsPerRow; w++ )
+            {
+                quint64 word = 0;
+                for ( int yy = y1; yy <= y2; yy++ )
+                {
+                    word |= horizontal[ yy * wordsPerRow + w ];
+                }
+                out[ w ] = word;
+            }
+        }
+    }
+}
+
+FloodFill::FloodFill( const QRect& area, PixelSource source )
+    : mArea( area.normalized() )
+    , mSource( source )
+{
+}
+
+void FloodFill::buildToleranceTable( QRgb seedColour )
+{
+    mSeedColour = seedColour;
+    for ( int channel = 0; channel < 4; channel++ )
+    {
+        int seedValue = ( seedColour >> ( channel * 8 ) ) & 0xFF;
+        for ( int v = 0; v < 256; v++ )
+        {
+            mMatchTable[ channel ][ v ] = ( std::abs( v - seedValue ) <= mTolerance ) ? 1 : 0;
+        }
+    }
+}
+
+void FloodFill::classifyRow( int y )
+{
+    const int width = mArea.width();
+    quint64* bits = row( mPassable, y );
+
+    const bool transparentMatches = ( mSeedColour == 0 ) ||
+        ( mMatchTable[ 0 ][ 0 ] & mMatchTable[ 1 ][ 0 ] & mMatchTable[ 2 ][ 0 ] & mMatchTable[ 3 ][ 0 ] );
+
+    int x = 0;
+    while ( x < width )
+    {
+        int count = 1;
+        const QRgb* pixels = mSource( mArea.left() + x, mArea.top() + y, &count );
+        count = qBound( 1, count, width - x );
+
+        if ( pixels == nullptr )
+        {
+            if ( transparentMatches )
+            {
+                setRange( bits, x, x + count - 1 );
+            }
+        }
+        else
+        {
+            for ( int i = 0; i < count; i++ )
+            {
+                QRgb p = pixels[ i ];
+                bool match = ( p == mSeedColour ) ||
+                    ( mMatchTable[ 0 ][ p & 0xFF ] & mMatchTable[ 1 ][ ( p >> 8 ) & 0xFF ] &
+                      mMatchTable[ 2 ][ ( p >> 16 ) & 0xFF ] & mMatchTable[ 3 ][ p >> 24 ] );
+                if ( match )
+                {
+                    bits[ ( x + i ) >> 6 ] |= quint64( 1 ) << ( ( x + i ) & 63 );
+                }
+            }
+        }
+        x += count;
+    }
+    mClassified[ y ] = true;
+}
+
+void FloodFill::closeGaps()
+{
+    const int height = mArea.height();
+    for ( int y = 0; y < height; y++ )
+    {
+        if ( !mClassified[ y ] )
+        {
+            classifyRow( y );
+        }
+    }
+
+    // Everything which doesn't match is an outline, thicken the outlines
+    // so that small openings in them are sealed.
+    Bits barrier( mPassable.size() );
+    const int tailBits = mArea.width() & 63;
+    const quint64 tailMask = ( tailBits == 0 ) ? ~quint64( 0 ) : ( ( quint64( 1 ) << tailBits ) - 1 );
+    for ( int y = 0; y < height; y++ )
+    {
+        for ( int w = 0; w < mWordsPerRow; w++ )
+        {
+            quint64 word = ~row( mPassable, y )[ w ];
+            if ( w == mWordsPerRow - 1 )
+            {
+                word &= tailMask;
+            }
+            row( barrier, y )[ w ] = word;
+        }
+    }
+    dilate( barrier, mWordsPerRow, height, mGapSize );
+
+    mMatching = mPassable;
+    for ( size_t i = 0; i < mPassable.size(); i++ )
+    {
+        mPassable[ i ] &= ~barrier[ i ];
+    }
+}
+
+void FloodFill::scanSpan( const Span& span, std::vector< Span >& stack )
+{
+    const int y = span.y;
+    if ( y < 0 || y >= mArea.height() )
+    {
+        return;
+    }
+    if ( !mClassified[ y ] )
+    {
+        classifyRow( y );
+    }
+
+    const quint64* passable = row( mPassable, y );
+    quint64* filled = row( mFilled, y );
+
+    int x = firstSet( passable, filled, span.x1, span.x2 );
+    while ( x >= 0 )
+    {
+        int left = runStart( passable, filled, x );
+        int right = runEnd( passable, filled, x, mWordsPerRow );
+        setRange( filled, left, right );
+        mFilledRect |= QRect( left, y, right - left + 1, 1 );
+
+        stack.push_back( Span{ left, right, y - 1 } );
+        stack.push_back( Span{ left, right, y + 1 } );
+
+        // right + 1 is blocked, the next run can't start before right + 2
+        if ( right + 2 > span.x2 )
+        {
+            break;
+        }
+        x = firstSet( passable, filled, right + 2, span.x2 );
+    }
+}
+
+bool FloodFill::fill( QPoint seed )
+{
+    if ( !mArea.contains( seed ) )
+    {
+        return false;
+    }
+
+    const int width = mArea.width();
+    const int height = mArea.height();
+    mWordsPerRow = ( width + 63 ) / 64;
+    mPassable.assign( mWordsPerRow * height, 0 );
+    mFilled.assign( mWordsPerRow * height, 0 );
+    mClassified.assign( height, false );
+    mFilledRect = QRect();
+
+    int count = 1;
+    const QRgb* seedPixel = mSource( seed.x(), seed.y(), &count );
+    buildToleranceTable( ( seedPixel != nullptr ) ? *seedPixel : 0 );
+
+    const int sx = seed.x() - mArea.left();
+    const int sy = seed.y() - mArea.top();
+
+    bool closingGaps = ( mGapSize > 0 );
+    if ( closingGaps )
+    {
+        closeGaps();
+
+        // clicked right next to an outline, fill as if there was no gap closing
+        if ( ( row( mPassable, sy )[ sx >> 6 ] & ( quint64( 1 ) << ( sx & 63 ) ) ) == 0 )
+        {
+            mPassable.swap( mMatching );
+            closingGaps = false;
+        }
+    }
+
+    std::vector< Span > stack;
+    stack.reserve( 256 );
+    stack.push_back( Span{ sx, sx, sy } );
+    while ( !stack.empty() )
+    {
+        Span span = stack.back();
+        stack.pop_back();
+        scanSpan( span, stack );
+    }
+
+    if ( closingGaps )
+    {
+        // the fill stopped gapSize pixels short of the outlines, grow it back into them
+        dilate( mFilled, mWordsPerRow, height, mGapSize );
+        for ( size_t i = 0; i < mFilled.size(); i++ )
+        {
+            mFilled[ i ] &= mMatching[ i ];
+        }
+        mFilledRect = mFilledRect.adjusted( -mGapSize, -mGapSize, mGapSize, mGapSize )
+                                 .intersected( QRect( 0, 0, width, height ) );
+    }
+    mMatching.clear();
+
+    mFilledRect.translate( mArea.topLeft() );
+    return true;
+}
+
+bool FloodFill::contains( int x, int y ) const
+{
+    if ( !mFilledRect.contains( x, y ) )
+    {
+        return false;
+    }
+    x -= mArea.left();
+    y -= mArea.top();
+    return ( row( mFilled, y )[ x >> 6 ] >> ( x & 63 ) ) & 1;
+}
+
+int FloodFill::filledPixelCount() const
+{
+    int count = 0;
+    for ( quint64 word : mFilled )
+    {
+        count += qPopulationCount( word );
+    }
+    return count;
+}
+
+void FloodFill::forEachSpan( std::function< void( int y, int x1, int x2 ) > action ) const
+{
+    if ( mFilledRect.isEmpty() )
+    {
+        return;
+    }
+    const QRect local = mFilledRect.translated( -mArea.topLeft() );
+    for ( int y = local.top(); y <= local.bottom(); y++ )
+    {
+        const quint64* filled = row( mFilled, y );
+        int x = firstSet( filled, nullptr, local.left(), local.right() );
+        while ( x >= 0 )
+        {
+            int end = runEnd( filled, nullptr, x, mWordsPerRow );
+            action( mArea.top() + y, mArea.left() + x, mArea.left() + end );
+            if ( end + 2 > local.right() )
+            {
+                break;
+            }
+            x = firstSet( filled, nullptr, end + 2, local.right() );
+        }
+    }
+}
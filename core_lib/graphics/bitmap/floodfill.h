@@ -0,0 +1,85 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <functional>
+#include <vector>
+#include <QRect>
+#include <QColor>
+
+
+/*
+ * Scanline flood fill working on packed bitsets.
+ * Rows are classified against the seed colour only when the fill first
+ * reaches them, the result is a mask of filled spans which the caller
+ * composites into its own storage.
+ */
+class FloodFill
+{
+public:
+    // Returns a pointer to pixel (x, y) and the number of pixels which follow it
+    // contiguously in memory (at least 1). nullptr means that many transparent pixels.
+    typedef std::function< const QRgb*( int x, int y, int* count ) > PixelSource;
+
+    FloodFill( const QRect& area, PixelSource source );
+
+    void setTolerance( int tolerance ) { mTolerance = tolerance; }
+    // Gaps in the outline up to twice this size are treated as closed, 0 disables it.
+    void setGapSize( int gapSize ) { mGapSize = qMax( 0, gapSize ); }
+
+    bool fill( QPoint seed );
+
+    bool contains( int x, int y ) const;
+    int  filledPixelCount() const;
+    QRect filledRect() const { return mFilledRect; }
+    void forEachSpan( std::function< void( int y, int x1, int x2 ) > action ) const;
+
+private:
+    struct Span
+    {
+        int x1;
+        int x2;
+        int y;
+    };
+
+    typedef std::vector< quint64 > Bits;
+
+    quint64*       row( Bits& bits, int y ) { return bits.data() + y * mWordsPerRow; }
+    const quint64* row( const Bits& bits, int y ) const { return bits.data() + y * mWordsPerRow; }
+
+    void buildToleranceTable( QRgb seedColour );
+    void classifyRow( int y );
+    void closeGaps();
+    void scanSpan( const Span& span, std::vector< Span >& stack );
+
+    QRect       mArea;
+    PixelSource mSource;
+    int         mTolerance = 0;
+    int         mGapSize = 0;
+    int         mWordsPerRow = 0;
+
+    quint8 mMatchTable[ 4 ][ 256 ]; // per channel, 1 where the value is within tolerance of the seed
+    QRgb   mSeedColour = 0;
+
+    Bits mPassable; // pixels the fill may enter
+    Bits mMatching; // pixels matching the seed colour, only kept while closing gaps
+    Bits mFilled;
+    std::vector< bool > mClassified;
+    QRect mFilledRect;
+};
+
+#endif // FLOODFILL_H
@@ -0,0 +1,301 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "pixelkernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PIXELKERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXELKERNELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXELKERNELS_TARGET_AVX2
+#endif
+
+
+void PixelKernels::uniteRowScalar( QRgb* dst, const QRgb* src, int count )
+{
+    for ( int x = 0; x < count; x++ )
+    {
+        QRgb p1 = dst[ x ];
+        QRgb p2 = src[ x ];
+
+        int a2 = qAlpha( p2 );
+        if ( a2 != 0 )
+        {
+            dst[ x ] = qRgba( qMax( qRed( p1 ), qRed( p2 ) ),
+                              qMax( qGreen( p1 ), qGreen( p2 ) ),
+                              qMax( qBlue( p1 ), qBlue( p2 ) ),
+                              qMax( qAlpha( p1 ), a2 ) );
+        }
+    }
+}
+
+void PixelKernels::compareAlphaRowScalar( QRgb* dst, const QRgb* src, int count )
+{
+    for ( int x = 0; x < count; x++ )
+    {
+        if ( qAlpha( dst[ x ] ) <= qAlpha( src[ x ] ) )
+        {
+            dst[ x ] = src[ x ];
+        }
+    }
+}
+
+namespace
+{
+    // a * b / 255, rounded the same way by the scalar and vector kernels
+    inline uint mul255( uint a, uint b )
+    {
+        uint t = a * b + 128;
+        return ( t + ( t >> 8 ) ) >> 8;
+    }
+}
+
+void PixelKernels::blendMaskRowScalar( QRgb* dst, const uchar* mask, QRgb colour, int count )
+{
+    for ( int x = 0; x < count; x++ )
+    {
+        uint m = mask[ x ];
+        if ( m == 0 )
+        {
+            continue;
+        }
+        uint a = mul255( qAlpha( colour ), m );
+        uint inv = 255 - a;
+        QRgb d = dst[ x ];
+        dst[ x ] = qRgba( qMin( 255u, mul255( qRed( colour ), m ) + mul255( qRed( d ), inv ) ),
+                          qMin( 255u, mul255( qGreen( colour ), m ) + mul255( qGreen( d ), inv ) ),
+                          qMin( 255u, mul255( qBlue( colour ), m ) + mul255( qBlue( d ), inv ) ),
+                          qMin( 255u, a + mul255( qAlpha( d ), inv ) ) );
+    }
+}
+
+#ifdef PIXELKERNELS_X86
+
+namespace
+{
+    // mul255() on 16 bit lanes
+    inline __m128i mul255SSE2( __m128i a, __m128i b )
+    {
+        __m128i t = _mm_add_epi16( _mm_mullo_epi16( a, b ), _mm_set1_epi16( 128 ) );
+        return _mm_srli_epi16( _mm_add_epi16( t, _mm_srli_epi16( t, 8 ) ), 8 );
+    }
+
+    // two pixels widened to 16 bit lanes, with their coverage m0, m1 spread over the channels
+    inline __m128i blendTwoSSE2( __m128i d, __m128i colour, __m128i m )
+    {
+        const __m128i full = _mm_set1_epi16( 255 );
+        __m128i s = mul255SSE2( colour, m );
+        __m128i a = _mm_shufflehi_epi16( _mm_shufflelo_epi16( s, _MM_SHUFFLE( 3, 3, 3, 3 ) ), _MM_SHUFFLE( 3, 3, 3, 3 ) );
+        return _mm_add_epi16( s, mul255SSE2( d, _mm_sub_epi16( full, a ) ) );
+    }
+
+    void blendMaskRowSSE2( QRgb* dst, const uchar* mask, QRgb colour, int count )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c = _mm_unpacklo_epi8( _mm_set1_epi32( static_cast< int >( colour ) ), zero );
+
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+        {
+            int m4;
+            memcpy( &m4, mask + x, 4 );
+            if ( m4 == 0 )
+            {
+                continue; // outside the dab, most of the corners
+            }
+            __m128i m16 = _mm_unpacklo_epi8( _mm_cvtsi32_si128( m4 ), zero ); // m0 m1 m2 m3
+            __m128i m32 = _mm_unpacklo_epi16( m16, m16 );                     // m0 m0 m1 m1 m2 m2 m3 m3
+            __m128i mLo = _mm_unpacklo_epi32( m32, m32 );
+            __m128i mHi = _mm_unpackhi_epi32( m32, m32 );
+
+            __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + x ) );
+            __m128i lo = blendTwoSSE2( _mm_unpacklo_epi8( d, zero ), c, mLo );
+            __m128i hi = blendTwoSSE2( _mm_unpackhi_epi8( d, zero ), c, mHi );
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + x ), _mm_packus_epi16( lo, hi ) );
+        }
+        PixelKernels::blendMaskRowScalar( dst + x, mask + x, colour, count - x );
+    }
+
+    void uniteRowSSE2( QRgb* dst, const QRgb* src, int count )
+    {
+        const __m128i alphaMask = _mm_set1_epi32( static_cast< int >( 0xFF000000 ) );
+        const __m128i zero = _mm_setzero_si128();
+
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+        {
+            __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + x ) );
+            __m128i s = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + x ) );
+
+            __m128i united = _mm_max_epu8( d, s );
+            __m128i keep = _mm_cmpeq_epi32( _mm_and_si128( s, alphaMask ), zero ); // src fully transparent
+            __m128i result = _mm_or_si128( _mm_and_si128( keep, d ), _mm_andnot_si128( keep, united ) );
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + x ), result );
+        }
+        PixelKernels::uniteRowScalar( dst + x, src + x, count - x );
+    }
+
+    void compareAlphaRowSSE2( QRgb* dst, const QRgb* src, int count )
+    {
+        int x = 0;
+        for ( ; x + 4 <= count; x += 4 )
+        {
+            __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + x ) );
+            __m128i s = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + x ) );
+
+            __m128i keep = _mm_cmpgt_epi32( _mm_srli_epi32( d, 24 ), _mm_srli_epi32( s, 24 ) );
+            __m128i result = _mm_or_si128( _mm_and_si128( keep, d ), _mm_andnot_si128( keep, s ) );
+
+            _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + x ), result );
+        }
+        PixelKernels::compareAlphaRowScalar( dst + x, src + x, count - x );
+    }
+
+    PIXELKERNELS_TARGET_AVX2 void uniteRowAVX2( QRgb* dst, const QRgb* src, int count )
+    {
+        const __m256i alphaMask = _mm256_set1_epi32( static_cast< int >( 0xFF000000 ) );
+        const __m256i zero = _mm256_setzero_si256();
+
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8 )
+        {
+            __m256i d = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( dst + x ) );
+            __m256i s = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( src + x ) );
+
+            __m256i united = _mm256_max_epu8( d, s );
+            __m256i keep = _mm256_cmpeq_epi32( _mm256_and_si256( s, alphaMask ), zero );
+            __m256i result = _mm256_or_si256( _mm256_and_si256( keep, d ), _mm256_andnot_si256( keep, united ) );
+
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( dst + x ), result );
+        }
+        uniteRowSSE2( dst + x, src + x, count - x );
+    }
+
+    PIXELKERNELS_TARGET_AVX2 void compareAlphaRowAVX2( QRgb* dst, const QRgb* src, int count )
+    {
+        int x = 0;
+        for ( ; x + 8 <= count; x += 8 )
+        {
+            __m256i d = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( dst + x ) );
+            __m256i s = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( src + x ) );
+
+            __m256i keep = _mm256_cmpgt_epi32( _mm256_srli_epi32( d, 24 ), _mm256_srli_epi32( s, 24 ) );
+            __m256i result = _mm256_or_si256( _mm256_and_si256( keep, d ), _mm256_andnot_si256( keep, s ) );
+
+            _mm256_storeu_si256( reinterpret_cast< __m256i* >( dst + x ), result );
+        }
+        compareAlphaRowSSE2( dst + x, src + x, count - x );
+    }
+
+    bool cpuHasAVX2()
+    {
+#if defined(_MSC_VER)
+        int info[ 4 ];
+        __cpuid( info, 1 );
+        bool osUsesXSave = ( info[ 2 ] & ( 1 << 27 ) ) != 0;
+        bool cpuHasAVX = ( info[ 2 ] & ( 1 << 28 ) ) != 0;
+        if ( !osUsesXSave || !cpuHasAVX )
+        {
+            return false;
+        }
+        if ( ( _xgetbv( 0 ) & 0x6 ) != 0x6 ) // the OS saves the ymm registers
+        {
+            return false;
+        }
+        __cpuidex( info, 7, 0 );
+        return ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) != 0;
+#else
+        return false;
+#endif
+    }
+}
+
+#endif // PIXELKERNELS_X86
+
+namespace
+{
+    typedef void ( *RowKernel )( QRgb*, const QRgb*, int );
+    typedef void ( *MaskKernel )( QRgb*, const uchar*, QRgb, int );
+
+    struct KernelTable
+    {
+        RowKernel unite = PixelKernels::uniteRowScalar;
+        RowKernel compareAlpha = PixelKernels::compareAlphaRowScalar;
+        MaskKernel blendMask = PixelKernels::blendMaskRowScalar;
+        const char* name = "scalar";
+
+        KernelTable()
+        {
+#ifdef PIXELKERNELS_X86
+            blendMask = blendMaskRowSSE2; // no AVX2 version of this one
+            if ( cpuHasAVX2() )
+            {
+                unite = uniteRowAVX2;
+                compareAlpha = compareAlphaRowAVX2;
+                name = "avx2";
+            }
+            else
+            {
+                // SSE2 is part of every x86-64 cpu and of anything Qt 5 runs on
+                unite = uniteRowSSE2;
+                compareAlpha = compareAlphaRowSSE2;
+                name = "sse2";
+            }
+#endif
+        }
+    };
+
+    const KernelTable& kernels()
+    {
+        static KernelTable table;
+        return table;
+    }
+}
+
+void PixelKernels::uniteRow( QRgb* dst, const QRgb* src, int count )
+{
+    kernels().unite( dst, src, count );
+}
+
+void PixelKernels::compareAlphaRow( QRgb* dst, const QRgb* src, int count )
+{
+    kernels().compareAlpha( dst, src, count );
+}
+
+void PixelKernels::blendMaskRow( QRgb* dst, const uchar* mask, QRgb colour, int count )
+{
+    kernels().blendMask( dst, mask, colour, count );
+}
+
+const char* PixelKernels::instructionSet()
+{
+    return kernels().name;
+}
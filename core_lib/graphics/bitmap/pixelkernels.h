@@ -0,0 +1,46 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QColor>
+
+/*
+ * Row kernels working on premultiplied ARGB32 scanlines.
+ * The SSE2 or AVX2 version is picked once at runtime, the scalar
+ * versions are kept public as reference for tests and benchmarks.
+ */
+namespace PixelKernels
+{
+    // dst = per channel max( dst, src ) where src is not fully transparent, on the
+    // premultiplied values as BitmapImage::add() did through QImage::pixel()
+    void uniteRow( QRgb* dst, const QRgb* src, int count );
+    void uniteRowScalar( QRgb* dst, const QRgb* src, int count );
+
+    // dst = src where alpha( dst ) <= alpha( src )
+    void compareAlphaRow( QRgb* dst, const QRgb* src, int count );
+    void compareAlphaRowScalar( QRgb* dst, const QRgb* src, int count );
+
+    // Source over of a premultiplied colour scaled by an 8 bit coverage mask,
+    // dst = colour * mask + dst * ( 1 - alpha( colour * mask ) )
+    void blendMaskRow( QRgb* dst, const uchar* mask, QRgb colour, int count );
+    void blendMaskRowScalar( QRgb* dst, const uchar* mask, QRgb colour, int count );
+
+    const char* instructionSet();
+}
+
+#endif // PIXELKERNELS_H
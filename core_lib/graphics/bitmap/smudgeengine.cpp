@@ -0,0 +1,268 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "smudgeengine.h"
+
+#include <cmath>
+#include <cstring>
+#include <QtMath>
+#include "bitmapimage.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SMUDGEENGINE_X86
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+    inline uint mul255( uint a, uint b )
+    {
+        uint t = a * b + 128;
+        return ( t + ( t >> 8 ) ) >> 8;
+    }
+
+#ifdef SMUDGEENGINE_X86
+    inline __m128i mul255SSE2( __m128i a, __m128i b )
+    {
+        __m128i t = _mm_add_epi16( _mm_mullo_epi16( a, b ), _mm_set1_epi16( 128 ) );
+        return _mm_srli_epi16( _mm_add_epi16( t, _mm_srli_epi16( t, 8 ) ), 8 );
+    }
+#endif
+}
+
+SmudgeEngine::SmudgeEngine( BitmapImage* image, QRect area )
+    : mImage( image )
+    , mArea( area.normalized() )
+{
+    mPixels = mImage->readPixels( mArea );
+}
+
+void SmudgeEngine::liquify( QPointF from, QPointF to, qreal width, qreal feather, qreal opacity )
+{
+    smudge( from, to, width, feather, qRound( 255 * opacity ), true );
+}
+
+void SmudgeEngine::blur( QPointF from, QPointF to, qreal width, qreal feather, qreal opacity )
+{
+    smudge( from, to, width, feather, qRound( 127 * opacity ), false );
+}
+
+void SmudgeEngine::apply()
+{
+    if ( !mPixels.isNull() )
+    {
+        mImage->writePixels( mArea.topLeft(), mPixels );
+    }
+}
+
+void SmudgeEngine::smudge( QPointF from, QPointF to, qreal width, qreal feather, int peakAlpha, bool isLiquify )
+{
+    const qreal radius = 0.5 * width;
+    if ( radius <= 0 || mPixels.isNull() )
+    {
+        return;
+    }
+    const QRect dab = QRectF( to.x() - radius, to.y() - radius, width, width ).toAlignedRect().intersected( mArea );
+    if ( dab.isEmpty() )
+    {
+        return;
+    }
+    const QPointF delta = to - from;
+
+    // the step reads what the previous ones left, not what it writes itself
+    QRectF reach = QRectF( dab ).united( QRectF( dab ).translated( -delta ) );
+    copyToScratch( reach.toAlignedRect().adjusted( -1, -1, 1, 1 ).intersected( mArea ) );
+
+    // the gradient stops of ScribbleArea::setGaussianGradient()
+    const qreal offset = qBound( 0.0, feather, 100.0 ) / 100.0;
+    const int alpha = peakAlpha - qRound( peakAlpha * offset );
+    const qreal solid = 1.0 - offset;
+
+    // the samples of a row are taken first, then the row is blended four pixels at a time
+    const int dabWidth = dab.width();
+    mRowColours.resize( dabWidth );
+    mRowWeights.resize( dabWidth );
+
+    for ( int y = dab.top(); y <= dab.bottom(); y++ )
+    {
+        const qreal dy = y + 0.5 - to.y();
+        for ( int x = dab.left(); x <= dab.right(); x++ )
+        {
+            const int i = x - dab.left();
+            mRowWeights[ i ] = 0;
+
+            const qreal dx = x + 0.5 - to.x();
+            const qreal t = std::sqrt( dx * dx + dy * dy ) / radius;
+            if ( t >= 1.0 )
+            {
+                continue;
+            }
+            const int g = qRound( alpha * ( ( t <= solid ) ? 1.0 : ( 1.0 - t ) / offset ) );
+            if ( g <= 0 )
+            {
+                continue;
+            }
+
+            // liquify drags the centre of the brush further than its edge
+            const qreal k = isLiquify ? g / 255.0 : 1.0;
+            const QRgb s = sample( x - k * delta.x(), y - k * delta.y() );
+            const uint sa = qAlpha( s );
+
+            uint r, gr, b;
+            if ( isLiquify )
+            {
+                // the colour of the pixel at full opacity, white where there is none
+                QRgb c = ( sa == 0 ) ? qRgb( 255, 255, 255 ) : qUnpremultiply( s );
+                r = qRed( c );
+                gr = qGreen( c );
+                b = qBlue( c );
+            }
+            else
+            {
+                // the pixel over white
+                r = qRed( s ) + 255 - sa;
+                gr = qGreen( s ) + 255 - sa;
+                b = qBlue( s ) + 255 - sa;
+            }
+
+            mRowColours[ i ] = qRgba( r, gr, b, 255 );
+            mRowWeights[ i ] = uchar( g );
+        }
+
+        QRgb* row = reinterpret_cast< QRgb* >( mPixels.scanLine( y - mArea.top() ) ) + ( dab.left() - mArea.left() );
+        blendRow( row, mRowColours.data(), mRowWeights.data(), dabWidth );
+    }
+}
+
+void SmudgeEngine::blendRowScalar( QRgb* dst, const QRgb* colour, const uchar* weight, int count )
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        const uint g = weight[ i ];
+        if ( g == 0 )
+        {
+            continue;
+        }
+        const uint inv = 255 - g;
+        const QRgb c = colour[ i ];
+        const QRgb d = dst[ i ];
+        dst[ i ] = qRgba( qMin( 255u, mul255( qRed( c ), g ) + mul255( qRed( d ), inv ) ),
+                          qMin( 255u, mul255( qGreen( c ), g ) + mul255( qGreen( d ), inv ) ),
+                          qMin( 255u, mul255( qBlue( c ), g ) + mul255( qBlue( d ), inv ) ),
+                          qMin( 255u, g + mul255( qAlpha( d ), inv ) ) );
+    }
+}
+
+void SmudgeEngine::blendRow( QRgb* dst, const QRgb* colour, const uchar* weight, int count )
+{
+#ifdef SMUDGEENGINE_X86
+    // two pixels per register in 16 bit lanes, a weight of 0 leaves the pixel as it is
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16( 255 );
+    const __m128i alphaMask = _mm_set1_epi32( static_cast< int >( 0xFF000000 ) );
+
+    int x = 0;
+    for ( ; x + 4 <= count; x += 4 )
+    {
+        int w4;
+        memcpy( &w4, weight + x, 4 );
+        if ( w4 == 0 )
+        {
+            continue; // outside the brush, most of the corners
+        }
+        __m128i w16 = _mm_unpacklo_epi8( _mm_cvtsi32_si128( w4 ), zero ); // w0 w1 w2 w3
+        __m128i w32 = _mm_unpacklo_epi16( w16, w16 );                     // w0 w0 w1 w1 w2 w2 w3 w3
+        __m128i wLo = _mm_unpacklo_epi32( w32, w32 );
+        __m128i wHi = _mm_unpackhi_epi32( w32, w32 );
+
+        __m128i c = _mm_or_si128( _mm_loadu_si128( reinterpret_cast< const __m128i* >( colour + x ) ), alphaMask );
+        __m128i d = _mm_loadu_si128( reinterpret_cast< const __m128i* >( dst + x ) );
+        __m128i lo = _mm_add_epi16( mul255SSE2( _mm_unpacklo_epi8( c, zero ), wLo ),
+                                    mul255SSE2( _mm_unpacklo_epi8( d, zero ), _mm_sub_epi16( full, wLo ) ) );
+        __m128i hi = _mm_add_epi16( mul255SSE2( _mm_unpackhi_epi8( c, zero ), wHi ),
+                                    mul255SSE2( _mm_unpackhi_epi8( d, zero ), _mm_sub_epi16( full, wHi ) ) );
+
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + x ), _mm_packus_epi16( lo, hi ) );
+    }
+    blendRowScalar( dst + x, colour + x, weight + x, count - x );
+#else
+    blendRowScalar( dst, colour, weight, count );
+#endif
+}
+
+void SmudgeEngine::copyToScratch( QRect rect )
+{
+    mScratchRect = rect;
+    mScratchStride = rect.width() + 2;
+    mScratch.assign( size_t( mScratchStride ) * ( rect.height() + 2 ), 0 );
+    for ( int y = rect.top(); y <= rect.bottom(); y++ )
+    {
+        const QRgb* src = reinterpret_cast< const QRgb* >( mPixels.constScanLine( y - mArea.top() ) ) + ( rect.left() - mArea.left() );
+        QRgb* dst = mScratch.data() + size_t( y - rect.top() + 1 ) * mScratchStride + 1;
+        memcpy( dst, src, rect.width() * sizeof( QRgb ) );
+    }
+}
+
+QRgb SmudgeEngine::sample( qreal x, qreal y ) const
+{
+    const int x0 = qFloor( x );
+    const int y0 = qFloor( y );
+    const int wx = qMin( 255, int( ( x - x0 ) * 256 ) );
+    const int wy = qMin( 255, int( ( y - y0 ) * 256 ) );
+
+    // the taps, counting the border
+    const int ix = x0 - mScratchRect.left() + 1;
+    const int iy = y0 - mScratchRect.top() + 1;
+    if ( ix < 0 || iy < 0 || ix + 1 >= mScratchStride || iy + 1 >= mScratchRect.height() + 2 )
+    {
+        return 0;
+    }
+    const QRgb* top = mScratch.data() + size_t( iy ) * mScratchStride + ix;
+    return bilinear( top, top + mScratchStride, wx, wy );
+}
+
+QRgb SmudgeEngine::bilinearScalar( const QRgb* top, const QRgb* bottom, int wx, int wy )
+{
+    auto mix = [ = ]( int shift )
+    {
+        uint t = ( ( ( top[ 0 ] >> shift ) & 0xFF ) * ( 256 - wx ) + ( ( top[ 1 ] >> shift ) & 0xFF ) * wx ) >> 8;
+        uint b = ( ( ( bottom[ 0 ] >> shift ) & 0xFF ) * ( 256 - wx ) + ( ( bottom[ 1 ] >> shift ) & 0xFF ) * wx ) >> 8;
+        return ( ( t * ( 256 - wy ) + b * wy ) >> 8 ) << shift;
+    };
+    return mix( 0 ) | mix( 8 ) | mix( 16 ) | mix( 24 );
+}
+
+QRgb SmudgeEngine::bilinear( const QRgb* top, const QRgb* bottom, int wx, int wy )
+{
+#ifdef SMUDGEENGINE_X86
+    // one pixel's four channels per 16 bit half of a register, the two taps of a row side by side
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsX = _mm_set_epi16( wx, wx, wx, wx, 256 - wx, 256 - wx, 256 - wx, 256 - wx );
+
+    __m128i t = _mm_mullo_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( reinterpret_cast< const __m128i* >( top ) ), zero ), weightsX );
+    __m128i b = _mm_mullo_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( reinterpret_cast< const __m128i* >( bottom ) ), zero ), weightsX );
+    t = _mm_srli_epi16( _mm_add_epi16( t, _mm_srli_si128( t, 8 ) ), 8 );
+    b = _mm_srli_epi16( _mm_add_epi16( b, _mm_srli_si128( b, 8 ) ), 8 );
+
+    __m128i v = _mm_add_epi16( _mm_mullo_epi16( t, _mm_set1_epi16( short( 256 - wy ) ) ),
+                               _mm_mullo_epi16( b, _mm_set1_epi16( short( wy ) ) ) );
+    v = _mm_srli_epi16( v, 8 );
+    return static_cast< QRgb >( _mm_cvtsi128_si32( _mm_packus_epi16( v, v ) ) );
+#else
+    return bilinearScalar( top, bottom, wx, wy );
+#endif
+}
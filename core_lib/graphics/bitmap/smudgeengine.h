@@ -0,0 +1,78 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef SMUDGEENGINE_H
+#define SMUDGEENGINE_H
+
+#include <vector>
+#include <QColor>
+#include <QImage>
+#include <QPointF>
+#include <QRect>
+
+class BitmapImage;
+
+
+/*
+ * Smudges the pixels of one area of a bitmap.
+ * The area is read once, every step of the stroke then works in place on
+ * its rows and apply() writes it back, so a whole input event costs a
+ * single read, write and redraw. Pixels are sampled between their centres
+ * with a bilinear filter and blended into a row four at a time, the SSE2
+ * versions are checked against the scalar ones.
+ */
+class SmudgeEngine
+{
+public:
+    SmudgeEngine( BitmapImage* image, QRect area );
+
+    // Drags the pixels under a round brush from one point to the next, all the
+    // way at its centre and less towards its feathered edge
+    void liquify( QPointF from, QPointF to, qreal width, qreal feather, qreal opacity );
+    // Lays a half transparent copy of the pixels at from over the ones at to
+    void blur( QPointF from, QPointF to, qreal width, qreal feather, qreal opacity );
+
+    void apply();
+
+    // Premultiplied pixels top[ 0 ], top[ 1 ], bottom[ 0 ], bottom[ 1 ] mixed
+    // with weights wx, wy in 1/256 of a pixel
+    static QRgb bilinear( const QRgb* top, const QRgb* bottom, int wx, int wy );
+    static QRgb bilinearScalar( const QRgb* top, const QRgb* bottom, int wx, int wy );
+
+    // dst = colour * weight + dst * ( 255 - weight ), the alpha of colour counts as 255
+    static void blendRow( QRgb* dst, const QRgb* colour, const uchar* weight, int count );
+    static void blendRowScalar( QRgb* dst, const QRgb* colour, const uchar* weight, int count );
+
+private:
+    void smudge( QPointF from, QPointF to, qreal width, qreal feather, int peakAlpha, bool isLiquify );
+    void copyToScratch( QRect rect );
+    QRgb sample( qreal x, qreal y ) const;
+
+    BitmapImage* mImage;
+    QRect  mArea;
+    QImage mPixels;
+
+    // What the current step reads, a copy with a transparent border of one pixel
+    QRect mScratchRect;
+    int   mScratchStride = 0;
+    std::vector< QRgb > mScratch;
+
+    // The samples and brush weights of the row being smudged
+    std::vector< QRgb >  mRowColours;
+    std::vector< uchar > mRowWeights;
+};
+
+#endif // SMUDGEENGINE_H
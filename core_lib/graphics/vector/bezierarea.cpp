@@ -31,7 +31,7 @@ BezierArea::BezierArea(QList<VertexRef> vertexList, int colour)
     mSelected = false;
 }
 
-VertexRef BezierArea::getVertexRef(int i)
+VertexRef BezierArea::getVertexRef(int i) const
 {
     while (i >= mVertex.size() )
     {
@@ -49,7 +49,7 @@ void BezierArea::setSelected(bool YesOrNo)
     mSelected = YesOrNo;
 }
 
-Status BezierArea::createDomElement( QXmlStreamWriter& xmlStream )
+Status BezierArea::createDomElement( QXmlStreamWriter& xmlStream ) const
 {
     xmlStream.writeStartElement( "area" );
     xmlStream.writeAttribute( "colourNumber", QString::number( mColourNumber ) );
@@ -31,11 +31,11 @@ public:
     BezierArea();
     BezierArea(QList<VertexRef> vertexList, int colour);
 
-    Status createDomElement(QXmlStreamWriter& xmlStream);
+    Status createDomElement(QXmlStreamWriter& xmlStream) const;
     void loadDomElement(QDomElement element);
 
-    VertexRef getVertexRef(int i);
-    int getColourNumber() { return mColourNumber; }
+    VertexRef getVertexRef(int i) const;
+    int getColourNumber() const { return mColourNumber; }
     void decreaseColourNumber() { mColourNumber--; }
     void setSelected(bool YesOrNo);
     bool isSelected() const { return mSelected; }
@@ -18,9 +18,50 @@ GNU General Public License for more details.
 #include <cmath>
 #include <QList>
 #include "beziercurve.h"
+#include "cubicsegments.h"
 #include "object.h"
 #include "pencilerror.h"
 
+BezierCurve::CachedPath& BezierCurve::CachedPath::operator=( const CachedPath& other )
+{
+    QPainterPath path;
+    bool ready = other.get( path );
+
+    QMutexLocker locker( &mMutex );
+    mPath = path;
+    mReady = ready;
+    return *this;
+}
+
+bool BezierCurve::CachedPath::get( QPainterPath& path ) const
+{
+    QMutexLocker locker( &mMutex );
+    if ( !mReady )
+    {
+        return false;
+    }
+    path = mPath;
+    return true;
+}
+
+// The first path built wins, a thread which built the same one meanwhile drops its copy
+void BezierCurve::CachedPath::publish( const QPainterPath& path ) const
+{
+    QMutexLocker locker( &mMutex );
+    if ( !mReady )
+    {
+        mPath = path;
+        mReady = true;
+    }
+}
+
+void BezierCurve::CachedPath::reset()
+{
+    QMutexLocker locker( &mMutex );
+    mReady = false;
+    mPath = QPainterPath();
+}
+
 BezierCurve::BezierCurve()
 {
 }
@@ -75,7 +116,7 @@ BezierCurve::BezierCurve(QList<QPointF> pointList, QList<qreal> pressureList, do
 }
 
 
-Status BezierCurve::createDomElement( QXmlStreamWriter& xmlStream )
+Status BezierCurve::createDomElement( QXmlStreamWriter& xmlStream ) const
 {
     xmlStream.writeStartElement( "curve" );
     xmlStream.writeAttribute( "width", QString::number( width ) );
@@ -161,12 +202,14 @@ void BezierCurve::loadDomElement(QDomElement element)
         }
         segmentTag = segmentTag.nextSibling();
     }
+    pointsChanged();
 }
 
 
 void BezierCurve::setOrigin(const QPointF& point)
 {
     origin = point;
+    pointsChanged();
 }
 
 void BezierCurve::setOrigin(const QPointF& point, const qreal& pressureValue, const bool& trueOrFalse)
@@ -174,6 +217,7 @@ void BezierCurve::setOrigin(const QPointF& point, const qreal& pressureValue, co
     origin = point;
     pressure[0] = pressureValue;
     selected[0] = trueOrFalse;
+    pointsChanged();
 }
 
 void BezierCurve::setC1(int i, const QPointF& point)
@@ -181,6 +225,7 @@ void BezierCurve::setC1(int i, const QPointF& point)
     if ( i >= 0 || i < c1.size() )
     {
         c1[i] = point;
+        pointsChanged();
     }
     else
     {
@@ -193,6 +238,7 @@ void BezierCurve::setC2(int i, const QPointF& point)
     if ( i >= 0 || i < c2.size() )
     {
         c2[i] = point;
+        pointsChanged();
     }
     else
     {
@@ -202,12 +248,13 @@ void BezierCurve::setC2(int i, const QPointF& point)
 
 void BezierCurve::setVertex(int i, const QPointF& point)
 {
-    if (i==-1) { origin = point; }
+    if (i==-1) { origin = point; pointsChanged(); }
     else
     {
         if ( i >= 0 || i < vertex.size() )
         {
             vertex[i] = point;
+            pointsChanged();
         }
         else
         {
@@ -221,6 +268,7 @@ void BezierCurve::setLastVertex(const QPointF& point)
     if (vertex.size()>0)
     {
         vertex[vertex.size()-1] = point;
+        pointsChanged();
     }
     else
     {
@@ -232,6 +280,7 @@ void BezierCurve::setLastVertex(const QPointF& point)
 void BezierCurve::setWidth(qreal desiredWidth)
 {
     width = desiredWidth;
+    mStrokedPath.reset();
 }
 
 void BezierCurve::setFeather(qreal desiredFeather)
@@ -254,7 +303,7 @@ void BezierCurve::setSelected(int i, bool YesOrNo)
     selected[i+1] = YesOrNo;
 }
 
-BezierCurve BezierCurve::transformed(QTransform transformation)
+BezierCurve BezierCurve::transformed(QTransform transformation) const
 {
     BezierCurve transformedCurve = *this; // copy the curve
     if (isSelected(-1)) { transformedCurve.setOrigin(transformation.map(origin)); }
@@ -299,6 +348,7 @@ void BezierCurve::transform(QTransform transformation)
             vertex[i] = transformation.map(vertex.at(i));
         }
     }
+    pointsChanged();
     //smoothCurve();
 }
 
@@ -309,6 +359,7 @@ void BezierCurve::appendCubic(const QPointF& c1Point, const QPointF& c2Point, co
     vertex.append(vertexPoint);
     pressure.append(pressureValue);
     selected.append(false);
+    pointsChanged();
 }
 
 void BezierCurve::addPoint(int position, const QPointF point)
@@ -328,6 +379,7 @@ void BezierCurve::addPoint(int position, const QPointF point)
         vertex.insert(position, point);
         pressure.insert(position, getPressure(position));
         selected.insert(position, isSelected(position) && isSelected(position-1));
+        pointsChanged();
 
         //smoothCurve();
     }
@@ -363,6 +415,7 @@ void BezierCurve::addPoint(int position, const qreal t)    // t is the fraction
         vertex.insert(position, vM);
         pressure.insert(position, getPressure(position));
         selected.insert(position, isSelected(position) && isSelected(position-1));
+        pointsChanged();
 
         //smoothCurve();
     }
@@ -401,16 +454,19 @@ void BezierCurve::removeVertex(int i)
                 c1.removeAt(i);
             }
         }
+        pointsChanged();
     }
 }
 
-void BezierCurve::drawPath(QPainter& painter, Object* object, QTransform transformation, bool simplified, bool showThinLines )
+void BezierCurve::drawPath(QPainter& painter, Object* object, QTransform transformation, bool simplified, bool showThinLines ) const
 {
     QColor colour = object->getColour(colourNumber).colour;
 
-    BezierCurve myCurve;
-    if (isPartlySelected()) { myCurve = (transformed(transformation)); }
-    else { myCurve = *this; }
+    // only a moving selection needs new paths, everything else draws the cached ones
+    BezierCurve transformedCurve;
+    bool isTransformed = !transformation.isIdentity() && isPartlySelected();
+    if (isTransformed) { transformedCurve = transformed(transformation); }
+    const BezierCurve& myCurve = isTransformed ? transformedCurve : *this;
 
     if ( variableWidth && !simplified && !invisible)
     {
@@ -486,7 +542,7 @@ void BezierCurve::drawPath(QPainter& painter, Object* object, QTransform transfo
 }
 
 // Without curve fitting
-QPainterPath BezierCurve::getStraightPath()
+QPainterPath BezierCurve::getStraightPath() const
 {
     QPainterPath path;
     path.moveTo(origin);
@@ -498,28 +554,39 @@ QPainterPath BezierCurve::getStraightPath()
 }
 
 // With bezier curve fitting
-QPainterPath BezierCurve::getSimplePath()
+QPainterPath BezierCurve::getSimplePath() const
 {
     QPainterPath path;
+    if (mSimplePath.get(path))
+    {
+        return path;
+    }
     path.moveTo(origin);
     for(int i=0; i<vertex.size(); i++)
     {
         path.cubicTo(c1.at(i), c2.at(i), vertex.at(i));
     }
+    mSimplePath.publish(path);
     return path;
 }
 
-QPainterPath BezierCurve::getStrokedPath()
+QPainterPath BezierCurve::getStrokedPath() const
 {
-    return getStrokedPath( width );
+    QPainterPath path;
+    if (!mStrokedPath.get(path))
+    {
+        path = getStrokedPath( width, true );
+        mStrokedPath.publish(path);
+    }
+    return path;
 }
 
-QPainterPath BezierCurve::getStrokedPath(qreal width)
+QPainterPath BezierCurve::getStrokedPath(qreal width) const
 {
     return getStrokedPath(width, true);
 }
 
-QPainterPath BezierCurve::getStrokedPath(qreal width, bool usePressure)
+QPainterPath BezierCurve::getStrokedPath(qreal width, bool usePressure) const
 {
     QPainterPath path;
     QPointF tangentVec, normalVec, normalVec2, normalVec2_1, normalVec2_2;
@@ -589,7 +656,7 @@ QPainterPath BezierCurve::getStrokedPath(qreal width, bool usePressure)
     return path;
 }
 
-QRectF BezierCurve::getBoundingRect()
+QRectF BezierCurve::getBoundingRect() const
 {
     return getSimplePath().boundingRect();
 }
@@ -668,6 +735,7 @@ void BezierCurve::smoothCurve()
         this->c1[n-1] = c2old;
         this->c2[n-1] = 0.5*(c2old+vertex.at(n-1));
     }
+    pointsChanged();
 }
 
 void BezierCurve::simplify(double tol, QList<QPointF>& inputList, int j, int k, QList<bool>& markList)
@@ -743,32 +811,14 @@ void BezierCurve::normalise(QPointF& point)
     }
 }
 
-qreal BezierCurve::findDistance(BezierCurve curve, int i, QPointF P, QPointF& nearestPoint, qreal& t)   //finds the distance between a cubic section and a point
+qreal BezierCurve::findDistance(const BezierCurve& curve, int i, QPointF P, QPointF& nearestPoint, qreal& t)   //finds the distance between a cubic section and a point
 {
-    //qDebug() << "---- INTER CUBIC SEGMENT";
-    int nSteps = 24;
-    QPointF Q;
-    Q = curve.getVertex(i-1);
-    qreal distMin = eLength(Q-P);
-    nearestPoint = Q;
-    t = 0;
-    for(int k=1; k<=nSteps; k++)
-    {
-        qreal s = (k+0.0)/nSteps;
-        Q = curve.getPointOnCubic(i, s);
-        qreal dist = eLength(Q-P);
-        if (dist <= distMin)
-        {
-            distMin = dist;
-            nearestPoint = Q;
-            t = s;
-        }
-    }
-    //QPointF Q1 = curve.getPointOnCubic(i, t);
-    return distMin;
+    QPointF cubic[4];
+    curve.getCubic(i, cubic);
+    return CubicSegments::distance(cubic, P, nearestPoint, t);
 }
 
-QPointF BezierCurve::getPointOnCubic(int i, qreal t)
+QPointF BezierCurve::getPointOnCubic(int i, qreal t) const
 {
     return (1.0-t)*(1.0-t)*(1.0-t)*getVertex(i-1)
            + 3*t*(1.0-t)*(1.0-t)*getC1(i)
@@ -776,8 +826,16 @@ QPointF BezierCurve::getPointOnCubic(int i, qreal t)
            + t*t*t*getVertex(i);
 }
 
+void BezierCurve::getCubic(int i, QPointF cubic[4]) const
+{
+    cubic[0] = getVertex(i-1);
+    cubic[1] = c1.at(i);
+    cubic[2] = c2.at(i);
+    cubic[3] = vertex.at(i);
+}
+
 
-bool BezierCurve::intersects(QPointF point, qreal distance)
+bool BezierCurve::intersects(QPointF point, qreal distance) const
 {
     bool result = false;
     if ( getStrokedPath(distance, false).contains(point) )
@@ -788,7 +846,7 @@ bool BezierCurve::intersects(QPointF point, qreal distance)
     return result;
 }
 
-bool BezierCurve::intersects(QRectF rectangle)
+bool BezierCurve::intersects(QRectF rectangle) const
 {
     bool result = false;
     if ( getSimplePath().controlPointRect().intersects(rectangle))
@@ -801,78 +859,11 @@ bool BezierCurve::intersects(QRectF rectangle)
     return result;
 }
 
-bool BezierCurve::findIntersection(BezierCurve curve1, int i1, BezierCurve curve2, int i2, QList<Intersection>& intersections)   //finds the intersection between two cubic sections
+bool BezierCurve::findIntersection(const BezierCurve& curve1, int i1, const BezierCurve& curve2, int i2, QList<Intersection>& intersections)   //finds the intersection between two cubic sections
 {
-    bool result = false;
-    //qDebug() << "---- INTER CUBIC CUBIC"  << i1 << i2;
-    QPointF P1, Q1, P2, Q2;
-    QLineF L1, L2;
-    QRectF R1;
-    QRectF R2;
-
-    P1 = curve1.getVertex(i1-1);
-    Q1 = curve1.getVertex(i1);
-    P2 = curve2.getVertex(i2-1);
-    Q2 = curve2.getVertex(i2);
-    L1 = QLineF(P1, Q1);
-    L2 = QLineF(P2, Q2);
-
-    //qDebug() << "-------------------- ";
-
-    R1.setTopLeft(P1);
-    R1.setBottomRight(Q1);
-    R2.setTopLeft(P2);
-    R2.setBottomRight(Q2);
-
-    QPointF intersectionPoint = QPointF(50.0, 50.0); // bogus point
-    QPointF* cubicIntersection = &intersectionPoint;
-    if ( R1.intersects(R2) || L2.intersect(L1, cubicIntersection) == QLineF::BoundedIntersection )
-    {
-        //if (L2.intersect(L1, intersection) == QLineF::BoundedIntersection) {
-        //qDebug() << "                   FOUND rectangle intersection ";
-        //if (intersectionPoint != curve1.getVertex(i1-1) && intersectionPoint != curve1.getVertex(i1)) {
-        //	qDebug() << "                   it's not one of the points ";
-        // find the cubic intersection
-        int nSteps = 24;
-        P1 = curve1.getVertex(i1-1);
-        for(int i=1; i<=nSteps; i++)
-        {
-            qreal s = (i+0.0)/nSteps;
-            Q1 = curve1.getPointOnCubic(i1, s);
-            P2 = curve2.getVertex(i2-1);
-            for(int j=1; j<=nSteps; j++)
-            {
-                qreal t = (j+0.0)/nSteps;
-                Q2 = curve2.getPointOnCubic(i2, t);
-                L1 = QLineF(P1, Q1);
-                L2 = QLineF(P2, Q2);
-                if (L2.intersect(L1, cubicIntersection) == QLineF::BoundedIntersection)
-                {
-                    QPointF intersectionPoint = *cubicIntersection;
-                    if (intersectionPoint != curve1.getVertex(i1-1) && intersectionPoint != curve1.getVertex(i1))
-                    {
-                        qreal fraction1 = eLength(intersectionPoint-Q1)/(0.0+eLength(Q1-P1));
-                        qreal fraction2 = eLength(intersectionPoint-Q2)/(0.0+eLength(Q2-P2));
-                        qreal t1 = (i - fraction1)/nSteps;
-                        qreal t2 = (j - fraction2)/nSteps;
-                        Intersection intersection;
-                        intersection.point = intersectionPoint;
-                        intersection.t1 = t1;
-                        intersection.t2 = t2;
-                        intersections.append( intersection );
-                        result = true;
-                        //qDebug() << "FOUND cubic interesection " << intersectionPoint << i << j;
-                    }
-                }
-                P2 = Q2;
-            }
-            P1 = Q1;
-        }
-    }
-    else
-    {
-        //return false; // approximation to speed up the calculation
-    }
-    //qDebug() << "------";
-    return result;
+    QPointF cubic1[4];
+    QPointF cubic2[4];
+    curve1.getCubic(i1, cubic1);
+    curve2.getCubic(i2, cubic2);
+    return CubicSegments::intersect(cubic1, cubic2, intersections);
 }
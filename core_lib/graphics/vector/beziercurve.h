@@ -18,6 +18,7 @@ GNU General Public License for more details.
 
 #include <QtXml>
 #include <QPainter>
+#include <QMutex>
 
 class Object;
 class Status;
@@ -35,7 +36,7 @@ public:
     BezierCurve(QList<QPointF> pointList);
     BezierCurve(QList<QPointF> pointList, QList<qreal> pressureList, double tol);
 
-    Status createDomElement(QXmlStreamWriter &xmlStream);
+    Status createDomElement(QXmlStreamWriter &xmlStream) const;
     void loadDomElement(QDomElement element);
 
     qreal getWidth() const { return width; }
@@ -53,8 +54,8 @@ public:
     bool isSelected() const { bool result=true; for(int i=0; i<selected.size(); i++) result = result && selected[i]; return result; }
     bool isPartlySelected() const { bool result=false; for(int i=0; i<selected.size(); i++) result = result || selected[i]; return result; }
     bool isInvisible() const { return invisible; }
-    bool intersects(QPointF point, qreal distance);
-    bool intersects(QRectF rectangle);
+    bool intersects(QPointF point, qreal distance) const;
+    bool intersects(QRectF rectangle) const;
 
     void setOrigin(const QPointF& point);
     void setOrigin(const QPointF& point, const qreal& pressureValue, const bool& trueOrFalse);
@@ -70,22 +71,23 @@ public:
     void setSelected(bool YesOrNo) { for(int i=0; i<selected.size(); i++) { selected[i] = YesOrNo; } }
     void setSelected(int i, bool YesOrNo);
 
-    BezierCurve transformed(QTransform transformation);
+    BezierCurve transformed(QTransform transformation) const;
     void transform(QTransform transformation);
 
     void appendCubic(const QPointF& c1Point, const QPointF& c2Point, const QPointF& vertexPoint, qreal pressureValue);
     void addPoint(int position, const QPointF point);
     void addPoint(int position, const qreal t);
-    QPointF getPointOnCubic(int i, qreal t);
+    QPointF getPointOnCubic(int i, qreal t) const;
+    void getCubic(int i, QPointF cubic[4]) const; // the four control points of section i
     void removeVertex(int i);
-    QPainterPath getStraightPath();
-    QPainterPath getSimplePath();
-    QPainterPath getStrokedPath();
-    QPainterPath getStrokedPath(qreal width);
-    QPainterPath getStrokedPath(qreal width, bool pressure);
-    QRectF getBoundingRect();
-
-    void drawPath(QPainter& painter, Object* object, QTransform transformation, bool simplified, bool showThinLines );
+    QPainterPath getStraightPath() const;
+    QPainterPath getSimplePath() const;
+    QPainterPath getStrokedPath() const;
+    QPainterPath getStrokedPath(qreal width) const;
+    QPainterPath getStrokedPath(qreal width, bool pressure) const;
+    QRectF getBoundingRect() const;
+
+    void drawPath(QPainter& painter, Object* object, QTransform transformation, bool simplified, bool showThinLines ) const;
     void createCurve(QList<QPointF>& pointList, QList<qreal>& pressureList );
     void smoothCurve();
 
@@ -95,10 +97,35 @@ public:
     static qreal eLength(const QPointF point); // returns the Euclidean length of a point (seen as a vector)
     static qreal mLength(const QPointF point); // returns the Manhattan length of a point (seen as a vector)
     static void normalise(QPointF& point); // normalises a point (seen as a vector);
-    static qreal findDistance(BezierCurve curve, int i, QPointF P, QPointF& nearestPoint, qreal& t); //finds the distance between a cubic section and a point
-    static bool findIntersection(BezierCurve curve1, int i1, BezierCurve curve2, int i2, QList<Intersection>& intersections); //finds the intersection between two cubic sections
+    static qreal findDistance(const BezierCurve& curve, int i, QPointF P, QPointF& nearestPoint, qreal& t); //finds the distance between a cubic section and a point
+    static bool findIntersection(const BezierCurve& curve1, int i1, const BezierCurve& curve2, int i2, QList<Intersection>& intersections); //finds the intersection between two cubic sections
 
 private:
+    // A path built from the points, kept until they change. Curves can be shared by
+    // images painted on different threads, so reading, publishing and resetting
+    // the path all take the mutex, like the area paths of VectorImage.
+    class CachedPath
+    {
+    public:
+        CachedPath() {}
+        CachedPath( const CachedPath& other ) { *this = other; }
+        CachedPath& operator=( const CachedPath& other );
+
+        bool get( QPainterPath& path ) const;
+        void publish( const QPainterPath& path ) const;
+        void reset();
+
+    private:
+        mutable QMutex mMutex;
+        mutable bool mReady = false;
+        mutable QPainterPath mPath;
+    };
+
+    void pointsChanged() { mSimplePath.reset(); mStrokedPath.reset(); }
+
+    CachedPath mSimplePath;
+    CachedPath mStrokedPath;
+
     QPointF origin;
     QList<QPointF> c1;
     QList<QPointF> c2;
@@ -0,0 +1,234 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "cubicsegments.h"
+#include <QLineF>
+
+
+namespace
+{
+    const int N_STEPS = 24;
+
+    // slack for rectangles of straight sections, which are flat
+    const qreal RECT_MARGIN = 1.0e-3;
+
+    // same expression as BezierCurve::getPointOnCubic, so the samples are identical
+    inline QPointF pointOnCubic( const QPointF cubic[ 4 ], qreal t )
+    {
+        return ( 1.0 - t ) * ( 1.0 - t ) * ( 1.0 - t ) * cubic[ 0 ]
+               + 3 * t * ( 1.0 - t ) * ( 1.0 - t ) * cubic[ 1 ]
+               + 3 * t * t * ( 1.0 - t ) * cubic[ 2 ]
+               + t * t * t * cubic[ 3 ];
+    }
+
+    void sample( const QPointF cubic[ 4 ], QPointF samples[ N_STEPS + 1 ] )
+    {
+        samples[ 0 ] = cubic[ 0 ];
+        for ( int k = 1; k <= N_STEPS; k++ )
+        {
+            samples[ k ] = pointOnCubic( cubic, ( k + 0.0 ) / N_STEPS );
+        }
+    }
+
+    struct Box
+    {
+        qreal left, top, right, bottom;
+    };
+
+    inline Box boxOf( QPointF a, QPointF b )
+    {
+        return Box { qMin( a.x(), b.x() ) - RECT_MARGIN, qMin( a.y(), b.y() ) - RECT_MARGIN,
+                     qMax( a.x(), b.x() ) + RECT_MARGIN, qMax( a.y(), b.y() ) + RECT_MARGIN };
+    }
+
+    inline bool overlap( const Box& a, const Box& b )
+    {
+        return a.left <= b.right && b.left <= a.right && a.top <= b.bottom && b.top <= a.bottom;
+    }
+}
+
+void CubicSegments::clear()
+{
+    for ( QVector< qreal >* v : { &mX0, &mY0, &mX1, &mY1, &mX2, &mY2, &mX3, &mY3 } )
+    {
+        v->clear();
+    }
+}
+
+void CubicSegments::reserve( int count )
+{
+    for ( QVector< qreal >* v : { &mX0, &mY0, &mX1, &mY1, &mX2, &mY2, &mX3, &mY3 } )
+    {
+        v->reserve( count );
+    }
+}
+
+int CubicSegments::append( QPointF p0, QPointF p1, QPointF p2, QPointF p3 )
+{
+    mX0.append( p0.x() ); mY0.append( p0.y() );
+    mX1.append( p1.x() ); mY1.append( p1.y() );
+    mX2.append( p2.x() ); mY2.append( p2.y() );
+    mX3.append( p3.x() ); mY3.append( p3.y() );
+    return size() - 1;
+}
+
+void CubicSegments::appendCurve( const BezierCurve& curve )
+{
+    reserve( size() + curve.getVertexSize() );
+    for ( int i = 0; i < curve.getVertexSize(); i++ )
+    {
+        append( curve.getVertex( i - 1 ), curve.getC1( i ), curve.getC2( i ), curve.getVertex( i ) );
+    }
+}
+
+void CubicSegments::controlPoints( int i, QPointF cubic[ 4 ] ) const
+{
+    cubic[ 0 ] = QPointF( mX0[ i ], mY0[ i ] );
+    cubic[ 1 ] = QPointF( mX1[ i ], mY1[ i ] );
+    cubic[ 2 ] = QPointF( mX2[ i ], mY2[ i ] );
+    cubic[ 3 ] = QPointF( mX3[ i ], mY3[ i ] );
+}
+
+QRectF CubicSegments::boundingRect( int i ) const
+{
+    qreal left = qMin( qMin( mX0[ i ], mX1[ i ] ), qMin( mX2[ i ], mX3[ i ] ) );
+    qreal right = qMax( qMax( mX0[ i ], mX1[ i ] ), qMax( mX2[ i ], mX3[ i ] ) );
+    qreal top = qMin( qMin( mY0[ i ], mY1[ i ] ), qMin( mY2[ i ], mY3[ i ] ) );
+    qreal bottom = qMax( qMax( mY0[ i ], mY1[ i ] ), qMax( mY2[ i ], mY3[ i ] ) );
+    return QRectF( QPointF( left, top ), QPointF( right, bottom ) );
+}
+
+qreal CubicSegments::distance( int i, QPointF point, QPointF& nearestPoint, qreal& t ) const
+{
+    QPointF cubic[ 4 ];
+    controlPoints( i, cubic );
+    return distance( cubic, point, nearestPoint, t );
+}
+
+bool CubicSegments::intersect( int i, const CubicSegments& other, int j, QList< Intersection >& intersections ) const
+{
+    QPointF cubic1[ 4 ];
+    QPointF cubic2[ 4 ];
+    controlPoints( i, cubic1 );
+    other.controlPoints( j, cubic2 );
+    return intersect( cubic1, cubic2, intersections );
+}
+
+void CubicSegments::boundingRects( QVector< QRectF >& rects ) const
+{
+    rects.resize( size() );
+    for ( int i = 0; i < size(); i++ )
+    {
+        rects[ i ] = boundingRect( i );
+    }
+}
+
+QRectF CubicSegments::controlRect( const QPointF cubic[ 4 ] )
+{
+    qreal left = qMin( qMin( cubic[ 0 ].x(), cubic[ 1 ].x() ), qMin( cubic[ 2 ].x(), cubic[ 3 ].x() ) );
+    qreal right = qMax( qMax( cubic[ 0 ].x(), cubic[ 1 ].x() ), qMax( cubic[ 2 ].x(), cubic[ 3 ].x() ) );
+    qreal top = qMin( qMin( cubic[ 0 ].y(), cubic[ 1 ].y() ), qMin( cubic[ 2 ].y(), cubic[ 3 ].y() ) );
+    qreal bottom = qMax( qMax( cubic[ 0 ].y(), cubic[ 1 ].y() ), qMax( cubic[ 2 ].y(), cubic[ 3 ].y() ) );
+    return QRectF( QPointF( left, top ), QPointF( right, bottom ) );
+}
+
+qreal CubicSegments::distance( const QPointF cubic[ 4 ], QPointF point, QPointF& nearestPoint, qreal& t )
+{
+    QPointF q = cubic[ 0 ];
+    qreal distMin = BezierCurve::eLength( q - point );
+    nearestPoint = q;
+    t = 0;
+    for ( int k = 1; k <= N_STEPS; k++ )
+    {
+        qreal s = ( k + 0.0 ) / N_STEPS;
+        q = pointOnCubic( cubic, s );
+        qreal dist = BezierCurve::eLength( q - point );
+        if ( dist <= distMin )
+        {
+            distMin = dist;
+            nearestPoint = q;
+            t = s;
+        }
+    }
+    return distMin;
+}
+
+bool CubicSegments::intersect( const QPointF cubic1[ 4 ], const QPointF cubic2[ 4 ], QList< Intersection >& intersections )
+{
+    // the sampled polylines stay within the rectangles of the control points
+    QRectF rect1 = controlRect( cubic1 ).adjusted( -RECT_MARGIN, -RECT_MARGIN, RECT_MARGIN, RECT_MARGIN );
+    QRectF rect2 = controlRect( cubic2 ).adjusted( -RECT_MARGIN, -RECT_MARGIN, RECT_MARGIN, RECT_MARGIN );
+    if ( !rect1.intersects( rect2 ) )
+    {
+        return false;
+    }
+
+    // the sections are only compared when their chords are close, as always
+    QRectF r1, r2;
+    r1.setTopLeft( cubic1[ 0 ] );
+    r1.setBottomRight( cubic1[ 3 ] );
+    r2.setTopLeft( cubic2[ 0 ] );
+    r2.setBottomRight( cubic2[ 3 ] );
+    QPointF crossing;
+    if ( !r1.intersects( r2 ) &&
+         QLineF( cubic2[ 0 ], cubic2[ 3 ] ).intersect( QLineF( cubic1[ 0 ], cubic1[ 3 ] ), &crossing ) != QLineF::BoundedIntersection )
+    {
+        return false;
+    }
+
+    QPointF samples1[ N_STEPS + 1 ];
+    QPointF samples2[ N_STEPS + 1 ];
+    Box boxes2[ N_STEPS ];
+    sample( cubic1, samples1 );
+    sample( cubic2, samples2 );
+    for ( int j = 0; j < N_STEPS; j++ )
+    {
+        boxes2[ j ] = boxOf( samples2[ j ], samples2[ j + 1 ] );
+    }
+
+    bool result = false;
+    for ( int i = 1; i <= N_STEPS; i++ )
+    {
+        const QPointF& p1 = samples1[ i - 1 ];
+        const QPointF& q1 = samples1[ i ];
+        Box box1 = boxOf( p1, q1 );
+        for ( int j = 1; j <= N_STEPS; j++ )
+        {
+            if ( !overlap( box1, boxes2[ j - 1 ] ) )
+            {
+                continue;
+            }
+            const QPointF& p2 = samples2[ j - 1 ];
+            const QPointF& q2 = samples2[ j ];
+            if ( QLineF( p2, q2 ).intersect( QLineF( p1, q1 ), &crossing ) != QLineF::BoundedIntersection )
+            {
+                continue;
+            }
+            if ( crossing != cubic1[ 0 ] && crossing != cubic1[ 3 ] )
+            {
+                qreal fraction1 = BezierCurve::eLength( crossing - q1 ) / ( 0.0 + BezierCurve::eLength( q1 - p1 ) );
+                qreal fraction2 = BezierCurve::eLength( crossing - q2 ) / ( 0.0 + BezierCurve::eLength( q2 - p2 ) );
+                Intersection intersection;
+                intersection.point = crossing;
+                intersection.t1 = ( i - fraction1 ) / N_STEPS;
+                intersection.t2 = ( j - fraction2 ) / N_STEPS;
+                intersections.append( intersection );
+                result = true;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,56 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+#ifndef CUBICSEGMENTS_H
+#define CUBICSEGMENTS_H
+
+#include <QVector>
+#include <QRectF>
+
+#include "beziercurve.h"
+
+
+/*
+ * Cubic sections stored as flat arrays of control point coordinates, one entry
+ * per section, so the geometry kernels read them without going through the
+ * lists of a BezierCurve. The static kernels take the four control points of
+ * one section and give the same results as sampling it in 24 steps.
+ */
+class CubicSegments
+{
+public:
+    void clear();
+    void reserve( int count );
+    int size() const { return mX0.size(); }
+
+    int append( QPointF p0, QPointF p1, QPointF p2, QPointF p3 );
+    void appendCurve( const BezierCurve& curve );
+
+    void controlPoints( int i, QPointF cubic[ 4 ] ) const;
+    QRectF boundingRect( int i ) const;
+    qreal distance( int i, QPointF point, QPointF& nearestPoint, qreal& t ) const;
+    bool intersect( int i, const CubicSegments& other, int j, QList< Intersection >& intersections ) const;
+
+    void boundingRects( QVector< QRectF >& rects ) const;
+
+    static QRectF controlRect( const QPointF cubic[ 4 ] );
+    static qreal distance( const QPointF cubic[ 4 ], QPointF point, QPointF& nearestPoint, qreal& t );
+    static bool intersect( const QPointF cubic1[ 4 ], const QPointF cubic2[ 4 ], QList< Intersection >& intersections );
+
+private:
+    QVector< qreal > mX0, mY0, mX1, mY1, mX2, mY2, mX3, mY3;
+};
+
+#endif // CUBICSEGMENTS_H
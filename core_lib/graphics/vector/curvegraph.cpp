@@ -0,0 +1,218 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "curvegraph.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace
+{
+    const int SAMPLES_PER_SECTION = 8;
+
+    quint64 cellKey( qint64 x, qint64 y )
+    {
+        return ( quint64( quint32( x ) ) << 32 ) | quint32( y );
+    }
+
+    // direction in which a cubic leaves p0, looking further along when control points coincide
+    qreal leavingAngle( QPointF p0, QPointF p1, QPointF p2, QPointF p3 )
+    {
+        for ( QPointF p : { p1, p2, p3 } )
+        {
+            QPointF d = p - p0;
+            if ( qAbs( d.x() ) + qAbs( d.y() ) > 1.0e-9 )
+            {
+                return std::atan2( d.y(), d.x() );
+            }
+        }
+        return 0.0;
+    }
+}
+
+CurveGraph::CurveGraph( const SharedList< BezierCurve >& curves, const QVector< int >& curveNumbers, qreal mergeDistance )
+    : mCurves( curves )
+    , mMergeDistance( qMax( mergeDistance, 1.0e-3 ) )
+{
+    for ( int curve : curveNumbers )
+    {
+        for ( int section = 0; section < mCurves.at( curve ).getVertexSize(); section++ )
+        {
+            addSection( curve, section );
+        }
+    }
+
+    for ( QVector< int >& outgoing : mOutgoing )
+    {
+        std::sort( outgoing.begin(), outgoing.end(), [ this ]( int a, int b )
+        {
+            return mEdges.at( a ).angle < mEdges.at( b ).angle;
+        } );
+        for ( int i = 0; i < outgoing.size(); i++ )
+        {
+            mEdges[ outgoing.at( i ) ].slot = i;
+        }
+    }
+}
+
+int CurveGraph::nodeAt( QPointF point )
+{
+    qint64 cx = qint64( std::floor( point.x() / mMergeDistance ) );
+    qint64 cy = qint64( std::floor( point.y() / mMergeDistance ) );
+    for ( qint64 y = cy - 1; y <= cy + 1; y++ )
+    {
+        for ( qint64 x = cx - 1; x <= cx + 1; x++ )
+        {
+            for ( int node : mNodeCells.value( cellKey( x, y ) ) )
+            {
+                if ( BezierCurve::eLength( mNodes.at( node ) - point ) <= mMergeDistance )
+                {
+                    return node;
+                }
+            }
+        }
+    }
+
+    mNodes.append( point );
+    mOutgoing.append( QVector< int >() );
+    mNodeCells[ cellKey( cx, cy ) ].append( mNodes.size() - 1 );
+    return mNodes.size() - 1;
+}
+
+void CurveGraph::addSection( int curve, int section )
+{
+    const BezierCurve& c = mCurves.at( curve );
+    QPointF p0 = c.getVertex( section - 1 );
+    QPointF p1 = c.getC1( section );
+    QPointF p2 = c.getC2( section );
+    QPointF p3 = c.getVertex( section );
+
+    int from = nodeAt( p0 );
+    int to = nodeAt( p3 );
+    if ( from == to && BezierCurve::eLength( p1 - p0 ) + BezierCurve::eLength( p2 - p0 ) <= mMergeDistance )
+    {
+        return; // collapsed to a point
+    }
+
+    HalfEdge forward { curve, section, true, from, to, leavingAngle( p0, p1, p2, p3 ), 0 };
+    HalfEdge backward { curve, section, false, to, from, leavingAngle( p3, p2, p1, p0 ), 0 };
+    mOutgoing[ from ].append( mEdges.size() );
+    mEdges.append( forward );
+    mOutgoing[ to ].append( mEdges.size() );
+    mEdges.append( backward );
+}
+
+// Keeps the face on the left: leave the end node by the edge just clockwise of the way back
+int CurveGraph::nextEdge( int edge ) const
+{
+    const HalfEdge& back = mEdges.at( edge ^ 1 );
+    const QVector< int >& outgoing = mOutgoing.at( back.from );
+    return outgoing.at( ( back.slot + outgoing.size() - 1 ) % outgoing.size() );
+}
+
+void CurveGraph::appendSamples( const HalfEdge& edge, QPolygonF& polygon ) const
+{
+    const BezierCurve& c = mCurves.at( edge.curve );
+    for ( int k = 1; k <= SAMPLES_PER_SECTION; k++ )
+    {
+        qreal t = qreal( k ) / SAMPLES_PER_SECTION;
+        polygon.append( c.getPointOnCubic( edge.section, edge.forward ? t : 1.0 - t ) );
+    }
+}
+
+QList< VertexRef > CurveGraph::enclosingFace( QPointF point, QRectF* bounds ) const
+{
+    QVector< bool > visited( mEdges.size(), false );
+    QVector< int > best;
+    QRectF bestBounds;
+    qreal bestArea = std::numeric_limits< qreal >::max();
+
+    QVector< int > face;
+    QPolygonF polygon;
+    for ( int first = 0; first < mEdges.size(); first++ )
+    {
+        if ( visited.at( first ) )
+        {
+            continue;
+        }
+
+        face.clear();
+        int edge = first;
+        do
+        {
+            visited[ edge ] = true;
+            face.append( edge );
+            edge = nextEdge( edge );
+        } while ( edge != first && face.size() <= mEdges.size() );
+
+        if ( edge != first )
+        {
+            continue;
+        }
+
+        polygon.clear();
+        for ( int e : face )
+        {
+            appendSamples( mEdges.at( e ), polygon );
+        }
+
+        // bounded faces come out with a positive signed area, outer boundaries negative
+        qreal area = 0;
+        for ( int i = 0; i < polygon.size(); i++ )
+        {
+            const QPointF& a = polygon.at( i );
+            const QPointF& b = polygon.at( ( i + 1 ) % polygon.size() );
+            area += a.x() * b.y() - b.x() * a.y();
+        }
+        area *= 0.5;
+        if ( area <= 1.0e-6 || area >= bestArea )
+        {
+            continue;
+        }
+
+        QRectF faceBounds = polygon.boundingRect();
+        if ( faceBounds.contains( point ) && polygon.containsPoint( point, Qt::WindingFill ) )
+        {
+            best = face;
+            bestBounds = faceBounds;
+            bestArea = area;
+        }
+    }
+
+    QList< VertexRef > result;
+    for ( int e : best )
+    {
+        const HalfEdge& edge = mEdges.at( e );
+        VertexRef start( edge.curve, edge.forward ? edge.section - 1 : edge.section );
+        VertexRef end( edge.curve, edge.forward ? edge.section : edge.section - 1 );
+        if ( result.isEmpty() || !( result.last() == start ) )
+        {
+            result.append( start );
+        }
+        result.append( end );
+    }
+    if ( result.size() > 1 && result.first() == result.last() )
+    {
+        result.removeLast();
+    }
+
+    if ( bounds != nullptr )
+    {
+        *bounds = bestBounds;
+    }
+    return result;
+}
@@ -0,0 +1,68 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+#ifndef CURVEGRAPH_H
+#define CURVEGRAPH_H
+
+#include <QHash>
+#include <QVector>
+#include <QPolygonF>
+
+#include "beziercurve.h"
+#include "sharedlist.h"
+#include "vertexref.h"
+
+
+/*
+ * Planar graph made of the cubic sections of some curves. Vertices closer than
+ * the merge distance become one node, the faces are found by walking around the
+ * nodes in angular order. Crossing curves have to be split at their crossings
+ * beforehand, the graph only connects curves at their vertices.
+ */
+class CurveGraph
+{
+public:
+    CurveGraph( const SharedList< BezierCurve >& curves, const QVector< int >& curveNumbers, qreal mergeDistance );
+
+    // Vertices around the smallest face containing the point, empty when no face encloses it
+    QList< VertexRef > enclosingFace( QPointF point, QRectF* bounds = nullptr ) const;
+
+private:
+    struct HalfEdge
+    {
+        int curve;
+        int section;  // cubic section of the curve, from vertex section - 1 to vertex section
+        bool forward; // in the direction of the curve
+        int from;
+        int to;
+        qreal angle;  // of the tangent leaving the from node
+        int slot;     // position in the outgoing edges of the from node
+    };
+
+    int  nodeAt( QPointF point );
+    void addSection( int curve, int section );
+    int  nextEdge( int edge ) const;
+    void appendSamples( const HalfEdge& edge, QPolygonF& polygon ) const;
+
+    const SharedList< BezierCurve >& mCurves;
+    qreal mMergeDistance;
+
+    QVector< QPointF > mNodes;
+    QHash< quint64, QVector< int > > mNodeCells;
+    QVector< HalfEdge > mEdges; // in pairs, edge ^ 1 is the same section walked the other way
+    QVector< QVector< int > > mOutgoing; // per node, by increasing angle
+};
+
+#endif // CURVEGRAPH_H
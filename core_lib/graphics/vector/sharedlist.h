@@ -0,0 +1,79 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+#ifndef SHAREDLIST_H
+#define SHAREDLIST_H
+
+#include <memory>
+#include <QVector>
+
+
+/*
+ * List whose items are shared between copies of the list. Copying the list
+ * costs one pointer per item, an item is only copied the first time it is
+ * written through a list which shares it. Writing means operator[] on a
+ * non-const list, read with at() to keep the sharing.
+ */
+template< typename T >
+class SharedList
+{
+    typedef QVector< std::shared_ptr< T > > Items;
+
+public:
+    class const_iterator
+    {
+    public:
+        explicit const_iterator( typename Items::const_iterator it ) : mIt( it ) {}
+        const T& operator*() const { return **mIt; }
+        const T* operator->() const { return mIt->get(); }
+        const_iterator& operator++() { ++mIt; return *this; }
+        bool operator==( const const_iterator& o ) const { return mIt == o.mIt; }
+        bool operator!=( const const_iterator& o ) const { return mIt != o.mIt; }
+    private:
+        typename Items::const_iterator mIt;
+    };
+
+    int  size() const { return mItems.size(); }
+    bool isEmpty() const { return mItems.isEmpty(); }
+
+    const T& at( int i ) const { return *mItems.at( i ); }
+    const T& operator[]( int i ) const { return *mItems.at( i ); }
+    T& operator[]( int i )
+    {
+        std::shared_ptr< T >& item = mItems[ i ];
+        if ( item.use_count() > 1 )
+        {
+            item = std::make_shared< T >( *item );
+        }
+        return *item;
+    }
+
+    void append( const T& t ) { mItems.append( std::make_shared< T >( t ) ); }
+    void insert( int i, const T& t ) { mItems.insert( i, std::make_shared< T >( t ) ); }
+    void removeAt( int i ) { mItems.remove( i ); }
+    void clear() { mItems.clear(); }
+
+    const_iterator begin() const { return const_iterator( mItems.constBegin() ); }
+    const_iterator end() const { return const_iterator( mItems.constEnd() ); }
+
+    // Owners of item i, copies of a list which haven't been written to yet count once
+    long useCount( int i ) const { return mItems.at( i ).use_count(); }
+    bool isSharedWith( int i, const SharedList& other, int j ) const { return mItems.at( i ) == other.mItems.at( j ); }
+
+private:
+    Items mItems;
+};
+
+#endif // SHAREDLIST_H
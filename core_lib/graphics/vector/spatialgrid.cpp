@@ -0,0 +1,150 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "spatialgrid.h"
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+    // rectangles spanning more cells go to the list of large items
+    const int MAX_CELLS_PER_RECT = 256;
+}
+
+SpatialGrid::SpatialGrid( qreal cellSize ) : mCellSize( cellSize )
+{
+}
+
+void SpatialGrid::clear()
+{
+    mCells.clear();
+    mItemCells.clear();
+    mLargeItems.clear();
+    mIsValid = false;
+}
+
+bool SpatialGrid::cellRange( const QRectF& rect, int& x1, int& y1, int& x2, int& y2 ) const
+{
+    const qreal limit = 1.0e6;
+    QRectF r = rect.normalized();
+    if ( !( r.left() > -limit && r.right() < limit && r.top() > -limit && r.bottom() < limit ) )
+    {
+        return false; // also catches NaN
+    }
+    x1 = int( std::floor( r.left() / mCellSize ) );
+    y1 = int( std::floor( r.top() / mCellSize ) );
+    x2 = int( std::floor( r.right() / mCellSize ) );
+    y2 = int( std::floor( r.bottom() / mCellSize ) );
+    return true;
+}
+
+void SpatialGrid::insert( int item, const QRectF& rect )
+{
+    int x1, y1, x2, y2;
+    if ( !cellRange( rect, x1, y1, x2, y2 ) ||
+         qint64( x2 - x1 + 1 ) * ( y2 - y1 + 1 ) > MAX_CELLS_PER_RECT )
+    {
+        if ( !mLargeItems.contains( item ) )
+        {
+            mLargeItems.append( item );
+        }
+        return;
+    }
+
+    QVector< quint64 >& itemCells = mItemCells[ item ];
+    for ( int y = y1; y <= y2; y++ )
+    {
+        for ( int x = x1; x <= x2; x++ )
+        {
+            quint64 key = cellKey( x, y );
+            if ( itemCells.contains( key ) )
+            {
+                continue;
+            }
+            itemCells.append( key );
+            mCells[ key ].append( item );
+        }
+    }
+}
+
+void SpatialGrid::remove( int item )
+{
+    mLargeItems.removeOne( item );
+
+    auto it = mItemCells.find( item );
+    if ( it == mItemCells.end() )
+    {
+        return;
+    }
+    for ( quint64 key : it.value() )
+    {
+        auto cell = mCells.find( key );
+        if ( cell == mCells.end() )
+        {
+            continue;
+        }
+        cell.value().removeOne( item );
+        if ( cell.value().isEmpty() )
+        {
+            mCells.erase( cell );
+        }
+    }
+    mItemCells.erase( it );
+}
+
+QVector< int > SpatialGrid::query( const QRectF& rect ) const
+{
+    QVector< int > result = mLargeItems;
+
+    int x1, y1, x2, y2;
+    if ( !cellRange( rect, x1, y1, x2, y2 ) ||
+         qint64( x2 - x1 + 1 ) * ( y2 - y1 + 1 ) > mCells.size() )
+    {
+        // cheaper to visit the occupied cells than the covered ones
+        QRectF r = rect.normalized();
+        for ( auto cell = mCells.constBegin(); cell != mCells.constEnd(); ++cell )
+        {
+            int x = int( qint32( cell.key() >> 32 ) );
+            int y = int( qint32( cell.key() & 0xFFFFFFFF ) );
+            qreal left = x * mCellSize;
+            qreal top = y * mCellSize;
+            if ( left <= r.right() && left + mCellSize >= r.left() &&
+                 top <= r.bottom() && top + mCellSize >= r.top() )
+            {
+                result += cell.value();
+            }
+        }
+    }
+    else
+    {
+        for ( int y = y1; y <= y2; y++ )
+        {
+            for ( int x = x1; x <= x2; x++ )
+            {
+                auto cell = mCells.constFind( cellKey( x, y ) );
+                if ( cell != mCells.constEnd() )
+                {
+                    result += cell.value();
+                }
+            }
+        }
+    }
+
+    std::sort( result.begin(), result.end() );
+    result.erase( std::unique( result.begin(), result.end() ), result.end() );
+    return result;
+}
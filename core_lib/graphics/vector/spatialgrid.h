@@ -0,0 +1,59 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <QHash>
+#include <QVector>
+#include <QRectF>
+
+
+/*
+ * Uniform grid of item numbers bucketed by bounding rectangles. An item may
+ * be inserted with several rectangles, queries return every item with a
+ * rectangle touching the query cell-wise, so callers still do the exact test.
+ * The grid is a cache: copies keep the cell size but start out invalid and
+ * empty, they are rebuilt by their owner.
+ */
+class SpatialGrid
+{
+public:
+    explicit SpatialGrid( qreal cellSize = 64.0 );
+    SpatialGrid( const SpatialGrid& other ) : mCellSize( other.mCellSize ) {}
+    SpatialGrid& operator=( const SpatialGrid& other ) { clear(); mCellSize = other.mCellSize; return *this; }
+
+    bool isValid() const { return mIsValid; }
+    void setValid() { mIsValid = true; }
+    void clear();
+
+    void insert( int item, const QRectF& rect );
+    void remove( int item );
+
+    // Sorted item numbers without duplicates
+    QVector< int > query( const QRectF& rect ) const;
+
+private:
+    bool cellRange( const QRectF& rect, int& x1, int& y1, int& x2, int& y2 ) const;
+    static quint64 cellKey( int x, int y ) { return ( quint64( quint32( x ) ) << 32 ) | quint32( y ); }
+
+    qreal mCellSize;
+    bool mIsValid = false;
+    QHash< quint64, QVector< int > > mCells;
+    QHash< int, QVector< quint64 > > mItemCells; // cells each item was put in
+    QVector< int > mLargeItems; // items too big to bucket, returned by every query
+};
+
+#endif // SPATIALGRID_H
@@ -15,10 +15,37 @@ GNU General Public License for more details.
 
 */
 #include <cmath>
+#include <algorithm>
 #include "object.h"
+#include "cubicsegments.h"
+#include "curvegraph.h"
 #include "vectorimage.h"
 
 
+namespace
+{
+    // bounding box of the control points of cubic section i, the section lies inside it
+    QRectF sectionRect(const BezierCurve& curve, int i)
+    {
+        QPointF p[4] = { curve.getVertex(i-1), curve.getC1(i), curve.getC2(i), curve.getVertex(i) };
+        qreal left = p[0].x(), right = p[0].x(), top = p[0].y(), bottom = p[0].y();
+        for (int k = 1; k < 4; k++)
+        {
+            left = qMin(left, p[k].x());
+            right = qMax(right, p[k].x());
+            top = qMin(top, p[k].y());
+            bottom = qMax(bottom, p[k].y());
+        }
+        return QRectF(QPointF(left, top), QPointF(right, bottom));
+    }
+
+    QRectF squareAround(QPointF point, qreal distance)
+    {
+        return QRectF(point.x() - distance, point.y() - distance, 2 * distance, 2 * distance);
+    }
+}
+
+
 VectorImage::VectorImage()
 {
     deselectAll();
@@ -109,7 +136,7 @@ Status VectorImage::createDomElement( QXmlStreamWriter& xmlStream )
     QStringList debugInfo = QStringList() << "VectorImage::createDomElement";
     for ( int i = 0; i < m_curves.size(); i++ )
     {
-        Status st = m_curves[ i ].createDomElement( xmlStream );
+        Status st = m_curves.at( i ).createDomElement( xmlStream );
         if ( !st.ok() )
         {
             QStringList curveDetails = st.detailsList();
@@ -122,7 +149,7 @@ Status VectorImage::createDomElement( QXmlStreamWriter& xmlStream )
     }
     for ( int i = 0; i < area.size(); i++ )
     {
-        Status st = area[ i ].createDomElement( xmlStream );
+        Status st = area.at( i ).createDomElement( xmlStream );
         if ( !st.ok() )
         {
             QStringList areaDetails = st.detailsList();
@@ -160,6 +187,8 @@ void VectorImage::loadDomElement(QDomElement element)
         atomTag = atomTag.nextSibling();
     }
     clean();
+    mCurveIndex.clear();
+    mAreaIndex.clear();
     modification();
 }
 
@@ -167,15 +196,16 @@ void VectorImage::addPoint(int curveNumber, int vertexNumber, qreal t)
 {
     //curve[curveNumber].addPoint(vertexNumber, point);
     m_curves[curveNumber].addPoint(vertexNumber, t);
+    updateCurveIndex(curveNumber);
     // updates the bezierAreas
     for(int j=0; j < area.size(); j++)
     {
         // shift the references of all the points beyond the new point
         for(int k=0; k< area.at(j).mVertex.size(); k++)
         {
-            if (area[j].getVertexRef(k).curveNumber == curveNumber)
+            if (area.at(j).getVertexRef(k).curveNumber == curveNumber)
             {
-                if (area[j].getVertexRef(k).vertexNumber >= vertexNumber)
+                if (area.at(j).getVertexRef(k).vertexNumber >= vertexNumber)
                 {
                     area[j].mVertex[k].vertexNumber++;
                 }
@@ -214,6 +244,15 @@ void VectorImage::removeCurveAt(int i)
     }
     // then remove curve
     m_curves.removeAt(i);
+    modification();
+    if (i == m_curves.size())
+    {
+        mCurveIndex.remove(i);
+    }
+    else
+    {
+        mCurveIndex.clear(); // the following curve numbers shift
+    }
 }
 
 void VectorImage::insertCurve(int position, BezierCurve& newCurve, qreal factor, bool interacts)
@@ -233,6 +272,7 @@ void VectorImage::insertCurve(int position, BezierCurve& newCurve, qreal factor,
         qreal tol = qMax( newCurve.getWidth() / factor, 3.0 / factor);
         //qDebug() << "tolerance" << tol;
 
+        ensureCurveIndex();
         checkCurveExtremity(newCurve, tol);
         checkCurveIntersections(newCurve, tol);
     }
@@ -242,6 +282,7 @@ void VectorImage::insertCurve(int position, BezierCurve& newCurve, qreal factor,
     //
     if (position < 0 || position > m_curves.size() - 1) {
         m_curves.append(newCurve);
+        updateCurveIndex(m_curves.size() - 1);
     }
     else {
         // If it's an insert we have to shift the curve numbers in the areas
@@ -256,6 +297,7 @@ void VectorImage::insertCurve(int position, BezierCurve& newCurve, qreal factor,
             }
         }
         m_curves.insert(position, newCurve);
+        mCurveIndex.clear();
     }
 
 
@@ -281,7 +323,16 @@ void VectorImage::checkCurveExtremity(BezierCurve& newCurve, qreal tolerance)
         newCurve.setVertex(newCurve.getVertexSize()-1, P);
     }
     // finds if the first or last point of the new curve is close to other curves
-    for(int i=0; i < m_curves.size(); i++)   // for each other curve
+    // the end points only snap to things within the tolerance, so curves further
+    // than twice the tolerance from them can't be affected
+    QVector<int> nearbyCurves = getCurvesNear(squareAround(newCurve.getVertex(-1), 2*tolerance));
+    for (int i : getCurvesNear(squareAround(newCurve.getVertex(newCurve.getVertexSize()-1), 2*tolerance)))
+    {
+        if (!nearbyCurves.contains(i)) nearbyCurves.append(i);
+    }
+    std::sort(nearbyCurves.begin(), nearbyCurves.end());
+
+    for(int i : nearbyCurves)   // for each other curve
     {
         for(int j=0; j < m_curves.at(i).getVertexSize(); j++)   // for each cubic section of the other curve
         {
@@ -308,7 +359,7 @@ void VectorImage::checkCurveExtremity(BezierCurve& newCurve, qreal tolerance)
                     {
                         QPointF nearestPoint = P;
                         qreal t = -1.0;
-                        qreal distance = BezierCurve::findDistance(m_curves[i], j, P, nearestPoint, t);
+                        qreal distance = BezierCurve::findDistance(m_curves.at(i), j, P, nearestPoint, t);
                         if (distance < tolerance)
                         {
                             newCurve.setOrigin(nearestPoint); //qDebug() << "--d " << nearestPoint;
@@ -338,7 +389,7 @@ void VectorImage::checkCurveExtremity(BezierCurve& newCurve, qreal tolerance)
                     {
                         QPointF nearestPoint = Q;
                         qreal t = -1.0;;
-                        qreal distance = BezierCurve::findDistance(m_curves[i], j, Q, nearestPoint, t);
+                        qreal distance = BezierCurve::findDistance(m_curves.at(i), j, Q, nearestPoint, t);
                         if (distance < tolerance)
                         {
                             newCurve.setLastVertex(nearestPoint); //qDebug() << "--g " << nearestPoint;
@@ -385,8 +436,12 @@ void VectorImage::checkCurveIntersections(BezierCurve& newCurve, qreal tolerance
         //if (k==newCurve.getVertexSize()-1) L1 = QLineF(P1, Q1- 1.5*tol*(P1-Q1)/BezierCurve::eLength(P1-Q1));  // we extend slightly the line for the last point
         //QPointF extension1 = 1.5*tol*(P1-Q1)/BezierCurve::eLength(P1-Q1);
         //L1 = QLineF(P1 + extension1, Q1 - extension1);
-        for(int i=0; i < m_curves.size(); i++)   // for each other curve // TO DO: should only loop on "nearby" curves instead of all
+        // only the curves whose sections come within the tolerance of this section can touch it
+        QRectF sectionBounds = sectionRect(newCurve, k).adjusted(-tolerance, -tolerance, tolerance, tolerance);
+        for(int i : getCurvesNear(sectionBounds))   // for each nearby curve
         {
+            bool moved = false;
+
             //BezierCurve otherCurve;
             //if (i==-1) { otherCurve = newCurve; } else {  otherCurve = curve.at(i); }
 
@@ -401,13 +456,13 @@ void VectorImage::checkCurveIntersections(BezierCurve& newCurve, qreal tolerance
 
             if (dist1 < 0.2*tolerance)
             {
-                m_curves[i].setVertex(-1, P1);  // memo: curve.at(i) is just a copy which can be read, curve[i] is a reference which can be modified
+                m_curves[i].setVertex(-1, P1); moved = true;  // memo: curve.at(i) is just a copy which can be read, curve[i] is a reference which can be modified
             }
             else
             {
                 if (dist2 < 0.2*tolerance)
                 {
-                    m_curves[i].setVertex(-1, P2);
+                    m_curves[i].setVertex(-1, P2); moved = true;
                 }
                 else
                 {
@@ -432,13 +487,13 @@ void VectorImage::checkCurveIntersections(BezierCurve& newCurve, qreal tolerance
             dist2 = BezierCurve::eLength(Q-P2);
             if (dist1 < 0.2*tolerance)
             {
-                m_curves[i].setVertex(m_curves.at(i).getVertexSize()-1, P1);
+                m_curves[i].setVertex(m_curves.at(i).getVertexSize()-1, P1); moved = true;
             }
             else
             {
                 if (dist2 < 0.2*tolerance)
                 {
-                    m_curves[i].setVertex(m_curves.at(i).getVertexSize()-1, P2);
+                    m_curves[i].setVertex(m_curves.at(i).getVertexSize()-1, P2); moved = true;
                 }
                 else
                 {
@@ -493,14 +548,14 @@ void VectorImage::checkCurveIntersections(BezierCurve& newCurve, qreal tolerance
                     }
                     if ( BezierCurve::eLength(intersectionPoint - m_curves.at(i).getVertex(j-1)) <= 0.1*tolerance )   // the first point is close to the intersection
                     {
-                        m_curves[i].setVertex(j-1, intersectionPoint); //qDebug() << "--n " << intersectionPoint;
+                        m_curves[i].setVertex(j-1, intersectionPoint); moved = true; //qDebug() << "--n " << intersectionPoint;
                         //qDebug() << "-------- recal2 " << j-1 << intersectionPoint;
                     }
                     else
                     {
                         if ( BezierCurve::eLength(intersectionPoint - m_curves.at(i).getVertex(j)) <= 0.1*tolerance )   // the second point is close to the intersection
                         {
-                            m_curves[i].setVertex(j, intersectionPoint); //qDebug() << "--o " << intersectionPoint;
+                            m_curves[i].setVertex(j, intersectionPoint); moved = true; //qDebug() << "--o " << intersectionPoint;
                             //qDebug() << "-------- recal2 " << j << intersectionPoint;
                         }
                         else     // none of the point is close to the intersection -> we add a new point
@@ -512,6 +567,7 @@ void VectorImage::checkCurveIntersections(BezierCurve& newCurve, qreal tolerance
                     }
                 }
             }
+            if (moved) updateCurveIndex(i);
         }
     }
 }
@@ -520,7 +576,7 @@ void VectorImage::select(QRectF rectangle)
 {
     for(int i=0; i< m_curves.size(); i++)
     {
-        if ( m_curves[i].intersects(rectangle) )
+        if ( m_curves.at(i).intersects(rectangle) )
         {
             setSelected(i, true);
         }
@@ -529,9 +585,10 @@ void VectorImage::select(QRectF rectangle)
             setSelected(i, false);
         }
     }
+    updateAreaPaths();
     for(int i=0; i< area.size(); i++)
     {
-        if ( rectangle.contains(area[i].mPath.boundingRect()) )
+        if ( rectangle.contains(area.at(i).mPath.boundingRect()) )
         {
             setAreaSelected(i, true);
         }
@@ -545,14 +602,20 @@ void VectorImage::select(QRectF rectangle)
 
 void VectorImage::setSelected(int curveNumber, bool YesOrNo)
 {
-    m_curves[curveNumber].setSelected(YesOrNo);
-    if (YesOrNo) mSelectionRect |= m_curves[curveNumber].getBoundingRect();
+    // writing would unshare the curve from the undo snapshots, only do it for a change
+    const BezierCurve& curve = m_curves.at(curveNumber);
+    bool unchanged = YesOrNo ? curve.isSelected() : !curve.isPartlySelected();
+    if (!unchanged) m_curves[curveNumber].setSelected(YesOrNo);
+    if (YesOrNo) mSelectionRect |= m_curves.at(curveNumber).getBoundingRect();
     modification();
 }
 
 void VectorImage::setSelected(int curveNumber, int vertexNumber, bool YesOrNo)
 {
-    m_curves[curveNumber].setSelected(vertexNumber, YesOrNo);
+    if (m_curves.at(curveNumber).isSelected(vertexNumber) != YesOrNo)
+    {
+        m_curves[curveNumber].setSelected(vertexNumber, YesOrNo);
+    }
     QPointF vertex = getVertex(curveNumber, vertexNumber);
     if (YesOrNo) mSelectionRect |= QRectF(vertex.x(), vertex.y(), 0.0, 0.0);
     modification();
@@ -581,24 +644,24 @@ void VectorImage::setSelected(QList<VertexRef> vertexList, bool YesOrNo)
 
 void VectorImage::setAreaSelected(int areaNumber, bool YesOrNo)
 {
-    area[areaNumber].setSelected(YesOrNo);
-    if (YesOrNo) mSelectionRect |= area[areaNumber].mPath.boundingRect();
+    if (area.at(areaNumber).isSelected() != YesOrNo) area[areaNumber].setSelected(YesOrNo);
+    if (YesOrNo) mSelectionRect |= area.at(areaNumber).mPath.boundingRect();
     modification();
 }
 
 bool VectorImage::isAreaSelected(int areaNumber)
 {
-    return area[areaNumber].isSelected();
+    return area.at(areaNumber).isSelected();
 }
 
 bool VectorImage::isSelected(int curveNumber)
 {
-    return m_curves[curveNumber].isSelected();
+    return m_curves.at(curveNumber).isSelected();
 }
 
 bool VectorImage::isSelected(int curveNumber, int vertexNumber)
 {
-    return m_curves[curveNumber].isSelected(vertexNumber);
+    return m_curves.at(curveNumber).isSelected(vertexNumber);
 }
 
 bool VectorImage::isSelected(VertexRef vertexRef)
@@ -661,11 +724,11 @@ void VectorImage::deselectAll()
 {
     for(int i=0; i< m_curves.size(); i++)
     {
-        m_curves[i].setSelected(false);
+        if (m_curves.at(i).isPartlySelected()) m_curves[i].setSelected(false);
     }
     for(int i=0; i< area.size(); i++)
     {
-        area[i].setSelected(false);
+        if (area.at(i).isSelected()) area[i].setSelected(false);
     }
     mSelectionRect = QRectF(0,0,0,0);
     mSelectionTransformation.reset();
@@ -683,7 +746,7 @@ void VectorImage::calculateSelectionRect()
     mSelectionRect = QRectF(0,0,0,0);
     for(int i=0; i< m_curves.size(); i++)
     {
-        if ( m_curves.at(i).isPartlySelected()) mSelectionRect |= m_curves[i].getBoundingRect();
+        if ( m_curves.at(i).isPartlySelected()) mSelectionRect |= m_curves.at(i).getBoundingRect();
     }
 }
 
@@ -698,7 +761,7 @@ void VectorImage::deleteSelection()
     // ---- deletes areas
     for(int i=0; i< area.size(); i++)
     {
-        if ( area[i].isSelected())
+        if ( area.at(i).isSelected())
         {
             area.removeAt(i);
             i--;
@@ -707,7 +770,7 @@ void VectorImage::deleteSelection()
     // ---- deletes curves
     for(int i=0; i< m_curves.size(); i++)
     {
-        if ( m_curves[i].isSelected())
+        if ( m_curves.at(i).isSelected())
         {
             // eliminates areas which are associated to this curve
             for(int j=0; j < area.size(); j++)
@@ -736,11 +799,16 @@ void VectorImage::deleteSelection()
             }*/
         }
     }
+    mCurveIndex.clear();
+    mAreaIndex.clear();
     modification();
 }
 
 void VectorImage::removeVertex(int i, int m)   // curve number i and vertex number m
 {
+    mCurveIndex.clear();
+    mAreaIndex.clear();
+
     // first eliminates areas which are associated to this point
     for(int j=0; j < area.size(); j++)
     {
@@ -757,7 +825,7 @@ void VectorImage::removeVertex(int i, int m)   // curve number i and vertex numb
         }
     }
     // then eliminates the point
-    if (m_curves[i].getVertexSize() > 1)
+    if (m_curves.at(i).getVertexSize() > 1)
     {
         // first possibility: we just remove the point in the curve
         /*
@@ -850,8 +918,9 @@ void VectorImage::paste(VectorImage& vectorImage)
         if ( !hasSelection || vectorImage.m_curves.at(i).isSelected() )
         {
             m_curves.append( vectorImage.m_curves.at(i) );
+            updateCurveIndex( m_curves.size() - 1 );
             selectedCurves << i;
-            mSelectionRect |= vectorImage.m_curves[i].getBoundingRect();
+            mSelectionRect |= vectorImage.m_curves.at(i).getBoundingRect();
         }
     }
     for(int i=0; i < vectorImage.area.size() ; i++)
@@ -876,6 +945,7 @@ void VectorImage::paste(VectorImage& vectorImage)
         }
         if (ok) area.append( newArea );
     }
+    mAreaIndex.clear();
     modification();
 }
 
@@ -890,7 +960,7 @@ int VectorImage::getColourNumber(QPointF point)
     int areaNumber = getLastAreaNumber(point);
     if (areaNumber != -1)
     {
-        result = area[areaNumber].mColourNumber;
+        result = area.at(areaNumber).mColourNumber;
     }
     return result;
 }
@@ -899,11 +969,11 @@ bool VectorImage::usesColour(int index)
 {
     for(int i=0; i< area.size(); i++)
     {
-        if (area[i].mColourNumber == index) return true;
+        if (area.at(i).mColourNumber == index) return true;
     }
     for(int i=0; i< m_curves.size(); i++)
     {
-        if (m_curves[i].getColourNumber() == index) return true;
+        if (m_curves.at(i).getColourNumber() == index) return true;
     }
     return false;
 }
@@ -912,11 +982,11 @@ void VectorImage::removeColour(int index)
 {
     for(int i=0; i< area.size(); i++)
     {
-        if (area[i].getColourNumber() > index) area[i].decreaseColourNumber();
+        if (area.at(i).getColourNumber() > index) area[i].decreaseColourNumber();
     }
     for(int i=0; i< m_curves.size(); i++)
     {
-        if (m_curves[i].getColourNumber() > index) m_curves[i].decreaseColourNumber();
+        if (m_curves.at(i).getColourNumber() > index) m_curves[i].decreaseColourNumber();
     }
 }
 
@@ -937,17 +1007,47 @@ void VectorImage::paintImage(QPainter& painter,
     // --- draw filled areas ----
     if (!simplified)
     {
-        for(int i=0; i< area.size(); i++)
+        // every painter, on whichever thread, updates the cached paths under the lock
+        // and then fills from its own copy of them; the areas themselves are left alone
+        QVector<QPainterPath> devicePaths;
+        QMutexLocker locker( &mAreaPaths.mutex );
+
+        // the area paths follow the curves, which only move with a modification
+        if ( mAreaPaths.version != modificationCount() )
         {
-            updateArea( area[i] ); // to do: if selected
+            mAreaPaths.paths.resize( area.size() );
+            for(int i=0; i< area.size(); i++)
+            {
+                BezierArea updated = area.at(i);
+                updateArea( updated ); // to do: if selected
+                mAreaPaths.paths[ i ] = updated.mPath;
+            }
+            mAreaPaths.version = modificationCount();
+            mAreaPaths.devicePaths.clear();
+        }
 
+        // areas are filled in device coordinates, keep them mapped while the view doesn't change
+        if ( mAreaPaths.devicePaths.size() != area.size() || mAreaPaths.deviceTransform != painterMatrix )
+        {
+            mAreaPaths.devicePaths.resize( area.size() );
+            for(int i=0; i< area.size(); i++)
+            {
+                mAreaPaths.devicePaths[ i ] = painterMatrix.map( mAreaPaths.paths.at( i ) );
+            }
+            mAreaPaths.deviceTransform = painterMatrix;
+        }
+        devicePaths = mAreaPaths.devicePaths;
+        locker.unlock();
+
+        for(int i=0; i< area.size(); i++)
+        {
             // --- fill areas ---- //
-            QColor colour = getColour(area[i].mColourNumber);
+            QColor colour = getColour(area.at(i).mColourNumber);
 
             painter.save();
             painter.setWorldMatrixEnabled( false );
 
-            if (area[i].isSelected())
+            if (area.at(i).isSelected())
             {
                 painter.setBrush( QBrush( QColor(255-colour.red(),255-colour.green(),255-colour.blue()), Qt::Dense6Pattern) );
             }
@@ -956,7 +1056,7 @@ void VectorImage::paintImage(QPainter& painter,
                 painter.setBrush( QBrush( colour, Qt::SolidPattern ));
             }
 
-            painter.drawPath( painter.transform().map( area[ i ].mPath ) );
+            painter.drawPath( devicePaths.at( i ) );
             painter.restore();
             painter.setWorldMatrixEnabled( true );
 
@@ -970,7 +1070,7 @@ void VectorImage::paintImage(QPainter& painter,
     //simplified = true;
     //painter.setClipRect( viewRect );
     //painter.setClipping(true);
-    for ( BezierCurve curve : m_curves )
+    for ( const BezierCurve& curve : m_curves )
     {
         curve.drawPath( painter, mObject, mSelectionTransformation, simplified, showThinCurves );
         painter.setClipping(false);
@@ -991,8 +1091,10 @@ void VectorImage::outputImage(QImage* image,
 
 void VectorImage::clear()
 {
-    while (m_curves.size() > 0) { m_curves.removeAt(0); }
-    while (area.size() > 0) { area.removeAt(0); }
+    m_curves.clear();
+    area.clear();
+    mCurveIndex.clear();
+    mAreaIndex.clear();
     modification();
 }
 
@@ -1000,7 +1102,7 @@ void VectorImage::clean()
 {
     for(int i=0; i<m_curves.size(); i++)
     {
-        if (m_curves.at(i).getVertexSize() == 0) { qDebug() << "CLEAN " << i; m_curves.removeAt(i); i--; }
+        if (m_curves.at(i).getVertexSize() == 0) { qDebug() << "CLEAN " << i; m_curves.removeAt(i); i--; mCurveIndex.clear(); }
     }
 }
 
@@ -1015,6 +1117,7 @@ void VectorImage::applySelectionTransformation(QTransform transf)
     {
         if ( m_curves.at(i).isPartlySelected()) {
             m_curves[i].transform(transf);
+            updateCurveIndex(i);
         }
     }
     calculateSelectionRect();
@@ -1086,13 +1189,13 @@ void VectorImage::applyVariableWidthToSelection(bool YesOrNo)
 QList<int> VectorImage::getCurvesCloseTo(QPointF P1, qreal maxDistance)
 {
     QList<int> result;
-    for(int j=0; j<m_curves.size(); j++)
+    for(int j : getCurvesNear(P1, maxDistance))
     {
         BezierCurve myCurve;
-        if (m_curves[j].isPartlySelected()) {
-            myCurve = m_curves[j].transformed(mSelectionTransformation);
+        if (m_curves.at(j).isPartlySelected()) {
+            myCurve = m_curves.at(j).transformed(mSelectionTransformation);
         } else {
-            myCurve = m_curves[j];
+            myCurve = m_curves.at(j);
         }
         if ( myCurve.intersects(P1, maxDistance) ) {
             result.append( j );
@@ -1108,7 +1211,7 @@ VertexRef VectorImage::getClosestVertexTo(QPointF P1, qreal maxDistance)
     result = VertexRef(-1, -1);  // result = [-1, -1]
     //qreal distance = image.width()*image.width(); // initial big value
     qreal distance = 400.0*400.0; // initial big value
-    for(int j=0; j<m_curves.size(); j++)
+    for(int j : getCurvesNear(P1, maxDistance))
     {
         for(int k=-1; k<m_curves.at(j).getVertexSize(); k++)
         {
@@ -1128,7 +1231,7 @@ VertexRef VectorImage::getClosestVertexTo(QPointF P1, qreal maxDistance)
 QList<VertexRef> VectorImage::getVerticesCloseTo(QPointF P1, qreal maxDistance)
 {
     QList<VertexRef> result;
-    for(int j=0; j<m_curves.size(); j++)
+    for(int j : getCurvesNear(P1, maxDistance))
     {
         for(int k=-1; k<m_curves.at(j).getVertexSize(); k++)
         {
@@ -1296,262 +1399,226 @@ int VectorImage::getCurveSize(int curveNumber)
     }
 }
 
-void VectorImage::fillPath(QList<QPointF> contourPath, int colour, float tolerance)
+void VectorImage::updateCurveIndex(int curveNumber)
 {
-    QList<VertexRef> vertexPath;
+    if (!mCurveIndex.isValid()) return; // rebuilt as a whole on the next query
 
-    for (QPointF point : contourPath) {
-        VertexRef vertex = getClosestVertexTo(point, tolerance);
-        if (vertex.curveNumber != -1 && !vertexPath.contains(vertex)) {
-            vertexPath.append(vertex);
-        }
+    mCurveIndex.remove(curveNumber);
+    const BezierCurve& curve = m_curves.at(curveNumber);
+    if (curve.getVertexSize() == 0)
+    {
+        mCurveIndex.insert(curveNumber, QRectF(curve.getOrigin(), curve.getOrigin()));
+    }
+    for(int i=0; i < curve.getVertexSize(); i++)
+    {
+        mCurveIndex.insert(curveNumber, sectionRect(curve, i));
     }
-
-    BezierArea bezierArea(vertexPath, colour);
-    addArea( bezierArea );
-    modification();
 }
 
-QList<QPointF> VectorImage::getfillContourPoints(QPoint point)
+void VectorImage::ensureCurveIndex()
 {
-    // We get the contour points from a bitmap version of the vector layer as it is much faster to process
-    QImage* image = new QImage( mSize, QImage::Format_ARGB32_Premultiplied );
-    image->fill(Qt::white);
-    QPainter painter( image );
-
-    // Adapt the QWidget view coordinates to the QImage coordinates
-    QTransform translate;
-    translate.translate( mSize.width() / 2.f , mSize.height() / 2.f );
-    painter.setTransform( translate );
-    paintImage( painter, true, true, false );
+    if (mCurveIndex.isValid()) return;
 
-    QList<QPoint> queue; // queue all the pixels of the filled area (as they are found)
-    QList<QPointF> contourPoints; // refs of points near the contour pixels
-
-    qreal maxWidth = mSize.width();
-    qreal maxHeight = mSize.height();
-
-    // To keep track of the highest y contour point to make sure it is on the main contour and not inside.
-    int highestY = point.y();
-
-    // Convert point to image coordinates as the image doesn't have the same coordinates origin as the
-    // QWidget view
-    QPointF startPoint((maxWidth / 2) + point.x(), (maxHeight / 2) + point.y());
-    queue.append( startPoint.toPoint() );
-
-    // Check the colour of the clicked point
-    QRgb colourFrom = image->pixel(startPoint.x(), startPoint.y());
-    QRgb colourTo = Qt::green;
-
-    QPoint currentPoint;
-
-    int leftX, rightX;
-    bool foundLeftBound, foundRightBound;
-
-    // ----- flood fill and remember the contour pixels -> contourPixels
-    // ----- from the standard flood fill algorithm
-    // ----- http://en.wikipedia.org/wiki/Flood_fill
-    while ( queue.size() > 0 ) {
+    mCurveIndex.clear();
+    mCurveIndex.setValid();
+    for(int i=0; i < m_curves.size(); i++)
+    {
+        updateCurveIndex(i);
+    }
+}
 
-        // Get the first point in the queue and remove it afterwards
-        currentPoint = queue.at(0);
-        queue.removeAt(0);
+// Brings the area paths and their index up to date with the curves, on the editing thread only
+void VectorImage::updateAreaPaths()
+{
+    if ( mAreaPaths.editedVersion == modificationCount() ) return;
 
-        // Inspect a line from edge to edge
-        if (image->pixel(currentPoint.x(), currentPoint.y()) == colourFrom) {
-            leftX = currentPoint.x();
-            rightX = currentPoint.x();
+    for(int i=0; i< area.size(); i++)
+    {
+        // only store the path when it moved, the area may be shared with undo snapshots
+        BezierArea updated = area.at(i);
+        updateArea( updated );
+        if ( updated.mPath != area.at(i).mPath )
+        {
+            area[i].mPath = updated.mPath;
+            if ( mAreaIndex.isValid() )
+            {
+                mAreaIndex.remove( i );
+                mAreaIndex.insert( i, updated.mPath.controlPointRect() );
+            }
+        }
+    }
+    mAreaPaths.editedVersion = modificationCount();
+}
 
-            foundLeftBound = false;
-            foundRightBound = false;
+void VectorImage::ensureAreaIndex()
+{
+    updateAreaPaths();
+    if (mAreaIndex.isValid()) return;
 
-            while (!foundLeftBound) {
-                leftX--;
+    mAreaIndex.clear();
+    mAreaIndex.setValid();
+    for(int i=0; i < area.size(); i++)
+    {
+        mAreaIndex.insert(i, area.at(i).mPath.controlPointRect());
+    }
+}
 
-                // Are we getting to the end of the document ?
-                if ( leftX < 1) {
-                    qWarning() << " Out of bound left ";
-                    QList<QPointF> emptylist;
-                    return emptylist;
-                }
+QVector<int> VectorImage::getCurvesNear(QRectF rect)
+{
+    ensureCurveIndex();
+    return mCurveIndex.query(rect);
+}
 
-                QPoint leftPoint = QPoint(leftX, currentPoint.y());
+// Curves with a section within distance of the point, partly selected curves
+// are found where the selection transformation shows them as well
+QVector<int> VectorImage::getCurvesNear(QPointF point, qreal distance)
+{
+    QRectF rect = squareAround(point, distance);
+    QVector<int> result = getCurvesNear(rect);
+    if (mSelectionTransformation.isIdentity())
+    {
+        return result;
+    }
 
-                // Are we getting to a curve ?
-                if ( image->pixel(leftPoint.x(), leftPoint.y()) != colourFrom &&
-                     image->pixel(leftPoint.x(), leftPoint.y()) != colourTo ) {
+    bool invertible = false;
+    QTransform inverse = mSelectionTransformation.inverted(&invertible);
+    if (!invertible || !mSelectionTransformation.isAffine())
+    {
+        result.clear();
+        for(int i=0; i < m_curves.size(); i++) result.append(i);
+        return result;
+    }
+    result += mCurveIndex.query(inverse.mapRect(rect));
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
 
-                    foundLeftBound = true;
+void VectorImage::fillPath(QList<QPointF> contourPath, int colour, float tolerance)
+{
+    QList<VertexRef> vertexPath;
 
-                    // Convert point to view coordinates
-                    QPointF contourPoint( leftPoint.x() - (maxWidth / 2), leftPoint.y() - (maxHeight / 2));
+    for (QPointF point : contourPath) {
+        VertexRef vertex = getClosestVertexTo(point, tolerance);
+        if (vertex.curveNumber != -1 && !vertexPath.contains(vertex)) {
+            vertexPath.append(vertex);
+        }
+    }
 
-                    // Check if the left bound is just a line crossing the main shape
-                    bool foundFillAfter = false;
-                    int increment = 1;
+    BezierArea bezierArea(vertexPath, colour);
+    addArea( bezierArea );
+    modification();
+}
 
-                    while (leftPoint.x() - increment > 0 && increment < 3 && !foundFillAfter) {
-                        QPoint pointAfter = QPoint(leftPoint.x() - increment, leftPoint.y());
+VectorImage::CurveSplits VectorImage::findCurveCrossings(const QVector<int>& curveNumbers, qreal tolerance) const
+{
+    struct Section { int curve; int index; };
 
-                        if (image->pixel(pointAfter.x(), pointAfter.y()) == colourTo) {
-                            foundFillAfter = true;
-                        }
+    // the sections of the curves, bucketed so that only neighbouring ones are compared
+    QVector<Section> sections;
+    CubicSegments segments;
+    for (int i : curveNumbers)
+    {
+        segments.appendCurve(m_curves.at(i));
+        for (int j = 0; j < m_curves.at(i).getVertexSize(); j++)
+        {
+            sections.append(Section{ i, j });
+        }
+    }
+    QVector<QRectF> rects;
+    segments.boundingRects(rects);
+    SpatialGrid grid;
+    for (int k = 0; k < rects.size(); k++)
+    {
+        grid.insert(k, rects.at(k));
+    }
 
-                        increment++;
-                    }
+    CurveSplits splits;
+    auto requestSplit = [&](const Section& section, qreal t, QPointF point)
+    {
+        const BezierCurve& curve = m_curves.at(section.curve);
+        if (BezierCurve::eLength(point - curve.getVertex(section.index - 1)) <= tolerance ||
+            BezierCurve::eLength(point - curve.getVertex(section.index)) <= tolerance)
+        {
+            return; // there is a vertex there already
+        }
+        QVector<CurveSplit>& curveSplits = splits[section.curve];
+        for (const CurveSplit& split : curveSplits)
+        {
+            if (split.section == section.index && BezierCurve::eLength(split.point - point) <= tolerance) return;
+        }
+        curveSplits.append(CurveSplit{ section.index, t, point });
+    };
 
-                    // If the bound is not a contour, we must ignore it
-                    if (foundFillAfter) {
+    for (int a = 0; a < sections.size(); a++)
+    {
+        const Section& sa = sections.at(a);
 
-                        // If the bound is not a contour, we must ignore it
-                        contourPoints.removeOne(contourPoint);
-                    } else {
-                        contourPoints.append(contourPoint);
-                    }
+        // crossings with the other sections
+        for (int b : grid.query(rects.at(a)))
+        {
+            if (b <= a) continue;
+            const Section& sb = sections.at(b);
+            QList<Intersection> intersections;
+            if (segments.intersect(a, segments, b, intersections))
+            {
+                for (const Intersection& intersection : intersections)
+                {
+                    requestSplit(sa, intersection.t1, intersection.point);
+                    requestSplit(sb, intersection.t2, intersection.point);
                 }
             }
+        }
+    }
 
-            while (!foundRightBound) {
-                rightX++;
-
-                // Are we getting to the end of the document ?
-                if ( rightX > maxWidth - 1 ) {
-                    qWarning() << " Out of bound right ";
-                    QList<QPointF> emptylist;
-                    return emptylist;
-                }
-
-                QPoint rightPoint = QPoint(rightX, currentPoint.y());
-
-                // Are we getting to a curve ?
-                if ( image->pixel(rightPoint.x(), rightPoint.y()) != colourFrom &&
-                     image->pixel(rightPoint.x(), rightPoint.y()) != colourTo) {
-
-                    foundRightBound = true;
-
-                    // Convert point to view coordinates
-                    QPointF contourPoint( rightPoint.x() - (maxWidth / 2), rightPoint.y() - (maxHeight / 2));
-
-                    // Check if the left bound is just a line crossing the main shape
-                    bool foundFillAfter = false;
-                    int increment = 1;
-
-                    while (rightPoint.x() + increment < maxWidth && increment < 3 && !foundFillAfter) {
-                        QPoint pointAfter = QPoint(rightPoint.x() + increment, rightPoint.y());
-
-                        if (image->pixel(pointAfter.x(), pointAfter.y()) == colourTo) {
-                            foundFillAfter = true;
-                        }
-
-                        increment++;
-                    }
-
-                    if (foundFillAfter) {
-
-                        // If the bound is not a contour, we must ignore it
-                        contourPoints.removeOne(contourPoint);
-                    } else {
-                        contourPoints.append(contourPoint);
-                    }
+    // curve ends resting on the middle of a section
+    for (int i : curveNumbers)
+    {
+        const BezierCurve& curve = m_curves.at(i);
+        int last = curve.getVertexSize() - 1;
+        if (last < 0) continue;
+        for (int end : { -1, last })
+        {
+            QPointF endPoint = curve.getVertex(end);
+            for (int b : grid.query(squareAround(endPoint, tolerance)))
+            {
+                const Section& sb = sections.at(b);
+                if (sb.curve == i && (sb.index == end || sb.index == end + 1)) continue; // its own section
+                QPointF nearestPoint;
+                qreal t = 0;
+                if (segments.distance(b, endPoint, nearestPoint, t) <= tolerance)
+                {
+                    requestSplit(sb, t, nearestPoint);
                 }
             }
+        }
+    }
 
-            int lineY = currentPoint.y();
-            int topY = lineY - 1;
-            int bottomY = lineY + 1;
-
-            if ( topY < 1 || bottomY > maxHeight - 1 ) {
-                qWarning() << " Out of bound top / bottom ";
-                QList<QPointF> emptylist;
-                return emptylist;
-            }
-
-            for (int x = leftX + 1; x < rightX; x++) {
-
-                // The current line point is checked (Coloured)
-                QPoint linePoint = QPoint(x, lineY);
-                image->setPixel(linePoint.x(), linePoint.y(), colourTo);
-
-                QPoint topPoint = QPoint(x, topY);
-
-                if ( image->pixel(topPoint.x(), topPoint.y()) != colourFrom &&
-                     image->pixel(topPoint.x(), topPoint.y()) != colourTo) {
-
-                    // Convert point to view coordinates
-                    QPointF contourPoint( topPoint.x() - (maxWidth / 2), topPoint.y() - (maxHeight / 2));
-
-                    // Check if the left bound is just a line crossing the main shape
-                    bool foundFillAfter = false;
-                    int increment = 1;
-
-                    while (topPoint.y() - increment > 0 && increment < 3 && !foundFillAfter) {
-                        QPoint pointAfter = QPoint(topPoint.x(), topPoint.y() - increment);
-
-                        if (image->pixel(pointAfter.x(), pointAfter.y()) == colourTo) {
-                            foundFillAfter = true;
-                        }
-                        increment ++;
-                    }
-
-
-                    if (foundFillAfter) {
-
-                        // If the bound is not a contour, we must ignore it
-                        contourPoints.removeOne(contourPoint);
-                    } else {
-                        contourPoints.append(contourPoint);
-                    }
-                } else {
-                    queue.append(topPoint);
-                }
-
-                QPoint bottomPoint = QPoint(x, bottomY);
-
-                if ( image->pixel(bottomPoint.x(), bottomPoint.y()) != colourFrom &&
-                     image->pixel(bottomPoint.x(), bottomPoint.y()) != colourTo ) {
-
-                    QPointF contourPoint( bottomPoint.x() - (maxWidth / 2), bottomPoint.y() - (maxHeight / 2));
-
-                    // Check if the left bound is just a line crossing the main shape
-                    bool foundFillAfter = false;
-                    int increment = 1;
-
-                    while (bottomPoint.y() + increment < maxHeight && increment < 3 && !foundFillAfter) {
-                        QPoint pointAfter = QPoint(bottomPoint.x(), bottomPoint.y() + increment);
-
-                        if (image->pixel(pointAfter.x(), pointAfter.y()) == colourTo) {
-                            foundFillAfter = true;
-                        }
-
-                        increment++;
-                    }
-
-                    if (foundFillAfter) {
-
-                        // If the bound is not a contour, we must ignore it
-                        contourPoints.removeOne(contourPoint);
-                    }
-                    else {
-
-                        // Keep track of the highest Y position (lowest point) at the beginning of the list
-                        // so that we can parse the list from a point that is a real extremity.
-                        // of the area.
-                        if (highestY < bottomY) {
+    return splits;
+}
 
-                            highestY = bottomY;
-                            contourPoints.insert(0, contourPoint);
-                        } else {
-                            contourPoints.append(contourPoint);
-                        }
-                    }
+void VectorImage::splitCurve(QVector<CurveSplit> splits, std::function<void(int section, qreal t)> addPoint)
+{
+    // split the later sections first so that the earlier ones keep their numbers,
+    // and within a section the further points first, the rest is then on [0, t]
+    std::sort(splits.begin(), splits.end(), [](const CurveSplit& a, const CurveSplit& b)
+    {
+        return (a.section != b.section) ? a.section > b.section : a.t > b.t;
+    });
 
-                } else {
-                    queue.append(bottomPoint);
-                }
-            }
+    int section = -1;
+    qreal upper = 1.0;
+    for (const CurveSplit& split : splits)
+    {
+        if (split.section != section)
+        {
+            section = split.section;
+            upper = 1.0;
         }
+        if (split.t <= 1.0e-3 || split.t >= upper - 1.0e-3) continue;
+        addPoint(section, split.t / upper);
+        upper = split.t;
     }
-    return contourPoints;
 }
 
 void VectorImage::fill(QPointF point, int colour, float tolerance)
@@ -1573,109 +1640,56 @@ void VectorImage::fill(QPointF point, int colour, float tolerance)
     // Check if we clicked on an area of the same color.
     // We don't want to create another area.
     int areaNum = getLastAreaNumber(point);
-    if (areaNum > -1 && area[areaNum].mColourNumber == colour) {
+    if (areaNum > -1 && area.at(areaNum).mColourNumber == colour) {
         return;
     }
 
-    // Get the contour points
-    QList<QPointF> contourPoints = getfillContourPoints(point.toPoint());
-
-    // Make a path from the external contour points.
-    // Put the points in the right order.
-    QList<QPointF> mainContourPath;
-    QPointF currentPoint;
-
-    if (contourPoints.size() > 0) {
-        currentPoint = QPointF(contourPoints[0].x(), contourPoints[0].y());
-        mainContourPath.append(currentPoint);
-        contourPoints.removeAt(0);
-    }
-
-    bool completedPath = false;
-    bool foundError = (contourPoints.size() < 1 && !completedPath);
-
-    int maxDelta = 2;
-    int minDelta = -2;
-
-    while (!completedPath && !foundError) {
-
-        bool foundNextPoint = false;
-
-        int i = 0;
-        while (i < contourPoints.size() && !foundNextPoint) {
-            QPointF point = contourPoints.at(i);
-
-            if (mainContourPath.contains(point)) {
-                contourPoints.removeAt(i);
-            }
-            else {
-                qreal deltaX = currentPoint.x() - point.x();
-                qreal deltaY = currentPoint.y() - point.y();
-
-                if ( (deltaX < maxDelta && deltaX > minDelta) &&
-                     (deltaY < maxDelta && deltaY > minDelta)) {
-
-                    currentPoint = QPointF(point.x(), point.y());
-                    mainContourPath.append(currentPoint);
-                    contourPoints.removeAt(i);
-
-                    foundNextPoint = true;
+    // The region comes from the curves around the point, look further out
+    // until the region found is closed within what was looked at
+    for (qreal radius = 64.0; ; radius *= 2)
+    {
+        QRectF box = squareAround(point, radius);
+        QVector<int> nearbyCurves = getCurvesNear(box);
 
-                    maxDelta = 2;
-                    minDelta = -2;
-                }
-                i++;
-            }
+        // the faces are looked for on split copies, only the curves around
+        // the face that gets filled are split for real
+        CurveSplits splits = findCurveCrossings(nearbyCurves, tolerance);
+        SharedList<BezierCurve> splitCurves = m_curves;
+        for (auto it = splits.begin(); it != splits.end(); ++it)
+        {
+            BezierCurve& curve = splitCurves[it.key()];
+            splitCurve(it.value(), [&](int section, qreal t) { curve.addPoint(section, t); });
         }
 
-        // Check if we have looped
-        if (!foundNextPoint) {
-
-            qreal deltaX = currentPoint.x() - mainContourPath[0].x();
-            qreal deltaY = currentPoint.y() - mainContourPath[0].y();
-
-            if ( (deltaX < maxDelta && deltaX > minDelta) &&
-                 (deltaY < maxDelta && deltaY > minDelta)) {
-                completedPath = true;
-                foundNextPoint = true;
-            }
-            else if (maxDelta == 2){
-                // Check if we can find the point after
-                //
-                maxDelta = 3;
-                minDelta = -3;
-                foundNextPoint = true;
+        CurveGraph graph(splitCurves, nearbyCurves, tolerance);
+        QRectF faceBounds;
+        QList<VertexRef> face = graph.enclosingFace(point, &faceBounds);
+        bool lookedEverywhere = (nearbyCurves.size() == m_curves.size());
+        if (!face.isEmpty() && (box.contains(faceBounds) || lookedEverywhere))
+        {
+            QSet<int> faceCurves;
+            for (const VertexRef& vertex : face)
+            {
+                faceCurves.insert(vertex.curveNumber);
             }
-            else {
-                qWarning() << " couldn't find next point after " << currentPoint.x() << ", " << currentPoint.y();
+            for (int curveNumber : faceCurves)
+            {
+                splitCurve(splits.value(curveNumber), [&](int section, qreal t) { addPoint(curveNumber, section, t); });
             }
+            addArea(BezierArea(face, colour));
+            return;
         }
-        else if (contourPoints.size() < 1) {
-            // If we found the next point and we have no more points, it means, we have the end of the path
-            completedPath = true;
-            foundNextPoint = true;
-        }
-
-        foundError = ( (contourPoints.size() < 1 && !completedPath) || !foundNextPoint );
+        if (lookedEverywhere) break;
     }
 
-    // Add exclude paths
+    // Check if we clicked on an area in this position and as we couldn't create one,
+    // we update this one. It may be an area drawn from a stroke path.
+    if (areaNum > -1) {
 
-    // Fill the path if we have one.
-    if (completedPath) {
-        fillPath(mainContourPath, colour, 10.0);
-    }
-    else {
-        // Check if we clicked on an area in this position and as we couldn't create one,
-        // we update this one. It may be an area drawn from a stroke path.
-        int areaNum = getLastAreaNumber(point);
-        if (areaNum > -1) {
-
-            int clickedColorNum = area[areaNum].getColourNumber();
+        int clickedColorNum = area.at(areaNum).getColourNumber();
 
-            if (clickedColorNum != colour) {
-                area[areaNum].setColourNumber(colour);
-            }
+        if (clickedColorNum != colour) {
+            area[areaNum].setColourNumber(colour);
         }
     }
 }
@@ -1684,17 +1698,22 @@ void VectorImage::addArea(BezierArea bezierArea)
 {
     updateArea(bezierArea);
     area.append( bezierArea );
+    if (mAreaIndex.isValid())
+    {
+        mAreaIndex.insert(area.size() - 1, bezierArea.mPath.controlPointRect());
+    }
     modification();
 }
 
 int VectorImage::getFirstAreaNumber(QPointF point)
 {
+    updateAreaPaths();
     int result = -1;
     for(int i=0; i<area.size() && result==-1; i++)
     {
-        if ( area[i].mPath.controlPointRect().contains( point ) )
+        if ( area.at(i).mPath.controlPointRect().contains( point ) )
         {
-            if ( area[i].mPath.contains( point ) )
+            if ( area.at(i).mPath.contains( point ) )
             {
                 result = i;
             }
@@ -1710,12 +1729,17 @@ int VectorImage::getLastAreaNumber(QPointF point)
 
 int VectorImage::getLastAreaNumber(QPointF point, int maxAreaNumber)
 {
+    ensureAreaIndex();
+    QVector<int> candidates = mAreaIndex.query( QRectF( point, point ) );
+
     int result = -1;
-    for(int i=maxAreaNumber; i>-1 && result==-1; i--)
+    for(int n=candidates.size()-1; n>-1 && result==-1; n--)
     {
-        if ( area[i].mPath.controlPointRect().contains( point ) )
+        int i = candidates.at(n);
+        if ( i > maxAreaNumber ) continue;
+        if ( area.at(i).mPath.controlPointRect().contains( point ) )
         {
-            if ( area[i].mPath.contains( point ) )
+            if ( area.at(i).mPath.contains( point ) )
             {
                 result = i;
             }
@@ -1730,6 +1754,7 @@ void VectorImage::removeArea(QPointF point)
     if ( areaNumber != -1)
     {
         area.removeAt(areaNumber);
+        mAreaIndex.clear();
     }
     modification();
 }
@@ -18,6 +18,7 @@ GNU General Public License for more details.
 #define VECTORIMAGE_H
 
 
+#include <functional>
 #include <QtXml>
 #include <QTransform>
 #include <QDebug>
@@ -28,6 +29,8 @@ GNU General Public License for more details.
 #include "beziercurve.h"
 #include "vertexref.h"
 #include "keyframe.h"
+#include "sharedlist.h"
+#include "spatialgrid.h"
 
 class Object;
 class QPainter;
@@ -122,8 +125,12 @@ public:
     QList<VertexRef> getAllVertices();
     int getCurveSize(int curveNumber);
 
-    QList<BezierCurve> m_curves;
-    QList<BezierArea> area;
+    // Call after moving the points of m_curves[curveNumber] directly
+    void updateCurveIndex(int curveNumber);
+
+    // Copies of the image share curves and areas until they are written to
+    SharedList<BezierCurve> m_curves;
+    SharedList<BezierArea> area;
     QList<int> m_curveDisplayOrders;
 
     qreal getDistance(VertexRef r1, VertexRef r2);
@@ -136,14 +143,50 @@ private:
 	void checkCurveExtremity(BezierCurve& newCurve, qreal tolerance);
 	void checkCurveIntersections(BezierCurve& newCurve, qreal tolerance);
 
-	QList<QPointF> getfillContourPoints(QPoint point);
+	// A point where a curve should get a vertex, on cubic section `section` at `t`
+	struct CurveSplit { int section; qreal t; QPointF point; };
+	typedef QMap<int, QVector<CurveSplit>> CurveSplits;
+	// Where the curves cross each other or end on one another, the curves are left as they are
+	CurveSplits findCurveCrossings(const QVector<int>& curveNumbers, qreal tolerance) const;
+	// Adds the vertices to the curve, the same splits always give the same vertex numbers
+	static void splitCurve(QVector<CurveSplit> splits, std::function<void(int section, qreal t)> addPoint);
 	void updateImageSize(BezierCurve& updatedCurve);
 
+    void ensureCurveIndex();
+    void updateAreaPaths();
+    void ensureAreaIndex();
+    QVector<int> getCurvesNear(QRectF rect);
+    QVector<int> getCurvesNear(QPointF point, qreal distance);
+
 private:
     Object* mObject = nullptr;
     QRectF mSelectionRect;
     QTransform mSelectionTransformation;
     QSize mSize;
+
+    // curve numbers by segment bounding boxes, area numbers by path bounds
+    SpatialGrid mCurveIndex;
+    SpatialGrid mAreaIndex;
+
+    // Area paths are rebuilt when the modification count moves on. Copies don't
+    // share the count, so they start over. Painting builds its own paths here,
+    // threads painting the same image take turns under the mutex. The paths
+    // stored in the areas and their index only change on the editing thread.
+    struct AreaPathCache
+    {
+        AreaPathCache() {}
+        AreaPathCache( const AreaPathCache& ) {}
+        AreaPathCache& operator=( const AreaPathCache& ) { version = -1; editedVersion = -1; paths.clear(); devicePaths.clear(); return *this; }
+
+        QMutex mutex;
+        int version = -1;
+        QVector<QPainterPath> paths;
+        QTransform deviceTransform;
+        QVector<QPainterPath> devicePaths;
+
+        int editedVersion = -1; // of the area paths, by updateAreaPaths()
+    };
+    AreaPathCache mAreaPaths;
 };
 
 #endif
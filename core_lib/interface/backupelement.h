@@ -18,50 +18,137 @@ GNU General Public License for more details.
 #ifndef BACKUPELEMENT_H
 #define BACKUPELEMENT_H
 
+#include <map>
+#include <memory>
+#include <vector>
 #include <QObject>
 #include "vectorimage.h"
 #include "bitmapimage.h"
 
 
 class Editor;
+class LayerBitmap;
 
 class BackupElement : public QObject
 {
     Q_OBJECT
 public:
-    enum types { UNDEFINED, BITMAP_MODIF, VECTOR_MODIF };
+    enum types { UNDEFINED, BITMAP_MODIF, VECTOR_MODIF, BITMAP_KEYS };
 
     QString undoText;
     bool somethingSelected;
     QRectF mySelection, myTransformedSelection, myTempTransformedSelection;
 
     virtual int type() { return UNDEFINED; }
-    virtual void restore(Editor*) { qDebug() << "Wrong"; }
+
+    // An element only knows the state from before the edit until it is sealed,
+    // which records what the edit changed. The editor seals the newest
+    // element when the next backup is made or when it gets undone.
+    bool isSealed() { return mIsSealed; }
+    virtual void seal( Editor* editor ) { saveSelectionAfter( editor ); mIsSealed = true; }
+    virtual void undo( Editor* ) { qDebug() << "Wrong"; }
+    virtual void redo( Editor* ) { qDebug() << "Wrong"; }
+
+    // Bytes held by the element, counted against the undo memory limit
+    virtual qint64 memoryUsage() { return 0; }
+
+protected:
+    void saveSelectionAfter( Editor* );
+    void restoreSelection( Editor*, bool after );
+
+    bool mIsSealed = false;
+
+private:
+    bool mSomethingSelectedAfter = false;
+    QRectF mSelectionAfter, mTransformedSelectionAfter, mTempTransformedSelectionAfter;
 };
 
+/*
+ * Keeps only the rectangle the edit touched, before and after, compressed.
+ * Until it is sealed it holds a copy() of the frame, which costs nothing
+ * as long as the tiles are still shared with the frame, but is counted at
+ * its full size since any stroke may detach all of them.
+ */
 class BackupBitmapElement : public BackupElement
 {
     Q_OBJECT
 public:
-    BackupBitmapElement(BitmapImage* bi) { bitmapImage = bi->copy(); }
+    BackupBitmapElement( BitmapImage* bi ) { mSnapshot = bi->copy(); }
 
     int layer, frame;
-    BitmapImage bitmapImage;
-    //BackupBitmapElement() { type = BackupElement::BITMAP_MODIF; }
-    int type() { return BackupElement::BITMAP_MODIF; }
-    void restore(Editor*);
+
+    int type() override { return BackupElement::BITMAP_MODIF; }
+    void seal( Editor* ) override;
+    void undo( Editor* ) override;
+    void redo( Editor* ) override;
+    qint64 memoryUsage() override;
+
+    QRect dirtyRect() { return mDirtyRect; }
+
+    static QByteArray packPixels( const QImage& );
+    static QImage     unpackPixels( const QByteArray&, QSize );
+
+private:
+    void apply( Editor*, const QByteArray& pixels, QRect bounds );
+
+    BitmapImage mSnapshot;
+    QRect mDirtyRect;
+    QRect mBoundsBefore, mBoundsAfter;
+    QByteArray mPixelsBefore, mPixelsAfter;
 };
 
 class BackupVectorElement : public BackupElement
 {
     Q_OBJECT
 public:
-    BackupVectorElement(VectorImage* vi) { vectorImage = *vi; }
+    BackupVectorElement( VectorImage* vi ) : mBefore( std::make_shared< VectorImage >( *vi ) ) {}
+    // Starts from the result of the previous element on the same frame, without copying it again
+    BackupVectorElement( std::shared_ptr< VectorImage > before ) : mBefore( before ) {}
+
     int layer, frame;
-    VectorImage vectorImage;
 
-    int type() { return BackupElement::VECTOR_MODIF; }
-    void restore(Editor*);
+    int type() override { return BackupElement::VECTOR_MODIF; }
+    void seal( Editor* ) override;
+    void undo( Editor* ) override;
+    void redo( Editor* ) override;
+    qint64 memoryUsage() override;
+
+    std::shared_ptr< VectorImage > after() { return mAfter; }
+
+private:
+    void apply( Editor*, VectorImage* image );
+
+    std::shared_ptr< VectorImage > mBefore;
+    std::shared_ptr< VectorImage > mAfter;
+};
+
+/*
+ * A batch of bitmap keys added in one go by the movie and image sequence
+ * imports. Undo removes the keys it added and puts back the ones it pasted
+ * onto, redo brings both back. The copies share their tiles with the keys
+ * of the layer until either is drawn on, but are counted at their full size
+ * like an unsealed BackupBitmapElement.
+ */
+class BackupBitmapKeysElement : public BackupElement
+{
+    Q_OBJECT
+public:
+    BackupBitmapKeysElement( LayerBitmap* layer, const std::vector< int >& positions );
+
+    int layer;
+
+    int type() override { return BackupElement::BITMAP_KEYS; }
+    void seal( Editor* ) override;
+    void undo( Editor* ) override;
+    void redo( Editor* ) override;
+    qint64 memoryUsage() override;
+
+private:
+    void update( Editor* );
+
+    std::vector< int > mPositions;          // ascending
+    std::map< int, BitmapImage > mBefore;   // the keys which were there already
+    std::map< int, BitmapImage > mAfter;    // every key of the batch
 };
 
 #endif // BACKUPELEMENT_H
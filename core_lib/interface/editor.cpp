@@ -16,6 +16,7 @@ GNU General Public License for more details.
 */
 
 #include "editor.h"
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <QApplication>
@@ -110,6 +111,8 @@ bool Editor::init()
 
     mIsAutosave = mPreferenceManager->isOn(SETTING::AUTO_SAVE);
     autosaveNumber = mPreferenceManager->getInt(SETTING::AUTO_SAVE_NUMBER);
+    mUndoMemoryLimit = qint64( mPreferenceManager->getInt( SETTING::UNDO_MEMORY_LIMIT ) ) * 1024 * 1024;
+    BitmapImage::setLoadedMemoryLimit( qint64( mPreferenceManager->getInt( SETTING::FRAME_MEMORY_LIMIT ) ) * 1024 * 1024 );
 
     //onionPrevFramesNum = mPreferenceManager->getInt(SETTING::ONION_PREV_FRAMES_NUM);
     //onionNextFramesNum = mPreferenceManager->getInt(SETTING::ONION_NEXT_FRAMES_NUM);
@@ -165,6 +168,12 @@ void Editor::settingUpdated(SETTING setting)
     case SETTING::AUTO_SAVE_NUMBER:
         autosaveNumber = mPreferenceManager->getInt( SETTING::AUTO_SAVE_NUMBER );
         break;
+    case SETTING::UNDO_MEMORY_LIMIT:
+        setUndoMemoryLimit( qint64( mPreferenceManager->getInt( SETTING::UNDO_MEMORY_LIMIT ) ) * 1024 * 1024 );
+        break;
+    case SETTING::FRAME_MEMORY_LIMIT:
+        BitmapImage::setLoadedMemoryLimit( qint64( mPreferenceManager->getInt( SETTING::FRAME_MEMORY_LIMIT ) ) * 1024 * 1024 );
+        break;
     case SETTING::ONION_TYPE:
         mScribbleArea->updateAllFrames();
         emit updateTimeLine();
@@ -186,6 +195,14 @@ BackupElement* Editor::currentBackup()
     }
 }
 
+void Editor::stopPrefetch()
+{
+	if ( mScribbleArea )
+	{
+		mScribbleArea->stopPrefetch();
+	}
+}
+
 void Editor::backup( QString undoText )
 {
 	if ( lastModifiedLayer > -1 && lastModifiedFrame > 0 )
@@ -198,17 +215,39 @@ void Editor::backup( QString undoText )
 	}
 }
 
-void Editor::backup( int backupLayer, int backupFrame, QString undoText )
+// Drops the steps which were undone and records what the newest one changed, before the next edit
+void Editor::sealBackups()
 {
 	while ( mBackupList.size() - 1 > mBackupIndex && mBackupList.size() > 0 )
 	{
 		delete mBackupList.takeLast();
 	}
-	while ( mBackupList.size() > 19 )   // we authorize only 20 levels of cancellation
+	BackupElement* previous = currentBackup();
+	if ( previous != nullptr && !previous->isSealed() )
 	{
-		delete mBackupList.takeFirst();
-		mBackupIndex--;
+		previous->seal( this );
 	}
+}
+
+void Editor::addBackup( BackupElement* element, QString undoText )
+{
+	element->undoText = undoText;
+	element->somethingSelected = this->getScribbleArea()->somethingSelected;
+	element->mySelection = this->getScribbleArea()->mySelection;
+	element->myTransformedSelection = this->getScribbleArea()->myTransformedSelection;
+	element->myTempTransformedSelection = this->getScribbleArea()->myTempTransformedSelection;
+	mBackupList.append( element );
+	mBackupIndex++;
+	trimBackups();
+}
+
+void Editor::backup( int backupLayer, int backupFrame, QString undoText )
+{
+	stopPrefetch(); // the edit follows the backup
+	sealBackups();
+	BackupElement* previous = currentBackup();
+
+	BackupElement* element = nullptr;
 	Layer* layer = mObject->getLayer( backupLayer );
 	if ( layer != NULL )
 	{
@@ -217,16 +256,10 @@ void Editor::backup( int backupLayer, int backupFrame, QString undoText )
             BitmapImage* bitmapImage = ( (LayerBitmap*)layer )->getLastBitmapImageAtFrame( backupFrame, 0 );
             if ( bitmapImage != NULL )
             {
-                BackupBitmapElement* element = new BackupBitmapElement(bitmapImage);
-                element->layer = backupLayer;
-                element->frame = backupFrame;
-                element->undoText = undoText;
-                element->somethingSelected = this->getScribbleArea()->somethingSelected;
-                element->mySelection = this->getScribbleArea()->mySelection;
-                element->myTransformedSelection = this->getScribbleArea()->myTransformedSelection;
-                element->myTempTransformedSelection = this->getScribbleArea()->myTempTransformedSelection;
-                mBackupList.append( element );
-                mBackupIndex++;
+                BackupBitmapElement* bitmapElement = new BackupBitmapElement( bitmapImage );
+                bitmapElement->layer = backupLayer;
+                bitmapElement->frame = backupFrame;
+                element = bitmapElement;
             }
         }
         else if ( layer->type() == Layer::VECTOR )
@@ -234,84 +267,376 @@ void Editor::backup( int backupLayer, int backupFrame, QString undoText )
             VectorImage* vectorImage = ( (LayerVector*)layer )->getLastVectorImageAtFrame( backupFrame, 0 );
             if ( vectorImage != NULL )
             {
-                BackupVectorElement* element = new BackupVectorElement(vectorImage);
-                element->layer = backupLayer;
-                element->frame = backupFrame;
-                element->undoText = undoText;
-                element->somethingSelected = this->getScribbleArea()->somethingSelected;
-                element->mySelection = this->getScribbleArea()->mySelection;
-                element->myTransformedSelection = this->getScribbleArea()->myTransformedSelection;
-                element->myTempTransformedSelection = this->getScribbleArea()->myTempTransformedSelection;
-                mBackupList.append( element );
-                mBackupIndex++;
+                BackupVectorElement* vectorElement = nullptr;
+                BackupVectorElement* previousVector = ( previous != nullptr && previous->type() == BackupElement::VECTOR_MODIF ) ?
+                    static_cast< BackupVectorElement* >( previous ) : nullptr;
+                if ( previousVector != nullptr && previousVector->layer == backupLayer && previousVector->frame == backupFrame )
+                {
+                    vectorElement = new BackupVectorElement( previousVector->after() );
+                }
+                else
+                {
+                    vectorElement = new BackupVectorElement( vectorImage );
+                }
+                vectorElement->layer = backupLayer;
+                vectorElement->frame = backupFrame;
+                element = vectorElement;
             }
 		}
 	}
+
+	if ( element != nullptr )
+	{
+		addBackup( element, undoText );
+	}
     emit updateBackup();
 }
 
-void BackupBitmapElement::restore( Editor* editor )
+void Editor::backupKeys( int layerNumber, const std::vector< int >& positions, QString undoText )
+{
+	stopPrefetch();
+	sealBackups();
+
+	Layer* layer = mObject->getLayer( layerNumber );
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
+	{
+		BackupBitmapKeysElement* element = new BackupBitmapKeysElement( static_cast< LayerBitmap* >( layer ), positions );
+		element->layer = layerNumber;
+		addBackup( element, undoText );
+	}
+	emit updateBackup();
+}
+
+void Editor::setUndoMemoryLimit( qint64 bytes )
+{
+	mUndoMemoryLimit = bytes;
+	trimBackups();
+}
+
+qint64 Editor::undoMemoryUsage()
+{
+	qint64 usage = 0;
+	for ( BackupElement* element : mBackupList )
+	{
+		usage += element->memoryUsage();
+	}
+	return usage;
+}
+
+void Editor::trimBackups()
+{
+	// Oldest first, never the element the user would undo next
+	qint64 usage = undoMemoryUsage();
+	while ( usage > mUndoMemoryLimit && mBackupIndex > 0 )
+	{
+		BackupElement* oldest = mBackupList.takeFirst();
+		usage -= oldest->memoryUsage();
+		delete oldest;
+		mBackupIndex--;
+	}
+}
+
+void BackupElement::saveSelectionAfter( Editor* editor )
+{
+	mSomethingSelectedAfter = editor->getScribbleArea()->somethingSelected;
+	mSelectionAfter = editor->getScribbleArea()->mySelection;
+	mTransformedSelectionAfter = editor->getScribbleArea()->myTransformedSelection;
+	mTempTransformedSelectionAfter = editor->getScribbleArea()->myTempTransformedSelection;
+}
+
+void BackupElement::restoreSelection( Editor* editor, bool after )
+{
+	ScribbleArea* scribbleArea = editor->getScribbleArea();
+	scribbleArea->somethingSelected = after ? mSomethingSelectedAfter : this->somethingSelected;
+	scribbleArea->mySelection = after ? mSelectionAfter : this->mySelection;
+	scribbleArea->myTransformedSelection = after ? mTransformedSelectionAfter : this->myTransformedSelection;
+	scribbleArea->myTempTransformedSelection = after ? mTempTransformedSelectionAfter : this->myTempTransformedSelection;
+}
+
+QByteArray BackupBitmapElement::packPixels( const QImage& image )
+{
+	const QImage pixels = image.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+	QByteArray raw;
+	raw.reserve( pixels.width() * pixels.height() * 4 );
+	for ( int y = 0; y < pixels.height(); y++ )
+	{
+		raw.append( reinterpret_cast< const char* >( pixels.constScanLine( y ) ), pixels.width() * 4 );
+	}
+	return qCompress( raw, 1 ); // strokes are mostly transparent, the fastest level does fine
+}
+
+QImage BackupBitmapElement::unpackPixels( const QByteArray& packed, QSize size )
 {
+	QByteArray raw = qUncompress( packed );
+	if ( raw.size() != size.width() * size.height() * 4 )
+	{
+		return QImage();
+	}
+	QImage pixels( size, QImage::Format_ARGB32_Premultiplied );
+	for ( int y = 0; y < size.height(); y++ )
+	{
+		memcpy( pixels.scanLine( y ), raw.constData() + y * size.width() * 4, size.width() * 4 );
+	}
+	return pixels;
+}
+
+void BackupBitmapElement::seal( Editor* editor )
+{
+	BackupElement::seal( editor );
+
+	BitmapImage* current = nullptr;
 	Layer* layer = editor->object()->getLayer( this->layer );
-	if ( layer != NULL )
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
 	{
-		if ( layer->type() == Layer::BITMAP )
+		current = ( (LayerBitmap*)layer )->getLastBitmapImageAtFrame( this->frame, 0 );
+	}
+	if ( current != nullptr )
+	{
+		mBoundsBefore = mSnapshot.bounds();
+		mBoundsAfter = current->bounds();
+		mDirtyRect = mSnapshot.differenceRect( *current );
+		if ( !mDirtyRect.isEmpty() )
 		{
-			*( ( (LayerBitmap*)layer )->getLastBitmapImageAtFrame( this->frame, 0 ) ) = this->bitmapImage;  // restore the image
+			mPixelsBefore = packPixels( mSnapshot.copy( mDirtyRect ).toImage() );
+			mPixelsAfter = packPixels( current->copy( mDirtyRect ).toImage() );
 		}
 	}
-	editor->getScribbleArea()->somethingSelected = this->somethingSelected;
-	editor->getScribbleArea()->mySelection = this->mySelection;
-	editor->getScribbleArea()->myTransformedSelection = this->myTransformedSelection;
-	editor->getScribbleArea()->myTempTransformedSelection = this->myTempTransformedSelection;
+	mSnapshot = BitmapImage();
+}
 
+qint64 BackupBitmapElement::memoryUsage()
+{
+	if ( !mIsSealed )
+	{
+		return qint64( mSnapshot.tileCount() ) * BitmapImage::TILE_SIZE * BitmapImage::TILE_SIZE * 4;
+	}
+	return mPixelsBefore.size() + mPixelsAfter.size();
+}
+
+void BackupBitmapElement::apply( Editor* editor, const QByteArray& pixels, QRect bounds )
+{
+	Layer* layer = editor->object()->getLayer( this->layer );
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
+	{
+		BitmapImage* image = ( (LayerBitmap*)layer )->getLastBitmapImageAtFrame( this->frame, 0 );
+		if ( image != nullptr )
+		{
+			if ( !mDirtyRect.isEmpty() )
+			{
+				image->writePixels( mDirtyRect.topLeft(), unpackPixels( pixels, mDirtyRect.size() ) );
+			}
+			image->setBounds( bounds );
+			image->modification();
+		}
+	}
 	editor->updateFrame( this->frame );
 	editor->scrubTo( this->frame );
 }
 
-void BackupVectorElement::restore( Editor* editor )
+void BackupBitmapElement::undo( Editor* editor )
 {
+	restoreSelection( editor, false );
+	apply( editor, mPixelsBefore, mBoundsBefore );
+}
+
+void BackupBitmapElement::redo( Editor* editor )
+{
+	restoreSelection( editor, true );
+	apply( editor, mPixelsAfter, mBoundsAfter );
+}
+
+void BackupVectorElement::seal( Editor* editor )
+{
+	BackupElement::seal( editor );
 	Layer* layer = editor->object()->getLayer( this->layer );
-	if ( layer != NULL )
+	if ( layer != NULL && layer->type() == Layer::VECTOR )
 	{
-		if ( layer->type() == Layer::VECTOR )
+		VectorImage* current = ( (LayerVector*)layer )->getLastVectorImageAtFrame( this->frame, 0 );
+		if ( current != nullptr )
+		{
+			mAfter = std::make_shared< VectorImage >( *current );
+		}
+	}
+	if ( !mAfter )
+	{
+		mAfter = mBefore;
+	}
+}
+
+qint64 BackupVectorElement::memoryUsage()
+{
+	// curves and areas are shared with the neighbouring snapshots, each holder pays its part
+	auto imageSize = []( VectorImage* image )
+	{
+		qint64 bytes = sizeof( VectorImage );
+		for ( int i = 0; i < image->m_curves.size(); i++ )
 		{
-			*( ( (LayerVector*)layer )->getLastVectorImageAtFrame( this->frame, 0 ) ) = this->vectorImage;  // restore the image
-			//((LayerVector*)layer)->getLastVectorImageAtFrame(this->frame, 0)->setModified(true); // why?
-			//editor->scribbleArea->setModified(layer, this->frame);
+			const BezierCurve& curve = image->m_curves.at( i );
+			qint64 curveBytes = sizeof( BezierCurve ) + ( curve.getVertexSize() + 1 ) * ( 3 * sizeof( QPointF ) + sizeof( float ) + sizeof( bool ) );
+			bytes += curveBytes / image->m_curves.useCount( i );
 		}
+		for ( int i = 0; i < image->area.size(); i++ )
+		{
+			qint64 areaBytes = sizeof( BezierArea ) + image->area.at( i ).mVertex.size() * sizeof( VertexRef );
+			bytes += areaBytes / image->area.useCount( i );
+		}
+		return bytes;
+	};
+	// images shared between consecutive elements are split between them
+	qint64 bytes = imageSize( mBefore.get() ) / mBefore.use_count();
+	if ( mAfter && mAfter != mBefore )
+	{
+		bytes += imageSize( mAfter.get() ) / mAfter.use_count();
 	}
-	editor->getScribbleArea()->somethingSelected = this->somethingSelected;
-	editor->getScribbleArea()->mySelection = this->mySelection;
-	editor->getScribbleArea()->myTransformedSelection = this->myTransformedSelection;
-	editor->getScribbleArea()->myTempTransformedSelection = this->myTempTransformedSelection;
+	return bytes;
+}
 
+void BackupVectorElement::apply( Editor* editor, VectorImage* image )
+{
+	Layer* layer = editor->object()->getLayer( this->layer );
+	if ( layer != NULL && layer->type() == Layer::VECTOR && image != nullptr )
+	{
+		VectorImage* target = ( (LayerVector*)layer )->getLastVectorImageAtFrame( this->frame, 0 );
+		if ( target != nullptr )
+		{
+			*target = *image;
+		}
+	}
 	editor->updateFrameAndVector( this->frame );
 	editor->scrubTo( this->frame );
 }
 
-void Editor::undo()
+void BackupVectorElement::undo( Editor* editor )
 {
-	if ( mBackupList.size() > 0 && mBackupIndex > -1 )
+	restoreSelection( editor, false );
+	apply( editor, mBefore.get() );
+}
+
+void BackupVectorElement::redo( Editor* editor )
+{
+	restoreSelection( editor, true );
+	apply( editor, mAfter.get() );
+}
+
+BackupBitmapKeysElement::BackupBitmapKeysElement( LayerBitmap* layer, const std::vector< int >& positions )
+	: mPositions( positions )
+{
+	std::sort( mPositions.begin(), mPositions.end() );
+	for ( int position : mPositions )
 	{
-		if ( mBackupIndex == mBackupList.size() - 1 )
+		BitmapImage* key = layer->getBitmapImageAtFrame( position );
+		if ( key != nullptr )
 		{
-			BackupElement* lastBackupElement = mBackupList[ mBackupIndex ];
-			if ( lastBackupElement->type() == BackupElement::BITMAP_MODIF )
+			mBefore[ position ] = key->copy();
+		}
+	}
+}
+
+void BackupBitmapKeysElement::seal( Editor* editor )
+{
+	BackupElement::seal( editor );
+	Layer* layer = editor->object()->getLayer( this->layer );
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
+	{
+		for ( int position : mPositions )
+		{
+			BitmapImage* key = static_cast< LayerBitmap* >( layer )->getBitmapImageAtFrame( position );
+			if ( key != nullptr )
 			{
-				BackupBitmapElement* lastBackupBitmapElement = (BackupBitmapElement*)lastBackupElement;
-				backup( lastBackupBitmapElement->layer, lastBackupBitmapElement->frame, "NoOp" );
-				mBackupIndex--;
+				mAfter[ position ] = key->copy();
 			}
-			if ( lastBackupElement->type() == BackupElement::VECTOR_MODIF )
+		}
+	}
+}
+
+qint64 BackupBitmapKeysElement::memoryUsage()
+{
+	qint64 tiles = 0;
+	for ( auto& pair : mBefore )
+	{
+		tiles += pair.second.tileCount();
+	}
+	for ( auto& pair : mAfter )
+	{
+		tiles += pair.second.tileCount();
+	}
+	return tiles * BitmapImage::TILE_SIZE * BitmapImage::TILE_SIZE * 4;
+}
+
+void BackupBitmapKeysElement::update( Editor* editor )
+{
+	editor->getScribbleArea()->updateAllFrames();
+	editor->scrubTo( mPositions.empty() ? editor->currentFrame() : mPositions.front() );
+	Q_EMIT editor->layers()->currentLayerChanged( editor->layers()->currentLayerIndex() ); // trigger timeline repaint.
+}
+
+void BackupBitmapKeysElement::undo( Editor* editor )
+{
+	restoreSelection( editor, false );
+	Layer* layer = editor->object()->getLayer( this->layer );
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
+	{
+		LayerBitmap* layerBitmap = static_cast< LayerBitmap* >( layer );
+		for ( int position : mPositions )
+		{
+			auto before = mBefore.find( position );
+			BitmapImage* key = layerBitmap->getBitmapImageAtFrame( position );
+			if ( key == nullptr )
+			{
+				continue;
+			}
+			if ( before == mBefore.end() )
+			{
+				layerBitmap->removeKeyFrame( position );
+			}
+			else
 			{
-				BackupVectorElement* lastBackupVectorElement = (BackupVectorElement*)lastBackupElement;
-				backup( lastBackupVectorElement->layer, lastBackupVectorElement->frame, "NoOp" );
-				mBackupIndex--;
+				*key = before->second;
 			}
 		}
-		//
-		mBackupList[ mBackupIndex ]->restore( this );
+	}
+	update( editor );
+}
+
+void BackupBitmapKeysElement::redo( Editor* editor )
+{
+	restoreSelection( editor, true );
+	Layer* layer = editor->object()->getLayer( this->layer );
+	if ( layer != NULL && layer->type() == Layer::BITMAP )
+	{
+		LayerBitmap* layerBitmap = static_cast< LayerBitmap* >( layer );
+		std::vector< KeyFrame* > newKeys;
+		for ( auto& pair : mAfter )
+		{
+			BitmapImage* key = layerBitmap->getBitmapImageAtFrame( pair.first );
+			if ( mBefore.find( pair.first ) != mBefore.end() && key != nullptr )
+			{
+				*key = pair.second;
+			}
+			else if ( key == nullptr )
+			{
+				BitmapImage* added = new BitmapImage( pair.second );
+				added->setPos( pair.first );
+				added->setModified( true );
+				newKeys.push_back( added );
+			}
+		}
+		layerBitmap->addKeyFrames( newKeys );
+	}
+	update( editor );
+}
+
+void Editor::undo()
+{
+	if ( mBackupList.size() > 0 && mBackupIndex > -1 )
+	{
+		stopPrefetch();
+		BackupElement* element = mBackupList[ mBackupIndex ];
+		if ( !element->isSealed() )
+		{
+			element->seal( this );
+		}
+		element->undo( this );
 		mBackupIndex--;
         mScribbleArea->cancelTransformedSelection();
         mScribbleArea->calculateSelectionRect(); // really ugly -- to improve
@@ -321,10 +646,11 @@ void Editor::undo()
 
 void Editor::redo()
 {
-	if ( mBackupList.size() > 0 && mBackupIndex < mBackupList.size() - 2 )
+	if ( mBackupIndex + 1 < mBackupList.size() )
 	{
+		stopPrefetch();
 		mBackupIndex++;
-		mBackupList[ mBackupIndex + 1 ]->restore( this );
+		mBackupList[ mBackupIndex ]->redo( this );
         emit updateBackup();
 	}
 }
@@ -363,7 +689,7 @@ void Editor::copy()
 				g_clipboardBitmapImage = ( (LayerBitmap*)layer )->getLastBitmapImageAtFrame( currentFrame(), 0 )->copy();  // copy the whole image
 			}
 			clipboardBitmapOk = true;
-			if ( g_clipboardBitmapImage.image() != NULL ) QApplication::clipboard()->setImage( *g_clipboardBitmapImage.image() );
+			QApplication::clipboard()->setImage( g_clipboardBitmapImage.toImage() );
 		}
 		if ( layer->type() == Layer::VECTOR )
 		{
@@ -378,11 +704,11 @@ void Editor::paste()
 	Layer* layer = mObject->getLayer( layers()->currentLayerIndex() );
 	if ( layer != NULL )
 	{
-		if ( layer->type() == Layer::BITMAP && g_clipboardBitmapImage.image() != NULL )
+		if ( layer->type() == Layer::BITMAP && !g_clipboardBitmapImage.toImage().isNull() )
 		{
 			backup( tr( "Paste" ) );
 			BitmapImage tobePasted = g_clipboardBitmapImage.copy();
-			qDebug() << "to be pasted --->" << tobePasted.image()->size();
+			qDebug() << "to be pasted --->" << tobePasted.bounds().size();
 			if ( mScribbleArea->somethingSelected )
 			{
 				QRectF selection = mScribbleArea->getSelection();
@@ -426,8 +752,7 @@ void Editor::clipboardChanged()
 	if ( clipboardBitmapOk == false )
 	{
 		g_clipboardBitmapImage.setImage( new QImage( QApplication::clipboard()->image() ) );
-		g_clipboardBitmapImage.bounds() = QRect( g_clipboardBitmapImage.topLeft(), g_clipboardBitmapImage.image()->size() );
-		qDebug() << "New clipboard image" << g_clipboardBitmapImage.image()->size();
+		qDebug() << "New clipboard image" << g_clipboardBitmapImage.bounds().size();
 	}
 	else
 	{
@@ -488,6 +813,7 @@ Status Editor::setObject( Object* newObject )
         return Status::SAFE;
     }
 
+    stopPrefetch();
     mObject.reset( newObject );
 
 
@@ -523,44 +849,6 @@ void Editor::updateObject()
     emit updateLayerCount();
 }
 
-bool Editor::exportSeqCLI( QString filePath, QString format, int width, int height, bool transparency, bool antialias )
-{
-    // Get the camera layer
-    int cameraLayerId = mLayerManager->getLastCameraLayer();
-    LayerCamera *cameraLayer = dynamic_cast< LayerCamera* >(mObject->getLayer(cameraLayerId));
-
-	if ( width < 0 )
-	{
-        width = cameraLayer->getViewRect().width();
-    }
-	if ( height < 0 )
-	{
-        height = cameraLayer->getViewRect().height();
-    }
-
-	QSize exportSize = QSize( width, height );
-	QByteArray exportFormat( format.toLatin1() );
-
-	//QTransform view = RectMapTransform( mScribbleArea->getViewRect(), QRectF( QPointF( 0, 0 ), exportSize ) );
-    //view = mScribbleArea->getView() * view;
-
-    int projectLength = mLayerManager->projectLength();
-
-    mObject->exportFrames( 1,
-                           projectLength,
-                           cameraLayer,
-						   exportSize,
-						   filePath,
-                           exportFormat,
-                           -1,
-                           transparency,
-                           antialias,
-                           NULL,
-                           0 );
-
-	return true;
-}
-
 QString Editor::workingDir() const
 {
     return mObject->workingDir();
@@ -601,6 +889,74 @@ bool Editor::importBitmapImage( QString filePath )
 	return true;
 }
 
+Status Editor::importMovie( MovieImporter& importer, ImportMovieDesc desc, std::function<void( float )> progress )
+{
+	Layer* layer = layers()->currentLayer();
+	if ( layer == nullptr || layer->type() != Layer::BITMAP )
+	{
+		return Status::ERROR_INVALID_LAYER_TYPE;
+	}
+
+	desc.startFrame = currentFrame();
+	desc.centre = mScribbleArea->getCentralPoint().toPoint();
+
+	std::vector< BitmapImage* > keys;
+	STATUS_CHECK( importer.run( desc, keys, progress ) );
+
+	insertBitmapKeys( layers()->currentLayerIndex(), keys, tr( "Import Movie" ) );
+	return Status::OK;
+}
+
+Status Editor::importImageSequence( QStringList files, int frameStep, bool autoCrop, std::function<void( float )> progress,
+                                   const std::atomic<bool>* canceled )
+{
+	Layer* layer = layers()->currentLayer();
+	if ( layer == nullptr || layer->type() != Layer::BITMAP )
+	{
+		return Status::ERROR_INVALID_LAYER_TYPE;
+	}
+
+	std::vector< BitmapImage* > keys;
+	Status st = LayerBitmap::loadImages( files, currentFrame(), frameStep, mScribbleArea->getCentralPoint().toPoint(),
+	                                     autoCrop, keys, progress, canceled );
+	if ( !st.ok() )
+	{
+		return st;
+	}
+	if ( keys.empty() )
+	{
+		return Status::FAIL;
+	}
+
+	insertBitmapKeys( layers()->currentLayerIndex(), keys, tr( "Import Image Sequence" ) );
+	return st; // lists the files left out
+}
+
+// Adds a batch of imported images to the layer as one undo step, then refreshes the canvas and the timeline once
+void Editor::insertBitmapKeys( int layerIndex, std::vector< BitmapImage* >& keys, QString undoText )
+{
+	LayerBitmap* layer = static_cast< LayerBitmap* >( mObject->getLayer( layerIndex ) );
+	Q_ASSERT( layer->type() == Layer::BITMAP );
+	if ( keys.empty() )
+	{
+		return;
+	}
+
+	std::vector< int > positions;
+	positions.reserve( keys.size() );
+	for ( BitmapImage* key : keys )
+	{
+		positions.push_back( key->pos() );
+	}
+	backupKeys( layerIndex, positions, undoText );
+
+	const int lastFrame = keys.back()->pos();
+	layer->insertImages( keys );
+
+	mScribbleArea->setModified( layerIndex, lastFrame );
+	scrubTo( lastFrame );
+}
+
 bool Editor::importVectorImage( QString filePath )
 {
 	Q_ASSERT( layers()->currentLayer()->type() == Layer::VECTOR );
@@ -709,6 +1065,7 @@ void Editor::moveFrameForward()
 	Layer* layer = layers()->currentLayer();
 	if ( layer != NULL )
 	{
+		stopPrefetch();
 		if ( layer->moveKeyFrameForward( currentFrame() ) )
 		{
 			mScribbleArea->updateAllFrames();
@@ -722,6 +1079,7 @@ void Editor::moveFrameBackward()
 	Layer* layer = layers()->currentLayer();
 	if ( layer != NULL )
 	{
+		stopPrefetch();
 		if ( layer->moveKeyFrameBackward( currentFrame() ) )
 		{
 			mScribbleArea->updateAllFrames();
@@ -777,6 +1135,7 @@ KeyFrame* Editor::addKeyFame( int layerNumber, int frameIndex )
     KeyFrame* keyFrame = KeyFrameFactory::create( layer->type(), mObject.get() );
     if ( keyFrame != nullptr )
     {
+        stopPrefetch();
         isOK = layer->addKeyFrame( frameIndex, keyFrame );
     }
     else
@@ -798,6 +1157,7 @@ void Editor::removeKey()
 	Layer* layer = layers()->currentLayer();
 	if ( layer != NULL )
     {
+		stopPrefetch();
 		layer->removeKeyFrame( currentFrame() );
 		
 		scrubBackward();
@@ -833,6 +1193,7 @@ void Editor::setCurrentLayer( int layerNumber )
 void Editor::switchVisibilityOfLayer( int layerNumber )
 {
 	Layer* layer = mObject->getLayer( layerNumber );
+	stopPrefetch();
 	if ( layer != NULL ) layer->switchVisibility();
 	mScribbleArea->updateAllFrames();
 
@@ -841,6 +1202,7 @@ void Editor::switchVisibilityOfLayer( int layerNumber )
 
 void Editor::moveLayer( int i, int j )
 {
+	stopPrefetch();
 	mObject->moveLayer( i, j );
 	if ( j < i )
 	{
@@ -18,10 +18,14 @@ GNU General Public License for more details.
 #ifndef EDITOR_H
 #define EDITOR_H
 
+#include <atomic>
 #include <memory>
+#include <functional>
+#include <vector>
 #include <QList>
 #include "backupelement.h"
 #include "pencilerror.h"
+#include "movieimporter.h"
 
 
 class QDragEnterEvent;
@@ -38,6 +42,7 @@ class PreferenceManager;
 class SoundManager;
 class ScribbleArea;
 class TimeLine;
+class BitmapImage;
 
 enum class SETTING;
 
@@ -78,6 +83,8 @@ public:
 
     void setScribbleArea( ScribbleArea* pScirbbleArea ) { mScribbleArea = pScirbbleArea; }
     ScribbleArea* getScribbleArea() { return mScribbleArea; }
+    // The playback prefetch paints the object from other threads, call this before changing it
+    void stopPrefetch();
 
     int  currentFrame();
     int  fps();
@@ -85,16 +92,23 @@ public:
     void scrubTo( int frameNumber );
 
     int  allLayers();
-    bool exportSeqCLI( QString filePath, QString format = "PNG", int width = -1, int height = -1, bool transparency = false, bool antialias = true );
     
     QString workingDir() const;
 
-    void importMovie( QString filePath, int fps );
+    // Decodes the movie into keys of the current bitmap layer from the current frame on
+    Status importMovie( MovieImporter& importer, ImportMovieDesc desc, std::function<void( float )> progress );
+    // Decodes the images in parallel into keys of the current bitmap layer, one every frameStep frames
+    Status importImageSequence( QStringList files, int frameStep, bool autoCrop, std::function<void( float )> progress,
+                                const std::atomic<bool>* canceled = nullptr );
 
     // backup
     int mBackupIndex;
     BackupElement* currentBackup();
     QList<BackupElement*> mBackupList;
+    // Oldest undo steps are dropped once the stack holds more than this
+    void   setUndoMemoryLimit( qint64 bytes );
+    qint64 undoMemoryLimit() const { return mUndoMemoryLimit; }
+    qint64 undoMemoryUsage();
 
 Q_SIGNALS:
     void updateTimeLine();
@@ -139,6 +153,8 @@ public: //slots
 
     void backup( QString undoText );
     void backup( int layerNumber, int frameNumber, QString undoText );
+    // Before a batch of bitmap keys lands on these positions of a layer
+    void backupKeys( int layerNumber, const std::vector< int >& positions, QString undoText );
     void undo();
     void redo();
     void copy();
@@ -163,6 +179,7 @@ protected:
 private:
     bool importBitmapImage( QString );
     bool importVectorImage( QString );
+    void insertBitmapKeys( int layerIndex, std::vector< BitmapImage* >& keys, QString undoText );
 
     // the object to be edited by the editor
     std::shared_ptr<Object> mObject = nullptr;
@@ -192,6 +209,10 @@ private:
 
     // backup
     void clearUndoStack();
+    void sealBackups();
+    void addBackup( BackupElement* element, QString undoText );
+    void trimBackups();
+    qint64 mUndoMemoryLimit = 256 * 1024 * 1024;
     int lastModifiedFrame;
     int lastModifiedLayer;
 
@@ -21,6 +21,9 @@ GNU General Public License for more details.
 #include <QScopedPointer>
 #include <QMessageBox>
 #include <QPixmapCache>
+#include <QScreen>
+#include <QWindow>
+#include <QGuiApplication>
 
 #include "beziercurve.h"
 #include "object.h"
@@ -48,10 +51,16 @@ mLog( "ScribbleArea" )
     setAttribute( Qt::WA_StaticContents );
 
     mStrokeManager.reset( new StrokeManager );
+
+    mStrokeDispatchTimer.setSingleShot( true );
+    mStrokeDispatchTimer.setTimerType( Qt::PreciseTimer );
+    connect( &mStrokeDispatchTimer, &QTimer::timeout, this, &ScribbleArea::dispatchStrokeSamples );
+    mStrokeDispatchClock.start();
 }
 
 ScribbleArea::~ScribbleArea()
 {
+    mPrefetcher.stop();
 	delete mBufferImg;
 }
 
@@ -168,6 +177,13 @@ void ScribbleArea::updateCurrentFrame()
 }
 
 void ScribbleArea::updateFrame( int frame )
+{
+    mCanvasRenderer.invalidateFrame( mEditor->object(), frame );
+    restartPrefetch();
+    redrawFrame( frame );
+}
+
+void ScribbleArea::redrawFrame( int frame )
 {
     int frameNumber = mEditor->layers()->LastFrameAtFrame( frame );
 
@@ -179,14 +195,23 @@ void ScribbleArea::updateFrame( int frame )
 
 	QPixmapCache::remove( mPixmapCacheKeys[ frameNumber ] );
 	mPixmapCacheKeys[ frameNumber] = QPixmapCache::Key();
+    mCanvasFrame = -1;
 
     update();
 }
 
 void ScribbleArea::updateAllFrames()
 {
+    mCanvasRenderer.invalidateAll();
+    redrawAllFrames();
+}
+
+void ScribbleArea::redrawAllFrames()
+{
+    restartPrefetch(); // the view or the drawings changed
     QPixmapCache::clear();
 	std::fill( mPixmapCacheKeys.begin(), mPixmapCacheKeys.end(), QPixmapCache::Key() );
+    mCanvasFrame = -1;
 
     update();
     mNeedUpdateAll = false;
@@ -224,6 +249,47 @@ void ScribbleArea::updateAllVectorLayers()
     updateAllFrames();
 }
 
+void ScribbleArea::setPlaying( bool isPlaying )
+{
+    if ( isPlaying )
+    {
+        startPrefetch();
+    }
+    else if ( mPrefetcher.isRunning() )
+    {
+        qCDebug( mLog ) << "Playback dropped" << mPrefetcher.droppedFrames() << "frames";
+        mPrefetcher.stop();
+        redrawFrame( mEditor->currentFrame() );
+    }
+}
+
+void ScribbleArea::startPrefetch()
+{
+    PlaybackManager* playback = mEditor->playback();
+    mPrefetcher.start( mEditor->object(),
+                       mEditor->currentFrame(),
+                       playback->startFrame(),
+                       playback->endFrame(),
+                       playback->isLooping(),
+                       mEditor->view()->getView(),
+                       size(),
+                       mPrefs->isOn( SETTING::ANTIALIAS ) );
+}
+
+void ScribbleArea::stopPrefetch()
+{
+    mPrefetcher.stop();
+}
+
+// A playback whose prefetch was stopped for an edit or a stroke picks it up again
+void ScribbleArea::restartPrefetch()
+{
+    if ( mEditor->playback()->isPlaying() && !mMouseInUse )
+    {
+        startPrefetch();
+    }
+}
+
 void ScribbleArea::setModified( int layerNumber, int frameNumber )
 {
     Layer *layer = mEditor->object()->getLayer( layerNumber );
@@ -428,6 +494,7 @@ void ScribbleArea::tabletEvent( QTabletEvent *event )
 {
     //qDebug() << "Device" << event->device() << "Pointer type" << event->pointerType();
     mStrokeManager->tabletEvent( event );
+    mTabletCursor = ( event->device() != QTabletEvent::NoDevice && event->pointerType() == QTabletEvent::Cursor );
 
     // Some tablets return "NoDevice" and Cursor.
     if (event->device() == QTabletEvent::NoDevice) {
@@ -479,8 +546,11 @@ bool ScribbleArea::areLayersSane() const
 
 void ScribbleArea::mousePressEvent( QMouseEvent* event )
 {
+    // tools change the drawings, which the prefetch threads may be reading
+    mPrefetcher.stop();
     mMouseInUse = true;
 
+    mStrokeDispatchTimer.stop();
     mStrokeManager->mousePressEvent( event );
 
     mUsePressure = currentTool()->properties.pressure;
@@ -590,6 +660,17 @@ void ScribbleArea::mouseMoveEvent( QMouseEvent *event )
 
     Q_EMIT refreshPreview();
 
+    // A tablet sends moves much faster than the screen shows them, a stroke
+    // takes them in once per frame instead of painting after each.
+    if ( event->buttons() == Qt::LeftButton && !currentTool()->isAdjusting && isStrokeTool() )
+    {
+        mStrokeManager->queueSample( event );
+        mStrokeButtons = event->buttons();
+        mStrokeModifiers = event->modifiers();
+        scheduleStrokeDispatch();
+        return;
+    }
+
     mStrokeManager->mouseMoveEvent( event );
     mCurrentPixel = mStrokeManager->getCurrentPixel();
     mCurrentPoint = mEditor->view()->mapScreenToCanvas( mCurrentPixel );
@@ -638,6 +719,26 @@ void ScribbleArea::mouseMoveEvent( QMouseEvent *event )
 
 void ScribbleArea::mouseReleaseEvent( QMouseEvent *event )
 {
+    // the stroke gets all of its moves before it ends
+    mStrokeDispatchTimer.stop();
+    if ( mStrokeManager->hasPendingSamples() )
+    {
+        dispatchStrokeSamples();
+    }
+    if ( mStrokeManager->latency().samples > 0 )
+    {
+        const StrokeLatency& latency = mStrokeManager->latency();
+        qCDebug( mLog ) << "Stroke latency: mean" << latency.meanMs << "ms, max" << latency.maxMs << "ms,"
+                        << latency.samples << "samples in" << latency.frames << "frames,"
+                        << latency.coalesced << "coalesced";
+    }
+    if ( mDabRasterizer.dabCount() > 0 )
+    {
+        qCDebug( mLog ) << "Brush:" << mDabRasterizer.dabCount() << "dabs at"
+                        << qRound( mDabRasterizer.dabsPerSecond() ) << "dabs/s";
+        mDabRasterizer.resetStats();
+    }
+
     mMouseInUse = false;
 
     // ---- checks ------
@@ -645,6 +746,7 @@ void ScribbleArea::mouseReleaseEvent( QMouseEvent *event )
     {
         currentTool()->stopAdjusting();
         mEditor->tools()->setWidth( currentTool()->properties.width );
+        restartPrefetch();
         return; // [SHIFT]+drag OR [CTRL]+drag
     }
 
@@ -654,6 +756,7 @@ void ScribbleArea::mouseReleaseEvent( QMouseEvent *event )
     {
         getTool( HAND )->mouseReleaseEvent( event );
         mMouseRightButtonInUse = false;
+        restartPrefetch();
         return;
     }
 
@@ -669,6 +772,7 @@ void ScribbleArea::mouseReleaseEvent( QMouseEvent *event )
     {
         setPrevTool();
     }
+    restartPrefetch();
 }
 
 void ScribbleArea::mouseDoubleClickEvent( QMouseEvent *event )
@@ -681,6 +785,7 @@ void ScribbleArea::resizeEvent( QResizeEvent *event )
     QWidget::resizeEvent( event );
     mCanvas = QPixmap( size() );
     mCanvas.fill(Qt::transparent);
+    mCanvasFrame = -1;
 
     this->setStyleSheet("background-color:yellow;");
 
@@ -726,7 +831,7 @@ void ScribbleArea::paintBitmapBuffer( )
 
     //qCDebug( mLog ) << "Paste Rect" << mBufferImg->bounds();
 
-    QRect rect = mEditor->view()->getView().mapRect( mBufferImg->bounds() );
+    QRect changed = mBufferImg->bounds();
 
     // Clear the buffer
     mBufferImg->clear();
@@ -734,12 +839,7 @@ void ScribbleArea::paintBitmapBuffer( )
     layer->setModified( mEditor->currentFrame(), true );
     emit modification();
 
-	int frameNumber = mEditor->currentFrame();
-	QPixmapCache::remove( mPixmapCacheKeys[frameNumber] );
-	mPixmapCacheKeys[frameNumber] = QPixmapCache::Key();
-
-    drawCanvas( mEditor->currentFrame(), rect.adjusted( -1, -1, 1, 1 ) );
-    update( rect );
+    redrawCanvasRect( changed );
 }
 
 void ScribbleArea::paintBitmapBufferRect( QRect rect )
@@ -777,19 +877,52 @@ void ScribbleArea::paintBitmapBufferRect( QRect rect )
 
         //qCDebug( mLog ) << "Paste Rect" << mBufferImg->bounds();
 
+        // the dabs reach further than their centres in rect
+        QRect changed = mBufferImg->bounds().united( rect );
+
         // Clear the buffer
         mBufferImg->clear();
 
         layer->setModified( mEditor->currentFrame(), true );
         emit modification();
 
-        int frameNumber = mEditor->currentFrame();
-        QPixmapCache::remove( mPixmapCacheKeys[frameNumber] );
-        mPixmapCacheKeys[frameNumber] = QPixmapCache::Key();
+        redrawCanvasRect( changed );
+    }
+}
+
+// Recomposites the part of the current frame a change covers, given in canvas
+// coordinates, instead of the whole canvas.
+void ScribbleArea::redrawCanvasRect( QRectF canvasRect )
+{
+    int frame = mEditor->currentFrame();
+    int frameNumber = mEditor->layers()->LastFrameAtFrame( frame );
+    QTransform view = mEditor->view()->getView();
+    QRect rect = view.mapRect( canvasRect ).toAlignedRect().adjusted( -1, -1, 1, 1 ) & mCanvas.rect();
+
+    if ( frameNumber >= 0 && static_cast< unsigned >( frameNumber ) < mPixmapCacheKeys.size() )
+    {
+        // the cache has to let go of the pixmap, or painting it would copy all of it
+        QPixmapCache::remove( mPixmapCacheKeys[ frameNumber ] );
+        mPixmapCacheKeys[ frameNumber ] = QPixmapCache::Key();
+    }
 
-        drawCanvas( mEditor->currentFrame(), rect.adjusted( -1, -1, 1, 1 ) );
+    if ( mCanvasFrame != frame || mCanvasView != view || mCanvas.size() != size() )
+    {
+        // the canvas shows something else, it's painted over in full
+        mCanvas = QPixmap( size() );
+        drawCanvas( frame, QRect() );
+        update();
+    }
+    else if ( !rect.isEmpty() )
+    {
+        drawCanvas( frame, rect );
         update( rect );
     }
+
+    if ( frameNumber >= 0 && static_cast< unsigned >( frameNumber ) < mPixmapCacheKeys.size() )
+    {
+        mPixmapCacheKeys[ frameNumber ] = QPixmapCache::insert( mCanvas );
+    }
 }
 
 void ScribbleArea::clearBitmapBuffer()
@@ -872,7 +1005,19 @@ void ScribbleArea::updateCanvasCursor()
 
 void ScribbleArea::paintEvent( QPaintEvent* event )
 {
-    if ( !mMouseInUse || currentTool()->type() == MOVE || currentTool()->type() == HAND || mMouseRightButtonInUse)
+    if ( mPrefetcher.isRunning() )
+    {
+        // playing: the frame was rendered ahead, when it isn't ready the last one stays up
+        QImage frameImage;
+        if ( mPrefetcher.takeFrame( mEditor->currentFrame(), frameImage ) )
+        {
+            mCanvas = QPixmap::fromImage( frameImage );
+            mCanvasFrame = -1; // not painted here
+        }
+        // the prefetch decodes keys as it goes, keep them within the memory limit
+        BitmapImage::trimLoadedImages();
+    }
+    else if ( !mMouseInUse || currentTool()->type() == MOVE || currentTool()->type() == HAND || mMouseRightButtonInUse)
     {
         // --- we retrieve the canvas from the cache; we create it if it doesn't exist
         int curIndex = mEditor->currentFrame();
@@ -880,9 +1025,14 @@ void ScribbleArea::paintEvent( QPaintEvent* event )
 
 		QPixmapCache::Key cachedKey = mPixmapCacheKeys[frameNumber];
 
-        if ( !QPixmapCache::find( cachedKey, &mCanvas ) )
+        if ( QPixmapCache::find( cachedKey, &mCanvas ) )
         {
-            drawCanvas( mEditor->currentFrame(), event->rect() );
+            mCanvasFrame = curIndex;
+        }
+        else
+        {
+            // all of it, the pixmap is cached for the frame
+            drawCanvas( mEditor->currentFrame(), QRect() );
             
 			mPixmapCacheKeys[frameNumber] = QPixmapCache::insert( mCanvas );
 			//qDebug() << "Repaint canvas!";
@@ -991,7 +1141,7 @@ void ScribbleArea::paintEvent( QPaintEvent* event )
                             // safety check
                             continue;
                         }
-                        BezierCurve myCurve = vectorImage->m_curves[ mClosestCurves[ k ] ];
+                        BezierCurve myCurve = vectorImage->m_curves.at( mClosestCurves[ k ] );
                         if ( myCurve.isPartlySelected() )
                         {
                             myCurve.transform( selectionTransformation );
@@ -1079,9 +1229,64 @@ void ScribbleArea::paintEvent( QPaintEvent* event )
     painter.drawRect( QRect( 0, 0, width(), height() ) );
 #endif
 
+    mStrokeManager->framePainted();
+
     event->accept();
 }
 
+bool ScribbleArea::isStrokeTool()
+{
+    switch ( currentTool()->type() )
+    {
+        case PENCIL:
+        case ERASER:
+        case PEN:
+        case BRUSH:
+        case SMUDGE:
+        case BUCKET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// At once when the last dispatch is a frame ago, at the next frame otherwise
+void ScribbleArea::scheduleStrokeDispatch()
+{
+    if ( mStrokeDispatchTimer.isActive() )
+    {
+        return;
+    }
+
+    QScreen* screen = ( window()->windowHandle() ) ? window()->windowHandle()->screen() : QGuiApplication::primaryScreen();
+    qreal refreshRate = ( screen && screen->refreshRate() >= 1 ) ? screen->refreshRate() : 60.0;
+    qint64 frameNs = qint64( 1.0e9 / refreshRate );
+
+    qint64 sinceLast = mStrokeDispatchClock.nsecsElapsed() - mLastStrokeDispatch;
+    mStrokeDispatchTimer.start( int( qMax( 0LL, ( frameNs - sinceLast ) / 1000000 ) ) );
+}
+
+void ScribbleArea::dispatchStrokeSamples()
+{
+    mLastStrokeDispatch = mStrokeDispatchClock.nsecsElapsed();
+
+    StrokeSample sample;
+    while ( mStrokeManager->dispatchSample( sample ) )
+    {
+        mCurrentPixel = mStrokeManager->getCurrentPixel();
+        mCurrentPoint = mEditor->view()->mapScreenToCanvas( mCurrentPixel );
+        mOffset = mCurrentPoint - mLastPoint;
+
+        if ( mStrokeManager->isTabletInUse() )
+        {
+            currentTool()->adjustPressureSensitiveProperties( sample.pressure, mTabletCursor );
+        }
+
+        QMouseEvent moveEvent( QEvent::MouseMove, sample.pos, Qt::NoButton, mStrokeButtons, mStrokeModifiers );
+        currentTool()->mouseMoveEvent( &moveEvent );
+    }
+}
+
 void ScribbleArea::drawCanvas( int frame, QRect rect )
 {
     Object* object = mEditor->object();
@@ -1111,6 +1316,14 @@ void ScribbleArea::drawCanvas( int frame, QRect rect )
     mCanvasRenderer.setCanvas( &mCanvas );
     mCanvasRenderer.setViewTransform( mEditor->view()->getView() );
     mCanvasRenderer.paint( object, mEditor->layers()->currentLayerIndex(), frame, rect );
+    if ( rect.isNull() )
+    {
+        mCanvasFrame = frame;
+        mCanvasView = mEditor->view()->getView();
+    }
+
+    // the frames just painted are the most recently used, they are the last to go
+    BitmapImage::trimLoadedImages();
 
     return;
 }
@@ -1154,23 +1367,7 @@ void ScribbleArea::drawPencil( QPointF thePoint, qreal brushWidth, QColor fillCo
 
 void ScribbleArea::drawBrush( QPointF thePoint, qreal brushWidth, qreal mOffset, QColor fillColour, qreal opacity, bool usingFeather, int useAA )
 {
-    QRectF rectangle( thePoint.x() - 0.5 * brushWidth, thePoint.y() - 0.5 * brushWidth, brushWidth, brushWidth );
-
-    BitmapImage gradientImg;
-    if (usingFeather==true)
-    {
-        QRadialGradient radialGrad( thePoint, 0.5 * brushWidth );
-        setGaussianGradient( radialGrad, fillColour, opacity, mOffset );
-
-        gradientImg.drawEllipse( rectangle, Qt::NoPen, radialGrad,
-                                   QPainter::CompositionMode_SourceOver, false );
-    }
-    else
-    {
-        mBufferImg->drawEllipse( rectangle, Qt::NoPen, QBrush(fillColour, Qt::SolidPattern),
-                                   QPainter::CompositionMode_SourceOver, useAA );
-    }
-    mBufferImg->paste( &gradientImg );
+    mDabRasterizer.stamp( mBufferImg, thePoint, brushWidth, mOffset, fillColour, opacity, usingFeather, useAA );
 }
 
 /**
@@ -1202,76 +1399,6 @@ void ScribbleArea::flipSelection(bool flipVertical)
     applyTransformedSelection();
 }
 
-void ScribbleArea::blurBrush( BitmapImage *bmiSource_, QPointF srcPoint_, QPointF thePoint_, qreal brushWidth_, qreal mOffset_, qreal opacity_ )
-{
-    QRadialGradient radialGrad( thePoint_, 0.5 * brushWidth_ );
-    setGaussianGradient( radialGrad, QColor( 255, 255, 255, 127 ), opacity_, mOffset_ );
-
-    QRectF srcRect( srcPoint_.x() - 0.5 * brushWidth_, srcPoint_.y() - 0.5 * brushWidth_, brushWidth_, brushWidth_ );
-    QRectF trgRect( thePoint_.x() - 0.5 * brushWidth_, thePoint_.y() - 0.5 * brushWidth_, brushWidth_, brushWidth_ );
-
-    BitmapImage bmiSrcClip = bmiSource_->copy( srcRect.toRect() );
-    BitmapImage bmiTmpClip = bmiSrcClip; // todo: find a shorter way
-
-    bmiTmpClip.drawRect( srcRect, Qt::NoPen, radialGrad, QPainter::CompositionMode_Source, mPrefs->isOn( SETTING::ANTIALIAS ) );
-    bmiSrcClip.bounds().moveTo( trgRect.topLeft().toPoint() );
-    bmiTmpClip.paste( &bmiSrcClip, QPainter::CompositionMode_SourceAtop );
-    mBufferImg->paste( &bmiTmpClip );
-}
-
-void ScribbleArea::liquifyBrush( BitmapImage *bmiSource_, QPointF srcPoint_, QPointF thePoint_, qreal brushWidth_, qreal mOffset_, qreal opacity_ )
-{
-    QPointF delta = ( thePoint_ - srcPoint_ ); // increment vector
-    QRectF trgRect( thePoint_.x() - 0.5 * brushWidth_, thePoint_.y() - 0.5 * brushWidth_, brushWidth_, brushWidth_ );
-
-    QRadialGradient radialGrad( thePoint_, 0.5 * brushWidth_ );
-    setGaussianGradient( radialGrad, QColor( 255, 255, 255, 255 ), opacity_, mOffset_ );
-
-    // Create gradient brush
-    BitmapImage* bmiTmpClip = new BitmapImage;
-    bmiTmpClip->drawRect( trgRect, Qt::NoPen, radialGrad, QPainter::CompositionMode_Source, mPrefs->isOn( SETTING::ANTIALIAS ) );
-
-    // Slide texture/pixels of the source image
-    qreal factor, factorGrad;
-    int xb, yb, xa, ya;
-
-    for ( yb = bmiTmpClip->bounds().top(); yb < bmiTmpClip->bounds().bottom(); yb++ )
-    {
-        for ( xb = bmiTmpClip->bounds().left(); xb < bmiTmpClip->bounds().right(); xb++ )
-        {
-            QColor color;
-            color.setRgba( bmiTmpClip->pixel( xb, yb ) );
-            factorGrad = color.alphaF(); // any from r g b a is ok
-
-            xa = xb - factorGrad*delta.x();
-            ya = yb - factorGrad*delta.y();
-
-            color.setRgba( bmiSource_->pixel( xa, ya ) );
-            factor = color.alphaF();
-
-            if ( factor > 0.0 )
-            {
-                color.setRed( color.red() / factor );
-                color.setGreen( color.green() / factor );
-                color.setBlue( color.blue() / factor );
-                color.setAlpha( 255 ); // Premultiplied color
-
-                color.setRed( color.red()*factorGrad );
-                color.setGreen( color.green()*factorGrad );
-                color.setBlue( color.blue()*factorGrad );
-                color.setAlpha( 255 * factorGrad ); // Premultiplied color
-
-                bmiTmpClip->setPixel( xb, yb, color.rgba() );
-            }
-            else {
-                bmiTmpClip->setPixel( xb, yb, qRgba( 255, 255, 255, 255 ) );
-            }
-        }
-    }
-    mBufferImg->paste( bmiTmpClip );
-    delete bmiTmpClip;
-}
-
 void ScribbleArea::drawPolyline(QPainterPath path, QPen pen, bool useAA)
 {
     QRectF updateRect = mEditor->view()->mapCanvasToScreen( path.boundingRect().toRect() ).adjusted( -1, -1, 1, 1);
@@ -1525,17 +1652,17 @@ void ScribbleArea::displaySelectionProperties()
             int selectedCurve = vectorImage->getFirstSelectedCurve();
             if ( selectedCurve != -1 )
             {
-                mEditor->tools()->setWidth( vectorImage->m_curves[ selectedCurve ].getWidth() );
-                mEditor->tools()->setFeather( vectorImage->m_curves[ selectedCurve ].getFeather() );
-                mEditor->tools()->setInvisibility( vectorImage->m_curves[ selectedCurve ].isInvisible() );
-                mEditor->tools()->setPressure( vectorImage->m_curves[ selectedCurve ].getVariableWidth() );
-                mEditor->color()->setColorNumber( vectorImage->m_curves[ selectedCurve ].getColourNumber() );
+                mEditor->tools()->setWidth( vectorImage->m_curves.at( selectedCurve ).getWidth() );
+                mEditor->tools()->setFeather( vectorImage->m_curves.at( selectedCurve ).getFeather() );
+                mEditor->tools()->setInvisibility( vectorImage->m_curves.at( selectedCurve ).isInvisible() );
+                mEditor->tools()->setPressure( vectorImage->m_curves.at( selectedCurve ).getVariableWidth() );
+                mEditor->color()->setColorNumber( vectorImage->m_curves.at( selectedCurve ).getColourNumber() );
             }
 
             int selectedArea = vectorImage->getFirstSelectedArea();
             if ( selectedArea != -1 )
             {
-                mEditor->color()->setColorNumber( vectorImage->area[ selectedArea ].mColourNumber );
+                mEditor->color()->setColorNumber( vectorImage->area.at( selectedArea ).mColourNumber );
             }
         }
     }
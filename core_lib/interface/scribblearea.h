@@ -29,16 +29,20 @@ GNU General Public License for more details.
 #include <QPoint>
 #include <QWidget>
 #include <QPixmapCache>
+#include <QTimer>
+#include <QElapsedTimer>
 
 #include "log.h"
 #include "pencildef.h"
 #include "vectorimage.h"
 #include "bitmapimage.h"
+#include "dabrasterizer.h"
 #include "colourref.h"
 #include "vectorselection.h"
 #include "colormanager.h"
 #include "viewmanager.h"
 #include "canvasrenderer.h"
+#include "frameprefetcher.h"
 #include "preferencemanager.h"
 
 
@@ -99,6 +103,9 @@ public:
     void updateCurrentFrame();
     void updateFrame( int frame );
     void updateAllFrames();
+    // Re-composite without re-rasterizing the layers, for when only the view or current frame changed
+    void redrawFrame( int frame );
+    void redrawAllFrames();
     void updateAllVectorLayersAtCurrentFrame();
     void updateAllVectorLayersAt( int frame );
     void updateAllVectorLayers();
@@ -120,6 +127,8 @@ public:
 
     bool isMouseInUse() { return mMouseInUse; }
 
+    const FramePrefetcher& prefetcher() const { return mPrefetcher; }
+
 signals:
     void modification();
     void modification( int );
@@ -147,6 +156,9 @@ public slots:
     void updateToolCursor();
     void paletteColorChanged(QColor);
 
+    void setPlaying( bool isPlaying );
+    void stopPrefetch(); // until the next redraw, before the object changes
+
 protected:
     void tabletEvent( QTabletEvent* ) override;
     void wheelEvent( QWheelEvent* ) override;
@@ -166,8 +178,6 @@ public:
     void drawPen( QPointF thePoint, qreal brushWidth, QColor fillColour, bool useAA = true );
     void drawPencil( QPointF thePoint, qreal brushWidth, QColor fillColour, qreal opacity );
     void drawBrush( QPointF thePoint, qreal brushWidth, qreal offset, QColor fillColour, qreal opacity, bool usingFeather = true, int useAA = 0 );
-    void blurBrush( BitmapImage *bmiSource_, QPointF srcPoint_, QPointF thePoint_, qreal brushWidth_, qreal offset_, qreal opacity_ );
-    void liquifyBrush( BitmapImage *bmiSource_, QPointF srcPoint_, QPointF thePoint_, qreal brushWidth_, qreal offset_, qreal opacity_ );
 
     void paintBitmapBuffer();
     void paintBitmapBufferRect( QRect rect );
@@ -181,12 +191,19 @@ public:
 
     BitmapImage* mBufferImg = nullptr; // used to pre-draw vector modifications
     BitmapImage* mStrokeImg = nullptr; // used for brush strokes before they are finalized
+    DabRasterizer mDabRasterizer; // brush, eraser and pencil dabs into mBufferImg
 
     QPixmap mCursorImg;
 
 private:
     void drawCanvas( int frame, QRect rect );
+    void redrawCanvasRect( QRectF canvasRect );
     void settingUpdated(SETTING setting);
+    void startPrefetch();
+    void restartPrefetch();
+    bool isStrokeTool();
+    void scheduleStrokeDispatch();
+    void dispatchStrokeSamples();
 
     MoveMode mMoveMode = MIDDLE;
     ToolType mPrevTemporalToolType;
@@ -197,6 +214,14 @@ private:
 
     std::unique_ptr< StrokeManager > mStrokeManager;
 
+    // Moves of a stroke reach the tool once per display frame
+    QTimer mStrokeDispatchTimer;
+    QElapsedTimer mStrokeDispatchClock;
+    qint64 mLastStrokeDispatch = 0;
+    Qt::MouseButtons mStrokeButtons = Qt::NoButton;
+    Qt::KeyboardModifiers mStrokeModifiers = Qt::NoModifier;
+    bool mTabletCursor = false;
+
     Editor* mEditor = nullptr;
 
     bool mIsSimplified  = false;
@@ -236,7 +261,10 @@ private:
     PreferenceManager *mPrefs = nullptr;
 
     QPixmap mCanvas;
+    int mCanvasFrame = -1;   // what mCanvas was painted for in full
+    QTransform mCanvasView;
     CanvasRenderer mCanvasRenderer;
+    FramePrefetcher mPrefetcher; // frames ahead of the playhead while playing
 
 	// Pixmap Cache keys
 	std::vector<QPixmapCache::Key> mPixmapCacheKeys;
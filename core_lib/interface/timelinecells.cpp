@@ -617,6 +617,7 @@ void TimeLineCells::mouseMoveEvent( QMouseEvent* event )
                             movingFrames        = true;
 
                             int offset = frameNumber - lastFrameNumber;
+                            mEditor->stopPrefetch();
                             currentLayer->moveSelectedFrames(offset);
 
                             mEditor->updateCurrentFrame();
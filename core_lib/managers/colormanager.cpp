@@ -67,6 +67,7 @@ void ColorManager::setColor(const QColor& newColor)
     QColor currentColor = editor()->object()->getColour( mCurrentColorIndex ).colour;
     if (currentColor != newColor)
     {
+        editor()->stopPrefetch(); // vector frames are painted with the palette
         editor()->object()->setColour( mCurrentColorIndex, newColor );
         emit colorChanged(newColor);
 
@@ -146,6 +146,7 @@ void LayerManager::gotoPreviouslayer()
 
 LayerBitmap* LayerManager::createBitmapLayer( const QString& strLayerName )
 {
+    editor()->stopPrefetch();
     LayerBitmap* layer = editor()->object()->addNewBitmapLayer();
     layer->setName( strLayerName );
     
@@ -156,6 +157,7 @@ LayerBitmap* LayerManager::createBitmapLayer( const QString& strLayerName )
 
 LayerVector* LayerManager::createVectorLayer( const QString& strLayerName )
 {
+    editor()->stopPrefetch();
     LayerVector* layer = editor()->object()->addNewVectorLayer();
     layer->setName( strLayerName );
     
@@ -166,6 +168,7 @@ LayerVector* LayerManager::createVectorLayer( const QString& strLayerName )
 
 LayerCamera* LayerManager::createCameraLayer( const QString& strLayerName )
 {
+    editor()->stopPrefetch();
     LayerCamera* layer = editor()->object()->addNewCameraLayer();
     layer->setName( strLayerName );
     
@@ -176,6 +179,7 @@ LayerCamera* LayerManager::createCameraLayer( const QString& strLayerName )
 
 LayerSound* LayerManager::createSoundLayer( const QString& strLayerName )
 {
+    editor()->stopPrefetch();
     LayerSound* layer = editor()->object()->addNewSoundLayer();
     layer->setName( strLayerName );
     
@@ -249,6 +253,7 @@ bool LayerManager::deleteCurrentLayer()
         return false;
     }
 
+    editor()->stopPrefetch();
     editor()->object()->deleteLayer( currentLayerIndex() );
 
     if ( currentLayerIndex() == editor()->object()->getLayerCount() )
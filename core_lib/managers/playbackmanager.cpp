@@ -17,7 +17,10 @@ GNU General Public License for more details.
 
 #include "playbackmanager.h"
 
+#include <cmath>
 #include <QTimer>
+#include <QAudioOutput>
+#include <QAudioDeviceInfo>
 #include "object.h"
 #include "editor.h"
 #include "layersound.h"
@@ -26,13 +29,15 @@ GNU General Public License for more details.
 #include "soundclip.h"
 #include "soundplayer.h"
 
-PlaybackManager::PlaybackManager( QObject* parent ) : BaseManager( parent )
+PlaybackManager::PlaybackManager( QObject* parent ) : BaseManager( parent ), mLog( "PlaybackManager" )
 {
+    ENABLE_DEBUG_LOG( mLog, false );
 }
 
 bool PlaybackManager::init()
 {
     mTimer = new QTimer( this );
+    mTimer->setTimerType( Qt::PreciseTimer );
     connect( mTimer, &QTimer::timeout, this, &PlaybackManager::timerTick );
     return true;
 }
@@ -78,11 +83,21 @@ void PlaybackManager::play()
         editor()->scrubTo( mStartFrame );
     }
 
-    mTimer->setInterval( 1000.0f / mFps );
+    restartClock( editor()->currentFrame() );
+    mStats = PlaybackStats();
+    mStatsClock.start();
+    mStatsWindowStart = 0;
+    mLastFrameTime = -1;
+    mFramesInWindow = 0;
+    mDeviationInWindow = 0.0;
+
+    // The timer only looks at the clock, a few times per frame
+    mTimer->setInterval( qMax( 1, 250 / mFps ) );
     mTimer->start();
 
     // Check for any sounds we should start playing part-way through.
     mCheckForSoundsHalfway = true;
+    playSounds( editor()->currentFrame(), editor()->currentFrame() );
 
     emit playStateChanged(true);
 }
@@ -91,6 +106,10 @@ void PlaybackManager::stop()
 {
     mTimer->stop();
     stopSounds();
+
+    qCDebug( mLog ) << "Playback: fps" << mStats.achievedFps << "of" << mFps
+                    << ", jitter" << mStats.jitterMs << "ms, A/V offset" << mStats.avOffsetMs
+                    << "ms," << mStats.skippedFrames << "frames skipped";
     emit playStateChanged(false);
 }
 
@@ -101,6 +120,19 @@ void PlaybackManager::setFps( int fps )
         mFps = fps;
         emit fpsChanged( mFps );
 
+        if ( isPlaying() )
+        {
+            restartClock( editor()->currentFrame() );
+            mTimer->setInterval( qMax( 1, 250 / mFps ) );
+
+            // the clips start at other samples now
+            if ( mAudioOutput )
+            {
+                stopSounds();
+                mCheckForSoundsHalfway = true;
+            }
+        }
+
         // Update key-frame lengths of sound layers,
         // since the length depends on fps.
         for ( int i = 0; i < object()->getLayerCount(); ++i )
@@ -115,7 +147,9 @@ void PlaybackManager::setFps( int fps )
     }
 }
 
-void PlaybackManager::playSounds( int frame )
+// Starts the clips beginning after previousFrame up to frame, or when starting
+// playback, the ones covering frame.
+void PlaybackManager::playSounds( int previousFrame, int frame )
 {
     // If sound is turned off, don't play anything.
     if(!mIsPlaySound)
@@ -123,6 +157,16 @@ void PlaybackManager::playSounds( int frame )
         return;
     }
 
+    if ( mCheckForSoundsHalfway && startMixedSound( frame ) )
+    {
+        mCheckForSoundsHalfway = false;
+        return;
+    }
+    if ( mAudioOutput )
+    {
+        return; // every clip is in the mix already
+    }
+
     std::vector< LayerSound* > kSoundLayers;
     for ( int i = 0; i < object()->getLayerCount(); ++i )
     {
@@ -145,23 +189,30 @@ void PlaybackManager::playSounds( int frame )
 
                 clip->playFromPosition(frame, mFps);
             }
-
-            // Set flag to false, since this check should only be done when
-            // starting play-back.
-            mCheckForSoundsHalfway = false;
         }
-        else if ( layer->keyExists( frame ) )
+        else
         {
-            KeyFrame* key = layer->getKeyFrameAt( frame );
-            SoundClip* clip = static_cast< SoundClip* >( key );
-
-            clip->play();
+            // frames skipped to keep up may hold the start of a clip
+            for ( int f = previousFrame + 1; f <= frame; f++ )
+            {
+                if ( layer->keyExists( f ) )
+                {
+                    SoundClip* clip = static_cast< SoundClip* >( layer->getKeyFrameAt( f ) );
+                    clip->playFromPosition(frame, mFps);
+                }
+            }
         }
     }
+
+    // Set flag to false, since this check should only be done when
+    // starting play-back.
+    mCheckForSoundsHalfway = false;
 }
 
 void PlaybackManager::stopSounds()
 {
+    stopMixedSound();
+
     std::vector< LayerSound* > kSoundLayers;
     for ( int i = 0; i < object()->getLayerCount(); ++i )
     {
@@ -182,24 +233,189 @@ void PlaybackManager::stopSounds()
     }
 }
 
+// Plays the mix of all clips from frame on, false when a clip isn't decoded
+// yet or can't be, or the output device doesn't take 16 bit stereo at 44.1 kHz.
+// The clips are decoded on the thread pool when they are loaded, never here.
+bool PlaybackManager::startMixedSound( int frame )
+{
+    Status st = mMixer.setDecodedClips( object(), mFps );
+    if ( !st.ok() )
+    {
+        qCDebug( mLog ) << st.details();
+        return false;
+    }
+    if ( mMixer.isEmpty() )
+    {
+        return false;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate( AudioMixer::SAMPLE_RATE );
+    format.setChannelCount( AudioMixer::CHANNELS );
+    format.setSampleSize( 16 );
+    format.setSampleType( QAudioFormat::SignedInt );
+    format.setByteOrder( QAudioFormat::LittleEndian );
+    format.setCodec( "audio/pcm" );
+    if ( !QAudioDeviceInfo::defaultOutputDevice().isFormatSupported( format ) )
+    {
+        return false;
+    }
+
+    mAudioDevice = new AudioMixerDevice( &mMixer, mMixer.frameToSample( frame ), this );
+    mAudioDevice->open( QIODevice::ReadOnly );
+    mAudioOutput = new QAudioOutput( format, this );
+    mAudioOutput->start( mAudioDevice );
+    mAudioStartFrame = frame;
+    return true;
+}
+
+void PlaybackManager::stopMixedSound()
+{
+    if ( mAudioOutput )
+    {
+        mAudioOutput->stop();
+        delete mAudioOutput;
+        delete mAudioDevice;
+        mAudioOutput = nullptr;
+        mAudioDevice = nullptr;
+    }
+}
+
+// Time of the mix that has been heard, what is still in the buffer is not
+qint64 PlaybackManager::mixedSoundPlayedUSecs() const
+{
+    const qint64 bytesPerSecond = AudioMixer::SAMPLE_RATE * AudioMixer::CHANNELS * sizeof( int16_t );
+    qint64 buffered = mAudioOutput->bufferSize() - mAudioOutput->bytesFree();
+    return qMax( 0LL, mAudioOutput->processedUSecs() - buffered * 1000000LL / bytesPerSecond );
+}
+
 void PlaybackManager::timerTick()
 {
-    playSounds( editor()->currentFrame() );
+    int currentFrame = editor()->currentFrame();
+    if ( mCheckForSoundsHalfway )
+    {
+        playSounds( currentFrame, currentFrame );
+    }
 
-    if ( editor()->currentFrame() >= mEndFrame )
+    int frame = int( std::floor( clockFrame() ) );
+    if ( frame <= currentFrame )
+    {
+        return; // still the time of the frame shown
+    }
+
+    if ( frame > mEndFrame )
     {
         if ( mIsLooping )
         {
+            stopSounds();
             editor()->scrubTo( mStartFrame );
+            restartClock( mStartFrame );
+            mCheckForSoundsHalfway = true;
+            playSounds( mStartFrame, mStartFrame );
+            frameShown( 1 );
         }
         else
         {
             stop();
         }
+        return;
+    }
+
+    mStats.skippedFrames += frame - currentFrame - 1;
+    editor()->scrubTo( frame );
+    playSounds( currentFrame, frame );
+    frameShown( frame - currentFrame );
+
+    double soundFrame = clockFrame();
+    mStats.avOffsetMs = ( mLastAudioPosition >= 0 ) ? float( ( frame - soundFrame ) * 1000.0 / mFps ) : 0.f;
+}
+
+// Frame due now, with the fraction of it elapsed. A playing sound is followed
+// whenever its player reports a new position, the timer fills in between.
+double PlaybackManager::clockFrame()
+{
+    double frame = mClockOrigin + mClock.nsecsElapsed() * 1.0e-9 * mFps;
+
+    qint64 position;
+    double audioFrame;
+    SoundClip* master = nullptr;
+    if ( mAudioOutput && mAudioOutput->state() == QAudio::ActiveState )
+    {
+        position = mixedSoundPlayedUSecs();
+        audioFrame = mAudioStartFrame + position * 1.0e-6 * mFps;
+    }
+    else if ( !mAudioOutput && ( master = audioMaster() ) != nullptr )
+    {
+        position = master->playbackPosition();
+        audioFrame = master->pos() + position * 1.0e-3 * mFps;
     }
     else
     {
-        editor()->scrubForward();
+        mLastAudioPosition = -1;
+        return frame;
+    }
+
+    // a position a second or more away is from before a seek which isn't done yet
+    if ( position != mLastAudioPosition && qAbs( audioFrame - frame ) < mFps )
+    {
+        mLastAudioPosition = position;
+        mClockOrigin += audioFrame - frame;
+        frame = audioFrame;
+    }
+    return frame;
+}
+
+void PlaybackManager::restartClock( int frame )
+{
+    mClock.start();
+    mClockOrigin = frame;
+    mLastAudioPosition = -1;
+}
+
+SoundClip* PlaybackManager::audioMaster()
+{
+    if ( !mIsPlaySound )
+    {
+        return nullptr;
+    }
+
+    SoundClip* master = nullptr;
+    for ( int i = 0; i < object()->getLayerCount() && master == nullptr; ++i )
+    {
+        Layer* layer = object()->getLayer( i );
+        if ( layer->type() == Layer::SOUND && layer->keyExistsWhichCovers( editor()->currentFrame() ) )
+        {
+            SoundClip* clip = static_cast< SoundClip* >( layer->getKeyFrameWhichCovers( editor()->currentFrame() ) );
+            if ( clip->isPlaying() )
+            {
+                master = clip;
+            }
+        }
+    }
+    return master;
+}
+
+void PlaybackManager::frameShown( int framesAdvanced )
+{
+    qint64 now = mStatsClock.nsecsElapsed();
+    if ( mLastFrameTime >= 0 )
+    {
+        double intervalMs = ( now - mLastFrameTime ) * 1.0e-6;
+        mDeviationInWindow += qAbs( intervalMs - framesAdvanced * 1000.0 / mFps );
+    }
+    mLastFrameTime = now;
+    mFramesInWindow++;
+
+    const qint64 window = now - mStatsWindowStart;
+    if ( window >= 1000000000LL )
+    {
+        mStats.achievedFps = float( mFramesInWindow * 1.0e9 / window );
+        mStats.jitterMs = float( mDeviationInWindow / mFramesInWindow );
+        emit statsUpdated( mStats );
+
+        mStatsWindowStart = now;
+        mFramesInWindow = 0;
+        mDeviationInWindow = 0.0;
     }
 }
 
@@ -18,9 +18,23 @@ GNU General Public License for more details.
 #ifndef PLAYBACKMANAGER_H
 #define PLAYBACKMANAGER_H
 
+#include <QElapsedTimer>
 #include "basemanager.h"
+#include "audiomixer.h"
+#include "log.h"
 
 class QTimer;
+class QAudioOutput;
+class SoundClip;
+
+
+struct PlaybackStats
+{
+    float achievedFps = 0.f; // frames shown per second
+    float jitterMs = 0.f;    // mean deviation of the time between frames from what the fps asks for
+    float avOffsetMs = 0.f;  // how far the frame shown is ahead of the sound, 0 without sound
+    int   skippedFrames = 0; // frames passed over to keep up with the clock
+};
 
 
 class PlaybackManager : public BaseManager
@@ -54,17 +68,29 @@ public:
     void setRangedEndFrame( int frame ) { mMarkOutFrame = frame; }
     void enableSound( bool b );
 
+    // Measured over the last second of playback
+    const PlaybackStats& stats() const { return mStats; }
+
 Q_SIGNALS:
     void fpsChanged( int fps );
     void loopStateChanged( bool b );
     void rangedPlaybackStateChanged( bool b );
     void playStateChanged( bool isPlaying );
+    void statsUpdated( const PlaybackStats& stats );
 
 private:
     void timerTick();
-    
-    void playSounds( int frame );
+
+    double clockFrame();
+    void restartClock( int frame );
+    SoundClip* audioMaster();
+    void frameShown( int framesAdvanced );
+
+    void playSounds( int previousFrame, int frame );
     void stopSounds();
+    bool startMixedSound( int frame );
+    void stopMixedSound();
+    qint64 mixedSoundPlayedUSecs() const;
 
     int mStartFrame = 1;
     int mEndFrame = 60;
@@ -78,7 +104,26 @@ private:
 
     int mFps = 12;
 
-    QTimer* mTimer = nullptr;
+    QTimer* mTimer = nullptr; // polls the clock a few times per frame
+
+    // The playhead follows this clock, or the sound being played when there is one
+    QElapsedTimer mClock;
+    double mClockOrigin = 1.0; // frame at the start of mClock
+    qint64 mLastAudioPosition = -1;
+
+    // All clips mixed into one output; the clips' own players are the fallback
+    AudioMixer mMixer;
+    QAudioOutput* mAudioOutput = nullptr;
+    AudioMixerDevice* mAudioDevice = nullptr;
+    int mAudioStartFrame = 1;
+
+    PlaybackStats mStats;
+    QLoggingCategory mLog;
+    QElapsedTimer mStatsClock;
+    qint64 mStatsWindowStart = 0;  // nanoseconds on mStatsClock
+    qint64 mLastFrameTime = -1;
+    int mFramesInWindow = 0;
+    double mDeviationInWindow = 0.0;
 
     bool mCheckForSoundsHalfway = false;
 };
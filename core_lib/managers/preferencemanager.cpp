@@ -70,6 +70,7 @@ void PreferenceManager::loadPrefs()
 
     set( SETTING::WINDOW_OPACITY,           settings.value( SETTING_WINDOW_OPACITY,         0 ).toInt() );
     set( SETTING::CURVE_SMOOTHING,          settings.value( SETTING_CURVE_SMOOTHING,        20 ).toInt() );
+    set( SETTING::FILL_GAP_SIZE,            settings.value( SETTING_FILL_GAP_SIZE,          0 ).toInt() );
 
     set( SETTING::BACKGROUND_STYLE,         settings.value( SETTING_BACKGROUND_STYLE,       "white" ).toString() );
 
@@ -78,6 +79,8 @@ void PreferenceManager::loadPrefs()
     // Files
     set( SETTING::AUTO_SAVE,                settings.value( SETTING_AUTO_SAVE,              true ).toBool() );
     set( SETTING::AUTO_SAVE_NUMBER,         settings.value( SETTING_AUTO_SAVE_NUMBER,       20 ).toInt() );
+    set( SETTING::UNDO_MEMORY_LIMIT,        settings.value( SETTING_UNDO_MEMORY_LIMIT,      256 ).toInt() ); // MB
+    set( SETTING::FRAME_MEMORY_LIMIT,       settings.value( SETTING_FRAME_MEMORY_LIMIT,     512 ).toInt() ); // MB
 
     // Timeline
     //
@@ -195,9 +198,22 @@ void PreferenceManager::set( SETTING option, int value )
     case SETTING::CURVE_SMOOTHING:
         settings.setValue( SETTING_CURVE_SMOOTHING, value );
         break;
+    case SETTING::FILL_GAP_SIZE:
+        if (value < 0) { value = 0; }
+        else if (value > 20) { value = 20; }
+        settings.setValue ( SETTING_FILL_GAP_SIZE, value );
+        break;
     case SETTING::AUTO_SAVE_NUMBER:
         settings.setValue ( SETTING_AUTO_SAVE_NUMBER, value );
         break;
+    case SETTING::UNDO_MEMORY_LIMIT:
+        if (value < 16) { value = 16; }
+        settings.setValue ( SETTING_UNDO_MEMORY_LIMIT, value );
+        break;
+    case SETTING::FRAME_MEMORY_LIMIT:
+        if (value < 64) { value = 64; }
+        settings.setValue ( SETTING_FRAME_MEMORY_LIMIT, value );
+        break;
     case SETTING::FRAME_SIZE:
         if (value < 4) { value = 4; }
         else if (value > 20) { value = 20; }
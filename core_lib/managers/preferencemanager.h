@@ -45,6 +45,8 @@ enum class SETTING
     BACKGROUND_STYLE,
     AUTO_SAVE,
     AUTO_SAVE_NUMBER,
+    UNDO_MEMORY_LIMIT,
+    FRAME_MEMORY_LIMIT,
     SHORT_SCRUB,
     FRAME_SIZE,
     TIMELINE_SIZE,
@@ -60,6 +62,7 @@ enum class SETTING
     MULTILAYER_ONION,
     LANGUAGE,
     LAYOUT_LOCK,
+    FILL_GAP_SIZE,
     COUNT, // COUNT must always be the last one.
 };
 
@@ -22,6 +22,7 @@ GNU General Public License for more details.
 #include "layersound.h"
 #include "soundclip.h"
 #include "soundplayer.h"
+#include "audiomixer.h"
 
 SoundManager::SoundManager( QObject* parnet ) : BaseManager( parnet )
 {
@@ -164,5 +165,8 @@ Status SoundManager::createMediaPlayer( SoundClip* clip )
 
     connect( newPlayer, &SoundPlayer::durationChanged, this, &SoundManager::onDurationChanged );
 
+    // have the PCM ready before the first playback
+    AudioMixer::preload( clip->fileName() );
+
     return Status::OK;
 }
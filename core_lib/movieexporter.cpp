@@ -16,17 +16,27 @@ GNU General Public License for more details.
 
 #include "movieexporter.h"
 
+#include <map>
 #include <vector>
 #include <cstdint>
+#include <algorithm>
 #include <QDir>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QBuffer>
+#include <QMutex>
 #include <QProcess>
+#include <QThreadPool>
+#include <QWaitCondition>
 #include <QApplication>
 #include <QStandardPaths>
 #include "object.h"
 #include "layercamera.h"
 #include "layersound.h"
+#include "bitmapimage.h"
 #include "soundclip.h"
+#include "audiomixer.h"
+#include "functiontask.h"
 
 #define IMAGE_FILENAME "/test_img_%05d.png"
 
@@ -69,34 +79,28 @@ struct WavFileHeader
 	}
 };
 
-int16_t safeSumInt16( int16_t a, int16_t b )
+QImage renderFrame( const Object* obj,
+					int frame,
+					QTransform view,
+					QSize camSize,
+					QSize exportSize,
+					bool transparent )
 {
-	int32_t a32 = static_cast<int32_t>( a );
-	int32_t b32 = static_cast<int32_t>( b );
+	QImage imageToExport( exportSize, QImage::Format_ARGB32_Premultiplied );
+	imageToExport.fill( transparent ? Qt::transparent : Qt::white );
 
-	if ( ( a32 + b32 ) > INT16_MAX )
-	{
-		return INT16_MAX;
-	}
-	else if ( ( a32 + b32 ) < INT16_MIN )
-	{
-		return INT16_MIN;
-	}
-	return a + b;
-}
+	QPainter painter( &imageToExport );
 
-void skipUselessChucks( WavFileHeader& header, QFile& file )
-{
-	// We only care about the 'data' chuck
-	while ( memcmp( header.dataChuckID, "data", 4 ) != 0 )
-	{
-		int skipByteCount = header.dataSize;
-		std::vector<char> skipData( skipByteCount );
-		file.read( skipData.data(), skipByteCount );
+	QTransform centralizeCamera;
+	centralizeCamera.translate( camSize.width() / 2, camSize.height() / 2 );
 
-		file.read( (char*)&header.dataChuckID, 4 );
-		file.read( (char*)&header.dataSize, 4 );
-	}
+	painter.setWorldTransform( view * centralizeCamera );
+	painter.setWindow( QRect( 0, 0, camSize.width(), camSize.height() ) );
+
+	obj->paintImage( painter, frame, false, true );
+
+	painter.end();
+	return imageToExport;
 }
 
 QString ffmpegLocation()
@@ -134,7 +138,7 @@ Status MovieExporter::run(const Object* obj,
 {
 	progress( 0.f );
 
-	QString ffmpegPath = ffmpegLocation();
+	QString ffmpegPath = mFFmpegPath.isEmpty() ? ffmpegLocation() : mFFmpegPath;
 	qDebug() << ffmpegPath;
 	if ( !QFile::exists( ffmpegPath ) )
 	{
@@ -169,6 +173,17 @@ Status MovieExporter::run(const Object* obj,
 	}
 	progress( 0.10f );
 
+	if ( !mDesc.useImageSequence )
+	{
+		// a failed stream is reported, rendering every frame again to disk wouldn't help ffmpeg
+		Status st = streamFramesToFFmpeg( obj, ffmpegPath, desc.strFileName, progress );
+		if ( st.ok() )
+		{
+			progress( 1.0f );
+		}
+		return st;
+	}
+
 	STATUS_CHECK( generateImageSequence( obj, progress ) );
 	progress( 0.99f );
 
@@ -184,118 +199,217 @@ QString MovieExporter::error()
 	return QString();
 }
 
+Status MovieExporter::exportImageSequence( const Object* obj,
+										   const ExportMovieDesc& desc,
+										   QString format,
+										   bool transparency,
+										   std::function<void( float )> progress )
+{
+	progress( 0.f );
+	STATUS_CHECK( checkInputParameters( desc ) );
+	mDesc = desc;
+
+	QByteArray imageFormat = format.toUpper().toLatin1();
+	QString extension = "." + format.toLower();
+	mTransparent = transparency && imageFormat != "JPG" && imageFormat != "JPEG" && imageFormat != "BMP";
+
+	QString basePath = desc.strFileName;
+	if ( basePath.endsWith( extension, Qt::CaseInsensitive ) )
+	{
+		basePath.chop( extension.size() );
+	}
+
+	auto encodeImage = [imageFormat]( const QImage& image )
+	{
+		QByteArray data;
+		QBuffer buffer( &data );
+		buffer.open( QIODevice::WriteOnly );
+		image.save( &buffer, imageFormat.constData() );
+		return data;
+	};
+
+	auto writeFile = [basePath, extension]( int frame, const QByteArray& data ) -> Status
+	{
+		QString strImgPath = basePath + QString::number( frame ).rightJustified( 4, '0' ) + extension;
+		QFile file( strImgPath );
+		bool bSave = !data.isEmpty() && file.open( QIODevice::WriteOnly ) && file.write( data ) == data.size();
+		if ( !bSave )
+		{
+			return Status( Status::FAIL, QStringList() << "MovieExporter::exportImageSequence" << strImgPath );
+		}
+		return Status::OK;
+	};
+
+	Status st = renderFrames( obj, encodeImage, writeFile, progress );
+	mTransparent = false;
+	if ( st.ok() )
+	{
+		progress( 1.0f );
+	}
+	return st;
+}
+
 Status MovieExporter::assembleAudio( const Object* obj, 
 									 QString ffmpegPath,
 									 std::function<void( float )> progress )
 {
-	// Quicktime assemble call
 	int startFrame = mDesc.startFrame;
 	int endFrame = mDesc.endFrame;
-	int fps = mDesc.fps;
 
 	Q_ASSERT( startFrame >= 0 );
     Q_ASSERT( endFrame >= startFrame );
 
-	float lengthInSec = ( endFrame - startFrame + 1 ) / (float)fps;
-	qDebug() << "Audio Length = " << lengthInSec << " seconds";
-
-	int32_t audioDataSize = 44100 * 2 * 2 * lengthInSec;
-
-	std::vector<int16_t> audioData( audioDataSize / sizeof( int16_t ) );
-
-	bool audioDataValid = false;
-
-	QDir dir( mTempWorkDir );
-	Q_ASSERT( dir.exists() );
-
-	QString tempAudioPath = mTempWorkDir + "/tmpaudio0.wav";
-	qDebug() << "TempAudio=" << tempAudioPath;
+	// every sound file is decoded once, files Qt can't read go through ffmpeg
+	AudioMixer mixer;
+	mixer.setFFmpegPath( ffmpegPath );
+	STATUS_CHECK( mixer.setClips( obj, mDesc.fps ) );
+	if ( mixer.isEmpty() )
+	{
+		return Status::SAFE;
+	}
 
-	std::vector< SoundClip* > allSoundClips;
+	const qint64 firstSample = mixer.frameToSample( startFrame );
+	const qint64 sampleCount = mixer.frameToSample( endFrame + 1 ) - firstSample;
+	const int32_t audioDataSize = static_cast<int32_t>( sampleCount * AudioMixer::CHANNELS * sizeof( int16_t ) );
+	qDebug() << "Audio Length = " << sampleCount / double( AudioMixer::SAMPLE_RATE ) << " seconds";
 
-	std::vector< LayerSound* > allSoundLayers = obj->getLayersByType<LayerSound>();
-	for ( LayerSound* layer : allSoundLayers )
+	// save mixed audio file ( will be used as audio stream )
+	QFile file( mTempWorkDir + "/tmpaudio.wav" );
+	if ( !file.open( QIODevice::WriteOnly ) )
 	{
-		layer->foreachKeyFrame( [&allSoundClips]( KeyFrame* key )
-		{
-			allSoundClips.push_back( static_cast<SoundClip*>( key ) );
-		} );
+		return Status::FAIL;
 	}
 
-	int clipCount = 0;
+	WavFileHeader outputHeader;
+	outputHeader.InitWithDefaultValues();
+	outputHeader.dataSize = audioDataSize;
+	outputHeader.chuckSize = 36 + audioDataSize;
+	file.write( (char*)&outputHeader, sizeof( outputHeader ) );
 
-	for ( SoundClip* clip : allSoundClips )
+	// a second at a time, the clips are mixed relative to the first exported frame
+	std::vector<int16_t> block( AudioMixer::SAMPLE_RATE * AudioMixer::CHANNELS );
+	for ( qint64 done = 0; done < sampleCount; done += AudioMixer::SAMPLE_RATE )
 	{
 		if ( mCanceled )
 		{
 			return Status::CANCELED;
 		}
+		int count = static_cast<int>( std::min<qint64>( AudioMixer::SAMPLE_RATE, sampleCount - done ) );
+		mixer.mix( firstSample + done, count, block.data() );
+		file.write( (char*)block.data(), count * AudioMixer::CHANNELS * sizeof( int16_t ) );
+		progress( 0.03f + 0.07f * done / sampleCount );
+	}
+	file.close();
 
-		// convert audio file: 44100Hz sampling rate, stereo, signed 16 bit little endian
-		// supported audio file types: wav, mp3, ogg... ( all file types supported by ffmpeg )
-		QString strCmd;
-		strCmd += QString("\"%1\"").arg( ffmpegPath );
-		strCmd += QString( " -i \"%1\" " ).arg( clip->fileName() );
-		strCmd += "-ar 44100 -acodec pcm_s16le -ac 2 -y ";
-		strCmd += QString( "\"%1\"" ).arg( tempAudioPath );
-
-		executeFFMpegCommand( strCmd );
-		qDebug() << "audio file: " + tempAudioPath;
-
-		// Read wav file header
-		WavFileHeader header;
-		QFile file( tempAudioPath );
-		file.open( QIODevice::ReadOnly );
-		file.read( (char*)&header, sizeof( WavFileHeader ) );
-
-		skipUselessChucks( header, file );
-
-		int32_t audioSize = header.dataSize;
+	return Status::OK;
+}
 
-		qDebug() << "audio len " << audioSize;
+/*
+ * Single pass export: raw RGBA frames are piped into ffmpeg's stdin as they
+ * come out of renderFrames(), with the mixed audio track muxed in on the way.
+ */
+Status MovieExporter::streamFramesToFFmpeg( const Object* obj,
+											QString ffmpegPath,
+											QString strOutputFile,
+											std::function<void( float )> progress )
+{
+	const QSize exportSize = mDesc.exportSize;
+	const QString tempAudioPath = mTempWorkDir + "/tmpaudio.wav";
+	const QString logPath = mTempWorkDir + "/ffmpeg.log";
+	const bool isGif = strOutputFile.endsWith( "gif" );
+
+	QStringList args;
+	args << "-f" << "rawvideo"
+		 << "-pixel_format" << "rgba"
+		 << "-video_size" << QString( "%1x%2" ).arg( exportSize.width() ).arg( exportSize.height() )
+		 << "-framerate" << QString::number( mDesc.fps )
+		 << "-i" << "-";
+	if ( !isGif && QFile::exists( tempAudioPath ) )
+	{
+		args << "-i" << tempAudioPath;
+	}
+	if ( isGif )
+	{
+		// http://superuser.com/questions/556029/ in a single pass, the palette
+		// comes from a 320 pixel wide copy as it did with two
+		args << "-filter_complex" << "split[a][b];[a]scale=320:-1:flags=lanczos,palettegen[p];[b][p]paletteuse";
+	}
+	else
+	{
+		args << "-pix_fmt" << "yuv420p";
+	}
+	args << "-y" << strOutputFile;
 
-		// before calling malloc should check: audioSize < max credible value
-		std::vector< int16_t > data( audioSize / sizeof( int16_t ) );
-		file.read( (char*)data.data(), audioSize );
-		audioDataValid = true;
+	// the end of what ffmpeg wrote to stderr says why it gave up
+	auto ffmpegError = [&]( QString what )
+	{
+		QFile log( logPath );
+		log.open( QIODevice::ReadOnly );
+		QStringList lines = QString::fromLocal8Bit( log.readAll() ).split( '\n', QString::SkipEmptyParts );
+		return Status( Status::FAIL, QStringList() << "MovieExporter::streamFramesToFFmpeg" << what
+		                                           << ( ffmpegPath + " " + args.join( ' ' ) ) << lines.mid( lines.size() - 20 ) );
+	};
+
+	// ffmpeg is chatty on stderr, a pipe nobody reads would stall it
+	QProcess ffmpeg;
+	ffmpeg.setStandardOutputFile( QProcess::nullDevice() );
+	ffmpeg.setStandardErrorFile( logPath );
+	ffmpeg.start( ffmpegPath, args );
+	if ( !ffmpeg.waitForStarted() )
+	{
+		return Status( Status::FAIL, QStringList() << "MovieExporter::streamFramesToFFmpeg" << "Could not execute ffmpeg"
+		                                           << ffmpegPath );
+	}
 
-		float fframe = (float)clip->pos() / (float)fps;
-		int delta = fframe * 44100 * 2;
-		qDebug() << "audio delta " << delta;
+	const qint64 frameBytes = qint64( exportSize.width() ) * exportSize.height() * 4;
 
-		int indexMax = std::min( audioSize / 2, audioDataSize / 2 - delta );
+	auto encodeRaw = []( const QImage& image )
+	{
+		QImage rgba = image.convertToFormat( QImage::Format_RGBA8888 );
+		return QByteArray( reinterpret_cast< const char* >( rgba.constBits() ), rgba.byteCount() );
+	};
 
-		// audio files 'mixing': 'higher' sound layers overwrite 'lower' sound layers
-		for ( int i = 0; i < indexMax; i++ )
+	auto writeToPipe = [&]( int, const QByteArray& data )
+	{
+		if ( data.size() != frameBytes || ffmpeg.state() != QProcess::Running )
 		{
-			audioData[ i + delta ] = safeSumInt16( audioData[ i + delta ], data[ i ] );
+			return Status::FAIL;
 		}
+		ffmpeg.write( data );
 
-		file.close();
+		// don't queue up more than a couple of frames ahead of ffmpeg
+		while ( ffmpeg.bytesToWrite() > frameBytes * 2 )
+		{
+			if ( !ffmpeg.waitForBytesWritten( 1000 ) && ffmpeg.state() != QProcess::Running )
+			{
+				return Status::FAIL;
+			}
+		}
+		return Status::OK;
+	};
 
-		float p = ( (float)clipCount / allSoundClips.size() );
-		progress( p * 0.1f );
-		clipCount++;
-	}
+	Status st = renderFrames( obj, encodeRaw, writeToPipe, [progress]( float f )
+	{
+		progress( 0.1f + f * 0.89f );
+	} );
 
-	if ( !audioDataValid )
+	if ( !st.ok() )
 	{
-		return Status::SAFE;
+		// a pipe write fails when ffmpeg has stopped reading, its log says why
+		const bool pipeBroken = ffmpeg.state() != QProcess::Running;
+		ffmpeg.kill();
+		ffmpeg.waitForFinished();
+		QFile::remove( strOutputFile );
+		return ( pipeBroken && !( st == Status::CANCELED ) ) ? ffmpegError( "ffmpeg stopped reading frames" ) : st;
 	}
 
-	// save mixed audio file ( will be used as audio stream )
-	QFile file( mTempWorkDir + "/tmpaudio.wav" );
-	file.open( QIODevice::WriteOnly );
-
-	WavFileHeader outputHeader;
-	outputHeader.InitWithDefaultValues();
-	outputHeader.dataSize = audioDataSize;
-	outputHeader.chuckSize = 36 + audioDataSize;
-
-	file.write( (char*)&outputHeader, sizeof( outputHeader ) );
-	file.write( (char*)audioData.data(), audioDataSize );
-	file.close();
+	ffmpeg.closeWriteChannel(); // the end of stdin ends the video stream
+	ffmpeg.waitForFinished( -1 );
 
+	if ( ffmpeg.exitStatus() != QProcess::NormalExit || ffmpeg.exitCode() != 0 )
+	{
+		return ffmpegError( QString( "ffmpeg exited with code %1" ).arg( ffmpeg.exitCode() ) );
+	}
 	return Status::OK;
 }
 
@@ -303,58 +417,150 @@ Status MovieExporter::generateImageSequence(
 	const Object* obj,
 	std::function<void(float)>  progress )
 {
-	int frameStart        = mDesc.startFrame;
-	int frameEnd          = mDesc.endFrame;
-	QSize exportSize      = mDesc.exportSize;
-	bool transparency     = false;
-	QString strCameraName = mDesc.strCameraName;
+	auto encodePng = []( const QImage& image )
+	{
+		QByteArray data;
+		QBuffer buffer( &data );
+		buffer.open( QIODevice::WriteOnly );
+		image.save( &buffer, "PNG" );
+		return data;
+	};
+
+	auto writeFile = [this]( int frame, const QByteArray& data )
+	{
+		QString imageFileWithFrameNumber = QString().sprintf( IMAGE_FILENAME, frame );
+		QString strImgPath = mTempWorkDir + imageFileWithFrameNumber;
+
+		QFile file( strImgPath );
+		bool bSave = !data.isEmpty() && file.open( QIODevice::WriteOnly ) && file.write( data ) == data.size();
+		qDebug() << "Save img to: " << strImgPath << ", Success=" << bSave;
+		return bSave ? Status::OK : Status::FAIL;
+	};
 
-	auto cameraLayer = (LayerCamera*)obj->findLayerByName( strCameraName, Layer::CAMERA );
+	return renderFrames( obj, encodePng, writeFile, [progress]( float f )
+	{
+		progress( 0.1f + f * 0.89f );
+	} );
+}
+
+/*
+ * Frames are rendered and encoded on a thread pool, a few frames ahead of the
+ * one being written. write() is called on the calling thread strictly in frame
+ * order, and so is progress(), which also runs while waiting so that the
+ * caller can process a cancel.
+ */
+Status MovieExporter::renderFrames( const Object* obj,
+									std::function<QByteArray( const QImage& )> encode,
+									std::function<Status( int, const QByteArray& )> write,
+									std::function<void( float )> progress )
+{
+	const int frameStart  = mDesc.startFrame;
+	const int frameEnd    = mDesc.endFrame;
+	const QSize exportSize = mDesc.exportSize;
+
+	auto cameraLayer = (LayerCamera*)obj->findLayerByName( mDesc.strCameraName, Layer::CAMERA );
 	if ( cameraLayer == nullptr )
 	{
 		cameraLayer = obj->getLayersByType< LayerCamera >().front();
 	}
+	const QSize camSize = cameraLayer->getViewSize();
+
+	// the keys decoded by the tasks stay decoded until the export is done
+	BitmapImage::UnloadBlocker keepLoaded;
+	obj->prepareThreadedPainting();
 
-	for ( int currentFrame = frameStart; currentFrame <= frameEnd; currentFrame++ )
+	QMutex resultMutex;
+	QWaitCondition resultReady;
+	std::map< int, std::pair< QByteArray, qint64 > > results; // encoded frame, nanoseconds it took
+	std::atomic<bool> writeFailed{ false };
+
+	QThreadPool pool; // declared last, so it's drained before anything the tasks use goes away
+	if ( mDesc.renderThreads > 0 )
 	{
-		if ( mCanceled )
+		pool.setMaxThreadCount( mDesc.renderThreads );
+	}
+	const int maxFramesAhead = pool.maxThreadCount() * 2;
+
+	auto submit = [&]( int frame )
+	{
+		QTransform view = cameraLayer->getViewAtFrame( frame );
+
+		pool.start( new FunctionTask( [=, &resultMutex, &resultReady, &results, &writeFailed]
 		{
-			return Status::CANCELED;
+			QByteArray data;
+			QElapsedTimer timer;
+			timer.start();
+			if ( !mCanceled && !writeFailed )
+			{
+				data = encode( renderFrame( obj, frame, view, camSize, exportSize, mTransparent ) );
+			}
+			qint64 renderNs = timer.nsecsElapsed();
+			QMutexLocker locker( &resultMutex );
+			results[ frame ] = std::make_pair( data, renderNs );
+			resultReady.wakeAll();
+		} ) );
+	};
+
+	const float frameCount = frameEnd - frameStart + 1;
+	float currentProgress = 0.f;
+	Status status = Status::OK;
+	int nextSubmit = frameStart;
+
+	for ( int frame = frameStart; frame <= frameEnd && !mCanceled; frame++ )
+	{
+		while ( nextSubmit <= frameEnd && nextSubmit - frame < maxFramesAhead )
+		{
+			submit( nextSubmit++ );
 		}
 
-		QImage imageToExport( exportSize, QImage::Format_ARGB32_Premultiplied );
-		QColor bgColor = Qt::white;
-		if ( transparency )
+		QByteArray data;
+		qint64 renderNs = 0;
+		resultMutex.lock();
+		while ( !mCanceled && results.find( frame ) == results.end() )
 		{
-			bgColor.setAlpha( 0 );
+			if ( !resultReady.wait( &resultMutex, 100 ) )
+			{
+				resultMutex.unlock();
+				progress( currentProgress ); // keeps the caller's event loop, and its cancel button, alive
+				resultMutex.lock();
+			}
 		}
-		imageToExport.fill( bgColor );
-
-		QPainter painter( &imageToExport );
-
-		QTransform view = cameraLayer->getViewAtFrame( currentFrame );
-
-		QSize camSize = cameraLayer->getViewSize();
-		QTransform centralizeCamera;
-		centralizeCamera.translate( camSize.width() / 2, camSize.height() / 2 );
+		auto it = results.find( frame );
+		if ( it != results.end() )
+		{
+			data = it->second.first;
+			renderNs = it->second.second;
+			results.erase( it );
+		}
+		resultMutex.unlock();
 
-		painter.setWorldTransform( view * centralizeCamera );
-		painter.setWindow( QRect( 0, 0, camSize.width(), camSize.height() ) );
+		if ( mCanceled )
+		{
+			break;
+		}
 
-		obj->paintImage( painter, currentFrame, false, true );
+		status = write( frame, data );
+		if ( !status.ok() )
+		{
+			writeFailed = true; // skip the frames still queued
+			break;
+		}
+		if ( mFrameCallback )
+		{
+			mFrameCallback( frame, renderNs );
+		}
 
-		QString imageFileWithFrameNumber = QString().sprintf( IMAGE_FILENAME,  currentFrame );
+		currentProgress = ( frame - frameStart + 1 ) / frameCount;
+		progress( currentProgress );
+	}
 
-		QString strImgPath = mTempWorkDir + imageFileWithFrameNumber;
-        bool bSave = imageToExport.save( strImgPath );
-        Q_ASSERT(bSave);
-        qDebug() << "Save img to: " << strImgPath << ", Success=" << bSave;
+	pool.waitForDone();
 
-		float fProgressValue = ( currentFrame / (float)( frameEnd - frameStart ) );
-		progress( 0.1f + ( fProgressValue * 0.99f ) );
+	if ( !status.ok() )
+	{
+		return status;
 	}
-
-	return Status::OK;
+	return mCanceled ? Status::CANCELED : Status::OK;
 }
 
 Status MovieExporter::combineVideoAndAudio( QString ffmpegPath, QString strOutputFile )
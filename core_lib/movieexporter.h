@@ -17,6 +17,7 @@ GNU General Public License for more details.
 #ifndef MOVIEEXPORTER_H
 #define MOVIEEXPORTER_H
 
+#include <atomic>
 #include <functional>
 #include <QString>
 #include <QSize>
@@ -25,6 +26,9 @@ GNU General Public License for more details.
 
 class Object;
 
+// The ffmpeg bundled with the application, or the one on the PATH
+QString ffmpegLocation();
+
 struct ExportMovieDesc
 {
 	QString strFileName;
@@ -34,6 +38,8 @@ struct ExportMovieDesc
 	int     fps        = 12;
 	QSize   exportSize{ 0, 0 };
 	QString strCameraName;
+	int     renderThreads = 0; // 0 means one per core
+	bool    useImageSequence = false; // write PNG files and encode them afterwards instead of streaming
 };
 
 class MovieExporter
@@ -47,11 +53,27 @@ public:
 				std::function<void(float)> progress );
 	QString error();
 
+	// Renders the frames to image files named after desc.strFileName with the
+	// frame number before the extension, e.g. out0001.png, without ffmpeg
+	Status exportImageSequence( const Object* obj,
+								const ExportMovieDesc& desc,
+								QString format,
+								bool transparency,
+								std::function<void(float)> progress );
+
 	void cancel() { mCanceled = true; }
+	void setFFmpegPath( QString path ) { mFFmpegPath = path; } // empty means the bundled or installed one
+	// Called in frame order once a frame is written, with the time it took to render and encode
+	void setFrameCallback( std::function<void( int frame, qint64 renderNs )> callback ) { mFrameCallback = callback; }
 
 private:
 	Status assembleAudio( const Object* obj, QString ffmpegPath, std::function<void( float )> progress );
+	Status streamFramesToFFmpeg( const Object* obj, QString ffmpegPath, QString strOutputFile, std::function<void( float )> progress );
 	Status generateImageSequence( const Object* obj, std::function<void(float)> progress );
+	Status renderFrames( const Object* obj,
+						 std::function<QByteArray( const QImage& )> encode,
+						 std::function<Status( int frame, const QByteArray& )> write,
+						 std::function<void( float )> progress );
 	Status combineVideoAndAudio( QString ffmpegPath, QString strOutputFile );
 
 	Status twoPassEncoding( QString ffmpeg, QString strOutputFile );
@@ -64,7 +86,10 @@ private:
     QTemporaryDir mTempDir;
 	QString mTempWorkDir;
 	ExportMovieDesc mDesc;
-	bool mCanceled = false;
+	QString mFFmpegPath;
+	bool    mTransparent = false;
+	std::function<void( int, qint64 )> mFrameCallback;
+	std::atomic<bool> mCanceled{ false };
 };
 
 #endif // MOVIEEXPORTER_H
\ No newline at end of file
@@ -0,0 +1,282 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#include "movieimporter.h"
+
+#include <cctype>
+#include <map>
+#include <QDebug>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include "bitmapimage.h"
+#include "movieexporter.h"
+#include "functiontask.h"
+
+
+namespace
+{
+    // ffmpeg prints the length of the input on stderr before the first frame
+    double parseDuration( const QByteArray& log )
+    {
+        static const QRegularExpression re( "Duration: (\\d+):(\\d+):(\\d+(\\.\\d+)?)" );
+        QRegularExpressionMatch match = re.match( QString::fromLatin1( log ) );
+        if ( !match.hasMatch() )
+        {
+            return 0.0;
+        }
+        return match.captured( 1 ).toInt() * 3600 + match.captured( 2 ).toInt() * 60 + match.captured( 3 ).toDouble();
+    }
+}
+
+MovieImporter::MovieImporter()
+{
+}
+
+MovieImporter::~MovieImporter()
+{
+}
+
+Status MovieImporter::run( const ImportMovieDesc& desc,
+                           std::vector< BitmapImage* >& keys,
+                           std::function<void( float )> progress )
+{
+    progress( 0.f );
+
+    if ( desc.strFileName.isEmpty() || desc.fps <= 0 || desc.frameStep <= 0 ||
+         desc.scale <= 0.f || desc.startFrame <= 0 )
+    {
+        return Status::INVALID_ARGUMENT;
+    }
+    if ( !QFile::exists( desc.strFileName ) )
+    {
+        return Status::FILE_NOT_FOUND;
+    }
+
+    QString ffmpegPath = mFFmpegPath.isEmpty() ? ffmpegLocation() : mFFmpegPath;
+    if ( !QFile::exists( ffmpegPath ) )
+    {
+        qDebug() << "Please place ffmpeg in " << ffmpegPath << " directory";
+        return Status::ERROR_FFMPEG_NOT_FOUND;
+    }
+
+    QStringList args = ffmpegArguments( desc );
+    qDebug() << ffmpegPath << args;
+
+    QProcess ffmpeg;
+    ffmpeg.setReadChannel( QProcess::StandardOutput );
+    ffmpeg.start( ffmpegPath, args, QIODevice::ReadOnly );
+    if ( !ffmpeg.waitForStarted() )
+    {
+        qDebug() << "ERROR: Could not execute FFmpeg.";
+        return Status::FAIL;
+    }
+
+    QThreadPool pool;
+    if ( desc.decodeThreads > 0 )
+    {
+        pool.setMaxThreadCount( desc.decodeThreads );
+    }
+    // frames waiting for a thread hold raw pixels, so ffmpeg is held up on the pipe instead
+    const int maxFramesInFlight = pool.maxThreadCount() * 2;
+
+    QMutex mutex;
+    QWaitCondition frameDone;
+    int framesInFlight = 0;
+    std::map< int, BitmapImage* > decoded;
+
+    const QPoint centre = desc.centre;
+    auto submit = [&]( int index, int position, QByteArray frame, int headerSize, QSize size )
+    {
+        {
+            QMutexLocker locker( &mutex );
+            while ( framesInFlight >= maxFramesInFlight )
+            {
+                frameDone.wait( &mutex );
+            }
+            framesInFlight++;
+        }
+        pool.start( new FunctionTask( [=, &mutex, &frameDone, &framesInFlight, &decoded]
+        {
+            const uchar* pixels = reinterpret_cast< const uchar* >( frame.constData() ) + headerSize;
+            QImage rgb( pixels, size.width(), size.height(), size.width() * 3, QImage::Format_RGB888 );
+
+            QRect bounds( centre - QPoint( size.width() / 2, size.height() / 2 ), size );
+            BitmapImage* key = new BitmapImage( bounds, rgb.convertToFormat( QImage::Format_ARGB32_Premultiplied ) );
+            key->setPos( position );
+            key->setModified( true );
+
+            QMutexLocker locker( &mutex );
+            decoded[ index ] = key;
+            framesInFlight--;
+            frameDone.wakeAll();
+        } ) );
+    };
+
+    QByteArray pending;
+    QByteArray log;
+    double expectedFrames = 0.0;
+    int frameCount = 0;
+    bool badStream = false;
+
+    while ( !mCanceled && !badStream )
+    {
+        bool running = ffmpeg.waitForReadyRead( 100 ) || ffmpeg.state() == QProcess::Running;
+        pending += ffmpeg.readAllStandardOutput();
+
+        if ( expectedFrames == 0.0 )
+        {
+            log += ffmpeg.readAllStandardError();
+            double duration = parseDuration( log );
+            expectedFrames = duration * desc.fps / desc.frameStep;
+        }
+
+        // cut the complete frames off the front of what came through the pipe
+        int offset = 0;
+        for ( ;; )
+        {
+            QSize size;
+            int headerSize = parsePpmHeader( pending.constData() + offset, pending.size() - offset, size );
+            if ( headerSize < 0 )
+            {
+                badStream = true;
+                break;
+            }
+            const int frameBytes = headerSize + size.width() * size.height() * 3;
+            if ( headerSize == 0 || pending.size() - offset < frameBytes )
+            {
+                break;
+            }
+            int position = desc.startFrame + frameCount * desc.frameStep;
+            submit( frameCount, position, pending.mid( offset, frameBytes ), headerSize, size );
+            frameCount++;
+            offset += frameBytes;
+        }
+        pending.remove( 0, offset );
+
+        if ( expectedFrames > 0.0 )
+        {
+            progress( qMin( 0.99f, float( frameCount / expectedFrames ) ) );
+        }
+
+        if ( !running && ffmpeg.bytesAvailable() == 0 )
+        {
+            break;
+        }
+    }
+
+    if ( mCanceled || badStream )
+    {
+        ffmpeg.kill();
+    }
+    ffmpeg.waitForFinished( -1 );
+    pool.waitForDone();
+
+    if ( mCanceled || badStream || frameCount == 0 )
+    {
+        for ( auto& pair : decoded )
+        {
+            delete pair.second;
+        }
+        if ( mCanceled )
+        {
+            return Status::CANCELED;
+        }
+        log += ffmpeg.readAllStandardError();
+        qDebug() << "ffmpeg:" << log;
+        return Status( Status::FAIL, QStringList() << "MovieImporter::run" << desc.strFileName
+                                                   << QString::fromLocal8Bit( log ).split( '\n' ).mid( 0, 20 ) );
+    }
+
+    keys.reserve( keys.size() + decoded.size() );
+    for ( auto& pair : decoded )
+    {
+        keys.push_back( pair.second );
+    }
+
+    progress( 1.f );
+    return Status::OK;
+}
+
+QStringList MovieImporter::ffmpegArguments( const ImportMovieDesc& desc )
+{
+    // the fps filter drops or repeats frames to match the project, every n-th one at the same rate
+    QString filters = QString( "fps=fps=%1/%2" ).arg( desc.fps ).arg( desc.frameStep );
+    if ( desc.scale < 1.f )
+    {
+        filters += QString( ",scale=trunc(iw*%1):trunc(ih*%1)" ).arg( desc.scale );
+    }
+
+    QStringList args;
+    args << "-nostdin"
+         << "-i" << desc.strFileName
+         << "-an" << "-sn"
+         << "-vf" << filters
+         << "-f" << "image2pipe"
+         << "-vcodec" << "ppm"
+         << "-";
+    return args;
+}
+
+int MovieImporter::parsePpmHeader( const char* data, int size, QSize& imageSize )
+{
+    if ( size < 2 )
+    {
+        return 0;
+    }
+    if ( data[ 0 ] != 'P' || data[ 1 ] != '6' )
+    {
+        return -1;
+    }
+
+    // width, height and the maximum value, each after some whitespace
+    int values[ 3 ];
+    int pos = 2;
+    for ( int& value : values )
+    {
+        while ( pos < size && isspace( static_cast< uchar >( data[ pos ] ) ) )
+        {
+            pos++;
+        }
+        const int start = pos;
+        value = 0;
+        while ( pos < size && isdigit( static_cast< uchar >( data[ pos ] ) ) && value < 1000000 )
+        {
+            value = value * 10 + ( data[ pos ] - '0' );
+            pos++;
+        }
+        if ( pos >= size )
+        {
+            return 0;
+        }
+        if ( pos == start || !isspace( static_cast< uchar >( data[ pos ] ) ) )
+        {
+            return -1;
+        }
+    }
+
+    // 16 bit samples are never asked for, and the size has to fit a QByteArray
+    if ( values[ 0 ] <= 0 || values[ 1 ] <= 0 || values[ 0 ] > 16384 || values[ 1 ] > 16384 || values[ 2 ] != 255 )
+    {
+        return -1;
+    }
+    imageSize = QSize( values[ 0 ], values[ 1 ] );
+    return pos + 1; // a single whitespace byte ends the header
+}
@@ -0,0 +1,71 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef MOVIEIMPORTER_H
+#define MOVIEIMPORTER_H
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <QStringList>
+#include <QPoint>
+#include <QSize>
+#include "pencilerror.h"
+
+class BitmapImage;
+
+struct ImportMovieDesc
+{
+    QString strFileName;
+    int     fps        = 12;  // of the project, the movie is resampled to it
+    int     frameStep  = 1;   // keeps every n-th frame and holds it for n frames
+    float   scale      = 1.f; // of the movie size, below 1 to downscale
+    int     startFrame = 1;   // position of the first key
+    QPoint  centre;           // of the imported images on the canvas
+    int     decodeThreads = 0; // 0 means one per core
+};
+
+/*
+ * Reads the frames of a movie from an ffmpeg pipe as binary PPM and turns
+ * them into bitmap keys on a thread pool while ffmpeg keeps decoding.
+ * Nothing touches the disk and no key is inserted anywhere, the caller
+ * gets them all at the end and adds them to a layer in one go.
+ */
+class MovieImporter
+{
+public:
+    MovieImporter();
+    ~MovieImporter();
+
+    // The keys come out in frame order with their positions set, owned by the caller
+    Status run( const ImportMovieDesc& desc,
+                std::vector< BitmapImage* >& keys,
+                std::function<void( float )> progress );
+
+    void cancel() { mCanceled = true; }
+    void setFFmpegPath( QString path ) { mFFmpegPath = path; } // empty means the bundled or installed one
+
+    // Size in bytes of the PPM header at the start of data, 0 while it is incomplete, -1 if it isn't one
+    static int parsePpmHeader( const char* data, int size, QSize& imageSize );
+
+private:
+    QStringList ffmpegArguments( const ImportMovieDesc& desc );
+
+    QString mFFmpegPath;
+    std::atomic<bool> mCanceled{ false };
+};
+
+#endif // MOVIEIMPORTER_H
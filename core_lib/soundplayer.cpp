@@ -72,6 +72,15 @@ void SoundPlayer::stop()
     }
 }
 
+bool SoundPlayer::isPlaying()
+{
+    if ( mMediaPlayer )
+    {
+        return mMediaPlayer->state() == QMediaPlayer::PlayingState;
+    }
+    return false;
+}
+
 int64_t SoundPlayer::duration()
 {
     if ( mMediaPlayer )
@@ -81,6 +90,15 @@ int64_t SoundPlayer::duration()
     return 0;
 }
 
+qint64 SoundPlayer::position()
+{
+    if ( mMediaPlayer )
+    {
+        return mMediaPlayer->position();
+    }
+    return 0;
+}
+
 void SoundPlayer::setMediaPlayerPosition(qint64 pos)
 {
     if( mMediaPlayer )
@@ -38,8 +38,10 @@ public:
 
     void play();
     void stop();
-    
+    bool isPlaying();
+
     int64_t duration();
+    qint64 position(); // in milliseconds, of the sound being played
     SoundClip* clip() { return mSoundClip; }
 
     void setMediaPlayerPosition( qint64 pos );
@@ -19,6 +19,9 @@ GNU General Public License for more details.
 #include "filemanager.h"
 #include "pencildef.h"
 #include "JlCompress.h"
+#include "quazip.h"
+#include "quazipfile.h"
+#include <QDirIterator>
 #include "fileformat.h"
 #include "object.h"
 
@@ -266,6 +269,22 @@ Status FileManager::save( Object* object, QString strFileName )
     debugDetails << QString("layerCount = %1").arg(layerCount);
     qCDebug( mLog ) << QString( "Total layers = %1" ).arg( layerCount );
 
+    // files written by this save, anything else in the working folder is unchanged
+    QStringList savedFiles;
+    // when the save fails, drop what was written so the next save encodes it again
+    // rather than copying the stale entry from the previous archive
+    auto discardSavedFiles = [ &savedFiles, isOldFile ]
+    {
+        if ( isOldFile )
+        {
+            return; // these are the user's own files, not a working copy
+        }
+        for ( const QString& s : savedFiles )
+        {
+            QFile::remove( s );
+        }
+    };
+
     bool isOkay = true;
     for ( int i = 0; i < layerCount; ++i )
     {
@@ -281,7 +300,7 @@ Status FileManager::save( Object* object, QString strFileName )
         case Layer::VECTOR:
         case Layer::SOUND:
         {
-            Status st = layer->save( strDataFolder );
+            Status st = layer->save( strDataFolder, &savedFiles );
             if( !st.ok() )
             {
                 isOkay = false;
@@ -303,12 +322,15 @@ Status FileManager::save( Object* object, QString strFileName )
         }
         if( !isOkay )
         {
+            discardSavedFiles();
             return Status( Status::FAIL, debugDetails, tr( "Internal Error" ), tr( "An internal error occurred while trying to save the file. Some or all of your file may not have saved." ) );
         }
     }
 
     // save palette
     object->savePalette( strDataFolder );
+    savedFiles << QDir( strDataFolder ).filePath( PFF_PALETTE_FILE ) << strMainXMLFile;
+    qCDebug( mLog ) << QString( "Rewrote %1 files" ).arg( savedFiles.size() );
 
     // -------- save main XML file -----------
     QScopedPointer<QFile> file( new QFile( strMainXMLFile ) );
@@ -337,15 +359,24 @@ Status FileManager::save( Object* object, QString strFileName )
 
     QTextStream out( file.data() );
     xmlDoc.save( out, IndentSize );
+    out.flush();
+    file->close();
 
     if ( !isOldFile )
     {
         qCDebug( mLog ) << "Now compressing data to PFF - PCLX ...";
 
-        bool ok = JlCompress::compressDir( strFileName, strTempWorkingFolder );
-        if ( !ok )
+        QSet<QString> writtenFiles;
+        for ( const QString& s : savedFiles )
+        {
+            writtenFiles.insert( QDir::cleanPath( s ) );
+        }
+
+        Status st = writeArchive( strFileName, strTempWorkingFolder, object->filePath(), writtenFiles );
+        if ( !st.ok() )
         {
-            return Status::FAIL;
+            discardSavedFiles();
+            return st;
         }
 
         qCDebug( mLog ) << "Compressed. File saved.";
@@ -357,6 +388,131 @@ Status FileManager::save( Object* object, QString strFileName )
     return Status::OK;
 }
 
+namespace
+{
+    bool copyZipData( QIODevice& in, QIODevice& out )
+    {
+        char buffer[ 64 * 1024 ];
+        while ( !in.atEnd() )
+        {
+            qint64 count = in.read( buffer, sizeof( buffer ) );
+            if ( count < 0 || out.write( buffer, count ) != count )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+/*
+ * Streams the working folder into a new archive. Files which were not written
+ * by this save and are still in the previous archive are copied over without
+ * decompressing them, so the cost of a save follows the size of the edits.
+ * The archive is built next to the target and only replaces it when complete.
+ */
+Status FileManager::writeArchive( const QString& strZipFile, const QString& strSourceFolder,
+                                  const QString& strPreviousZipFile, const QSet<QString>& writtenFiles )
+{
+    QStringList debugDetails = QStringList() << "FileManager::writeArchive" << QString( "strZipFile = " ).append( strZipFile );
+
+    QuaZip previousZip( strPreviousZipFile );
+    QHash<QString, QuaZipFileInfo64> previousEntries;
+    if ( !strPreviousZipFile.isEmpty() && QFile::exists( strPreviousZipFile ) && previousZip.open( QuaZip::mdUnzip ) )
+    {
+        for ( bool more = previousZip.goToFirstFile(); more; more = previousZip.goToNextFile() )
+        {
+            QuaZipFileInfo64 info;
+            if ( previousZip.getCurrentFileInfo( &info ) )
+            {
+                previousEntries.insert( info.name, info );
+            }
+        }
+    }
+
+    const QString strTempZipFile = strZipFile + PFF_TMP_COMPRESS_EXT;
+    QuaZip zip( strTempZipFile );
+    if ( !zip.open( QuaZip::mdCreate ) )
+    {
+        return Status( Status::ERROR_FILE_CANNOT_OPEN, debugDetails << QString( "Cannot create " ).append( strTempZipFile ) );
+    }
+
+    int copiedCount = 0;
+    int compressedCount = 0;
+    bool isOkay = true;
+
+    const QDir sourceDir( strSourceFolder );
+    QDirIterator it( strSourceFolder, QDir::AllDirs | QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories );
+    while ( isOkay && it.hasNext() )
+    {
+        const QString strFilePath = it.next();
+        const QFileInfo fileInfo = it.fileInfo();
+        QString strEntryName = sourceDir.relativeFilePath( strFilePath );
+
+        if ( fileInfo.isDir() )
+        {
+            QuaZipFile dirEntry( &zip );
+            isOkay = dirEntry.open( QIODevice::WriteOnly, QuaZipNewInfo( strEntryName + "/", strFilePath ), nullptr, 0, 0 );
+            dirEntry.close();
+            continue;
+        }
+
+        auto previous = previousEntries.find( strEntryName );
+        bool isUnchanged = previous != previousEntries.end() &&
+                           previous->uncompressedSize == static_cast<quint64>( fileInfo.size() ) &&
+                           !writtenFiles.contains( QDir::cleanPath( strFilePath ) );
+
+        QuaZipFile out( &zip );
+        if ( isUnchanged && previousZip.setCurrentFile( strEntryName ) )
+        {
+            int method = 0;
+            int level = 0;
+            QuaZipFile in( &previousZip );
+            isOkay = in.open( QIODevice::ReadOnly, &method, &level, true ) &&
+                     out.open( QIODevice::WriteOnly, QuaZipNewInfo( *previous ), nullptr, previous->crc, method, level, true ) &&
+                     copyZipData( in, out );
+            in.close();
+            ++copiedCount;
+        }
+        else
+        {
+            QFile in( strFilePath );
+            isOkay = in.open( QIODevice::ReadOnly ) &&
+                     out.open( QIODevice::WriteOnly, QuaZipNewInfo( strEntryName, strFilePath ) ) &&
+                     copyZipData( in, out );
+            ++compressedCount;
+        }
+        out.close();
+        isOkay = isOkay && out.getZipError() == UNZ_OK;
+
+        if ( !isOkay )
+        {
+            debugDetails << QString( "Failed to write entry " ).append( strEntryName );
+        }
+    }
+
+    zip.close();
+    previousZip.close();
+    if ( !isOkay || zip.getZipError() != UNZ_OK )
+    {
+        QFile::remove( strTempZipFile );
+        return Status( Status::FAIL, debugDetails );
+    }
+
+    if ( QFile::exists( strZipFile ) && !QFile::remove( strZipFile ) )
+    {
+        QFile::remove( strTempZipFile );
+        return Status( Status::ERROR_FILE_CANNOT_OPEN, debugDetails << QString( "Cannot replace the existing file" ) );
+    }
+    if ( !QFile::rename( strTempZipFile, strZipFile ) )
+    {
+        return Status( Status::FAIL, debugDetails << QString( "Cannot rename " ).append( strTempZipFile ) );
+    }
+
+    qCDebug( mLog ) << QString( "Archive written, %1 entries copied, %2 compressed" ).arg( copiedCount ).arg( compressedCount );
+    return Status::OK;
+}
+
 ObjectData* FileManager::loadProjectData( const QDomElement& docElem )
 {
     ObjectData* data = new ObjectData;
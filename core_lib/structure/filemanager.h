@@ -21,6 +21,7 @@ GNU General Public License for more details.
 
 #include <QObject>
 #include <QString>
+#include <QSet>
 #include <QDomElement>
 #include "log.h"
 #include "pencildef.h"
@@ -50,6 +51,8 @@ Q_SIGNALS:
 
 private:
     void unzip( const QString& strZipFile, const QString& strUnzipTarget );
+    Status writeArchive( const QString& strZipFile, const QString& strSourceFolder,
+                         const QString& strPreviousZipFile, const QSet<QString>& writtenFiles );
     
     bool loadObject( Object*, const QDomElement& root );
     bool loadObjectOldWay( Object*, const QDomElement& root );
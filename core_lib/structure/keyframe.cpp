@@ -22,6 +22,26 @@ KeyFrame::KeyFrame()
 {
 }
 
+KeyFrame::KeyFrame( const KeyFrame& k )
+{
+    mFrame = k.mFrame;
+    mLength = k.mLength;
+    mIsModified = k.mIsModified;
+    mIsSelected = k.mIsSelected;
+    mAttachedFileName = k.mAttachedFileName;
+}
+
+KeyFrame& KeyFrame::operator=( const KeyFrame& k )
+{
+    mFrame = k.mFrame;
+    mLength = k.mLength;
+    mIsModified = true;
+    mIsSelected = k.mIsSelected;
+    mAttachedFileName = k.mAttachedFileName;
+    ++mModificationCount;
+    return *this;
+}
+
 KeyFrame::~KeyFrame()
 {
     for ( KeyFrameEventListener* listener : mEventListeners )
@@ -33,7 +53,7 @@ KeyFrame::~KeyFrame()
 void KeyFrame::addEventListener( KeyFrameEventListener* listener )
 {
     auto it = std::find( mEventListeners.begin(), mEventListeners.end(), listener );
-    if ( it != mEventListeners.end() )
+    if ( it == mEventListeners.end() )
     {
         mEventListeners.push_back( listener );
     }
@@ -30,6 +30,9 @@ class KeyFrame
 {
 public:
     KeyFrame();
+    // Copies don't inherit the listeners, an assignment marks the keyframe modified
+    KeyFrame( const KeyFrame& k );
+    KeyFrame& operator=( const KeyFrame& k );
     virtual ~KeyFrame();
 
     int  pos() { return mFrame; }
@@ -38,9 +41,11 @@ public:
     int length() { return mLength; }
     void setLength( int len )  { mLength = len; }
     
-    void modification() { mIsModified = true; }
-    void setModified( bool b ) { mIsModified = b; }
+    void modification() { mIsModified = true; ++mModificationCount; }
+    void setModified( bool b ) { mIsModified = b; if ( b ) { ++mModificationCount; } }
     bool isModified() { return mIsModified; };
+    // Keeps counting after a save clears isModified(), so caches can tell they are stale
+    int  modificationCount() { return mModificationCount; }
    
     void setSelected( bool b ) { mIsSelected = b; }
     bool isSelected() { return mIsSelected; }
@@ -58,6 +63,7 @@ private:
     int mLength      =  1;
     bool mIsModified = false;
     bool mIsSelected = false;
+    int  mModificationCount = 0;
     QString mAttachedFileName;
 
     std::vector< KeyFrameEventListener* > mEventListeners;
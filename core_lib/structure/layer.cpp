@@ -16,6 +16,7 @@ GNU General Public License for more details.
 */
 
 #include <climits>
+#include <vector>
 #include <cassert>
 #include <QtDebug>
 #include <QInputDialog>
@@ -27,13 +28,6 @@ GNU General Public License for more details.
 #include "timeline.h"
 #include "timelinecells.h"
 
-// Used to sort the selected frames list
-//
-bool sortAsc(int left, int right)
-{
-    return left < right;
-}
-
 Layer::Layer( Object* pObject, LAYER_TYPE eType ) : QObject( pObject )
 {
     mObject = pObject;
@@ -207,12 +201,32 @@ bool Layer::addKeyFrame( int position, KeyFrame* pKeyFrame )
     return true;
 }
 
+bool Layer::addKeyFrames( const std::vector< KeyFrame* >& keys )
+{
+    for ( KeyFrame* key : keys )
+    {
+        if ( mKeyFrames.find( key->pos() ) != mKeyFrames.end() )
+        {
+            return false;
+        }
+    }
+
+    // the map is in descending order, each key of an ascending batch goes right before the previous one
+    auto hint = mKeyFrames.end();
+    for ( KeyFrame* key : keys )
+    {
+        hint = mKeyFrames.insert( hint, std::make_pair( key->pos(), key ) );
+    }
+    return true;
+}
+
 bool Layer::removeKeyFrame( int position )
 {
     auto frame = getKeyFrameWhichCovers(position);
     if(frame)
     {
         mKeyFrames.erase(frame->pos());
+        mSelectedFrames.erase(frame->pos());
         delete frame;
     }
 
@@ -305,14 +319,23 @@ bool Layer::loadKey( KeyFrame* pKey )
     return true;
 }
 
-Status Layer::save( QString strDataFolder )
+Status Layer::save( QString strDataFolder, QStringList* savedFiles )
 {
     QStringList debugInfo = QStringList() << "Layer::save" << QString( "strDataFolder = " ).append( strDataFolder );
     bool isOkay = true;
+    prepareSave( strDataFolder );
 	for ( auto pair : mKeyFrames )
 	{
 		KeyFrame* pKeyFrame = pair.second;
+        if ( !needSaveFrame( pKeyFrame, strDataFolder ) )
+        {
+            continue;
+        }
         Status st = saveKeyFrame( pKeyFrame, strDataFolder );
+        if ( st.ok() && savedFiles != nullptr && !pKeyFrame->fileName().isEmpty() )
+        {
+            savedFiles->append( pKeyFrame->fileName() );
+        }
         if( !st.ok() )
         {
             isOkay = false;
@@ -331,6 +354,15 @@ Status Layer::save( QString strDataFolder )
     return Status::OK;
 }
 
+bool Layer::isKeyFrameStoredIn( KeyFrame* pKeyFrame, const QString& strFilePath )
+{
+    if ( pKeyFrame->isModified() || pKeyFrame->fileName().isEmpty() )
+    {
+        return false;
+    }
+    return QDir::cleanPath( pKeyFrame->fileName() ) == QDir::cleanPath( strFilePath ) && QFile::exists( strFilePath );
+}
+
 void Layer::paintTrack( QPainter& painter, TimeLineCells* cells, int x, int y, int width, int height, bool selected, int frameSize )
 {
     painter.setFont( QFont( "helvetica", height / 2 ) );
@@ -493,13 +525,12 @@ void Layer::setUpdated()
     mObject->setLayerUpdated(mId);
 }
 
-void Layer::setModified( int position, bool )
+void Layer::setModified( int position, bool isModified )
 {
-    auto it = mKeyFrames.find( position );
-    if ( it != mKeyFrames.end() )
+    KeyFrame* keyFrame = getLastKeyFrameAtPosition( position );
+    if ( keyFrame )
     {
-        //KeyFrame* pKeyFrame = it->second;
-        //pKeyFrame->
+        keyFrame->setModified( isModified );
     }
 }
 
@@ -508,7 +539,7 @@ bool Layer::isFrameSelected(int position)
     KeyFrame *keyFrame = getKeyFrameWhichCovers(position);
     if(keyFrame)
     {
-        return mSelectedFrames_byLast.contains(keyFrame->pos());
+        return mSelectedFrames.count(keyFrame->pos()) > 0;
     }
     else
     {
@@ -522,28 +553,15 @@ void Layer::setFrameSelected(int position, bool isSelected)
     if (keyFrame != nullptr) {
         int startPosition = keyFrame->pos();
 
-        if (isSelected && !mSelectedFrames_byLast.contains(startPosition)) {
-
-            // Add the selected frame to the lists
-            //
-            mSelectedFrames_byLast.insert(0, startPosition);
-            mSelectedFrames_byPosition.append(startPosition);
-
-            // We need to keep the list of selected frames sorted
-            // in order to easily handle their movement
-            //
-            qSort(mSelectedFrames_byPosition.begin(), mSelectedFrames_byPosition.end(), sortAsc);
-
+        if (isSelected) {
+            mSelectedFrames.insert(startPosition);
+            mLastSelectedFrame = startPosition;
         }
-        else if (!isSelected){
-
-            // Remove the selected frame from the lists
-            //
-            int iLast = mSelectedFrames_byLast.indexOf(startPosition);
-            mSelectedFrames_byLast.removeAt(iLast);
-
-            int iPos = mSelectedFrames_byPosition.indexOf(startPosition);
-            mSelectedFrames_byPosition.removeAt(iPos);
+        else {
+            mSelectedFrames.erase(startPosition);
+            if (mLastSelectedFrame == startPosition) {
+                mLastSelectedFrame = mSelectedFrames.empty() ? -1 : *mSelectedFrames.rbegin();
+            }
         }
         keyFrame->setSelected(isSelected);
     }
@@ -562,25 +580,30 @@ void Layer::toggleFrameSelected(int position, bool allowMultiple)
 
 void Layer::extendSelectionTo(int position)
 {
-    if (mSelectedFrames_byLast.count() > 0 ) {
-        int lastSelected = mSelectedFrames_byLast[0];
-        int startPos;
-        int endPos;
+    if (mSelectedFrames.empty()) {
+        return;
+    }
 
-        if (lastSelected < position) {
-            startPos = lastSelected;
-            endPos = position;
-        }
-        else {
-            startPos = position;
-            endPos = lastSelected;
-        }
+    int startPos = qMin(mLastSelectedFrame, position);
+    int endPos = qMax(mLastSelectedFrame, position);
 
-        int i = startPos;
-        while (i <= endPos) {
-            setFrameSelected(i, true);
-            i++;
-        }
+    // A keyframe that starts before the range can still cover its first frame
+    KeyFrame* covering = getKeyFrameWhichCovers(startPos);
+    if (covering != nullptr) {
+        setFrameSelected(covering->pos(), true);
+    }
+
+    // Visit only the keyframes in the range, not every frame of it
+    auto begin = mKeyFrames.lower_bound(endPos);
+    auto end = mKeyFrames.upper_bound(startPos);
+    for (auto it = begin; it != end; ++it) {
+        mSelectedFrames.insert(it->first);
+        it->second->setSelected(true);
+    }
+
+    // like selecting frame by frame, the last keyframe of the range is the new anchor
+    if (begin != end) {
+        mLastSelectedFrame = begin->first;
     }
 }
 
@@ -602,106 +625,91 @@ void Layer::selectAllFramesAfter( int position )
 
 void Layer::deselectAll()
 {
-    mSelectedFrames_byLast.clear();
-    mSelectedFrames_byPosition.clear();
-
-    for ( auto pair : mKeyFrames )
+    for ( int position : mSelectedFrames )
     {
-        pair.second->setSelected(false);
+        KeyFrame* keyFrame = getKeyFrameAt( position );
+        if ( keyFrame != nullptr )
+        {
+            keyFrame->setSelected( false );
+        }
     }
+    mSelectedFrames.clear();
+    mLastSelectedFrame = -1;
 }
 
 bool Layer::moveSelectedFrames(int offset)
 {
+    if (offset == 0 || mSelectedFrames.empty()) {
+        return false;
+    }
 
-    if (offset != 0 && mSelectedFrames_byPosition.count() > 0) {
-
-        // If we are moving to the right we start moving selected frames from the highest (right) to the lowest (left)
-        int indexInSelection = mSelectedFrames_byPosition.count() - 1;
-        int step = -1;
-
-        if (offset < 0) {
-
-            // If we are moving to the left we start moving selected frames from the lowest (left) to the highest (right)
-            indexInSelection = 0;
-            step = 1;
-
-            // Check if we are not moving out of the timeline
-            if (mSelectedFrames_byPosition[0] + offset < 1) {
-                return false;
-            }
-        }
-
-
-        while ( indexInSelection > -1 && indexInSelection < mSelectedFrames_byPosition.count() ) {
-
-            int fromPos = mSelectedFrames_byPosition[indexInSelection];
-            int toPos = fromPos + offset;
-
-            // Get the frame to move
-            KeyFrame *selectedFrame = getKeyFrameAt(fromPos);
-
-            if (selectedFrame != nullptr) {
-
-                mKeyFrames.erase(fromPos);
-
-                // Slide back every frame between fromPos to toPos
-                // to avoid having 2 frames in the same position
-                //
-                bool isBetween = true;
-                int targetPosition = fromPos;
-
-                while (isBetween) {
-
-                    int framePosition = targetPosition - step;
+    const int firstSelected = *mSelectedFrames.begin();
+    const int lastSelected = *mSelectedFrames.rbegin();
 
-                    KeyFrame *frame = getKeyFrameAt(framePosition);
+    // Check if we are not moving out of the timeline
+    if (firstSelected + offset < 1) {
+        return false;
+    }
 
-                    if (frame != nullptr) {
-                        mKeyFrames.erase(framePosition);
+    // Only the positions between the first selected frame and where the last one
+    // lands can change, the keyframes there are taken out and put back once
+    const int low = (offset > 0) ? firstSelected : firstSelected + offset;
+    const int high = (offset > 0) ? lastSelected + offset : lastSelected;
 
-                        frame->setPos(targetPosition);
-                        mKeyFrames.insert( std::make_pair( targetPosition, frame ) );
-                    }
+    auto rangeBegin = mKeyFrames.lower_bound(high); // mKeyFrames is in descending order
+    auto rangeEnd = mKeyFrames.upper_bound(low);
+    std::vector<std::pair<int, KeyFrame*>> frames(rangeBegin, rangeEnd);
+    mKeyFrames.erase(rangeBegin, rangeEnd);
 
-                    targetPosition = targetPosition - step;
-                    if (fromPos < toPos && (targetPosition < fromPos || targetPosition >= toPos)) {
-                        isBetween = false;
-                    }
-                    if (fromPos > toPos && (targetPosition > fromPos || targetPosition <= toPos)) {
-                        isBetween = false;
-                    }
-                }
+    std::vector<int> targets;
+    targets.reserve(mSelectedFrames.size());
+    for (int position : mSelectedFrames) {
+        targets.push_back(position + offset);
+    }
 
-                // If the first frame is moving, we need to create a new first frame
-                if (fromPos == 1) {
-                    addNewEmptyKeyAt(1);
-                }
+    // The other frames keep their order and fill, one after the other, the
+    // positions of the range that no selected frame lands on.
+    // Walking both in ascending order makes this linear in the range's keyframes.
+    auto selected = mSelectedFrames.begin();
+    int selectedBefore = 0;
+    size_t targetsBefore = 0;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        int position = it->first;
+        KeyFrame* frame = it->second;
 
-                // Update the position of the selected frame
-                selectedFrame->setPos(toPos);
-                mKeyFrames.insert( std::make_pair( toPos, selectedFrame ) );
+        int newPosition;
+        if (mSelectedFrames.count(position) > 0) {
+            newPosition = position + offset;
+        }
+        else {
+            while (selected != mSelectedFrames.end() && *selected < position) {
+                ++selected;
+                ++selectedBefore;
             }
-
-            indexInSelection = indexInSelection + step;
+            int rank = position - low - selectedBefore;
+            while (targetsBefore < targets.size() && targets[targetsBefore] <= low + rank + int(targetsBefore)) {
+                ++targetsBefore;
+            }
+            newPosition = low + rank + int(targetsBefore);
         }
 
+        frame->setPos(newPosition);
+        mKeyFrames.insert(std::make_pair(newPosition, frame));
+    }
 
-        // Update selection lists
-        //
-        for (int i=0; i<mSelectedFrames_byPosition.count(); i++) {
-            mSelectedFrames_byPosition[i] = mSelectedFrames_byPosition[i] + offset;
-        }
-        for (int i=0; i<mSelectedFrames_byLast.count(); i++) {
-            mSelectedFrames_byLast[i] = mSelectedFrames_byLast[i] + offset;
-        }
-
-        return true;
+    // If the first frame is moving, we need to create a new first frame
+    if (firstSelected == 1) {
+        addNewEmptyKeyAt(1);
     }
-    else {
-        return false;
+
+    std::set<int> moved;
+    for (int position : targets) {
+        moved.insert(moved.end(), position);
     }
+    mSelectedFrames.swap(moved);
+    mLastSelectedFrame += offset;
 
+    return true;
 }
 
 bool isLayerPaintable( Layer* layer )
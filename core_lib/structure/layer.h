@@ -18,6 +18,8 @@ GNU General Public License for more details.
 #define LAYER_H
 
 #include <map>
+#include <set>
+#include <vector>
 #include <functional>
 #include <QString>
 #include <QPainter>
@@ -82,6 +84,8 @@ public:
 
     bool addNewEmptyKeyAt( int position );
     bool addKeyFrame( int position, KeyFrame* );
+    // Takes keys with their positions set, all of them or none when a position is taken
+    bool addKeyFrames( const std::vector< KeyFrame* >& keys );
     bool removeKeyFrame(int position);
     bool swapKeyFrames( int position1, int position2 );
     bool moveKeyFrameForward( int position );
@@ -104,9 +108,13 @@ public:
     void selectAllFramesAfter( int position );
     void deselectAll();
 
+    // Moves the selected keyframes by offset, the keyframes in between fill the
+    // positions they leave, in their order
     bool moveSelectedFrames( int offset );
     
-    Status save( QString dataFolder );
+    // Only keyframes which changed since they were last written to dataFolder are
+    // encoded again, the paths of the files written are appended to savedFiles.
+    Status save( QString dataFolder, QStringList* savedFiles = nullptr );
 
     // graphic representation -- could be put in another class
     void paintTrack(QPainter& painter, TimeLineCells* cells, int x, int y, int width, int height, bool selected, int frameSize);
@@ -126,6 +134,12 @@ public:
 protected:
     void setId( int LayerId ) { mId = LayerId; }
 
+    virtual bool needSaveFrame( KeyFrame*, const QString& strDataFolder ) { Q_UNUSED( strDataFolder ); return true; }
+    // Called before any keyframe is written to strDataFolder
+    virtual void prepareSave( const QString& strDataFolder ) { Q_UNUSED( strDataFolder ); }
+    // True when strFilePath already holds the unmodified content of the keyframe
+    bool isKeyFrameStoredIn( KeyFrame*, const QString& strFilePath );
+
 private:
     LAYER_TYPE meType = UNDEFINED;
     Object* mObject   = nullptr;
@@ -133,12 +147,10 @@ private:
 
     std::map<int, KeyFrame*, std::greater<int>> mKeyFrames;
 
-    // We need to keep track of selected frames ordered by last selected
-    // and by position.
-    // Both should be pre-sorted on each selection for optimization purpose when moving frames.
-    //
-    QList<int> mSelectedFrames_byLast; // Used to hadle selection range (based on last selected
-    QList<int> mSelectedFrames_byPosition; // Used to handle frames movements on the timeline
+    // Start positions of the selected keyframes, in ascending order so that
+    // moveSelectedFrames can shift them in one pass
+    std::set<int> mSelectedFrames;
+    int mLastSelectedFrame = -1; // anchor of extendSelectionTo()
 };
 
 bool isLayerPaintable( Layer* );
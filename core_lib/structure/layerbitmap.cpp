@@ -14,10 +14,76 @@ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 GNU General Public License for more details.
 
 */
+#include <algorithm>
+#include <map>
 #include <QtDebug>
+#include <QImageReader>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
 #include "keyframe.h"
 #include "bitmapimage.h"
 #include "layerbitmap.h"
+#include "functiontask.h"
+
+
+namespace
+{
+    // The smallest rectangle holding every pixel which isn't fully transparent, empty if there is none
+    QRect opaqueRect( const QImage& image )
+    {
+        Q_ASSERT( image.format() == QImage::Format_ARGB32_Premultiplied );
+        const int width = image.width();
+        const int height = image.height();
+
+        // premultiplied, so a transparent pixel is 0
+        auto rowIsEmpty = [&]( int y )
+        {
+            const QRgb* row = reinterpret_cast< const QRgb* >( image.constScanLine( y ) );
+            return std::all_of( row, row + width, []( QRgb p ) { return p == 0; } );
+        };
+
+        int top = 0;
+        while ( top < height && rowIsEmpty( top ) )
+        {
+            top++;
+        }
+        if ( top == height )
+        {
+            return QRect();
+        }
+        int bottom = height - 1;
+        while ( rowIsEmpty( bottom ) )
+        {
+            bottom--;
+        }
+
+        // each row only needs looking at outside of the columns found so far
+        int left = width - 1;
+        int right = 0;
+        for ( int y = top; y <= bottom; y++ )
+        {
+            const QRgb* row = reinterpret_cast< const QRgb* >( image.constScanLine( y ) );
+            for ( int x = 0; x < left; x++ )
+            {
+                if ( row[ x ] != 0 )
+                {
+                    left = x;
+                    break;
+                }
+            }
+            for ( int x = width - 1; x > right; x-- )
+            {
+                if ( row[ x ] != 0 )
+                {
+                    right = x;
+                    break;
+                }
+            }
+        }
+        return QRect( QPoint( left, top ), QPoint( qMax( left, right ), bottom ) );
+    }
+}
 
 
 LayerBitmap::LayerBitmap( Object* object ) : Layer( object, Layer::BITMAP )
@@ -30,6 +96,128 @@ LayerBitmap::~LayerBitmap()
 {
 }
 
+Status LayerBitmap::loadImages( const QStringList& files, int startFrame, int frameStep, QPoint centre, bool autoCrop,
+                                std::vector< BitmapImage* >& images, std::function<void( float )> progress,
+                                const std::atomic<bool>* canceled )
+{
+    if ( startFrame < 1 || frameStep < 1 )
+    {
+        return Status::INVALID_ARGUMENT;
+    }
+    progress( 0.f );
+
+    auto isCanceled = [canceled] { return canceled != nullptr && *canceled; };
+
+    QMutex mutex;
+    QWaitCondition imageDone;
+    std::map< int, BitmapImage* > decoded;
+    int finished = 0;
+
+    QThreadPool pool;
+    for ( int i = 0; i < files.size(); i++ )
+    {
+        const QString path = files[ i ];
+        pool.start( new FunctionTask( [=, &mutex, &imageDone, &decoded, &finished]
+        {
+            QImage image = QImageReader( path ).read();
+            BitmapImage* bitmapImage = nullptr;
+            if ( !image.isNull() )
+            {
+                image = image.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+
+                // the image stays where it would have been uncropped
+                QRect rect = image.rect();
+                QPoint topLeft = centre - QPoint( image.width() / 2, image.height() / 2 );
+                if ( autoCrop )
+                {
+                    rect = opaqueRect( image );
+                    image = rect.isEmpty() ? QImage() : image.copy( rect );
+                }
+                bitmapImage = rect.isEmpty() ? new BitmapImage : new BitmapImage( rect.translated( topLeft ), image );
+                bitmapImage->setModified( true );
+            }
+
+            QMutexLocker locker( &mutex );
+            decoded[ i ] = bitmapImage;
+            finished++;
+            imageDone.wakeAll();
+        } ) );
+    }
+
+    mutex.lock();
+    while ( finished < files.size() && !isCanceled() )
+    {
+        imageDone.wait( &mutex, 100 );
+        const float f = float( finished ) / files.size();
+        mutex.unlock();
+        progress( f ); // keeps the caller's event loop alive
+        mutex.lock();
+    }
+    mutex.unlock();
+
+    if ( isCanceled() )
+    {
+        // the images being read are finished, the others never start
+        pool.clear();
+        pool.waitForDone();
+        for ( auto& pair : decoded )
+        {
+            delete pair.second;
+        }
+        return Status::CANCELED;
+    }
+    pool.waitForDone();
+
+    QStringList unreadable;
+    int position = startFrame;
+    for ( auto& pair : decoded )
+    {
+        if ( pair.second != nullptr )
+        {
+            pair.second->setPos( position );
+            images.push_back( pair.second );
+            position += frameStep;
+        }
+        else
+        {
+            unreadable << files[ pair.first ];
+        }
+    }
+
+    progress( 1.f );
+    if ( unreadable.isEmpty() )
+    {
+        return Status::OK;
+    }
+    // the images which could be read are still handed over
+    QStringList details = QStringList() << "LayerBitmap::loadImages" << unreadable;
+    return Status( position == startFrame ? Status::ERROR_LOAD_IMAGE_FAIL : Status::SAFE, details );
+}
+
+void LayerBitmap::insertImages( std::vector< BitmapImage* >& images )
+{
+    std::vector< KeyFrame* > newKeys;
+    newKeys.reserve( images.size() );
+    for ( BitmapImage* image : images )
+    {
+        BitmapImage* existing = getBitmapImageAtFrame( image->pos() );
+        if ( existing != nullptr )
+        {
+            existing->paste( image );
+            delete image;
+        }
+        else
+        {
+            newKeys.push_back( image );
+        }
+    }
+    images.clear();
+
+    bool added = addKeyFrames( newKeys );
+    Q_ASSERT( added );
+    Q_UNUSED( added );
+}
+
 BitmapImage* LayerBitmap::getBitmapImageAtFrame( int frameNumber )
 {
     Q_ASSERT( frameNumber >= 1 );
@@ -46,6 +234,8 @@ void LayerBitmap::loadImageAtFrame( QString path, QPoint topLeft, int frameNumbe
 {
     BitmapImage* pKeyFrame = new BitmapImage( path, topLeft );
     pKeyFrame->setPos( frameNumber );
+    pKeyFrame->setFileName( path );
+    pKeyFrame->setModified( false );
     loadKey( pKeyFrame );
 }
 
@@ -57,14 +247,35 @@ Status LayerBitmap::saveKeyFrame( KeyFrame* pKeyFrame, QString path )
     QString theFileName = fileName( pKeyFrame->pos() );
     QString strFilePath = QDir( path ).filePath( theFileName );
     debugInfo << QString( "strFilePath = " ).arg( strFilePath );
-    if ( !pBitmapImage->image()->save( strFilePath ) && !pBitmapImage->image()->isNull() )
+    QImage image = pBitmapImage->toImage();
+    if ( !image.save( strFilePath ) && !image.isNull() )
     {
         return Status( Status::FAIL, debugInfo << QString( "pBitmapImage could not be saved" ) );
     }
 
+    pBitmapImage->setFileName( strFilePath );
+    pBitmapImage->setFileStored();
     return Status::OK;
 }
 
+void LayerBitmap::prepareSave( const QString& strDataFolder )
+{
+    // A frame which hasn't been decoded yet still reads from its old file,
+    // which may be overwritten by another frame once the frames are moved around.
+    foreachKeyFrame( [&]( KeyFrame* pKeyFrame )
+    {
+        if ( needSaveFrame( pKeyFrame, strDataFolder ) )
+        {
+            static_cast< BitmapImage* >( pKeyFrame )->loadFile();
+        }
+    } );
+}
+
+bool LayerBitmap::needSaveFrame( KeyFrame* pKeyFrame, const QString& strDataFolder )
+{
+    return !isKeyFrameStoredIn( pKeyFrame, QDir( strDataFolder ).filePath( fileName( pKeyFrame->pos() ) ) );
+}
+
 QString LayerBitmap::fileName( int frame )
 {
     QString layerNumberString = QString::number( id() );
@@ -17,6 +17,7 @@ GNU General Public License for more details.
 #ifndef LAYERBITMAP_H
 #define LAYERBITMAP_H
 
+#include <atomic>
 #include "layer.h"
 
 class BitmapImage;
@@ -35,12 +36,24 @@ public:
     QDomElement createDomElement( QDomDocument& doc ) override;
     void loadDomElement( QDomElement element, QString dataDirPath ) override;
 
+    // Decodes the files on a pool of threads into keys centred on centre, one every frameStep
+    // frames from startFrame on, in file order. Files which can't be read are left out and
+    // listed in the details, of Status::SAFE when some were read, else ERROR_LOAD_IMAGE_FAIL.
+    // Setting canceled stops it with Status::CANCELED and no images.
+    static Status loadImages( const QStringList& files, int startFrame, int frameStep, QPoint centre, bool autoCrop,
+                              std::vector< BitmapImage* >& images, std::function<void( float )> progress,
+                              const std::atomic<bool>* canceled = nullptr );
+    // Adds the images as new keys in one go, those landing on an existing key are pasted onto it and deleted
+    void insertImages( std::vector< BitmapImage* >& images );
+
     BitmapImage* getBitmapImageAtFrame( int frameNumber );
     BitmapImage* getLastBitmapImageAtFrame( int frameNumber, int increment );
 
     qreal getOpacity() { return mOpacity; }
 protected:
     Status saveKeyFrame( KeyFrame*, QString strPath ) override;
+    bool needSaveFrame( KeyFrame*, const QString& strDataFolder ) override;
+    void prepareSave( const QString& strDataFolder ) override;
     qreal mOpacity;
 private:
     QString fileName( int index );
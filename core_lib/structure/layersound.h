@@ -45,6 +45,8 @@ public:
 
 protected:
     Status saveKeyFrame( KeyFrame*, QString path ) override;
+    // Clips are stored in the file they were loaded from, nothing is written
+    bool needSaveFrame( KeyFrame*, const QString& ) override { return false; }
 };
 
 #endif
@@ -92,6 +92,8 @@ void LayerVector::loadImageAtFrame(QString path, int frameNumber)
     vecImg->setPos( frameNumber );
     vecImg->setObject( object() );
     vecImg->read( path );
+    vecImg->setFileName( path );
+    vecImg->setModified( false );
     addKeyFrame( frameNumber, vecImg );
 }
 
@@ -115,9 +117,16 @@ Status LayerVector::saveKeyFrame( KeyFrame* pKeyFrame, QString path )
         return Status( Status::FAIL, debugInfo );
     }
 
+    pVecImage->setFileName( strFilePath );
+    pVecImage->setModified( false );
     return Status::OK;
 }
 
+bool LayerVector::needSaveFrame( KeyFrame* pKeyFrame, const QString& strDataFolder )
+{
+    return !isKeyFrameStoredIn( pKeyFrame, QDir( strDataFolder ).filePath( fileName( pKeyFrame->pos() ) ) );
+}
+
 QString LayerVector::fileName( int frame )
 {
     QString layerNumberString = QString::number( id() );
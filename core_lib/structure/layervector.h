@@ -44,6 +44,7 @@ public:
 
 protected:
     Status saveKeyFrame( KeyFrame*, QString path ) override;
+    bool needSaveFrame( KeyFrame*, const QString& strDataFolder ) override;
     QString fileName( int index );
 };
 
@@ -443,6 +443,28 @@ void Object::loadDefaultPalette()
     addColour( ColourRef( QColor( 227, 177, 105 ), QString( tr( "Dark Skin - shade" ) ) ) );
 }
 
+void Object::prepareThreadedPainting() const
+{
+    // Bitmaps are only read once they are tiled. The ones still on disk are
+    // decoded by whichever thread needs them first, vector images guard their
+    // own path caches.
+    for ( int i = 0; i < getLayerCount(); i++ )
+    {
+        Layer* layer = getLayer( i );
+        if ( layer->type() == Layer::BITMAP )
+        {
+            layer->foreachKeyFrame( []( KeyFrame* key )
+            {
+                BitmapImage* bitmapImage = static_cast< BitmapImage* >( key );
+                if ( bitmapImage->isLoaded() )
+                {
+                    bitmapImage->ensureTiled();
+                }
+            } );
+        }
+    }
+}
+
 void Object::paintImage( QPainter& painter, int frameNumber,
                          bool background,
                          bool antialiasing ) const
@@ -96,6 +96,8 @@ public:
 	bool loadXML( QDomElement element, ProgressCallback progress = [] (float){} );
 
     void paintImage( QPainter& painter, int frameNumber, bool background, bool antialiasing ) const;
+    // Call before painting frames on several threads at once, painting the keys then only reads them
+    void prepareThreadedPainting() const;
 
     QString copyFileToDataFolder( QString strFilePath );
 
@@ -78,8 +78,7 @@ void SoundClip::play()
 void SoundClip::playFromPosition(int frameNumber, int fps)
 {
     int framesIntoSound = frameNumber - pos();
-    int msPerFrame = 1000 / fps;
-    int msIntoSound = framesIntoSound * msPerFrame;
+    qint64 msIntoSound = qint64( framesIntoSound ) * 1000 / fps;
 
     if ( mPlayer )
     {
@@ -96,6 +95,16 @@ void SoundClip::stop()
     }
 }
 
+bool SoundClip::isPlaying()
+{
+    return mPlayer && mPlayer->isPlaying();
+}
+
+qint64 SoundClip::playbackPosition()
+{
+    return mPlayer ? mPlayer->position() : 0;
+}
+
 int64_t SoundClip::duration() const
 {
     return mDuration;
@@ -43,6 +43,8 @@ public:
     void play();
     void playFromPosition(int frameNumber, int fps);
     void stop();
+    bool isPlaying();
+    qint64 playbackPosition(); // milliseconds into the sound
 
     int64_t duration() const;
     void setDuration(const int64_t &duration);
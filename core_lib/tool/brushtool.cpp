@@ -269,7 +269,7 @@ void BrushTool::paintAt( QPointF point )
         BlitRect rect;
 
         rect.extend( point.toPoint() );
-        mScribbleArea->drawBrush( QPoint( qRound(point.x() ), qRound(point.y() )),
+        mScribbleArea->drawBrush( point,
                                   brushWidth,
                                   properties.feather,
                                   mEditor->color()->frontColor(),
@@ -285,7 +285,7 @@ void BrushTool::paintAt( QPointF point )
 void BrushTool::drawStroke()
 {
     StrokeTool::drawStroke();
-    QList<QPointF> p = m_pStrokeManager->interpolateStroke();
+    StrokeSegment p = m_pStrokeManager->interpolateStroke();
 
     Layer* layer = mEditor->layers()->currentLayer();
 
@@ -320,7 +320,7 @@ void BrushTool::drawStroke()
             QPointF point = mLastBrushPoint + ( i + 1 ) * brushStep * ( getCurrentPoint() - mLastBrushPoint ) / distance;
 
             rect.extend( point.toPoint() );
-            mScribbleArea->drawBrush( QPoint( qRound(point.x() ),qRound(point.y() )),
+            mScribbleArea->drawBrush( point,
                                       brushWidth,
                                       properties.feather,
                                       mEditor->color()->frontColor(),
@@ -135,9 +135,9 @@ void BucketTool::paintBitmap(Layer* layer)
     BitmapImage::floodFill( targetImage,
                             cameraRect,
                             point,
-                            Qt::transparent,
                             qPremultiply( mEditor->color()->frontColor().rgba() ),
-                            properties.tolerance * 2.55 );
+                            properties.tolerance * 2.55,
+                            mEditor->preference()->getInt( SETTING::FILL_GAP_SIZE ) );
 
     mScribbleArea->setModified( layerNumber, mEditor->currentFrame() );
     mScribbleArea->setAllDirty();
@@ -169,7 +169,7 @@ void BucketTool::paintVector(QMouseEvent *event, Layer* layer)
 void BucketTool::drawStroke()
 {
     StrokeTool::drawStroke();
-    QList<QPointF> p = m_pStrokeManager->interpolateStroke();
+    StrokeSegment p = m_pStrokeManager->interpolateStroke();
 
     Layer* layer = mEditor->layers()->currentLayer();
 
@@ -24,7 +24,7 @@ GNU General Public License for more details.
 #include "layerbitmap.h"
 #include "layervector.h"
 #include "strokemanager.h"
-#include "blitrect.h"
+#include "smudgeengine.h"
 
 #include "smudgetool.h"
 
@@ -207,6 +207,7 @@ void SmudgeTool::mouseReleaseEvent(QMouseEvent *event)
             {
                 int curveNumber = mScribbleArea->vectorSelection.curve.at(k);
                 vectorImage->m_curves[curveNumber].smoothCurve();
+                vectorImage->updateCurveIndex(curveNumber);
             }
             mScribbleArea->setModified(mEditor->layers()->currentLayerIndex(), mEditor->currentFrame());
         }
@@ -258,7 +259,7 @@ void SmudgeTool::drawStroke()
 
     BitmapImage *targetImage = ((LayerBitmap *)layer)->getLastBitmapImageAtFrame(mEditor->currentFrame(), 0);
     StrokeTool::drawStroke();
-    QList<QPointF> p = m_pStrokeManager->interpolateStroke();
+    StrokeSegment p = m_pStrokeManager->interpolateStroke();
 
     for (int i = 0; i < p.size(); i++)
     {
@@ -271,65 +272,50 @@ void SmudgeTool::drawStroke()
     //opacity = currentPressure; // todo: Probably not interesting?!
     //brushWidth = brushWidth * opacity;
 
-    BlitRect rect;
     QPointF a = mLastBrushPoint;
     QPointF b = getCurrentPoint();
 
-
-    if (toolMode == 0) // liquify hard (default)
+    // liquify hard (default) steps twice as far along the stroke as liquify smooth
+    bool isLiquify = ( toolMode == 0 );
+    qreal brushStep = 2.0;
+    qreal distance = isLiquify ? QLineF(b, a).length() / 2.0 : QLineF(b, a).length();
+    int steps = qRound(distance / brushStep);
+    if (steps <= 0 || targetImage == nullptr)
     {
-        qreal brushStep = 2;
-        qreal distance = QLineF(b, a).length()/2.0;
-        int steps = qRound(distance / brushStep);
-        int rad = qRound(brushWidth / 2.0) + 2;
+        return;
+    }
 
-        QPointF sourcePoint = mLastBrushPoint;
-        for (int i = 0; i < steps; i++)
-        {
-            QPointF targetPoint = mLastBrushPoint + (i + 1) * (brushStep) * (b - mLastBrushPoint) / distance;
-            rect.extend(targetPoint.toPoint());
-            mScribbleArea->liquifyBrush( targetImage,
-                                                sourcePoint,
-                                                targetPoint,
-                                                brushWidth,
-                                                offset,
-                                                opacity);
-
-            if (i == (steps - 1))
-            {
-                mLastBrushPoint = targetPoint;
-            }
-            sourcePoint = targetPoint;
-            mScribbleArea->paintBitmapBufferRect( rect );
-            mScribbleArea->refreshBitmap(rect, rad);
-        }
+    QVector<QPointF> points;
+    points.reserve(steps + 1);
+    points.append(mLastBrushPoint);
+    for (int i = 0; i < steps; i++)
+    {
+        points.append(mLastBrushPoint + (i + 1) * (brushStep) * (b - mLastBrushPoint) / distance);
     }
-    else // liquify smooth
+
+    // Every pixel the steps read or write, read and written back once for the whole event
+    int rad = qRound(brushWidth / 2.0) + 2;
+    QRect area;
+    for (const QPointF& point : points)
     {
-        qreal brushStep = 2.0;
-        qreal distance = QLineF(b, a).length();
-        int steps = qRound(distance / brushStep);
-        int rad = qRound(brushWidth / 2.0) + 2;
+        area |= QRect(point.toPoint(), QSize(1, 1)).adjusted(-rad, -rad, rad, rad);
+    }
 
-        QPointF sourcePoint = mLastBrushPoint;
-        for (int i = 0; i < steps; i++)
+    SmudgeEngine engine(targetImage, area);
+    for (int i = 0; i < steps; i++)
+    {
+        if (isLiquify)
         {
-            QPointF targetPoint = mLastBrushPoint + (i + 1) * (brushStep) * (b - mLastBrushPoint) / distance;
-            rect.extend(targetPoint.toPoint());
-            mScribbleArea->blurBrush( targetImage,
-                                                sourcePoint,
-                                                targetPoint,
-                                                brushWidth,
-                                                offset,
-                                                opacity);
-
-            if (i == (steps - 1))
-            {
-                mLastBrushPoint = targetPoint;
-            }
-            sourcePoint = targetPoint;
-            mScribbleArea->paintBitmapBufferRect( rect );
-            mScribbleArea->refreshBitmap(rect, rad);
+            engine.liquify(points[i], points[i + 1], brushWidth, offset, opacity);
+        }
+        else
+        {
+            engine.blur(points[i], points[i + 1], brushWidth, offset, opacity);
         }
     }
+    engine.apply();
+    mLastBrushPoint = points.last();
+
+    mScribbleArea->paintBitmapBufferRect(area);
+    mScribbleArea->refreshBitmap(area, 0);
 }
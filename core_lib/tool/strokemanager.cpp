@@ -23,32 +23,37 @@
 #include <limits>
 #include <QDebug>
 #include <QLineF>
-#include <QPainterPath>
 #include "strokemanager.h"
 #include "object.h"
 
 
 StrokeManager::StrokeManager()
 {
-    m_timeshot = 0;
-
     mTabletInUse = false;
     mTabletPressure = 0;
     mMeanPressure = 0;
 
+    mClock.start();
     reset();
-    connect(&timer, &QTimer::timeout, this, &StrokeManager::interpolatePollAndPaint);
 }
 
 void StrokeManager::reset()
 {
     mStrokeStarted = false;
-    pressureQueue.clear();
-    strokeQueue.clear();
+    mPendingHead = 0;
+    mPendingCount = 0;
+    mMeanHead = 0;
+    mMeanCount = 0;
     pressure = 0.0f;
     hasTangent = false;
-    timer.stop();
     mInpolLevel = -1;
+
+    mUnpaintedOldest = -1;
+    mUnpaintedSum = 0;
+    mUnpaintedCount = 0;
+    mLatencySumMs = 0.0;
+    mPaintedSamples = 0;
+    mLatency = StrokeLatency();
 }
 
 void StrokeManager::setPressure(float pressure)
@@ -110,6 +115,8 @@ void StrokeManager::tabletEvent(QTabletEvent* event)
     if (event->type() == QEvent::TabletRelease) { mTabletInUse = false; }
 
     mTabletPosition = event->posF();
+    mTabletXTilt = event->xTilt();
+    mTabletYTilt = event->yTilt();
     setPressure(event->pressure());
 }
 
@@ -121,6 +128,7 @@ void StrokeManager::setInpolLevel(int level)
 void StrokeManager::mouseMoveEvent(QMouseEvent* event)
 {
     QPointF pos = getEventPosition(event);
+    pollMeanUntil( mClock.nsecsElapsed() );
 
     // only applied to drawing tools.
     if (mInpolLevel != -1){
@@ -134,6 +142,87 @@ void StrokeManager::mouseMoveEvent(QMouseEvent* event)
     }
 }
 
+void StrokeManager::queueSample(QMouseEvent* event)
+{
+    StrokeSample sample;
+    sample.pos = getEventPosition( event );
+    sample.pressure = mTabletInUse ? mTabletPressure : 1.0;
+    sample.xTilt = mTabletXTilt;
+    sample.yTilt = mTabletYTilt;
+    sample.time = mClock.nsecsElapsed();
+
+    if ( mPendingCount > 0 )
+    {
+        StrokeSample& last = mSamples[ ( mPendingHead + mPendingCount - 1 ) % SAMPLE_CAPACITY ];
+        QPointF d = sample.pos - last.pos;
+        if ( d.x() * d.x() + d.y() * d.y() < 0.25 || mPendingCount == SAMPLE_CAPACITY )
+        {
+            // it keeps the time it waited since the first of them
+            sample.time = last.time;
+            last = sample;
+            mLatency.coalesced++;
+            return;
+        }
+    }
+    mSamples[ ( mPendingHead + mPendingCount ) % SAMPLE_CAPACITY ] = sample;
+    mPendingCount++;
+}
+
+bool StrokeManager::dispatchSample(StrokeSample& sample)
+{
+    if ( mPendingCount == 0 )
+    {
+        return false;
+    }
+    sample = mSamples[ mPendingHead ];
+    mPendingHead = ( mPendingHead + 1 ) % SAMPLE_CAPACITY;
+    mPendingCount--;
+
+    if ( mTabletInUse )
+    {
+        setPressure( sample.pressure );
+    }
+    pollMeanUntil( sample.time );
+    if ( mInpolLevel != -1 )
+    {
+        smoothMousePos( sample.pos );
+    }
+    else
+    {
+        mLastPixel = mCurrentPixel;
+        mCurrentPixel = sample.pos;
+        mLastInterpolated = mCurrentPixel;
+    }
+
+    if ( mUnpaintedCount == 0 )
+    {
+        mUnpaintedOldest = sample.time;
+    }
+    mUnpaintedSum += sample.time;
+    mUnpaintedCount++;
+    mLatency.samples++;
+    return true;
+}
+
+void StrokeManager::framePainted()
+{
+    if ( mUnpaintedCount == 0 )
+    {
+        return;
+    }
+    const qint64 now = mClock.nsecsElapsed();
+    mLatencySumMs += ( double( now ) * mUnpaintedCount - mUnpaintedSum ) * 1.0e-6;
+    mPaintedSamples += mUnpaintedCount;
+
+    mLatency.frames++;
+    mLatency.meanMs = float( mLatencySumMs / mPaintedSamples );
+    mLatency.maxMs = qMax( mLatency.maxMs, float( ( now - mUnpaintedOldest ) * 1.0e-6 ) );
+
+    mUnpaintedOldest = -1;
+    mUnpaintedSum = 0;
+    mUnpaintedCount = 0;
+}
+
 void StrokeManager::smoothMousePos(QPointF pos)
 {
 
@@ -153,14 +242,6 @@ void StrokeManager::smoothMousePos(QPointF pos)
         mLastPixel = mCurrentPixel;
         mCurrentPixel = smoothPos;
         mLastInterpolated = mCurrentPixel;
-
-        // shift queue
-        while ( strokeQueue.size()  >= STROKE_QUEUE_LENGTH )
-        {
-            strokeQueue.pop_front();
-        }
-
-        strokeQueue.push_back( smoothPos );
     } else if (mInpolLevel == 2 ) {
 
         smoothPos = QPointF( ( pos.x() + mLastInterpolated.x() ) / 2.0, ( pos.y() + mLastInterpolated.y() ) / 2.0 );
@@ -187,44 +268,25 @@ void StrokeManager::smoothMousePos(QPointF pos)
 QPointF StrokeManager::interpolateStart(QPointF firstPoint)
 {
         if (mInpolLevel == 1) {
-            // Clear queue
-            strokeQueue.clear();
-            pressureQueue.clear();
-
-            mSingleshotTime.start();
-            previousTime = mSingleshotTime.elapsed();
-
+            mMeanCount = 0;
             mLastPixel = firstPoint;
         }
         else if (mInpolLevel == 2){
 
-            mSingleshotTime.start();
-            previousTime = mSingleshotTime.elapsed();
-
-            int sampleSize = 5;
-
-            // Clear queue
-            strokeQueue.clear();
-            pressureQueue.clear();
-
-            assert(sampleSize > 0);
-
-            // fill strokeQueue with firstPoint x times
-            for ( int i = sampleSize; i > 0; i--) {
-                strokeQueue.enqueue(firstPoint);
+            // fill the mean with firstPoint
+            for ( int i = 0; i < MEAN_SAMPLES; i++ ) {
+                mMeanQueue[ i ] = firstPoint;
             }
+            mMeanHead = 0;
+            mMeanCount = MEAN_SAMPLES;
 
             // last interpolated stroke should always be firstPoint
             mLastInterpolated = firstPoint;
 
-            // draw and poll each millisecond
-            timer.setInterval(sampleSize);
-            timer.start();
+            // polled every 5 ms from here on, as the samples come in
+            mLastMeanPoll = mClock.nsecsElapsed();
         } else if (mInpolLevel == 0) {
-            // Clear queue
-            strokeQueue.clear();
-            pressureQueue.clear();
-
+            mMeanCount = 0;
             mLastPixel = firstPoint;
         }
     return firstPoint;
@@ -232,65 +294,71 @@ QPointF StrokeManager::interpolateStart(QPointF firstPoint)
 
 void StrokeManager::interpolatePoll()
 {
-    // remove oldest stroke
-    strokeQueue.dequeue();
-
-    // add new stroke with the last interpolated pixel position
-    strokeQueue.enqueue(mLastInterpolated);
+    // replace the oldest position with the last interpolated one
+    mMeanQueue[ mMeanHead ] = mLastInterpolated;
+    mMeanHead = ( mMeanHead + 1 ) % MEAN_SAMPLES;
 }
 
-void StrokeManager::interpolatePollAndPaint()
+// The polls which fall due up to time; more than a queue full of them all
+// put in the same position, so that is where it stops.
+void StrokeManager::pollMeanUntil(qint64 time)
 {
-    //qDebug() <<"inpol:" << mInpolLevel << "strokes"<< strokeQueue;
-    if (!strokeQueue.isEmpty())
+    if ( mInpolLevel != 2 || mMeanCount == 0 )
+    {
+        return;
+    }
+    const qint64 due = ( time - mLastMeanPoll ) / MEAN_POLL_NS;
+    if ( due <= 0 )
+    {
+        return;
+    }
+    mLastMeanPoll += due * MEAN_POLL_NS;
+    for ( qint64 i = 0; i < qMin( due, qint64( MEAN_SAMPLES ) ); i++ )
     {
         interpolatePoll();
-        interpolateStroke();
+        StrokeSegment points;
+        meanInpolOp( points );
     }
 }
 
-QList<QPointF> StrokeManager::interpolateStroke()
+StrokeSegment StrokeManager::interpolateStroke()
 {
-    // is nan initially
-    QList<QPointF> result;
-
-    qreal x = 0,
-          y = 0,
-          pressure = 0;
+    StrokeSegment result;
 
     if (mInpolLevel == 1) {
 
-        result = tangentInpolOp(result);
+        tangentInpolOp(result);
 
     }
     else if (mInpolLevel == 2){
 
-        result = meanInpolOp(result, x, y, pressure);
+        meanInpolOp(result);
 
     } else if (mInpolLevel == 0) {
 
-        result = noInpolOp(result);
+        noInpolOp(result);
 
     }
     return result;
 }
 
-QList<QPointF> StrokeManager::noInpolOp(QList<QPointF> points)
+void StrokeManager::noInpolOp(StrokeSegment& points)
 {
     setPressure(getPressure());
 
-    points << mLastPixel << mLastPixel << mCurrentPixel << mCurrentPixel;
+    points[ 0 ] = mLastPixel;
+    points[ 1 ] = mLastPixel;
+    points[ 2 ] = mCurrentPixel;
+    points[ 3 ] = mCurrentPixel;
+    points.count = 4;
 
     // Set lastPixel to CurrentPixel
     // new interpolated pixel
     mLastPixel = mCurrentPixel;
-
-    return points;
 }
 
-QList<QPointF> StrokeManager::tangentInpolOp(QList<QPointF> points)
+void StrokeManager::tangentInpolOp(StrokeSegment& points)
 {
-    int time = mSingleshotTime.elapsed();
     static const qreal smoothness = 1.f;
     QLineF line( mLastPixel, mCurrentPixel);
 
@@ -299,13 +367,7 @@ QList<QPointF> StrokeManager::tangentInpolOp(QList<QPointF> points)
     if ( !hasTangent && scaleFactor > 0.01f)
     {
         hasTangent = true;
-        /*
-        qDebug() << "scaleFactor" << scaleFactor
-                 << "current pixel " << mCurrentPixel
-                 << "last pixel" << mLastPixel;
-         */
         m_previousTangent = (mCurrentPixel - mLastPixel) * smoothness / (3.0 * scaleFactor);
-        //qDebug() << "previous tangent" << m_previousTangent;
         QLineF _line(QPointF(0,0), m_previousTangent);
         // don't bother for small tangents, as they can induce single pixel wobbliness
         if (_line.length() < 2)
@@ -317,84 +379,65 @@ QList<QPointF> StrokeManager::tangentInpolOp(QList<QPointF> points)
     {
         QPointF c1 = mLastPixel + m_previousTangent * scaleFactor;
         QPointF newTangent = (mCurrentPixel - c1) * smoothness / (3.0 * scaleFactor);
-        //qDebug() << "scalefactor1=" << scaleFactor << m_previousTangent << newTangent;
         if (scaleFactor == 0)
         {
             newTangent = QPointF(0,0);
         }
-        else
-        {
-            //QLineF _line(QPointF(0,0), newTangent);
-            //if (_line.length() < 2)
-            //{
-            //    newTangent = QPointF(0,0);
-            //}
-        }
         QPointF c2 = mCurrentPixel - newTangent * scaleFactor;
-        //c1 = mLastPixel;
-        //c2 = mCurrentPixel;
-        points << mLastPixel << c1 << c2 << mCurrentPixel;
-        /*
-        qDebug() << mLastPixel
-                 << c1
-                 << c2
-                 << mCurrentPixel;
-         */
+        points[ 0 ] = mLastPixel;
+        points[ 1 ] = c1;
+        points[ 2 ] = c2;
+        points[ 3 ] = mCurrentPixel;
+        points.count = 4;
         m_previousTangent = newTangent;
     }
-
-    previousTime = time;
-    return points;
-
 }
 
 // Mean sampling interpolation operation
-QList<QPointF> StrokeManager::meanInpolOp(QList<QPointF> points, qreal x, qreal y, qreal pressure)
+void StrokeManager::meanInpolOp(StrokeSegment& points)
 {
-    for (int i = 0; i < strokeQueue.size(); i++) {
-           x += strokeQueue[i].x();
-           y += strokeQueue[i].y();
-           pressure += getPressure();
+    if ( mMeanCount == 0 )
+    {
+        return;
+    }
+
+    qreal x = 0;
+    qreal y = 0;
+    for (int i = 0; i < mMeanCount; i++) {
+           x += mMeanQueue[i].x();
+           y += mMeanQueue[i].y();
     }
 
-    // get arichmic mean of x, y and pressure
-    x /= strokeQueue.size();
-    y /= strokeQueue.size();
-    pressure /= strokeQueue.size();
+    // get arichmic mean of x and y
+    x /= mMeanCount;
+    y /= mMeanCount;
 
     // Use our interpolated points
-    QPointF mNewInterpolated = mLastInterpolated;
-    mNewInterpolated = QPointF(x,y);
+    QPointF mNewInterpolated = QPointF(x,y);
 
-    points << mLastPixel << mLastInterpolated << mNewInterpolated << mCurrentPixel;
+    points[ 0 ] = mLastPixel;
+    points[ 1 ] = mLastInterpolated;
+    points[ 2 ] = mNewInterpolated;
+    points[ 3 ] = mCurrentPixel;
+    points.count = 4;
 
     // Set lastPixel non interpolated pixel to our
     // new interpolated pixel
     mLastPixel = mNewInterpolated;
-
-    return points;
 }
 
 void StrokeManager::interpolateEnd()
 {
-    // Stop timer
-    timer.stop();
     if (mInpolLevel == 2) {
-        if (!strokeQueue.isEmpty())
+        if (mMeanCount > 0)
         {
-
-            // How many samples should we get point from?
-            // TODO: Qt slider.
-            int sampleSize = 5;
-
-            assert(sampleSize > 0);
-            for (int i = sampleSize; i > 0; i--)
+            // the polls which the rest of the stroke would have had
+            for (int i = MEAN_SAMPLES; i > 0; i--)
             {
                 interpolatePoll();
                 interpolateStroke();
             }
-        } else {
-            // Do nothing
         }
     }
+    mMeanCount = 0;
 }
@@ -18,17 +18,45 @@ GNU General Public License for more details.
 #ifndef STROKEMANAGER_H
 #define STROKEMANAGER_H
 
-#include <QQueue>
 #include <QPointF>
 #include <QList>
 #include <QPoint>
-#include <time.h>
 #include <QTabletEvent>
-#include <QTimer>
-#include <QTime>
+#include <QElapsedTimer>
 #include "object.h"
 #include "assert.h"
 
+
+// One input event of a stroke
+struct StrokeSample
+{
+    QPointF pos;
+    qreal pressure = 1.0;
+    qreal xTilt = 0;
+    qreal yTilt = 0;
+    qint64 time = 0; // nanoseconds on the stroke manager's clock, when the event came in
+};
+
+// The cubic from the last position to the current one, empty when there is none yet
+struct StrokeSegment
+{
+    QPointF points[ 4 ];
+    int count = 0;
+
+    int size() const { return count; }
+    QPointF& operator[]( int i ) { return points[ i ]; }
+    const QPointF& operator[]( int i ) const { return points[ i ]; }
+};
+
+struct StrokeLatency
+{
+    float meanMs = 0.f;    // from an event coming in to the frame showing it being painted
+    float maxMs = 0.f;
+    int frames = 0;        // frames painted with new samples in them
+    int samples = 0;       // samples dispatched to the tool
+    int coalesced = 0;     // moves merged into the sample before them
+};
+
 class StrokeManager : public QObject
 {
 public:
@@ -45,15 +73,23 @@ public:
     int getInpolLevel() { return mInpolLevel; }
     bool isTabletInUse() { return mTabletInUse; }
 
-    QList<QPointF> interpolateStroke();
-    void interpolatePoll();
+    // Moves are queued as they come in and handed out once per display frame.
+    // Moves closer than half a pixel to the last queued one replace it.
+    void queueSample(QMouseEvent* event);
+    bool hasPendingSamples() const { return mPendingCount > 0; }
+    // Takes the oldest queued sample and moves the stroke to it, like mouseMoveEvent()
+    bool dispatchSample(StrokeSample& sample);
+    // Called once a frame is painted, measures how long the samples in it waited
+    void framePainted();
+    const StrokeLatency& latency() const { return mLatency; }
+
+    StrokeSegment interpolateStroke();
     QPointF interpolateStart(QPointF firstPoint);
-    void interpolatePollAndPaint();
     void interpolateEnd();
     void smoothMousePos(QPointF pos);
-    QList<QPointF> meanInpolOp( QList<QPointF> points, qreal x, qreal y, qreal pressure );
-    QList<QPointF> noInpolOp(QList<QPointF> points);
-    QList<QPointF> tangentInpolOp(QList<QPointF> points);
+    void meanInpolOp( StrokeSegment& points );
+    void noInpolOp( StrokeSegment& points );
+    void tangentInpolOp( StrokeSegment& points );
 
     QPointF getLastPressPixel() const { return mLastPressPixel; }
     QPointF getCurrentPixel() const { return mCurrentPixel; }
@@ -63,19 +99,39 @@ public:
 
 private:
 
-    static const int STROKE_QUEUE_LENGTH = 3; // 4 points for cubic bezier
+    static const int SAMPLE_CAPACITY = 256;  // about a second of a fast tablet
+    static const int MEAN_SAMPLES = 5;       // positions averaged by the mean interpolation
+    static const qint64 MEAN_POLL_NS = 5000000; // a position goes into the mean every 5 ms
 
     void reset();
+    void interpolatePoll();
+    void pollMeanUntil(qint64 time);
 
     QPointF getEventPosition(QMouseEvent *);
 
     float pressure = 1.0f; // last pressure
-    QQueue<QPointF> strokeQueue;
-    QQueue<qreal> pressureQueue;
 
-    QTimer timer;
+    QElapsedTimer mClock;
+
+    // pending samples, a ring so that input never allocates
+    StrokeSample mSamples[ SAMPLE_CAPACITY ];
+    int mPendingHead = 0;
+    int mPendingCount = 0;
+
+    // dispatched samples not painted yet
+    qint64 mUnpaintedOldest = -1;
+    qint64 mUnpaintedSum = 0;
+    int mUnpaintedCount = 0;
+    double mLatencySumMs = 0.0;
+    int mPaintedSamples = 0;
+    StrokeLatency mLatency;
+
+    // last positions for the mean interpolation, also a ring
+    QPointF mMeanQueue[ MEAN_SAMPLES ];
+    int mMeanHead = 0;
+    int mMeanCount = 0;
+    qint64 mLastMeanPoll = 0;
 
-    QTime mSingleshotTime;
     QPointF mLastPressPixel2 = { 0, 0 };
     QPointF mLastPressPixel = { 0, 0 };
     QPointF mCurrentPixel   = { 0, 0 };
@@ -85,18 +141,17 @@ private:
 
     QPointF m_previousTangent;
     bool    hasTangent   = false;
-    int     previousTime = 0;
 
     bool    mStrokeStarted = false;
 
     bool    mTabletInUse = false;
     float   mTabletPressure = 1.f;
+    qreal   mTabletXTilt = 0;
+    qreal   mTabletYTilt = 0;
     int     mInpolLevel = 0;
     QPointF mTabletPosition;
     qreal mMeanPressure;
 
-    clock_t m_timeshot;
-
 };
 
 #endif // STROKEMANAGER_H
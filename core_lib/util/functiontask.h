@@ -0,0 +1,34 @@
+/*
+
+Pencil - Traditional Animation Software
+Copyright (C) 2012-2017 Matthew Chiawen Chang
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+*/
+
+#ifndef FUNCTIONTASK_H
+#define FUNCTIONTASK_H
+
+#include <functional>
+#include <QRunnable>
+
+// Runs a function on a QThreadPool, which deletes the task once it is done
+class FunctionTask : public QRunnable
+{
+public:
+    explicit FunctionTask( std::function< void() > f ) : mFunction( f ) {}
+    void run() override { mFunction(); }
+
+private:
+    std::function< void() > mFunction;
+};
+
+#endif // FUNCTIONTASK_H
@@ -148,6 +148,8 @@ enum BackgroundStyle
 #define SHORTCUTS_GROUP             "Shortcuts"
 #define SETTING_AUTO_SAVE           "AutoSave"
 #define SETTING_AUTO_SAVE_NUMBER    "AutosaveNumber"
+#define SETTING_UNDO_MEMORY_LIMIT   "UndoMemoryLimit"
+#define SETTING_FRAME_MEMORY_LIMIT  "FrameMemoryLimit"
 #define SETTING_TOOL_CURSOR         "ToolCursors"
 #define SETTING_DOTTED_CURSOR       "DottedCursors"
 #define SETTING_HIGH_RESOLUTION     "HighResPosition"
@@ -156,6 +158,7 @@ enum BackgroundStyle
 #define SETTING_WINDOW_GEOMETRY     "WindowGeometry"
 #define SETTING_WINDOW_STATE        "WindowState"
 #define SETTING_CURVE_SMOOTHING     "CurveSmoothing"
+#define SETTING_FILL_GAP_SIZE       "FillGapSize"
 #define SETTING_DISPLAY_EFFECT      "RenderEffect"
 #define SETTING_SHORT_SCRUB         "ShortScrub"
 #define SETTING_FRAME_SIZE          "FrameSize"
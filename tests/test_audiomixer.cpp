@@ -0,0 +1,118 @@
+#include "test_audiomixer.h"
+
+#include <vector>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include "audiomixer.h"
+#include "object.h"
+#include "layersound.h"
+
+
+static std::vector< int16_t > randomSamples( int count, uint seed )
+{
+    qsrand( seed );
+    std::vector< int16_t > samples( count );
+    for ( int16_t& s : samples )
+    {
+        // plenty of loud ones, so that the sums saturate
+        s = int16_t( ( qrand() % 65536 ) - 32768 );
+    }
+    return samples;
+}
+
+// a mono 16 bit wav at 44.1 kHz with every sample set to value
+static void writeWav( const QString& fileName, int sampleCount, int16_t value )
+{
+    QFile file( fileName );
+    file.open( QIODevice::WriteOnly );
+    auto write32 = [ &file ]( qint32 v ) { file.write( reinterpret_cast< const char* >( &v ), 4 ); };
+    auto write16 = [ &file ]( qint16 v ) { file.write( reinterpret_cast< const char* >( &v ), 2 ); };
+
+    file.write( "RIFF" );
+    write32( 36 + sampleCount * 2 );
+    file.write( "WAVEfmt " );
+    write32( 16 );
+    write16( 1 );
+    write16( 1 );
+    write32( AudioMixer::SAMPLE_RATE );
+    write32( AudioMixer::SAMPLE_RATE * 2 );
+    write16( 2 );
+    write16( 16 );
+    file.write( "data" );
+    write32( sampleCount * 2 );
+    for ( int i = 0; i < sampleCount; i++ )
+    {
+        write16( value );
+    }
+}
+
+void TestAudioMixer::testMixRowMatchesScalar()
+{
+    // odd lengths run through the vector body and the scalar tail
+    for ( int count : { 0, 1, 7, 8, 9, 17, 1023 } )
+    {
+        std::vector< int16_t > src = randomSamples( count, count + 1 );
+        std::vector< int16_t > expected = randomSamples( count, count + 100 );
+        std::vector< int16_t > actual = expected;
+
+        AudioMixer::mixRowScalar( expected.data(), src.data(), count );
+        AudioMixer::mixRow( actual.data(), src.data(), count );
+        QVERIFY( expected == actual );
+    }
+}
+
+void TestAudioMixer::testMixPlacesClipsAtTheirFrames()
+{
+    QTemporaryDir dir;
+    QString loud = dir.path() + "/loud.wav";
+    QString quiet = dir.path() + "/quiet.wav";
+    writeWav( loud, AudioMixer::SAMPLE_RATE, 30000 ); // a second
+    writeWav( quiet, AudioMixer::SAMPLE_RATE, 1000 );
+
+    Object object;
+    object.init();
+    LayerSound* layer1 = object.addNewSoundLayer();
+    LayerSound* layer2 = object.addNewSoundLayer();
+    QVERIFY( layer1->loadSoundClipAtFrame( "loud", loud, 1 ).ok() );
+    QVERIFY( layer2->loadSoundClipAtFrame( "quiet", quiet, 7 ).ok() );
+
+    AudioMixer mixer;
+    QVERIFY( mixer.setClips( &object, 12 ).ok() );
+    QVERIFY( !mixer.isEmpty() );
+
+    // frames 1 to 24 at 12 fps, the quiet clip comes in half a second later
+    const qint64 first = mixer.frameToSample( 1 );
+    const int count = int( mixer.frameToSample( 25 ) - first );
+    std::vector< int16_t > out( count * AudioMixer::CHANNELS );
+    mixer.mix( first, count, out.data() );
+
+    const int half = AudioMixer::SAMPLE_RATE / 2;
+    QCOMPARE( out[ 0 ], int16_t( 30000 ) );
+    QCOMPARE( out[ 1 ], int16_t( 30000 ) ); // mono to both channels
+    QCOMPARE( out[ half * 2 ], int16_t( 31000 ) );
+    QCOMPARE( out[ ( AudioMixer::SAMPLE_RATE + 10 ) * 2 ], int16_t( 1000 ) );
+    QCOMPARE( out.back(), int16_t( 0 ) );
+}
+
+void TestAudioMixer::testDecodedClipsNeverWait()
+{
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/clip.wav";
+    writeWav( fileName, AudioMixer::SAMPLE_RATE, 500 );
+
+    Object object;
+    object.init();
+    LayerSound* layer = object.addNewSoundLayer();
+    QVERIFY( layer->loadSoundClipAtFrame( "clip", fileName, 1 ).ok() );
+
+    // nothing decoded yet, so it fails and has the pool decode the clip
+    AudioMixer mixer;
+    QVERIFY( !mixer.setDecodedClips( &object, 12 ).ok() );
+    QVERIFY( mixer.isEmpty() );
+
+    QThreadPool::globalInstance()->waitForDone();
+    QVERIFY( mixer.setDecodedClips( &object, 12 ).ok() );
+    QVERIFY( !mixer.isEmpty() );
+    QVERIFY( AudioMixer::cacheUsage() >= qint64( AudioMixer::SAMPLE_RATE * AudioMixer::CHANNELS * sizeof( int16_t ) ) );
+}
@@ -0,0 +1,17 @@
+#ifndef TEST_AUDIOMIXER_H
+#define TEST_AUDIOMIXER_H
+
+#include "AutoTest.h"
+
+class TestAudioMixer : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testMixRowMatchesScalar();
+    void testMixPlacesClipsAtTheirFrames();
+    void testDecodedClipsNeverWait();
+};
+
+DECLARE_TEST( TestAudioMixer )
+
+#endif // TEST_AUDIOMIXER_H
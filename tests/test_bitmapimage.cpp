@@ -1,5 +1,9 @@
 #include "test_bitmapimage.h"
+#include <vector>
+#include <QTemporaryDir>
 #include "bitmapimage.h"
+#include "dabrasterizer.h"
+#include "smudgeengine.h"
 
 void TestBitmapImage::initTestCase()
 {
@@ -38,3 +42,314 @@ void TestBitmapImage::testInitWithColorAndBoundary()
     QCOMPARE( b->width(), 30 );
     QCOMPARE( b->height(), 40 );
 }
+
+void TestBitmapImage::testExtendAllocatesNoTiles()
+{
+    BitmapImage b;
+    b.extend( QRect( -5000, -5000, 10000, 10000 ) );
+
+    QCOMPARE( b.width(), 10000 );
+    QCOMPARE( b.height(), 10000 );
+    QCOMPARE( b.tileCount(), 0 );
+    QCOMPARE( b.pixel( 0, 0 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testDrawOnlyAllocatesTouchedTiles()
+{
+    BitmapImage b;
+    b.extend( QRect( 0, 0, 4000, 4000 ) );
+    b.drawRect( QRectF( 10, 10, 20, 20 ), Qt::NoPen, QBrush( Qt::red ), QPainter::CompositionMode_SourceOver, false );
+
+    QCOMPARE( b.tileCount(), 1 );
+    QCOMPARE( b.pixel( 15, 15 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 100, 100 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testSetPixelAcrossTiles()
+{
+    BitmapImage b;
+    const int T = BitmapImage::TILE_SIZE;
+    b.setPixel( -1, -1, qRgba( 1, 2, 3, 255 ) );
+    b.setPixel( T, T, qRgba( 4, 5, 6, 255 ) );
+
+    QCOMPARE( b.pixel( -1, -1 ), qRgba( 1, 2, 3, 255 ) );
+    QCOMPARE( b.pixel( T, T ), qRgba( 4, 5, 6, 255 ) );
+    QCOMPARE( b.tileCount(), 2 );
+
+    QImage* flat = b.image();
+    QCOMPARE( flat->size(), b.bounds().size() );
+    QCOMPARE( flat->pixel( 0, 0 ), qRgba( 1, 2, 3, 255 ) );
+}
+
+void TestBitmapImage::testClearRectReleasesTiles()
+{
+    const int T = BitmapImage::TILE_SIZE;
+    BitmapImage b( QRect( 0, 0, T * 4, T * 4 ), Qt::blue );
+    QCOMPARE( b.tileCount(), 16 );
+
+    b.clear( QRect( 0, 0, T * 2, T * 4 ) );
+    QCOMPARE( b.tileCount(), 8 );
+    QCOMPARE( b.pixel( 1, 1 ), qRgba( 0, 0, 0, 0 ) );
+    QCOMPARE( b.pixel( T * 3, 1 ), qRgba( 0, 0, 255, 255 ) );
+}
+
+void TestBitmapImage::testPasteAndMoveTopLeft()
+{
+    BitmapImage src( QRect( 0, 0, 10, 10 ), Qt::green );
+    src.moveTopLeft( QPoint( 1000, -1000 ) );
+
+    BitmapImage dst;
+    dst.paste( &src );
+
+    QCOMPARE( dst.bounds(), QRect( 1000, -1000, 10, 10 ) );
+    QCOMPARE( dst.pixel( 1005, -995 ), qRgba( 0, 255, 0, 255 ) );
+    QCOMPARE( dst.pixel( 5, 5 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testFloodFillStopsAtOutline()
+{
+    BitmapImage b;
+    b.drawRect( QRectF( 10, 10, 80, 80 ), QPen( Qt::black, 2 ), Qt::NoBrush, QPainter::CompositionMode_SourceOver, false );
+
+    BitmapImage::floodFill( &b, QRect( 0, 0, 200, 200 ), QPoint( 50, 50 ), qRgba( 255, 0, 0, 255 ), 0 );
+
+    QCOMPARE( b.pixel( 50, 50 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 12, 12 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 10, 50 ), qRgba( 0, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 150, 150 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testFloodFillClosesGaps()
+{
+    BitmapImage b;
+    b.drawRect( QRectF( 10, 10, 80, 80 ), QPen( Qt::black, 2 ), Qt::NoBrush, QPainter::CompositionMode_SourceOver, false );
+    b.clear( QRect( 50, 8, 3, 5 ) ); // open a 3 pixel gap in the top edge
+
+    BitmapImage leaking = b.copy();
+    BitmapImage::floodFill( &leaking, QRect( 0, 0, 200, 200 ), QPoint( 50, 50 ), qRgba( 255, 0, 0, 255 ), 0 );
+    QCOMPARE( leaking.pixel( 150, 150 ), qRgba( 255, 0, 0, 255 ) );
+
+    BitmapImage::floodFill( &b, QRect( 0, 0, 200, 200 ), QPoint( 50, 50 ), qRgba( 255, 0, 0, 255 ), 0, 2 );
+    QCOMPARE( b.pixel( 50, 50 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 12, 12 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 150, 150 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testFloodFillMarksModified()
+{
+    BitmapImage b;
+    b.drawRect( QRectF( 10, 10, 80, 80 ), QPen( Qt::black, 2 ), Qt::NoBrush, QPainter::CompositionMode_SourceOver, false );
+
+    int count = b.modificationCount();
+    BitmapImage::floodFill( &b, QRect( 0, 0, 200, 200 ), QPoint( 50, 50 ), qRgba( 255, 0, 0, 255 ), 0 );
+    QVERIFY( b.modificationCount() > count );
+
+    // the seed already has the colour, nothing to do
+    count = b.modificationCount();
+    BitmapImage::floodFill( &b, QRect( 0, 0, 200, 200 ), QPoint( 50, 50 ), qRgba( 255, 0, 0, 255 ), 0 );
+    QCOMPARE( b.modificationCount(), count );
+}
+
+void TestBitmapImage::benchmarkFloodFill1080p()
+{
+    BitmapImage b;
+    b.drawLine( QPointF( 0, 540 ), QPointF( 1920, 540 ), QPen( Qt::black, 3 ), QPainter::CompositionMode_SourceOver, false );
+
+    QBENCHMARK_ONCE
+    {
+        BitmapImage::floodFill( &b, QRect( 0, 0, 1920, 1080 ), QPoint( 100, 100 ), qRgba( 255, 0, 0, 255 ), 25 );
+    }
+    QCOMPARE( b.pixel( 1900, 500 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 1900, 600 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testDifferenceRectOfCopy()
+{
+    BitmapImage b( QRect( 0, 0, 1920, 1080 ), Qt::white );
+    BitmapImage before = b.copy();
+    QVERIFY( b.differenceRect( before ).isEmpty() );
+
+    b.drawRect( QRectF( 500, 300, 20, 10 ), Qt::NoPen, QBrush( Qt::red ), QPainter::CompositionMode_SourceOver, false );
+    QCOMPARE( b.differenceRect( before ), QRect( 500, 300, 20, 10 ) );
+    QCOMPARE( before.pixel( 505, 305 ), qRgba( 255, 255, 255, 255 ) );
+
+    b.setPixel( -100, -100, qRgba( 0, 0, 0, 255 ) ); // outside the old bounds
+    QCOMPARE( b.differenceRect( before ), QRect( QPoint( -100, -100 ), QPoint( 519, 309 ) ) );
+}
+
+void TestBitmapImage::testWritePixelsRestoresRegion()
+{
+    BitmapImage b;
+    b.drawRect( QRectF( 10, 10, 40, 40 ), Qt::NoPen, QBrush( Qt::blue ), QPainter::CompositionMode_SourceOver, false );
+    BitmapImage before = b.copy();
+
+    b.drawRect( QRectF( 30, 30, 100, 100 ), Qt::NoPen, QBrush( Qt::red ), QPainter::CompositionMode_SourceOver, false );
+    QRect dirty = b.differenceRect( before );
+    QImage oldPixels = before.copy( dirty ).toImage();
+
+    b.writePixels( dirty.topLeft(), oldPixels );
+    b.setBounds( before.bounds() );
+
+    QVERIFY( b.differenceRect( before ).isEmpty() );
+    QCOMPARE( b.bounds(), before.bounds() );
+    QCOMPARE( b.pixel( 40, 40 ), qRgba( 0, 0, 255, 255 ) );
+}
+
+void TestBitmapImage::testSetBoundsDropsPixelsOutside()
+{
+    const int T = BitmapImage::TILE_SIZE;
+    BitmapImage b( QRect( 0, 0, T * 2, T * 2 ), Qt::blue );
+    QCOMPARE( b.tileCount(), 4 );
+
+    b.setBounds( QRect( 0, 0, T, T + 1 ) );
+    QCOMPARE( b.tileCount(), 2 );
+
+    b.setBounds( QRect( 0, 0, T * 2, T * 2 ) );
+    QCOMPARE( b.pixel( 0, T ), qRgba( 0, 0, 255, 255 ) );
+    QCOMPARE( b.pixel( 0, T + 1 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestBitmapImage::testToImageKeepsImageClean()
+{
+    BitmapImage b( QRect( 0, 0, 10, 10 ), Qt::blue );
+    b.setModified( false );
+    const int count = b.modificationCount();
+
+    QCOMPARE( b.toImage().pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+    QVERIFY( !b.isModified() );
+    QCOMPARE( b.modificationCount(), count );
+
+    b.image();
+    QVERIFY( b.isModified() );
+}
+
+void TestBitmapImage::testFileIsDecodedOnFirstUse()
+{
+    QTemporaryDir dir;
+    QString path = dir.path() + "/001.001.png";
+    QImage img( 100, 80, QImage::Format_ARGB32_Premultiplied );
+    img.fill( Qt::red );
+    img.save( path );
+
+    BitmapImage b( path, QPoint( 10, 20 ) );
+    QVERIFY( !b.isLoaded() );
+    QCOMPARE( b.bounds(), QRect( 10, 20, 100, 80 ) );
+
+    QCOMPARE( b.pixel( 50, 50 ), qRgba( 255, 0, 0, 255 ) );
+    QVERIFY( b.isLoaded() );
+    QVERIFY( !b.isModified() );
+}
+
+void TestBitmapImage::testOnlyCleanImagesUnload()
+{
+    QTemporaryDir dir;
+    QString path = dir.path() + "/001.001.png";
+    QImage img( 100, 80, QImage::Format_ARGB32_Premultiplied );
+    img.fill( Qt::blue );
+    img.save( path );
+
+    BitmapImage b( path, QPoint( 0, 0 ) );
+    b.setFileName( path );
+    b.setModified( false );
+    b.loadFile();
+    QVERIFY( b.unloadFile() );
+    QVERIFY( !b.isLoaded() );
+    QCOMPARE( b.pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+
+    b.setPixel( 5, 5, qRgba( 0, 255, 0, 255 ) );
+    QVERIFY( !b.unloadFile() );
+    QCOMPARE( b.pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+
+    {
+        BitmapImage::UnloadBlocker keepLoaded;
+        b.toImage().save( path );
+        b.setFileStored();
+        QVERIFY( !b.unloadFile() );
+    }
+    QVERIFY( b.unloadFile() );
+    QCOMPARE( b.pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+}
+
+void TestBitmapImage::testStampDabFromCachedMask()
+{
+    BitmapImage b;
+    DabRasterizer dabs;
+
+    dabs.stamp( &b, QPointF( 20, 20 ), 10, 0, Qt::red, 1.0, false, true );
+    dabs.stamp( &b, QPointF( 50, 20 ), 10, 0, Qt::red, 1.0, false, true );
+    QCOMPARE( dabs.cachedMaskCount(), 1 ); // same width and sub-pixel position
+    QCOMPARE( dabs.dabCount(), qint64( 2 ) );
+
+    QCOMPARE( b.pixel( 20, 20 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 50, 24 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 30, 20 ), qRgba( 0, 0, 0, 0 ) );
+
+    // half feathered: flat at half the alpha in the middle, fading out to the edge
+    dabs.stamp( &b, QPointF( 100.25, 20 ), 20, 50, Qt::blue, 1.0, true, false );
+    QCOMPARE( dabs.cachedMaskCount(), 2 );
+    QCOMPARE( qAlpha( b.pixel( 100, 20 ) ), 127 );
+    QVERIFY( qAlpha( b.pixel( 108, 20 ) ) < 127 );
+    QCOMPARE( qAlpha( b.pixel( 112, 20 ) ), 0 );
+}
+
+void TestBitmapImage::testSmudgeBilinearMatchesScalar()
+{
+    qsrand( 7 );
+    for ( int i = 0; i < 1000; i++ )
+    {
+        QRgb top[ 2 ], bottom[ 2 ];
+        for ( int k = 0; k < 2; k++ )
+        {
+            top[ k ] = qPremultiply( qRgba( qrand() % 256, qrand() % 256, qrand() % 256, qrand() % 256 ) );
+            bottom[ k ] = qPremultiply( qRgba( qrand() % 256, qrand() % 256, qrand() % 256, qrand() % 256 ) );
+        }
+        int wx = qrand() % 256;
+        int wy = qrand() % 256;
+        QCOMPARE( SmudgeEngine::bilinear( top, bottom, wx, wy ), SmudgeEngine::bilinearScalar( top, bottom, wx, wy ) );
+    }
+
+    QRgb top[ 2 ] = { qRgba( 0, 0, 0, 0 ), qRgba( 200, 0, 0, 200 ) };
+    QRgb bottom[ 2 ] = { qRgba( 0, 0, 0, 0 ), qRgba( 200, 0, 0, 200 ) };
+    QCOMPARE( SmudgeEngine::bilinearScalar( top, bottom, 128, 0 ), qRgba( 100, 0, 0, 100 ) );
+}
+
+void TestBitmapImage::testSmudgeBlendRowMatchesScalar()
+{
+    qsrand( 11 );
+    // odd lengths run through the vector body and the scalar tail
+    for ( int count : { 0, 1, 3, 4, 5, 8, 13, 64 } )
+    {
+        std::vector< QRgb > colour( count ), expected( count );
+        std::vector< uchar > weight( count );
+        for ( int i = 0; i < count; i++ )
+        {
+            colour[ i ] = qRgba( qrand() % 256, qrand() % 256, qrand() % 256, qrand() % 256 );
+            expected[ i ] = qPremultiply( qRgba( qrand() % 256, qrand() % 256, qrand() % 256, qrand() % 256 ) );
+            weight[ i ] = uchar( ( i % 3 == 0 ) ? 0 : qrand() % 256 );
+        }
+        std::vector< QRgb > actual = expected;
+
+        SmudgeEngine::blendRowScalar( expected.data(), colour.data(), weight.data(), count );
+        SmudgeEngine::blendRow( actual.data(), colour.data(), weight.data(), count );
+        QVERIFY( expected == actual );
+    }
+}
+
+void TestBitmapImage::testLiquifyDragsPixels()
+{
+    BitmapImage b;
+    b.drawRect( QRectF( 0, 0, 20, 40 ), Qt::NoPen, QBrush( Qt::red ), QPainter::CompositionMode_Source, false );
+    b.drawRect( QRectF( 20, 0, 20, 40 ), Qt::NoPen, QBrush( Qt::blue ), QPainter::CompositionMode_Source, false );
+
+    SmudgeEngine engine( &b, QRect( 0, 0, 40, 40 ) );
+    for ( int x = 16; x < 24; x += 2 )
+    {
+        engine.liquify( QPointF( x, 20 ), QPointF( x + 2, 20 ), 16, 0, 1.0 );
+    }
+    QCOMPARE( b.pixel( 21, 20 ), qRgba( 0, 0, 255, 255 ) ); // nothing changes before apply()
+    engine.apply();
+
+    // the red is dragged into the blue at the centre of the brush, not outside of it
+    QCOMPARE( b.pixel( 21, 20 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( b.pixel( 21, 5 ), qRgba( 0, 0, 255, 255 ) );
+}
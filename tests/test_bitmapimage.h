@@ -13,6 +13,25 @@ private slots:
     void testInitImage();
     void testInitSize();
     void testInitWithColorAndBoundary();
+    void testExtendAllocatesNoTiles();
+    void testDrawOnlyAllocatesTouchedTiles();
+    void testSetPixelAcrossTiles();
+    void testClearRectReleasesTiles();
+    void testPasteAndMoveTopLeft();
+    void testFloodFillStopsAtOutline();
+    void testFloodFillClosesGaps();
+    void testFloodFillMarksModified();
+    void benchmarkFloodFill1080p();
+    void testDifferenceRectOfCopy();
+    void testWritePixelsRestoresRegion();
+    void testSetBoundsDropsPixelsOutside();
+    void testToImageKeepsImageClean();
+    void testFileIsDecodedOnFirstUse();
+    void testOnlyCleanImagesUnload();
+    void testStampDabFromCachedMask();
+    void testSmudgeBilinearMatchesScalar();
+    void testSmudgeBlendRowMatchesScalar();
+    void testLiquifyDragsPixels();
 };
 
 DECLARE_TEST( TestBitmapImage );
@@ -0,0 +1,128 @@
+#include "test_canvasrenderer.h"
+
+#include <QPixmap>
+#include "canvasrenderer.h"
+#include "object.h"
+#include "layervector.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
+#include "vectorimage.h"
+
+static const int VECTOR_LAYER = 1; // Object::init() adds camera, vector and bitmap layers
+static const int BITMAP_LAYER = 2;
+
+
+void TestCanvasRenderer::init()
+{
+    mObject = new Object();
+    mObject->init();
+}
+
+void TestCanvasRenderer::cleanup()
+{
+    delete mObject;
+    mObject = nullptr;
+}
+
+void TestCanvasRenderer::testRepaintHitsLayerCache()
+{
+    QPixmap canvas( 320, 240 );
+    CanvasRenderer renderer;
+    renderer.setCanvas( &canvas );
+
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+    QCOMPARE( renderer.cacheHits(), 0 );
+    QCOMPARE( renderer.cacheMisses(), 1 );
+
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+    QCOMPARE( renderer.cacheHits(), 1 );
+    QCOMPARE( renderer.cacheMisses(), 1 );
+}
+
+void TestCanvasRenderer::testModificationInvalidatesLayerCache()
+{
+    QPixmap canvas( 320, 240 );
+    CanvasRenderer renderer;
+    renderer.setCanvas( &canvas );
+
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+
+    auto layer = static_cast< LayerVector* >( mObject->getLayer( VECTOR_LAYER ) );
+    layer->getVectorImageAtFrame( 1 )->modification();
+
+    renderer.resetCacheCounters();
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+    QCOMPARE( renderer.cacheHits(), 0 );
+    QCOMPARE( renderer.cacheMisses(), 1 );
+
+    renderer.invalidateFrame( mObject, 1 );
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+    QCOMPARE( renderer.cacheMisses(), 2 );
+}
+
+void TestCanvasRenderer::testViewChangeMissesLayerCache()
+{
+    QPixmap canvas( 320, 240 );
+    CanvasRenderer renderer;
+    renderer.setCanvas( &canvas );
+
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+    renderer.setViewTransform( QTransform::fromScale( 2, 2 ) );
+    renderer.paint( mObject, VECTOR_LAYER, 1, canvas.rect() );
+
+    QCOMPARE( renderer.cacheHits(), 0 );
+    QCOMPARE( renderer.cacheMisses(), 2 );
+}
+
+void TestCanvasRenderer::testOnionSkinReusesRasterizedFrames()
+{
+    auto layer = static_cast< LayerVector* >( mObject->getLayer( VECTOR_LAYER ) );
+    layer->addNewEmptyKeyAt( 2 );
+    layer->addNewEmptyKeyAt( 3 );
+
+    QPixmap canvas( 320, 240 );
+    CanvasRenderer renderer;
+    renderer.setCanvas( &canvas );
+
+    RenderOptions options;
+    options.bPrevOnionSkin = true;
+    options.bNextOnionSkin = true;
+    options.nPrevOnionSkinCount = 1;
+    options.nNextOnionSkinCount = 1;
+    renderer.setOptions( options );
+
+    // frame 2 rasterizes 1 and 3 as onion skins and 2 itself
+    renderer.paint( mObject, VECTOR_LAYER, 2, canvas.rect() );
+    QCOMPARE( renderer.cacheMisses(), 3 );
+
+    renderer.resetCacheCounters();
+    renderer.paint( mObject, VECTOR_LAYER, 2, canvas.rect() );
+    QCOMPARE( renderer.cacheHits(), 3 );
+    QCOMPARE( renderer.cacheMisses(), 0 );
+}
+
+void TestCanvasRenderer::testPartialPaintOnlyTouchesDirtyRect()
+{
+    QPixmap canvas( 320, 240 );
+    CanvasRenderer renderer;
+    renderer.setCanvas( &canvas );
+    renderer.paint( mObject, BITMAP_LAYER, 1, QRect() );
+    QImage before = canvas.toImage();
+
+    auto layer = static_cast< LayerBitmap* >( mObject->getLayer( BITMAP_LAYER ) );
+    layer->getBitmapImageAtFrame( 1 )->drawRect( QRectF( 0, 0, 200, 100 ), Qt::NoPen, QBrush( Qt::red ),
+                                                 QPainter::CompositionMode_SourceOver, false );
+
+    // only the left half is recomposited, though the rectangle reaches further
+    QRect dirty( 0, 0, 100, 240 );
+    renderer.paint( mObject, BITMAP_LAYER, 1, dirty );
+    QImage partial = canvas.toImage();
+
+    renderer.paint( mObject, BITMAP_LAYER, 1, QRect() );
+    QImage full = canvas.toImage();
+
+    QCOMPARE( partial.copy( dirty ), full.copy( dirty ) );
+    QRect outside( 100, 0, 220, 240 );
+    QCOMPARE( partial.copy( outside ), before.copy( outside ) );
+    QVERIFY( full.copy( outside ) != before.copy( outside ) );
+}
@@ -0,0 +1,27 @@
+#ifndef TESTCANVASRENDERER_H
+#define TESTCANVASRENDERER_H
+
+#include "AutoTest.h"
+class Object;
+
+class TestCanvasRenderer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testRepaintHitsLayerCache();
+    void testModificationInvalidatesLayerCache();
+    void testViewChangeMissesLayerCache();
+    void testOnionSkinReusesRasterizedFrames();
+    void testPartialPaintOnlyTouchesDirtyRect();
+
+private:
+    Object* mObject = nullptr;
+};
+
+DECLARE_TEST( TestCanvasRenderer )
+
+#endif // TESTCANVASRENDERER_H
@@ -0,0 +1,162 @@
+#include "test_editorbackup.h"
+#include "object.h"
+#include "editor.h"
+#include "scribblearea.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
+#include "backupelement.h"
+
+namespace
+{
+    const int BITMAP_LAYER = 2; // camera, vector, bitmap after Object::init()
+
+    // random pixels don't compress, so every edit costs about the same
+    QImage noise( QSize size, uint seed )
+    {
+        qsrand( seed );
+        QImage image( size, QImage::Format_ARGB32_Premultiplied );
+        for ( int y = 0; y < size.height(); y++ )
+        {
+            QRgb* row = reinterpret_cast< QRgb* >( image.scanLine( y ) );
+            for ( int x = 0; x < size.width(); x++ )
+            {
+                row[ x ] = qRgba( qrand() % 256, qrand() % 256, qrand() % 256, 255 );
+            }
+        }
+        return image;
+    }
+}
+
+void TestEditorBackup::init()
+{
+    Object* object = new Object();
+    object->init();
+
+    mScribbleArea = new ScribbleArea( nullptr );
+    mEditor = new Editor();
+    mEditor->setScribbleArea( mScribbleArea );
+    mEditor->init();
+    mEditor->setObject( object );
+    mScribbleArea->setCore( mEditor );
+    mScribbleArea->init();
+}
+
+void TestEditorBackup::cleanup()
+{
+    delete mScribbleArea;
+    delete mEditor;
+}
+
+BitmapImage* TestEditorBackup::bitmapAtFrame( int frame )
+{
+    LayerBitmap* layer = static_cast< LayerBitmap* >( mEditor->object()->getLayer( BITMAP_LAYER ) );
+    return layer->getLastBitmapImageAtFrame( frame, 0 );
+}
+
+void TestEditorBackup::testBitmapUndoRedoRestoresPixels()
+{
+    BitmapImage* image = bitmapAtFrame( 1 );
+    image->drawRect( QRectF( 0, 0, 40, 40 ), Qt::NoPen, QBrush( Qt::blue ), QPainter::CompositionMode_Source, false );
+
+    mEditor->backup( BITMAP_LAYER, 1, "Draw" );
+    image->drawRect( QRectF( 10, 10, 20, 20 ), Qt::NoPen, QBrush( Qt::red ), QPainter::CompositionMode_Source, false );
+    QCOMPARE( image->pixel( 15, 15 ), qRgba( 255, 0, 0, 255 ) );
+
+    mEditor->undo();
+    image = bitmapAtFrame( 1 );
+    QCOMPARE( image->pixel( 15, 15 ), qRgba( 0, 0, 255, 255 ) );
+    QCOMPARE( image->pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+
+    mEditor->redo();
+    image = bitmapAtFrame( 1 );
+    QCOMPARE( image->pixel( 15, 15 ), qRgba( 255, 0, 0, 255 ) );
+    QCOMPARE( image->pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+}
+
+void TestEditorBackup::testUndoSealsNewestElement()
+{
+    mEditor->backup( BITMAP_LAYER, 1, "Draw" );
+    BackupElement* element = mEditor->currentBackup();
+    QVERIFY( element != nullptr );
+    QVERIFY( !element->isSealed() );
+
+    bitmapAtFrame( 1 )->writePixels( QPoint( 0, 0 ), noise( QSize( 32, 32 ), 1 ) );
+    mEditor->undo();
+
+    QVERIFY( element->isSealed() );
+    QVERIFY( element->memoryUsage() > 0 ); // it kept the stroke to redo it
+    QVERIFY( qAlpha( bitmapAtFrame( 1 )->pixel( 10, 10 ) ) == 0 );
+}
+
+void TestEditorBackup::testNextBackupSealsPrevious()
+{
+    mEditor->backup( BITMAP_LAYER, 1, "First" );
+    BackupElement* first = mEditor->currentBackup();
+    bitmapAtFrame( 1 )->writePixels( QPoint( 0, 0 ), noise( QSize( 32, 32 ), 2 ) );
+
+    mEditor->backup( BITMAP_LAYER, 1, "Second" );
+    QVERIFY( first->isSealed() );
+    QVERIFY( !mEditor->currentBackup()->isSealed() );
+}
+
+void TestEditorBackup::testUnsealedElementCountsSnapshot()
+{
+    bitmapAtFrame( 1 )->writePixels( QPoint( 0, 0 ), noise( QSize( 300, 300 ), 3 ) );
+
+    mEditor->backup( BITMAP_LAYER, 1, "Draw" );
+    BackupElement* element = mEditor->currentBackup();
+    QVERIFY( !element->isSealed() );
+    QVERIFY( element->memoryUsage() >= 300 * 300 * 4 );
+}
+
+void TestEditorBackup::testTrimStaysWithinLimit()
+{
+    const qint64 limit = 1024 * 1024;
+    mEditor->setUndoMemoryLimit( limit );
+
+    for ( int i = 0; i < 40; i++ )
+    {
+        mEditor->backup( BITMAP_LAYER, 1, "Draw" );
+        bitmapAtFrame( 1 )->writePixels( QPoint( 0, 0 ), noise( QSize( 128, 128 ), 10 + i ) );
+        QVERIFY( mEditor->undoMemoryUsage() <= limit );
+    }
+    QVERIFY( mEditor->mBackupList.size() < 40 );
+    QCOMPARE( mEditor->mBackupIndex, mEditor->mBackupList.size() - 1 );
+
+    // the steps left still undo in order
+    mEditor->undo();
+    QCOMPARE( bitmapAtFrame( 1 )->pixel( 5, 5 ), noise( QSize( 128, 128 ), 48 ).pixel( 5, 5 ) );
+}
+
+void TestEditorBackup::testKeyBatchUndoRedo()
+{
+    LayerBitmap* layer = static_cast< LayerBitmap* >( mEditor->object()->getLayer( BITMAP_LAYER ) );
+    bitmapAtFrame( 1 )->drawRect( QRectF( 0, 0, 40, 40 ), Qt::NoPen, QBrush( Qt::blue ), QPainter::CompositionMode_Source, false );
+
+    // the first one is pasted onto the existing key, the others are new
+    std::vector< BitmapImage* > keys;
+    std::vector< int > positions;
+    for ( int position : { 1, 3, 5 } )
+    {
+        BitmapImage* key = new BitmapImage( QRect( 0, 0, 10, 10 ), Qt::green );
+        key->setPos( position );
+        keys.push_back( key );
+        positions.push_back( position );
+    }
+    mEditor->backupKeys( BITMAP_LAYER, positions, "Import" );
+    layer->insertImages( keys );
+    QVERIFY( layer->keyExists( 3 ) );
+    QCOMPARE( bitmapAtFrame( 1 )->pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+
+    mEditor->undo();
+    QVERIFY( !layer->keyExists( 3 ) );
+    QVERIFY( !layer->keyExists( 5 ) );
+    QCOMPARE( bitmapAtFrame( 1 )->pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+    QCOMPARE( bitmapAtFrame( 1 )->pixel( 20, 20 ), qRgba( 0, 0, 255, 255 ) );
+
+    mEditor->redo();
+    QVERIFY( layer->keyExists( 3 ) );
+    QVERIFY( layer->keyExists( 5 ) );
+    QCOMPARE( bitmapAtFrame( 1 )->pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+    QCOMPARE( bitmapAtFrame( 5 )->pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+}
@@ -0,0 +1,35 @@
+#ifndef TEST_EDITORBACKUP_H
+#define TEST_EDITORBACKUP_H
+
+#include "AutoTest.h"
+
+class Editor;
+class ScribbleArea;
+class BitmapImage;
+
+
+class TestEditorBackup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testBitmapUndoRedoRestoresPixels();
+    void testUndoSealsNewestElement();
+    void testNextBackupSealsPrevious();
+    void testUnsealedElementCountsSnapshot();
+    void testTrimStaysWithinLimit();
+    void testKeyBatchUndoRedo();
+
+private:
+    BitmapImage* bitmapAtFrame( int frame );
+
+    Editor* mEditor = nullptr;
+    ScribbleArea* mScribbleArea = nullptr;
+};
+
+DECLARE_TEST( TestEditorBackup )
+
+#endif
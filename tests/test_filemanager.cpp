@@ -10,6 +10,8 @@
 #include "filemanager.h"
 #include "util.h"
 #include "object.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
 
 typedef std::shared_ptr< FileManager > FileManagerPtr;
 
@@ -272,3 +274,61 @@ void TestFileManager::testLoadPCLX()
     QVERIFY( layer->name() == "MyBitmapLayer" );
     QVERIFY( layer->id() == 5 );
 }
+
+void TestFileManager::testSaveOnlyRewritesModifiedFrames()
+{
+    QTemporaryDir testDir( "PENCIL_TEST_XXXXXXXX" );
+    if ( !testDir.isValid() )
+    {
+        QFAIL( "bad." );
+    }
+
+    QFile theXML( testDir.path() + "/" + PFF_XML_FILE_NAME );
+    theXML.open( QIODevice::WriteOnly );
+
+    QTextStream fout( &theXML );
+    fout << "<!DOCTYPE PencilDocument><document>";
+    fout << "  <object>";
+    fout << "    <layer name='MyBitmapLayer' id='5' visibility='1' type='1' >";
+    fout << "      <image frame='1' topLeftY='0' src='005.001.png' topLeftX='0' />";
+    fout << "      <image frame='2' topLeftY='0' src='005.002.png' topLeftX='0' />";
+    fout << "    </layer>";
+    fout << "  </object>";
+    fout << "</document>";
+    fout.flush();
+    theXML.close();
+
+    QDir dir( testDir.path() );
+    dir.mkdir( PFF_DATA_DIR );
+    dir.cd( PFF_DATA_DIR );
+    QImage img( 10, 10, QImage::Format_ARGB32_Premultiplied );
+    img.fill( Qt::red );
+    img.save( dir.filePath( "005.001.png" ) );
+    img.fill( Qt::blue );
+    img.save( dir.filePath( "005.002.png" ) );
+
+    QTemporaryFile tmpPCLX( "PENCIL_TEST_XXXXXXXX.pclx" );
+    tmpPCLX.open();
+    JlCompress::compressDir( tmpPCLX.fileName(), testDir.path() );
+
+    FileManager fm;
+    QScopedPointer< Object > o( fm.load( tmpPCLX.fileName() ) );
+    QVERIFY( fm.error().ok() );
+
+    const QString strUntouched = QDir( o->workingDir() ).filePath( "data/005.002.png" );
+    const QDateTime untouchedTime = QFileInfo( strUntouched ).lastModified();
+
+    LayerBitmap* layer = static_cast< LayerBitmap* >( o->getLayer( 0 ) );
+    layer->getBitmapImageAtFrame( 1 )->drawRect( QRectF( 0, 0, 10, 10 ), Qt::NoPen, QBrush( Qt::green ),
+                                                   QPainter::CompositionMode_Source, false );
+
+    Status st = fm.save( o.data(), tmpPCLX.fileName() );
+    QVERIFY( st.ok() );
+    QCOMPARE( QFileInfo( strUntouched ).lastModified(), untouchedTime );
+
+    QScopedPointer< Object > reloaded( fm.load( tmpPCLX.fileName() ) );
+    QVERIFY( fm.error().ok() );
+    LayerBitmap* reloadedLayer = static_cast< LayerBitmap* >( reloaded->getLayer( 0 ) );
+    QCOMPARE( reloadedLayer->getBitmapImageAtFrame( 1 )->pixel( 5, 5 ), qRgba( 0, 255, 0, 255 ) );
+    QCOMPARE( reloadedLayer->getBitmapImageAtFrame( 2 )->pixel( 5, 5 ), qRgba( 0, 0, 255, 255 ) );
+}
@@ -24,6 +24,7 @@ private slots:
 
     void testGeneratePCLX();
     void testLoadPCLX();
+    void testSaveOnlyRewritesModifiedFrames();
 };
 
 DECLARE_TEST(TestFileManager)
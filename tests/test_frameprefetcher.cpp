@@ -0,0 +1,64 @@
+#include "test_frameprefetcher.h"
+
+#include "frameprefetcher.h"
+#include "object.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
+
+static const int BITMAP_LAYER = 2; // Object::init() adds camera, vector and bitmap layers
+
+
+void TestFramePrefetcher::init()
+{
+    mObject = new Object();
+    mObject->init();
+}
+
+void TestFramePrefetcher::cleanup()
+{
+    delete mObject;
+    mObject = nullptr;
+}
+
+void TestFramePrefetcher::testRendersAheadOfPlayhead()
+{
+    FramePrefetcher prefetcher;
+    prefetcher.start( mObject, 1, 1, 10, false, QTransform(), QSize( 64, 48 ), false, 2 );
+    QCOMPARE( prefetcher.capacity(), 4 );
+    QTRY_COMPARE( prefetcher.framesReady(), 4 ); // frames 2 to 5
+
+    QImage image;
+    QVERIFY( prefetcher.takeFrame( 2, image ) );
+    QCOMPARE( image.size(), QSize( 64, 48 ) );
+    QVERIFY( prefetcher.takeFrame( 4, image ) ); // 3 is skipped
+    QCOMPARE( prefetcher.droppedFrames(), 0 );
+
+    // a jump away from the frames rendered ahead starts over from there
+    QVERIFY( !prefetcher.takeFrame( 9, image ) );
+    QCOMPARE( prefetcher.droppedFrames(), 1 );
+    QTRY_COMPARE( prefetcher.framesReady(), 1 ); // only frame 10 is left
+    QVERIFY( prefetcher.takeFrame( 10, image ) );
+
+    prefetcher.stop();
+    QVERIFY( !prefetcher.isRunning() );
+}
+
+void TestFramePrefetcher::testStartsAgainAfterStop()
+{
+    FramePrefetcher prefetcher;
+    prefetcher.start( mObject, 1, 1, 10, false, QTransform(), QSize( 64, 48 ), false, 2 );
+    prefetcher.stop();
+    QCOMPARE( prefetcher.framesReady(), 0 );
+
+    // the object may change once stop() returns, the next start renders the new drawing
+    auto layer = static_cast< LayerBitmap* >( mObject->getLayer( BITMAP_LAYER ) );
+    layer->getBitmapImageAtFrame( 1 )->drawRect( QRectF( 0, 0, 64, 48 ), Qt::NoPen, QBrush( Qt::red ),
+                                                 QPainter::CompositionMode_SourceOver, false );
+
+    prefetcher.start( mObject, 1, 1, 10, false, QTransform(), QSize( 64, 48 ), false, 2 );
+    QTRY_COMPARE( prefetcher.framesReady(), 4 );
+    QImage image;
+    QVERIFY( prefetcher.takeFrame( 2, image ) );
+    QCOMPARE( image.pixel( 32, 24 ), qRgb( 255, 0, 0 ) );
+    prefetcher.stop();
+}
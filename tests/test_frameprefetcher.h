@@ -0,0 +1,24 @@
+#ifndef TESTFRAMEPREFETCHER_H
+#define TESTFRAMEPREFETCHER_H
+
+#include "AutoTest.h"
+class Object;
+
+class TestFramePrefetcher : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void testRendersAheadOfPlayhead();
+    void testStartsAgainAfterStop();
+
+private:
+    Object* mObject = nullptr;
+};
+
+DECLARE_TEST( TestFramePrefetcher )
+
+#endif // TESTFRAMEPREFETCHER_H
@@ -7,7 +7,9 @@
 #include "layersound.h"
 #include "object.h"
 #include "util.h"
+#include "bitmapimage.h"
 #include <memory>
+#include <QTemporaryDir>
 
 TestLayer::TestLayer()
 {
@@ -195,3 +197,130 @@ void TestLayer::testNextKeyFramePosition()
     QCOMPARE( pLayer->getNextKeyFramePosition( 1 ), 5 );
     QCOMPARE( pLayer->getNextKeyFramePosition( 2 ), 5 );
 }
+
+void TestLayer::testMoveSelectedFrames()
+{
+    Layer* pLayer = m_pObject->addNewBitmapLayer();
+    OnScopeExit( m_pObject->deleteLayer( pLayer ) );
+
+    for ( int i = 2; i <= 5; ++i )
+    {
+        pLayer->addNewEmptyKeyAt( i );
+    }
+    KeyFrame* key2 = pLayer->getKeyFrameAt( 2 );
+    KeyFrame* key3 = pLayer->getKeyFrameAt( 3 );
+    KeyFrame* key4 = pLayer->getKeyFrameAt( 4 );
+    KeyFrame* key5 = pLayer->getKeyFrameAt( 5 );
+
+    pLayer->setFrameSelected( 2, true );
+    pLayer->setFrameSelected( 3, true );
+    QVERIFY( pLayer->moveSelectedFrames( 2 ) );
+
+    // the frames in between slide back into the place of the selection
+    QCOMPARE( pLayer->getKeyFrameAt( 2 ), key4 );
+    QCOMPARE( pLayer->getKeyFrameAt( 3 ), key5 );
+    QCOMPARE( pLayer->getKeyFrameAt( 4 ), key2 );
+    QCOMPARE( pLayer->getKeyFrameAt( 5 ), key3 );
+    QCOMPARE( key2->pos(), 4 );
+    QVERIFY( pLayer->isFrameSelected( 4 ) );
+    QVERIFY( !pLayer->isFrameSelected( 2 ) );
+
+    QVERIFY( !pLayer->moveSelectedFrames( -4 ) );
+    QVERIFY( pLayer->moveSelectedFrames( -2 ) );
+    QCOMPARE( pLayer->getKeyFrameAt( 2 ), key2 );
+    QCOMPARE( pLayer->getKeyFrameAt( 5 ), key5 );
+}
+
+void TestLayer::testMoveSelectedFramesOnLongLayer()
+{
+    Layer* pLayer = m_pObject->addNewBitmapLayer();
+    OnScopeExit( m_pObject->deleteLayer( pLayer ) );
+
+    const int frameCount = 10000;
+    for ( int i = 2; i <= frameCount; ++i )
+    {
+        pLayer->addNewEmptyKeyAt( i );
+    }
+
+    pLayer->setFrameSelected( 100, true );
+    pLayer->extendSelectionTo( 5000 );
+    QVERIFY( pLayer->isFrameSelected( 4000 ) );
+    QVERIFY( !pLayer->isFrameSelected( 5001 ) );
+
+    KeyFrame* first = pLayer->getKeyFrameAt( 100 );
+    KeyFrame* following = pLayer->getKeyFrameAt( 5001 );
+
+    for ( int i = 0; i < 100; ++i )
+    {
+        QVERIFY( pLayer->moveSelectedFrames( 30 ) );
+    }
+
+    QCOMPARE( first->pos(), 3100 );
+    QCOMPARE( pLayer->getKeyFrameAt( 3100 ), first );
+    QCOMPARE( following->pos(), 100 );
+    QCOMPARE( pLayer->getMaxKeyFramePosition(), frameCount );
+    QVERIFY( pLayer->isFrameSelected( 8000 ) );
+    QVERIFY( !pLayer->isFrameSelected( 100 ) );
+
+    pLayer->deselectAll();
+    QVERIFY( !pLayer->isFrameSelected( 8000 ) );
+}
+
+void TestLayer::testLoadAndInsertImages()
+{
+    QTemporaryDir dir;
+    QStringList files;
+    for ( int i = 0; i < 3; i++ )
+    {
+        QImage image( 100, 80, QImage::Format_ARGB32_Premultiplied );
+        image.fill( Qt::transparent );
+        image.setPixel( 10 + i, 20, qRgba( 255, 0, 0, 255 ) );
+        image.setPixel( 30, 40 + i, qRgba( 0, 0, 255, 255 ) );
+        files << dir.path() + QString( "/%1.png" ).arg( i );
+        QVERIFY( image.save( files.last() ) );
+    }
+    files.insert( 1, dir.path() + "/missing.png" ); // left out, the others keep their spacing
+
+    std::vector< BitmapImage* > images;
+    Status st = LayerBitmap::loadImages( files, 3, 2, QPoint( 0, 0 ), true, images, []( float ) {} );
+    QCOMPARE( st.code(), Status::SAFE );
+    QVERIFY( st.detailsList().contains( dir.path() + "/missing.png" ) );
+    QCOMPARE( int( images.size() ), 3 );
+    for ( int i = 0; i < 3; i++ )
+    {
+        QCOMPARE( images[ i ]->pos(), 3 + 2 * i );
+        // cropped to the two pixels, in place of the uncropped image centred on the origin
+        QCOMPARE( images[ i ]->bounds(), QRect( QPoint( 10 + i - 50, 20 - 40 ), QPoint( 30 - 50, 40 + i - 40 ) ) );
+    }
+
+    std::unique_ptr< LayerBitmap > layer( new LayerBitmap( m_pObject ) );
+    layer->addNewEmptyKeyAt( 5 );
+    BitmapImage* existing = layer->getBitmapImageAtFrame( 5 );
+
+    layer->insertImages( images );
+    QVERIFY( images.empty() );
+    QCOMPARE( layer->keyFrameCount(), 3 );
+    QCOMPARE( layer->getBitmapImageAtFrame( 5 ), existing ); // pasted onto, not replaced
+    QCOMPARE( existing->bounds(), QRect( QPoint( 11 - 50, 20 - 40 ), QPoint( 30 - 50, 41 - 40 ) ) );
+    QVERIFY( layer->keyExists( 3 ) );
+    QVERIFY( layer->keyExists( 7 ) );
+}
+
+void TestLayer::testLoadImagesCanceled()
+{
+    QTemporaryDir dir;
+    QStringList files;
+    for ( int i = 0; i < 8; i++ )
+    {
+        QImage image( 64, 64, QImage::Format_ARGB32_Premultiplied );
+        image.fill( Qt::red );
+        files << dir.path() + QString( "/%1.png" ).arg( i );
+        QVERIFY( image.save( files.last() ) );
+    }
+
+    std::atomic<bool> canceled{ true };
+    std::vector< BitmapImage* > images;
+    Status st = LayerBitmap::loadImages( files, 1, 1, QPoint( 0, 0 ), false, images, []( float ) {}, &canceled );
+    QCOMPARE( st.code(), Status::CANCELED );
+    QVERIFY( images.empty() );
+}
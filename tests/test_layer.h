@@ -35,6 +35,12 @@ private slots:
     void testPreviousKeyFramePosition();
     void testNextKeyFramePosition();
 
+    void testMoveSelectedFrames();
+    void testMoveSelectedFramesOnLongLayer();
+
+    void testLoadAndInsertImages();
+    void testLoadImagesCanceled();
+
 
 private:
     Object* m_pObject = nullptr;
@@ -0,0 +1,124 @@
+#include "test_movieexporter.h"
+
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include "movieexporter.h"
+#include "object.h"
+#include "layercamera.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
+
+// The movie tests run against the ffmpeg found on the PATH, they are skipped without one.
+
+void TestMovieExporter::initTestCase()
+{
+    mFFmpegPath = QStandardPaths::findExecutable( "ffmpeg" );
+}
+
+void TestMovieExporter::init()
+{
+    if ( mFFmpegPath.isEmpty() && QTest::currentTestFunction() != QString( "testExportImageSequenceFiles" ) )
+    {
+        QSKIP( "ffmpeg not found" );
+    }
+
+    mObject = new Object();
+    mObject->init();
+
+    LayerBitmap* layer = mObject->getLayersByType< LayerBitmap >().front();
+    layer->addNewEmptyKeyAt( 3 );
+    layer->getBitmapImageAtFrame( 1 )->drawRect( QRectF( -50, -50, 100, 100 ), Qt::NoPen, QBrush( Qt::red ),
+                                                 QPainter::CompositionMode_SourceOver, false );
+    layer->getBitmapImageAtFrame( 3 )->drawRect( QRectF( 0, 0, 100, 100 ), Qt::NoPen, QBrush( Qt::blue ),
+                                                 QPainter::CompositionMode_SourceOver, false );
+}
+
+void TestMovieExporter::cleanup()
+{
+    delete mObject;
+    mObject = nullptr;
+}
+
+static ExportMovieDesc testDesc( Object* object, QString fileName )
+{
+    ExportMovieDesc desc;
+    desc.strFileName   = fileName;
+    desc.startFrame    = 1;
+    desc.endFrame      = 6;
+    desc.fps           = 12;
+    desc.exportSize    = QSize( 160, 120 );
+    desc.strCameraName = object->getLayersByType< LayerCamera >().front()->name();
+    return desc;
+}
+
+void TestMovieExporter::testStreamingExport()
+{
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/streamed.mp4";
+
+    float lastProgress = 0.f;
+    MovieExporter exporter;
+    exporter.setFFmpegPath( mFFmpegPath );
+    Status st = exporter.run( mObject, testDesc( mObject, fileName ), [&]( float f ) { lastProgress = f; } );
+
+    QVERIFY( st.ok() );
+    QCOMPARE( lastProgress, 1.f );
+    QVERIFY( QFileInfo( fileName ).size() > 0 );
+}
+
+void TestMovieExporter::testImageSequenceExport()
+{
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/sequence.mp4";
+
+    ExportMovieDesc desc = testDesc( mObject, fileName );
+    desc.useImageSequence = true;
+    desc.renderThreads = 2;
+
+    MovieExporter exporter;
+    exporter.setFFmpegPath( mFFmpegPath );
+    Status st = exporter.run( mObject, desc, []( float ) {} );
+
+    QVERIFY( st.ok() );
+    QVERIFY( QFileInfo( fileName ).size() > 0 );
+}
+
+void TestMovieExporter::testStreamingGifExport()
+{
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/streamed.gif";
+
+    MovieExporter exporter;
+    exporter.setFFmpegPath( mFFmpegPath );
+    Status st = exporter.run( mObject, testDesc( mObject, fileName ), []( float ) {} );
+
+    QVERIFY( st.ok() );
+    QVERIFY( QFileInfo( fileName ).size() > 0 );
+}
+
+void TestMovieExporter::testExportImageSequenceFiles()
+{
+    QTemporaryDir dir;
+    QString fileName = dir.path() + "/frame.png";
+
+    ExportMovieDesc desc = testDesc( mObject, fileName );
+    desc.renderThreads = 3;
+
+    std::vector< int > framesWritten;
+    MovieExporter exporter;
+    exporter.setFrameCallback( [&]( int frame, qint64 renderNs )
+    {
+        QVERIFY( renderNs >= 0 );
+        framesWritten.push_back( frame );
+    } );
+    Status st = exporter.exportImageSequence( mObject, desc, "png", true, []( float ) {} );
+
+    QVERIFY( st.ok() );
+    QCOMPARE( framesWritten, std::vector< int >( { 1, 2, 3, 4, 5, 6 } ) );
+    for ( int frame = 1; frame <= 6; frame++ )
+    {
+        QImage image( dir.path() + QString( "/frame%1.png" ).arg( frame, 4, 10, QChar( '0' ) ) );
+        QCOMPARE( image.size(), QSize( 160, 120 ) );
+        QVERIFY( image.hasAlphaChannel() );
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef TESTMOVIEEXPORTER_H
+#define TESTMOVIEEXPORTER_H
+
+#include "AutoTest.h"
+class Object;
+
+class TestMovieExporter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testStreamingExport();
+    void testImageSequenceExport();
+    void testStreamingGifExport();
+    void testExportImageSequenceFiles();
+
+private:
+    QString mFFmpegPath;
+    Object* mObject = nullptr;
+};
+
+DECLARE_TEST( TestMovieExporter )
+
+#endif // TESTMOVIEEXPORTER_H
@@ -0,0 +1,81 @@
+#include "test_movieimporter.h"
+
+#include <memory>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include "movieimporter.h"
+#include "movieexporter.h"
+#include "object.h"
+#include "layercamera.h"
+#include "layerbitmap.h"
+#include "bitmapimage.h"
+
+void TestMovieImporter::testParsePpmHeader()
+{
+    QSize size;
+    QByteArray ppm( "P6\n320 240\n255\n" );
+    QCOMPARE( MovieImporter::parsePpmHeader( ppm.constData(), ppm.size(), size ), ppm.size() );
+    QCOMPARE( size, QSize( 320, 240 ) );
+
+    // cut anywhere in the header, it waits for more
+    for ( int i = 0; i < ppm.size(); i++ )
+    {
+        QCOMPARE( MovieImporter::parsePpmHeader( ppm.constData(), i, size ), 0 );
+    }
+
+    QByteArray png( "\x89PNG\r\n\x1a\n" );
+    QCOMPARE( MovieImporter::parsePpmHeader( png.constData(), png.size(), size ), -1 );
+
+    QByteArray deep( "P6 2 2 65535\n" );
+    QCOMPARE( MovieImporter::parsePpmHeader( deep.constData(), deep.size(), size ), -1 );
+}
+
+// Exports a short movie with ffmpeg and reads it back, skipped without ffmpeg on the PATH
+void TestMovieImporter::testImportExportedMovie()
+{
+    QString ffmpegPath = QStandardPaths::findExecutable( "ffmpeg" );
+    if ( ffmpegPath.isEmpty() )
+    {
+        QSKIP( "ffmpeg not found" );
+    }
+
+    std::unique_ptr< Object > object( new Object );
+    object->init();
+    LayerBitmap* layer = object->getLayersByType< LayerBitmap >().front();
+    layer->getBitmapImageAtFrame( 1 )->drawRect( QRectF( -50, -50, 100, 100 ), Qt::NoPen, QBrush( Qt::red ),
+                                                 QPainter::CompositionMode_SourceOver, false );
+
+    QTemporaryDir dir;
+    ExportMovieDesc exportDesc;
+    exportDesc.strFileName   = dir.path() + "/source.mp4";
+    exportDesc.startFrame    = 1;
+    exportDesc.endFrame      = 12;
+    exportDesc.fps           = 12;
+    exportDesc.exportSize    = QSize( 160, 120 );
+    exportDesc.strCameraName = object->getLayersByType< LayerCamera >().front()->name();
+
+    MovieExporter exporter;
+    exporter.setFFmpegPath( ffmpegPath );
+    QVERIFY( exporter.run( object.get(), exportDesc, []( float ) {} ).ok() );
+
+    ImportMovieDesc desc;
+    desc.strFileName = exportDesc.strFileName;
+    desc.fps         = 12;
+    desc.frameStep   = 2;
+    desc.scale       = 0.5f;
+    desc.startFrame  = 5;
+
+    std::vector< BitmapImage* > keys;
+    MovieImporter importer;
+    importer.setFFmpegPath( ffmpegPath );
+    Status st = importer.run( desc, keys, []( float ) {} );
+
+    QVERIFY( st.ok() );
+    QVERIFY( keys.size() >= 5 && keys.size() <= 7 ); // one second on twos, give or take the rounding of the fps filter
+    for ( size_t i = 0; i < keys.size(); i++ )
+    {
+        QCOMPARE( keys[ i ]->pos(), 5 + 2 * int( i ) );
+        QCOMPARE( keys[ i ]->bounds().size(), QSize( 80, 60 ) );
+        delete keys[ i ];
+    }
+}
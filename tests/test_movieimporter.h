@@ -0,0 +1,17 @@
+#ifndef TESTMOVIEIMPORTER_H
+#define TESTMOVIEIMPORTER_H
+
+#include "AutoTest.h"
+
+class TestMovieImporter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testParsePpmHeader();
+    void testImportExportedMovie();
+};
+
+DECLARE_TEST( TestMovieImporter )
+
+#endif // TESTMOVIEIMPORTER_H
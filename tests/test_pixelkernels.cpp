@@ -0,0 +1,186 @@
+#include "test_pixelkernels.h"
+
+#include <QImage>
+#include <vector>
+#include "pixelkernels.h"
+
+
+static std::vector< QRgb > randomRow( int count, uint seed )
+{
+    qsrand( seed );
+    std::vector< QRgb > row( count );
+    for ( QRgb& p : row )
+    {
+        int a = ( qrand() % 3 == 0 ) ? 0 : qrand() % 256;
+        p = qPremultiply( qRgba( qrand() % 256, qrand() % 256, qrand() % 256, a ) );
+    }
+    return row;
+}
+
+void TestPixelKernels::initTestCase()
+{
+    mDst = QImage( 3840, 2160, QImage::Format_ARGB32_Premultiplied );
+    mSrc = QImage( 3840, 2160, QImage::Format_ARGB32_Premultiplied );
+    for ( int y = 0; y < mDst.height(); y++ )
+    {
+        QRgb* dst = reinterpret_cast< QRgb* >( mDst.scanLine( y ) );
+        QRgb* src = reinterpret_cast< QRgb* >( mSrc.scanLine( y ) );
+        for ( int x = 0; x < mDst.width(); x++ )
+        {
+            dst[ x ] = qPremultiply( qRgba( x % 256, y % 256, 128, ( x + y ) % 256 ) );
+            src[ x ] = qPremultiply( qRgba( y % 256, 64, x % 256, ( x * 3 ) % 256 ) );
+        }
+    }
+}
+
+void TestPixelKernels::testUniteRowMatchesScalar()
+{
+    // odd lengths run through the vector body and the scalar tail
+    for ( int count : { 0, 1, 3, 4, 7, 8, 9, 17, 1023 } )
+    {
+        std::vector< QRgb > src = randomRow( count, count + 1 );
+        std::vector< QRgb > expected = randomRow( count, count + 100 );
+        std::vector< QRgb > actual = expected;
+
+        PixelKernels::uniteRowScalar( expected.data(), src.data(), count );
+        PixelKernels::uniteRow( actual.data(), src.data(), count );
+        QVERIFY( expected == actual );
+    }
+}
+
+void TestPixelKernels::testUniteRowMatchesPixelLoop()
+{
+    // pixel() and setPixel() hand over premultiplied values as they are on this format,
+    // so the channels were always compared premultiplied
+    QImage dst = mDst.copy( 0, 0, 256, 4 );
+    QImage expected = dst.copy();
+    const QImage src = mSrc.copy( 0, 0, 256, 4 );
+    for ( int y = 0; y < src.height(); y++ )
+    {
+        for ( int x = 0; x < src.width(); x++ )
+        {
+            QRgb p1 = expected.pixel( x, y );
+            QRgb p2 = src.pixel( x, y );
+            if ( qAlpha( p2 ) != 0 )
+            {
+                expected.setPixel( x, y, qRgba( qMax( qRed( p1 ), qRed( p2 ) ),
+                                                qMax( qGreen( p1 ), qGreen( p2 ) ),
+                                                qMax( qBlue( p1 ), qBlue( p2 ) ),
+                                                qMax( qAlpha( p1 ), qAlpha( p2 ) ) ) );
+            }
+        }
+        PixelKernels::uniteRow( reinterpret_cast< QRgb* >( dst.scanLine( y ) ),
+                                reinterpret_cast< const QRgb* >( src.constScanLine( y ) ), src.width() );
+    }
+    QVERIFY( dst == expected );
+
+    // half transparent red under quarter transparent green
+    QRgb d = qRgba( 100, 0, 0, 128 );
+    const QRgb s = qRgba( 0, 60, 0, 64 );
+    PixelKernels::uniteRowScalar( &d, &s, 1 );
+    QCOMPARE( d, qRgba( 100, 60, 0, 128 ) );
+}
+
+void TestPixelKernels::testCompareAlphaRowMatchesScalar()
+{
+    for ( int count : { 0, 1, 3, 4, 7, 8, 9, 17, 1023 } )
+    {
+        std::vector< QRgb > src = randomRow( count, count + 1 );
+        std::vector< QRgb > expected = randomRow( count, count + 100 );
+        std::vector< QRgb > actual = expected;
+
+        PixelKernels::compareAlphaRowScalar( expected.data(), src.data(), count );
+        PixelKernels::compareAlphaRow( actual.data(), src.data(), count );
+        QVERIFY( expected == actual );
+    }
+}
+
+void TestPixelKernels::testBlendMaskRowMatchesScalar()
+{
+    for ( int count : { 0, 1, 3, 4, 7, 8, 9, 17, 1023 } )
+    {
+        std::vector< uchar > mask( count );
+        for ( int i = 0; i < count; i++ )
+        {
+            mask[ i ] = ( i % 5 == 0 ) ? 0 : static_cast< uchar >( ( i * 37 ) % 256 );
+        }
+        std::vector< QRgb > expected = randomRow( count, count + 100 );
+        std::vector< QRgb > actual = expected;
+        const QRgb colour = qPremultiply( qRgba( 200, 40, 90, 180 ) );
+
+        PixelKernels::blendMaskRowScalar( expected.data(), mask.data(), colour, count );
+        PixelKernels::blendMaskRow( actual.data(), mask.data(), colour, count );
+        QVERIFY( expected == actual );
+    }
+}
+
+void TestPixelKernels::benchmarkUnitePixelLoop()
+{
+    QImage dst = mDst.copy();
+    QBENCHMARK_ONCE
+    {
+        for ( int y = 0; y < mSrc.height(); y++ )
+        {
+            for ( int x = 0; x < mSrc.width(); x++ )
+            {
+                QRgb p1 = dst.pixel( x, y );
+                QRgb p2 = mSrc.pixel( x, y );
+                if ( qAlpha( p2 ) != 0 )
+                {
+                    dst.setPixel( x, y, qRgba( qMax( qRed( p1 ), qRed( p2 ) ),
+                                               qMax( qGreen( p1 ), qGreen( p2 ) ),
+                                               qMax( qBlue( p1 ), qBlue( p2 ) ),
+                                               qMax( qAlpha( p1 ), qAlpha( p2 ) ) ) );
+                }
+            }
+        }
+    }
+}
+
+void TestPixelKernels::benchmarkUniteRowKernel()
+{
+    QImage dst = mDst.copy();
+    QBENCHMARK_ONCE
+    {
+        for ( int y = 0; y < mSrc.height(); y++ )
+        {
+            PixelKernels::uniteRow( reinterpret_cast< QRgb* >( dst.scanLine( y ) ),
+                                    reinterpret_cast< const QRgb* >( mSrc.constScanLine( y ) ),
+                                    mSrc.width() );
+        }
+    }
+}
+
+void TestPixelKernels::benchmarkCompareAlphaPixelLoop()
+{
+    QImage dst = mDst.copy();
+    QBENCHMARK_ONCE
+    {
+        for ( int y = 0; y < mSrc.height(); y++ )
+        {
+            for ( int x = 0; x < mSrc.width(); x++ )
+            {
+                QRgb p1 = dst.pixel( x, y );
+                QRgb p2 = mSrc.pixel( x, y );
+                if ( qAlpha( p1 ) <= qAlpha( p2 ) )
+                {
+                    dst.setPixel( x, y, p2 );
+                }
+            }
+        }
+    }
+}
+
+void TestPixelKernels::benchmarkCompareAlphaRowKernel()
+{
+    QImage dst = mDst.copy();
+    QBENCHMARK_ONCE
+    {
+        for ( int y = 0; y < mSrc.height(); y++ )
+        {
+            PixelKernels::compareAlphaRow( reinterpret_cast< QRgb* >( dst.scanLine( y ) ),
+                                           reinterpret_cast< const QRgb* >( mSrc.constScanLine( y ) ),
+                                           mSrc.width() );
+        }
+    }
+}
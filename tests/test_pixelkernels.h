@@ -0,0 +1,30 @@
+#ifndef TEST_PIXELKERNELS_H
+#define TEST_PIXELKERNELS_H
+
+#include "AutoTest.h"
+
+class TestPixelKernels : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void testUniteRowMatchesScalar();
+    void testUniteRowMatchesPixelLoop();
+    void testCompareAlphaRowMatchesScalar();
+    void testBlendMaskRowMatchesScalar();
+
+    // 4K images, QImage::pixel()/setPixel() loops as used before vs the row kernels
+    void benchmarkUnitePixelLoop();
+    void benchmarkUniteRowKernel();
+    void benchmarkCompareAlphaPixelLoop();
+    void benchmarkCompareAlphaRowKernel();
+
+private:
+    QImage mDst;
+    QImage mSrc;
+};
+
+DECLARE_TEST( TestPixelKernels )
+
+#endif // TEST_PIXELKERNELS_H
@@ -0,0 +1,68 @@
+#include "test_strokemanager.h"
+
+#include <QMouseEvent>
+#include "strokemanager.h"
+
+
+static QMouseEvent moveTo( QPointF pos )
+{
+    return QMouseEvent( QEvent::MouseMove, pos, Qt::NoButton, Qt::LeftButton, Qt::NoModifier );
+}
+
+void TestStrokeManager::testSubPixelMovesAreCoalesced()
+{
+    StrokeManager strokeManager;
+    QMouseEvent press( QEvent::MouseButtonPress, QPointF( 10, 10 ), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier );
+    strokeManager.mousePressEvent( &press );
+
+    for ( QPointF pos : { QPointF( 20, 10 ), QPointF( 20.2, 10.1 ), QPointF( 20.3, 10.2 ), QPointF( 30, 10 ) } )
+    {
+        QMouseEvent move = moveTo( pos );
+        strokeManager.queueSample( &move );
+    }
+    QCOMPARE( strokeManager.latency().coalesced, 2 );
+
+    StrokeSample sample;
+    QVERIFY( strokeManager.dispatchSample( sample ) );
+    QCOMPARE( sample.pos, QPointF( 20.3, 10.2 ) ); // the latest of the merged moves
+    QVERIFY( strokeManager.dispatchSample( sample ) );
+    QCOMPARE( sample.pos, QPointF( 30, 10 ) );
+    QVERIFY( !strokeManager.dispatchSample( sample ) );
+}
+
+void TestStrokeManager::testDispatchKeepsOrderAndMovesTheStroke()
+{
+    StrokeManager strokeManager;
+    QMouseEvent press( QEvent::MouseButtonPress, QPointF( 0, 0 ), Qt::LeftButton, Qt::LeftButton, Qt::NoModifier );
+    strokeManager.mousePressEvent( &press );
+    strokeManager.setInpolLevel( 0 );
+    strokeManager.interpolateStart( QPointF( 0, 0 ) );
+
+    for ( int i = 1; i <= 300; i++ )
+    {
+        QMouseEvent move = moveTo( QPointF( i, 0 ) );
+        strokeManager.queueSample( &move );
+    }
+
+    // more moves than the ring holds, the last ones are merged
+    StrokeSample sample;
+    qreal lastX = 0;
+    int count = 0;
+    while ( strokeManager.dispatchSample( sample ) )
+    {
+        QVERIFY( sample.pos.x() > lastX );
+        QCOMPARE( strokeManager.getCurrentPixel(), sample.pos );
+        lastX = sample.pos.x();
+        count++;
+    }
+    QCOMPARE( lastX, 300.0 );
+    QCOMPARE( count + strokeManager.latency().coalesced, 300 );
+
+    StrokeSegment segment = strokeManager.interpolateStroke();
+    QCOMPARE( segment.size(), 4 );
+    QCOMPARE( segment[ 3 ], QPointF( 300, 0 ) );
+
+    strokeManager.framePainted();
+    QCOMPARE( strokeManager.latency().frames, 1 );
+    QVERIFY( strokeManager.latency().maxMs >= strokeManager.latency().meanMs );
+}
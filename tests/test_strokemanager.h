@@ -0,0 +1,16 @@
+#ifndef TEST_STROKEMANAGER_H
+#define TEST_STROKEMANAGER_H
+
+#include "AutoTest.h"
+
+class TestStrokeManager : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testSubPixelMovesAreCoalesced();
+    void testDispatchKeepsOrderAndMovesTheStroke();
+};
+
+DECLARE_TEST( TestStrokeManager )
+
+#endif // TEST_STROKEMANAGER_H
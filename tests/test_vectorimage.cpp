@@ -0,0 +1,379 @@
+#include "test_vectorimage.h"
+
+#include <deque>
+#include "object.h"
+#include "cubicsegments.h"
+#include "vectorimage.h"
+
+
+static void addStrokes( VectorImage& image, int count )
+{
+    for ( int i = 0; i < count; i++ )
+    {
+        qreal x = ( i % 100 ) * 10;
+        qreal y = ( i / 100 ) * 10;
+        QList< QPointF > points { QPointF( x, y ), QPointF( x + 3, y + 1 ), QPointF( x + 6, y + 4 ), QPointF( x + 8, y + 8 ) };
+        BezierCurve curve( points );
+        curve.setWidth( 1.0 );
+        curve.setFeather( 0.0 );
+        curve.setColourNumber( 0 );
+        image.addCurve( curve, 1.0, false );
+    }
+}
+
+static int sharedCurveCount( const VectorImage& a, const VectorImage& b )
+{
+    int count = 0;
+    for ( int i = 0; i < a.m_curves.size(); i++ )
+    {
+        count += a.m_curves.isSharedWith( i, b.m_curves, i ) ? 1 : 0;
+    }
+    return count;
+}
+
+void TestVectorImage::testCopySharesCurves()
+{
+    VectorImage image;
+    addStrokes( image, 100 );
+
+    VectorImage snapshot = image;
+    QCOMPARE( snapshot.m_curves.size(), 100 );
+    QCOMPARE( sharedCurveCount( image, snapshot ), 100 );
+}
+
+void TestVectorImage::testWriteUnsharesOnlyThatCurve()
+{
+    VectorImage image;
+    addStrokes( image, 100 );
+    VectorImage snapshot = image;
+
+    image.m_curves[ 42 ].setWidth( 7.0 );
+
+    QCOMPARE( sharedCurveCount( image, snapshot ), 99 );
+    QCOMPARE( image.m_curves.at( 42 ).getWidth(), 7.0 );
+    QCOMPARE( snapshot.m_curves.at( 42 ).getWidth(), 1.0 );
+
+    image.removeCurveAt( 0 );
+    QCOMPARE( image.m_curves.size(), 99 );
+    QCOMPARE( snapshot.m_curves.size(), 100 );
+}
+
+void TestVectorImage::testSelectionKeepsSharing()
+{
+    VectorImage image;
+    addStrokes( image, 100 );
+    VectorImage snapshot = image;
+
+    image.deselectAll();
+    image.select( QRectF( -1, -1, 10, 10 ) ); // the first stroke only
+    QCOMPARE( sharedCurveCount( image, snapshot ), 99 );
+    QVERIFY( image.isSelected( 0 ) );
+    QVERIFY( !snapshot.isSelected( 0 ) );
+}
+
+void TestVectorImage::benchmarkSnapshotAndEdit10kCurves()
+{
+    VectorImage image;
+    addStrokes( image, 10000 );
+
+    // what an undo step costs: keep the old state, then change one curve
+    std::deque< VectorImage > snapshots;
+    QBENCHMARK
+    {
+        snapshots.push_back( image );
+        image.m_curves[ 0 ].setWidth( snapshots.size() );
+        if ( snapshots.size() > 20 )
+        {
+            snapshots.pop_front();
+        }
+    }
+    // every snapshot only owns the curve that was edited after it
+    QCOMPARE( sharedCurveCount( image, snapshots.back() ), 9999 );
+}
+
+static QList< VertexRef > verticesCloseToByScan( VectorImage& image, QPointF p, qreal maxDistance )
+{
+    QList< VertexRef > result;
+    for ( VertexRef ref : image.getAllVertices() )
+    {
+        QPointF d = image.getVertex( ref ) - p;
+        if ( d.x() * d.x() + d.y() * d.y() < maxDistance * maxDistance )
+        {
+            result.append( ref );
+        }
+    }
+    return result;
+}
+
+void TestVectorImage::testIndexedQueriesMatchFullScan()
+{
+    VectorImage image;
+    addStrokes( image, 2000 );
+    image.removeCurveAt( 150 );
+
+    // a partly selected curve is found where it is shown, not where it is stored
+    image.deselectAll();
+    image.setSelected( 7, true );
+    image.setSelectionTransformation( QTransform::fromTranslate( 2000, 500 ) );
+
+    QList< QPointF > probes { QPointF( 73, 4 ), QPointF( 503, 64 ), QPointF( 1000, 1000 ), QPointF( 2073, 504 ) };
+    for ( QPointF p : probes )
+    {
+        QCOMPARE( image.getVerticesCloseTo( p, 6.0 ), verticesCloseToByScan( image, p, 6.0 ) );
+
+        QList< int > curvesByScan;
+        for ( int i = 0; i < image.m_curves.size(); i++ )
+        {
+            BezierCurve curve = image.m_curves.at( i );
+            if ( curve.isPartlySelected() ) curve = curve.transformed( QTransform::fromTranslate( 2000, 500 ) );
+            if ( curve.intersects( p, 6.0 ) ) curvesByScan.append( i );
+        }
+        QCOMPARE( image.getCurvesCloseTo( p, 6.0 ), curvesByScan );
+    }
+    QCOMPARE( image.getClosestVertexTo( QPointF( 2070, 500 ), 5.0 ).curveNumber, 7 );
+
+    // moved curves are found at their new place
+    image.applySelectionTransformation();
+    QVERIFY( image.getCurvesCloseTo( QPointF( 2070, 500 ), 3.0 ).contains( 7 ) );
+    QVERIFY( !image.getCurvesCloseTo( QPointF( 70, 0 ), 3.0 ).contains( 7 ) );
+}
+
+void TestVectorImage::benchmarkStrokeInto5kCurves()
+{
+    VectorImage image;
+    addStrokes( image, 5000 );
+
+    // a stroke passing along the last row of curves, checked against them for intersections
+    QList< QPointF > points { QPointF( 200, 504 ), QPointF( 230, 505 ), QPointF( 260, 504 ), QPointF( 290, 505 ) };
+    QBENCHMARK
+    {
+        BezierCurve stroke( points );
+        stroke.setWidth( 1.0 );
+        image.addCurve( stroke, 1.0, true );
+        image.removeCurveAt( image.m_curves.size() - 1 );
+    }
+    QCOMPARE( image.m_curves.size(), 5000 );
+}
+
+void TestVectorImage::testRepaintFollowsMovedCurve()
+{
+    Object object;
+    object.loadDefaultPalette();
+    VectorImage image;
+    image.setObject( &object );
+
+    QList< QPointF > points { QPointF( 10, 10 ), QPointF( 50, 10 ), QPointF( 50, 50 ), QPointF( 10, 50 ), QPointF( 10, 10 ) };
+    BezierCurve square( points );
+    square.setWidth( 2.0 );
+    square.setColourNumber( 0 );
+    square.setVariableWidth( false );
+    square.setInvisibility( false );
+    image.addCurve( square, 1.0, false );
+    image.addArea( BezierArea( QList< VertexRef >{ VertexRef( 0, -1 ), VertexRef( 0, 0 ), VertexRef( 0, 1 ), VertexRef( 0, 2 ), VertexRef( 0, 3 ) }, 1 ) );
+
+    QImage canvas( 200, 100, QImage::Format_ARGB32_Premultiplied );
+    image.outputImage( &canvas, QTransform(), false, false, false );
+    QCOMPARE( canvas.pixel( 30, 30 ), qRgb( 255, 0, 0 ) );
+
+    // the cached curve and area paths have to follow the move
+    image.selectAll();
+    image.applySelectionTransformation( QTransform::fromTranslate( 100, 0 ) );
+    image.deselectAll();
+    image.outputImage( &canvas, QTransform(), false, false, false );
+    QCOMPARE( canvas.pixel( 130, 30 ), qRgb( 255, 0, 0 ) );
+    QCOMPARE( canvas.pixel( 30, 30 ), qRgba( 0, 0, 0, 0 ) );
+}
+
+void TestVectorImage::testPaintLeavesAreasAlone()
+{
+    Object object;
+    object.loadDefaultPalette();
+    VectorImage image;
+    image.setObject( &object );
+
+    QList< QPointF > points { QPointF( 10, 10 ), QPointF( 50, 10 ), QPointF( 50, 50 ), QPointF( 10, 50 ), QPointF( 10, 10 ) };
+    BezierCurve square( points );
+    square.setWidth( 2.0 );
+    square.setColourNumber( 0 );
+    image.addCurve( square, 1.0, false );
+    image.addArea( BezierArea( QList< VertexRef >{ VertexRef( 0, -1 ), VertexRef( 0, 0 ), VertexRef( 0, 1 ), VertexRef( 0, 2 ), VertexRef( 0, 3 ) }, 1 ) );
+    QCOMPARE( image.getLastAreaNumber( QPointF( 30, 30 ) ), 0 );
+
+    image.selectAll();
+    image.applySelectionTransformation( QTransform::fromTranslate( 100, 0 ) );
+    image.deselectAll();
+
+    // painting a snapshot, as the prefetch threads do, doesn't write to the areas it shares
+    VectorImage snapshot = image;
+    QImage canvas( 200, 100, QImage::Format_ARGB32_Premultiplied );
+    snapshot.outputImage( &canvas, QTransform(), false, false, false );
+    QVERIFY( snapshot.area.isSharedWith( 0, image.area, 0 ) );
+
+    // the editing side finds the area where the curve went
+    QCOMPARE( image.getLastAreaNumber( QPointF( 130, 30 ) ), 0 );
+    QCOMPARE( image.getLastAreaNumber( QPointF( 30, 30 ) ), -1 );
+    QCOMPARE( image.getFirstAreaNumber( QPointF( 130, 30 ) ), 0 );
+}
+
+void TestVectorImage::benchmarkRepaint5kCurves1kAreas()
+{
+    Object object;
+    object.loadDefaultPalette();
+    VectorImage image;
+    image.setObject( &object );
+    addStrokes( image, 5000 );
+    for ( int i = 0; i < 1000; i++ )
+    {
+        image.addArea( BezierArea( QList< VertexRef >{ VertexRef( i, -1 ), VertexRef( i, 0 ), VertexRef( i, 1 ), VertexRef( i, 2 ) }, 1 ) );
+    }
+
+    // the first paint builds the paths, an unchanged frame replays them after that
+    QImage canvas( 1000, 500, QImage::Format_ARGB32_Premultiplied );
+    image.outputImage( &canvas, QTransform(), false, false, true );
+    QBENCHMARK
+    {
+        image.outputImage( &canvas, QTransform(), false, false, true );
+    }
+}
+
+void TestVectorImage::testFillFindsEnclosingRegion()
+{
+    // a hash sign: two horizontal and two vertical strokes crossing each other
+    VectorImage image;
+    QList< QList< QPointF > > strokes {
+        { QPointF( 0, 10 ), QPointF( 100, 10 ) },
+        { QPointF( 0, 90 ), QPointF( 100, 90 ) },
+        { QPointF( 10, 0 ), QPointF( 10, 100 ) },
+        { QPointF( 90, 0 ), QPointF( 90, 100 ) },
+        // a cross nearby which bounds nothing that is filled
+        { QPointF( 100, 100 ), QPointF( 120, 120 ) },
+        { QPointF( 100, 120 ), QPointF( 120, 100 ) } };
+    for ( const QList< QPointF >& points : strokes )
+    {
+        BezierCurve stroke( points );
+        stroke.setWidth( 1.0 );
+        image.addCurve( stroke, 1.0, false );
+    }
+    const int crossSections = image.getCurveSize( 4 );
+
+    // the crossings become vertices and the middle square is filled
+    image.fill( QPointF( 50, 50 ), 1, 3.0 );
+    QCOMPARE( image.area.size(), 1 );
+    QCOMPARE( image.getLastAreaNumber( QPointF( 50, 50 ) ), 0 );
+    QCOMPARE( image.getLastAreaNumber( QPointF( 5, 50 ) ), -1 );
+    QCOMPARE( image.getLastAreaNumber( QPointF( 95, 95 ) ), -1 );
+
+    // nothing encloses a point outside
+    image.fill( QPointF( 200, 200 ), 1, 3.0 );
+    QCOMPARE( image.area.size(), 1 );
+
+    // only the curves around the filled square got vertices
+    QCOMPARE( image.getCurveSize( 4 ), crossSections );
+    QCOMPARE( image.getCurveSize( 5 ), crossSections );
+}
+
+static BezierCurve randomCurve( int sections, qreal size )
+{
+    QList< QPointF > points;
+    for ( int i = 0; i <= sections; i++ )
+    {
+        points.append( QPointF( qrand() % int( size ), qrand() % int( size ) ) );
+    }
+    BezierCurve curve( points );
+    for ( int i = 0; i < sections; i++ )
+    {
+        curve.setC1( i, QPointF( qrand() % int( size ), qrand() % int( size ) ) );
+        curve.setC2( i, QPointF( qrand() % int( size ), qrand() % int( size ) ) );
+    }
+    return curve;
+}
+
+// the sampling the kernels replace, without any of their early outs
+static QList< Intersection > intersectionsBySampling( const BezierCurve& curve1, int i1, const BezierCurve& curve2, int i2 )
+{
+    QList< Intersection > result;
+    QRectF r1, r2;
+    r1.setTopLeft( curve1.getVertex( i1 - 1 ) );
+    r1.setBottomRight( curve1.getVertex( i1 ) );
+    r2.setTopLeft( curve2.getVertex( i2 - 1 ) );
+    r2.setBottomRight( curve2.getVertex( i2 ) );
+    QPointF crossing;
+    QLineF chord1( curve1.getVertex( i1 - 1 ), curve1.getVertex( i1 ) );
+    QLineF chord2( curve2.getVertex( i2 - 1 ), curve2.getVertex( i2 ) );
+    if ( !r1.intersects( r2 ) && chord2.intersect( chord1, &crossing ) != QLineF::BoundedIntersection )
+    {
+        return result;
+    }
+    QPointF p1 = curve1.getVertex( i1 - 1 );
+    for ( int i = 1; i <= 24; i++ )
+    {
+        QPointF q1 = curve1.getPointOnCubic( i1, i / 24.0 );
+        QPointF p2 = curve2.getVertex( i2 - 1 );
+        for ( int j = 1; j <= 24; j++ )
+        {
+            QPointF q2 = curve2.getPointOnCubic( i2, j / 24.0 );
+            if ( QLineF( p2, q2 ).intersect( QLineF( p1, q1 ), &crossing ) == QLineF::BoundedIntersection &&
+                 crossing != curve1.getVertex( i1 - 1 ) && crossing != curve1.getVertex( i1 ) )
+            {
+                Intersection intersection;
+                intersection.point = crossing;
+                intersection.t1 = ( i - BezierCurve::eLength( crossing - q1 ) / BezierCurve::eLength( q1 - p1 ) ) / 24;
+                intersection.t2 = ( j - BezierCurve::eLength( crossing - q2 ) / BezierCurve::eLength( q2 - p2 ) ) / 24;
+                result.append( intersection );
+            }
+            p2 = q2;
+        }
+        p1 = q1;
+    }
+    return result;
+}
+
+void TestVectorImage::testSegmentKernelsMatchSampling()
+{
+    qsrand( 7 );
+    for ( int n = 0; n < 200; n++ )
+    {
+        BezierCurve a = randomCurve( 3, 200 );
+        BezierCurve b = randomCurve( 3, 200 );
+        for ( int i = 0; i < 3; i++ )
+        {
+            for ( int j = 0; j < 3; j++ )
+            {
+                QList< Intersection > expected = intersectionsBySampling( a, i, b, j );
+                QList< Intersection > found;
+                QCOMPARE( BezierCurve::findIntersection( a, i, b, j, found ), !expected.isEmpty() );
+                QCOMPARE( found.size(), expected.size() );
+                for ( int k = 0; k < found.size(); k++ )
+                {
+                    QCOMPARE( found.at( k ).point, expected.at( k ).point );
+                    QCOMPARE( found.at( k ).t1, expected.at( k ).t1 );
+                }
+            }
+        }
+    }
+}
+
+void TestVectorImage::benchmarkSectionIntersections()
+{
+    // a new 50 section stroke against the sections of 5000 curves, as when checking a stroke on a dense frame
+    qsrand( 11 );
+    CubicSegments segments;
+    for ( int i = 0; i < 5000; i++ )
+    {
+        segments.appendCurve( randomCurve( 3, 1000 ) );
+    }
+    CubicSegments stroke;
+    stroke.appendCurve( randomCurve( 50, 1000 ) );
+
+    QBENCHMARK
+    {
+        QList< Intersection > intersections;
+        for ( int k = 0; k < stroke.size(); k++ )
+        {
+            for ( int i = 0; i < segments.size(); i++ )
+            {
+                stroke.intersect( k, segments, i, intersections );
+            }
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef TESTVECTORIMAGE_H
+#define TESTVECTORIMAGE_H
+
+#include "AutoTest.h"
+
+class TestVectorImage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCopySharesCurves();
+    void testWriteUnsharesOnlyThatCurve();
+    void testSelectionKeepsSharing();
+    void benchmarkSnapshotAndEdit10kCurves();
+    void testIndexedQueriesMatchFullScan();
+    void benchmarkStrokeInto5kCurves();
+    void testRepaintFollowsMovedCurve();
+    void testPaintLeavesAreasAlone();
+    void benchmarkRepaint5kCurves1kAreas();
+    void testFillFindsEnclosingRegion();
+    void testSegmentKernelsMatchSampling();
+    void benchmarkSectionIntersections();
+};
+
+DECLARE_TEST( TestVectorImage )
+
+#endif // TESTVECTORIMAGE_H
@@ -36,7 +36,16 @@ HEADERS += \
     test_object.h \
     test_filemanager.h \
     test_bitmapimage.h \
-    test_viewmanager.h
+    test_viewmanager.h \
+    test_pixelkernels.h \
+    test_canvasrenderer.h \
+    test_frameprefetcher.h \
+    test_movieexporter.h \
+    test_movieimporter.h \
+    test_audiomixer.h \
+    test_strokemanager.h \
+    test_editorbackup.h \
+    test_vectorimage.h
 
 SOURCES += \
     main.cpp \
@@ -45,7 +54,16 @@ SOURCES += \
     test_object.cpp \
     test_filemanager.cpp \
     test_bitmapimage.cpp \
-    test_viewmanager.cpp
+    test_viewmanager.cpp \
+    test_pixelkernels.cpp \
+    test_canvasrenderer.cpp \
+    test_frameprefetcher.cpp \
+    test_movieexporter.cpp \
+    test_movieimporter.cpp \
+    test_audiomixer.cpp \
+    test_strokemanager.cpp \
+    test_editorbackup.cpp \
+    test_vectorimage.cpp
 
 linux-* {
     LIBS += -lz